@@ -1,6 +1,8 @@
 package Slic3r::GCode::Reader;
 use Moo;
 
+use Slic3r::Geometry qw(PI);
+
 has 'config'    => (is => 'ro', default => sub { Slic3r::Config::GCode->new });
 has 'X' => (is => 'rw', default => sub {0});
 has 'Y' => (is => 'rw', default => sub {0});
@@ -47,7 +49,7 @@ sub parse {
         }
         
         # check motion
-        if ($command =~ /^G[01]$/) {
+        if ($command =~ /^G[0-3]$/) {
             foreach my $axis (@AXES) {
                 if (exists $args{$axis}) {
                     $self->$axis(0) if $axis eq 'E' && $self->config->use_relative_e_distances;
@@ -58,7 +60,9 @@ sub parse {
                     $info{"new_$axis"}  = $self->$axis;
                 }
             }
-            $info{dist_XY} = sqrt(($info{dist_X}**2) + ($info{dist_Y}**2));
+            $info{dist_XY} = $command =~ /^G[23]$/
+                ? $self->_arc_length($command, \%args, \%info)
+                : sqrt(($info{dist_X}**2) + ($info{dist_Y}**2));
             if (exists $args{E}) {
                 if ($info{dist_E} > 0) {
                     $info{extruding} = 1;
@@ -74,7 +78,7 @@ sub parse {
         $cb->($self, $command, \%args, \%info);
         
         # update coordinates
-        if ($command =~ /^(?:G[01]|G92)$/) {
+        if ($command =~ /^(?:G[0-3]|G92)$/) {
             for my $axis (@AXES, 'F') {
                 $self->$axis($args{$axis}) if exists $args{$axis};
             }
@@ -84,4 +88,19 @@ sub parse {
     }
 }
 
+# Length of the arc of a G2 or G3, whose I and J are relative to its start.
+sub _arc_length {
+    my ($self, $command, $args, $info) = @_;
+    
+    my $i = $args->{I} // 0;
+    my $j = $args->{J} // 0;
+    # angles of the start and end points around the center
+    my $start = atan2(-$j, -$i);
+    my $end = atan2($info->{new_Y} - ($self->Y + $j), $info->{new_X} - ($self->X + $i));
+    my $angle = $command eq 'G3' ? $end - $start : $start - $end;
+    # an arc ending where it starts is a full circle
+    $angle += 2*PI if $angle <= 0;
+    return sqrt($i**2 + $j**2) * $angle;
+}
+
 1;
@@ -1258,6 +1258,10 @@ sub options {
         printer_settings_id
         printer_notes
         use_set_and_wait_bed use_set_and_wait_extruder
+        machine_max_feedrate_x machine_max_feedrate_y machine_max_feedrate_z machine_max_feedrate_e
+        machine_max_acceleration_x machine_max_acceleration_y machine_max_acceleration_z machine_max_acceleration_e
+        machine_max_acceleration_extruding machine_max_acceleration_retracting machine_max_acceleration_travel
+        machine_max_jerk_x machine_max_jerk_y machine_max_jerk_z machine_max_jerk_e
     );
 }
 
@@ -1414,6 +1418,26 @@ sub build {
             $optgroup->append_single_option_line('use_set_and_wait_bed');
         }
     }
+    {
+        my $page = $self->add_options_page('Machine limits', 'time.png');
+        {
+            my $optgroup = $page->new_optgroup('Limits used to estimate the print time');
+            foreach my $limit (qw(feedrate acceleration jerk)) {
+                my $line = Slic3r::GUI::OptionsGroup::Line->new(
+                    label => "Max $limit",
+                );
+                $line->append_option($optgroup->get_option("machine_max_${limit}_$_"))
+                    for qw(x y z e);
+                $optgroup->append_line($line);
+            }
+            my $line = Slic3r::GUI::OptionsGroup::Line->new(
+                label => 'Max acceleration of moves',
+            );
+            $line->append_option($optgroup->get_option("machine_max_acceleration_$_"))
+                for qw(extruding retracting travel);
+            $optgroup->append_line($line);
+        }
+    }
     {
         my $page = $self->add_options_page('Custom G-code', 'script.png');
         {
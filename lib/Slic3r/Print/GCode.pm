@@ -8,7 +8,6 @@ has '_gcodegen'                      => (is => 'rw');
 has '_cooling_buffer'                => (is => 'rw');
 has '_spiral_vase'                   => (is => 'rw');
 has '_vibration_limit'               => (is => 'rw');
-has '_arc_fitting'                   => (is => 'rw');
 has '_pressure_regulator'            => (is => 'rw');
 has '_skirt_done'                    => (is => 'rw', default => sub { {} });  # print_z => 1
 has '_brim_done'                     => (is => 'rw');
@@ -54,9 +53,6 @@ sub BUILD {
     $self->_vibration_limit(Slic3r::GCode::VibrationLimit->new(config => $self->config))
         if $self->config->vibration_limit != 0;
     
-    $self->_arc_fitting(Slic3r::GCode::ArcFitting->new(config => $self->config))
-        if $self->config->gcode_arcs;
-    
     $self->_pressure_regulator(Slic3r::GCode::PressureRegulator->new(config => $self->config))
         if $self->config->pressure_advance > 0;
 }
@@ -752,11 +748,6 @@ sub filter {
     $gcode = $self->_pressure_regulator->process($gcode, $flush)
         if defined $self->_pressure_regulator;
     
-    # apply arc fitting if enabled;
-    # this does not depend on speeds but changes G1 XY commands into G2/G2 IJ
-    $gcode = $self->_arc_fitting->process($gcode)
-        if defined $self->_arc_fitting;
-    
     return $gcode;
 }
 
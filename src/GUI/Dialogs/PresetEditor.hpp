@@ -228,7 +228,11 @@ public:
             "retract_length_toolchange"s, "retract_restart_extra_toolchange"s, "retract_lift_above"s, "retract_lift_below"s,
             "printer_settings_id"s,
             "printer_notes"s,
-            "use_set_and_wait_bed"s, "use_set_and_wait_extruder"s
+            "use_set_and_wait_bed"s, "use_set_and_wait_extruder"s,
+            "machine_max_feedrate_x"s, "machine_max_feedrate_y"s, "machine_max_feedrate_z"s, "machine_max_feedrate_e"s,
+            "machine_max_acceleration_x"s, "machine_max_acceleration_y"s, "machine_max_acceleration_z"s, "machine_max_acceleration_e"s,
+            "machine_max_acceleration_extruding"s, "machine_max_acceleration_retracting"s, "machine_max_acceleration_travel"s,
+            "machine_max_jerk_x"s, "machine_max_jerk_y"s, "machine_max_jerk_z"s, "machine_max_jerk_e"s
         };
     }
     
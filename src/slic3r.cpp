@@ -1,6 +1,7 @@
 #include "ConfigBase.hpp"
 #include "Geometry.hpp"
 #include "IO.hpp"
+#include "Log.hpp"
 #include "Model.hpp"
 #include "SLAPrint.hpp"
 #include "Print.hpp"
@@ -239,8 +240,16 @@ main(int argc, char **argv)
             }
             print.validate();
 
+            if (!cli_config.slice_cache.value.empty())
+                print.slice_cache = std::make_shared<SliceCache>(cli_config.slice_cache.value,
+                    uint64_t(std::max(cli_config.slice_cache_size.value, 1)) * 1024 * 1024);
+
             print.export_gcode(outfile);
 
+            if (print.slice_cache)
+                Slic3r::Log::info("SliceCache") << print.slice_cache->hits() << " hits, "
+                    << print.slice_cache->misses() << " misses\n";
+
         } else {
             boost::nowide::cerr << "error: command not supported" << std::endl;
             return 1;
@@ -0,0 +1,186 @@
+#include <catch.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "GCode/ArcFitting.hpp"
+#include "GCodeReader.hpp"
+#include "GCodeTimeEstimator.hpp"
+#include "GCodeWriter.hpp"
+#include "Log.hpp"
+
+using namespace Slic3r;
+
+namespace {
+
+/// Points every step radians along an arc of a circle, in mm.
+Points
+circle(double cx, double cy, double radius, double from, double to, double step)
+{
+    Points points;
+    const int count = static_cast<int>(std::round(std::abs(to - from) / step));
+    for (int i = 0; i <= count; ++i) {
+        const double angle = from + (to - from) * i / count;
+        points.push_back(Point(scale_(cx + radius * cos(angle)), scale_(cy + radius * sin(angle))));
+    }
+    return points;
+}
+
+/// A writer with a single extruder.
+GCodeWriter
+writer()
+{
+    GCodeWriter writer;
+    writer.config.set_defaults();
+    writer.set_extruders(std::vector<unsigned int>{0});
+    writer.set_extruder(0);
+    return writer;
+}
+
+#ifdef TEST_PERFORMANCE
+/// The G-code of points, with the arcs found by fitting when it's given.
+std::string
+extrude(const Points &points, const ArcFitting* fitting)
+{
+    GCodeWriter w = writer();
+    std::string gcode;
+    const auto to_gcode = [] (const Point &point) { return Pointf(unscale(point.x), unscale(point.y)); };
+    std::vector<ArcFitting::Arc> arcs;
+    if (fitting != nullptr) arcs = fitting->fit(points);
+    auto arc = arcs.cbegin();
+    for (size_t i = 1; i < points.size(); ++i) {
+        if (arc != arcs.cend() && arc->first == i-1) {
+            w.extrude_arc_to_xy(&gcode, to_gcode(points[arc->last]),
+                Pointf(unscale(arc->center.x - points[i-1].x), unscale(arc->center.y - points[i-1].y)),
+                arc->ccw, 0.05 * unscale(arc->length));
+            i = arc->last;
+            ++arc;
+            continue;
+        }
+        w.extrude_to_xy(&gcode, to_gcode(points[i]), 0.05 * unscale(points[i-1].distance_to(points[i])));
+    }
+    return gcode;
+}
+
+size_t
+lines(const std::string &gcode)
+{
+    return std::count(gcode.begin(), gcode.end(), '\n');
+}
+#endif // TEST_PERFORMANCE
+
+}
+
+SCENARIO("ArcFitting finds the runs of points on a circle") {
+    const ArcFitting fitting(scale_(0.01));
+    GIVEN("Points along half a circle") {
+        const Points points = circle(5, 5, 10, 0, PI, PI / 60);
+        const std::vector<ArcFitting::Arc> arcs = fitting.fit(points);
+        THEN("they make a single counterclockwise arc around the center") {
+            REQUIRE(arcs.size() == 1);
+            REQUIRE(arcs[0].first == 0);
+            REQUIRE(arcs[0].last == points.size() - 1);
+            REQUIRE(arcs[0].ccw);
+            REQUIRE(unscale(arcs[0].center.x) == Approx(5).epsilon(0.001));
+            REQUIRE(unscale(arcs[0].center.y) == Approx(5).epsilon(0.001));
+            REQUIRE(unscale(arcs[0].length) == Approx(10 * PI).epsilon(0.001));
+        }
+    }
+    GIVEN("Points along a circle the other way") {
+        const Points points = circle(0, 0, 3, PI, 0, PI / 30);
+        THEN("they make a clockwise arc") {
+            const std::vector<ArcFitting::Arc> arcs = fitting.fit(points);
+            REQUIRE(arcs.size() == 1);
+            REQUIRE(!arcs[0].ccw);
+        }
+    }
+    GIVEN("A whole circle") {
+        const Points points = circle(0, 0, 3, 0, 2 * PI, PI / 30);
+        THEN("it is split in arcs of at most max_angle") {
+            const std::vector<ArcFitting::Arc> arcs = fitting.fit(points);
+            REQUIRE(arcs.size() == 2);
+            REQUIRE(arcs[0].last == arcs[1].first);
+            for (const ArcFitting::Arc &arc : arcs)
+                REQUIRE(arc.length <= fitting.max_angle * scale_(3) * 1.001);
+        }
+    }
+    GIVEN("A straight line and a zigzag") {
+        Points line, zigzag;
+        for (int i = 0; i < 20; ++i) {
+            line.push_back(Point(scale_(i), scale_(2 * i)));
+            zigzag.push_back(Point(scale_(i), scale_(i % 2)));
+        }
+        THEN("they have no arcs") {
+            REQUIRE(fitting.fit(line).empty());
+            REQUIRE(fitting.fit(zigzag).empty());
+        }
+    }
+    GIVEN("Points off the circle by more than the tolerance") {
+        Points points = circle(0, 0, 10, 0, PI / 2, PI / 40);
+        points[10].x += scale_(0.1);
+        THEN("no arc covers them") {
+            for (const ArcFitting::Arc &arc : fitting.fit(points))
+                REQUIRE((arc.last <= 10 || arc.first >= 10));
+        }
+    }
+}
+
+SCENARIO("Arcs are written as G2/G3 and read back along their length") {
+    GIVEN("A writer at X10 Y0") {
+        GCodeWriter w = writer();
+        w.travel_to_xy(Pointf(10, 0));
+        THEN("a counterclockwise arc is a G3 with its center relative to the start") {
+            REQUIRE(w.extrude_arc_to_xy(Pointf(-10, 0), Pointf(-10, 0), true, 1) == "G3 X-10.000 Y0.000 I-10.000 J0.000 E1.00000\n");
+        }
+        THEN("a clockwise one is a G2") {
+            REQUIRE(w.extrude_arc_to_xy(Pointf(0, -10), Pointf(-10, 0), false, 1).substr(0, 3) == "G2 ");
+        }
+    }
+    GIVEN("Half a circle of radius 10 from X10 Y0") {
+        const std::string arc {"G1 X10 Y0 F6000\nG3 X-10 Y0 I-10 J0 E1\n"};
+        THEN("its length is half the circumference and the position is its end") {
+            GCodeReader reader;
+            float length = 0;
+            reader.parse(arc, [&length] (GCodeReader&, const GCodeReader::GCodeLine &line) {
+                if (line.cmd == "G3") length = line.dist_arc();
+            });
+            REQUIRE(length == Approx(10 * PI));
+            REQUIRE(reader.X == -10.f);
+        }
+        THEN("the time estimate is that of a straight move as long") {
+            GCodeTimeEstimator along_arc, along_line;
+            along_arc.parse(arc);
+            along_line.parse("G1 X10 Y0 F6000\nG1 X" + std::to_string(10 + 10 * PI) + " Y0 E1\n");
+            REQUIRE(along_arc.time == Approx(along_line.time));
+        }
+    }
+}
+
+#ifdef TEST_PERFORMANCE
+TEST_CASE("Arc fitting size reduction and throughput", "[benchmark]") {
+    // rounded perimeters, finely tessellated like the slices of a mesh
+    Points points;
+    for (int i = 0; i < 200; ++i) {
+        const Points arc = circle(i % 20 * 25, i / 20 * 25, 5 + i % 7, 0, 1.25 * PI, PI / 90);
+        points.insert(points.end(), arc.begin(), arc.end());
+    }
+    const ArcFitting fitting(scale_(0.01));
+
+    auto t0 = std::chrono::steady_clock::now();
+    const std::string legacy = extrude(points, nullptr);
+    const double legacy_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    t0 = std::chrono::steady_clock::now();
+    const std::string ours = extrude(points, &fitting);
+    const double ours_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    Slic3r::Log::info("ArcFitting") << points.size() << " points: G1 only " << lines(legacy) << " lines, "
+        << legacy.size() << " bytes in " << legacy_ms << " ms, with arcs " << lines(ours) << " lines, "
+        << ours.size() << " bytes in " << ours_ms << " ms ("
+        << points.size() / ours_ms * 1000 << " points/s)\n";
+    REQUIRE(lines(ours) * 10 < lines(legacy));
+    REQUIRE(ours.size() * 5 < legacy.size());
+}
+#endif // TEST_PERFORMANCE
@@ -0,0 +1,158 @@
+#include <catch.hpp>
+#include <chrono>
+#include <vector>
+
+#include "BridgeDetector.hpp"
+#include "ClipperUtils.hpp"
+#include "Geometry.hpp"
+#include "Log.hpp"
+
+using namespace Slic3r;
+
+namespace {
+
+Polygon
+polygon_scale(const std::vector<Pointf> &points)
+{
+    Polygon polygon;
+    for (const Pointf &point : points)
+        polygon.points.push_back(Point(scale_(point.x), scale_(point.y)));
+    return polygon;
+}
+
+/// A bridge over the hole of an O-shaped lower slice.
+BridgeDetector
+o_shaped(double x, double y, double rotate)
+{
+    ExPolygon lower;
+    lower.contour = polygon_scale({Pointf(-2, -2), Pointf(x + 2, -2), Pointf(x + 2, y + 2), Pointf(-2, y + 2)});
+    lower.holes.push_back(polygon_scale({Pointf(0, 0), Pointf(0, y), Pointf(x, y), Pointf(x, 0)}));
+    lower.translate(scale_(20), scale_(20));
+    lower.rotate(Geometry::deg2rad(rotate), Point(scale_(x / 2), scale_(y / 2)));
+    Polygon hole = lower.holes.front();
+    hole.reverse();
+    return BridgeDetector(ExPolygon(hole), ExPolygonCollection(ExPolygons{lower}), scale_(0.5));
+}
+
+/// The angle detected with the given number of threads, or -1.
+double
+detect(BridgeDetector bd, int threads)
+{
+    bd.threads = threads;
+    return bd.detect_angle() ? bd.angle : -1;
+}
+
+bool
+angle_is(double angle, double expected_deg, double tolerance_deg = 5.001)
+{
+    return angle >= 0 && Geometry::directions_parallel(angle, Geometry::deg2rad(expected_deg), Geometry::deg2rad(tolerance_deg));
+}
+
+}
+
+SCENARIO("BridgeDetector finds the direction that bridges the most") {
+    GIVEN("O-shaped overhangs") {
+        THEN("the bridge goes across the short side") {
+            REQUIRE(angle_is(detect(o_shaped(20, 10, 0), 1), 90));
+            REQUIRE(angle_is(detect(o_shaped(10, 20, 0), 1), 0));
+            REQUIRE(angle_is(detect(o_shaped(20, 10, 45), 1), 135, 20));
+            REQUIRE(angle_is(detect(o_shaped(20, 10, 135), 1), 45, 20));
+        }
+    }
+    GIVEN("A bridge between two pads") {
+        const ExPolygon bridge(polygon_scale({Pointf(20, 20), Pointf(40, 20), Pointf(40, 30), Pointf(20, 30)}));
+        ExPolygons lower {
+            ExPolygon(polygon_scale({Pointf(18, 20), Pointf(20, 20), Pointf(20, 30), Pointf(18, 30)})),
+            ExPolygon(polygon_scale({Pointf(40, 20), Pointf(42, 20), Pointf(42, 30), Pointf(40, 30)})),
+        };
+        const BridgeDetector bd(bridge, ExPolygonCollection(lower), scale_(0.5));
+        THEN("it goes from one pad to the other") {
+            REQUIRE(angle_is(detect(bd, 1), 0));
+        }
+    }
+    GIVEN("A rectangle anchored all around (GH #2477)") {
+        const ExPolygon bridge(Polygon(std::vector<Point>({Point(30299990, 14299990), Point(1500010, 14299990),
+            Point(1500010, 1500010), Point(30299990, 1500010)})));
+        ExPolygon lower(Polygon(std::vector<Point>({Point(31800000, 15800000), Point(0, 15800000),
+            Point(0, 0), Point(31800000, 0)})));
+        lower.holes.push_back(Polygon(std::vector<Point>({Point(1499999, 1500000), Point(1499999, 14300000),
+            Point(30300000, 14300000), Point(30300000, 1500000)})));
+        const BridgeDetector bd(bridge, ExPolygonCollection(ExPolygons{lower}), 500000);
+        THEN("it goes across the short side") {
+            REQUIRE(angle_is(detect(bd, 1), 90));
+        }
+    }
+    GIVEN("A bridge with no anchors") {
+        const ExPolygon bridge(polygon_scale({Pointf(0, 0), Pointf(10, 0), Pointf(10, 10), Pointf(0, 10)}));
+        const ExPolygon lower(polygon_scale({Pointf(30, 0), Pointf(40, 0), Pointf(40, 10), Pointf(30, 10)}));
+        THEN("there is no direction") {
+            REQUIRE(detect(BridgeDetector(bridge, ExPolygonCollection(ExPolygons{lower}), scale_(0.5)), 1) == -1);
+        }
+    }
+    GIVEN("Bridges scored with more threads") {
+        THEN("they get the same angles as with one") {
+            for (double rotate : {0., 10., 33., 45., 60., 135.}) {
+                const BridgeDetector bd = o_shaped(20, 10, rotate);
+                REQUIRE(detect(bd, 4) == detect(bd, 1));
+            }
+        }
+    }
+}
+
+#ifdef TEST_PERFORMANCE
+TEST_CASE("Bridge angle detection throughput", "[benchmark]") {
+    // a bridge over an irregular hole, anchored all around
+    std::vector<Pointf> points;
+    for (int i = 0; i < 360; ++i) {
+        const double radius = 30 + 5 * sin(Geometry::deg2rad(7 * i));
+        points.push_back(Pointf(radius * cos(Geometry::deg2rad(i)), radius * sin(Geometry::deg2rad(i))));
+    }
+    const Polygon hole = polygon_scale(points);
+    ExPolygon lower(polygon_scale({Pointf(-50, -50), Pointf(50, -50), Pointf(50, 50), Pointf(-50, 50)}));
+    lower.holes.push_back(hole);
+    lower.holes.back().reverse();
+    const ExPolygonCollection lower_slices(ExPolygons{lower});
+    const BridgeDetector bd(ExPolygon(hole), lower_slices, scale_(0.4));
+
+    // the coverage of each line by a Clipper intersection, as it was measured
+    // before, on the angles of the configured resolution only
+    auto t0 = std::chrono::steady_clock::now();
+    const Polygons clip_area = offset(bd.expolygon, +bd.extrusion_width / 2);
+    const ExPolygons anchors = intersection_ex(offset(bd.expolygon, bd.extrusion_width), to_polygons(offset2_ex(lower_slices,
+        +bd.extrusion_width / 2, -bd.extrusion_width / 2)), true);
+    double legacy_coverage = 0;
+    for (int i = 0; i <= PI / bd.resolution; ++i) {
+        Polygons my_clip_area = clip_area;
+        ExPolygons my_anchors = anchors;
+        for (Polygon &p : my_clip_area) p.rotate(-i * bd.resolution, Point(0, 0));
+        for (ExPolygon &e : my_anchors) e.rotate(-i * bd.resolution, Point(0, 0));
+        BoundingBox bb;
+        for (const ExPolygon &e : my_anchors) bb.merge(e.bounding_box());
+        Lines lines;
+        for (coord_t y = bb.min.y; y <= bb.max.y; y += bd.extrusion_width)
+            lines.push_back(Line(Point(bb.min.x, y), Point(bb.max.x, y)));
+        double coverage = 0;
+        for (const Line &line : intersection_ln(lines, my_clip_area)) {
+            if (!Geometry::contains(my_anchors, line.a) || !Geometry::contains(my_anchors, line.b)) continue;
+            coverage += Geometry::area(intersection(my_clip_area, offset((Polyline)line, +bd.extrusion_width / 2)));
+        }
+        legacy_coverage = std::max(legacy_coverage, coverage);
+    }
+    const double legacy_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    double first_ms = 0;
+    const double angle = detect(bd, 1);
+    for (unsigned int threads = 1; threads <= std::max(2u, boost::thread::hardware_concurrency()); ++threads) {
+        t0 = std::chrono::steady_clock::now();
+        const double threaded = detect(bd, threads);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        if (threads == 1) first_ms = ms;
+        Slic3r::Log::info("BridgeDetector") << threads << " threads: " << ms << " ms (speedup "
+            << first_ms / ms << "x)\n";
+        REQUIRE(threaded == angle);
+    }
+    Slic3r::Log::info("BridgeDetector") << "Clipper per line: " << legacy_ms << " ms on "
+        << int(PI / bd.resolution) + 1 << " angles (best coverage " << legacy_coverage << "), scan lines: " << first_ms << " ms on all the candidates\n";
+    REQUIRE(first_ms < legacy_ms);
+}
+#endif // TEST_PERFORMANCE
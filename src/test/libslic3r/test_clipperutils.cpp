@@ -0,0 +1,157 @@
+#include <catch.hpp>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include "ClipperUtils.hpp"
+#include "Log.hpp"
+
+using namespace Slic3r;
+
+namespace {
+
+/// Wavy rings, some parts of them narrower than others.
+Polygons
+shapes(int count)
+{
+    Polygons shapes;
+    for (int k = 0; k < count; ++k) {
+        const double cx = (k % 10) * 40, cy = (k / 10) * 40;
+        Polygon contour, hole;
+        for (int i = 0; i < 120; ++i) {
+            const double a = 2 * PI * i / 120;
+            const double r = 15 + 2 * sin(9 * a + k);
+            const double width = 1 + 0.6 * sin(5 * a + k);
+            contour.points.push_back(Point(scale_(cx + r * cos(a)), scale_(cy + r * sin(a))));
+            hole.points.push_back(Point(scale_(cx + (r - width) * cos(a)), scale_(cy + (r - width) * sin(a))));
+        }
+        hole.reverse();
+        shapes.push_back(contour);
+        shapes.push_back(hole);
+    }
+    return shapes;
+}
+
+Polygons
+circles(int count, double radius)
+{
+    Polygons circles;
+    for (int k = 0; k < count; ++k) {
+        Polygon circle;
+        for (int i = 0; i < 64; ++i) {
+            const double a = 2 * PI * i / 64;
+            circle.points.push_back(Point(scale_((k % 10) * 40 + 12 + radius * cos(a)), scale_((k / 10) * 40 + radius * sin(a))));
+        }
+        circles.push_back(circle);
+    }
+    return circles;
+}
+
+bool
+same(const Polygons &a, const Polygons &b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (a[i].points != b[i].points) return false;
+    return true;
+}
+
+bool
+same(const ExPolygons &a, const ExPolygons &b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (a[i].contour.points != b[i].contour.points || !same(a[i].holes, b[i].holes)) return false;
+    return true;
+}
+
+/// The chain of operations of a perimeter and its gap detection, with the
+/// wrappers.
+Polygons
+perimeter(const Polygons &last, coord_t spacing)
+{
+    const Polygons offsets = offset2(last, -(spacing + spacing/2 - 1), +(spacing/2 - 1));
+    Polygons gaps = diff(offset(last, -0.5*spacing), offset(offsets, +0.5*spacing + 10));
+    polygons_append(gaps, to_polygons(diff_ex(offset2(gaps, -spacing/10, +spacing/10), offset2(gaps, -spacing, +spacing), true)));
+    return gaps;
+}
+
+/// The same chain in a context.
+Polygons
+perimeter(ClipperContext &clipper, const Polygons &polygons, coord_t spacing)
+{
+    const ClipperLib::Paths last = ClipperContext::paths(polygons);
+    const ClipperLib::Paths offsets = clipper.offset2(last, -(spacing + spacing/2 - 1), +(spacing/2 - 1));
+    const ClipperLib::Paths gaps = clipper.diff(clipper.offset(last, -0.5*spacing), clipper.offset(offsets, +0.5*spacing + 10));
+    Polygons retval = ClipperContext::polygons(gaps);
+    polygons_append(retval, to_polygons(clipper.diff_ex(clipper.offset2(gaps, -spacing/10, +spacing/10),
+        clipper.offset2(gaps, -spacing, +spacing), true)));
+    return retval;
+}
+
+}
+
+SCENARIO("ClipperContext gives the results of the wrappers") {
+    GIVEN("Islands with holes and circles overlapping them") {
+        const Polygons subject = shapes(4);
+        const Polygons clip = circles(4, 8);
+        const ClipperLib::Paths subject_paths = ClipperContext::paths(subject);
+        const ClipperLib::Paths clip_paths = ClipperContext::paths(clip);
+        ClipperContext clipper;
+        THEN("the offsets are the same") {
+            REQUIRE(same(ClipperContext::polygons(clipper.offset(subject_paths, -scale_(0.4))), offset(subject, -scale_(0.4))));
+            REQUIRE(same(ClipperContext::polygons(clipper.offset(subject_paths, scale_(1), CLIPPER_OFFSET_SCALE, jtRound, scale_(0.01))),
+                offset(subject, scale_(1), CLIPPER_OFFSET_SCALE, jtRound, scale_(0.01))));
+            REQUIRE(same(ClipperContext::polygons(clipper.offset2(subject_paths, -scale_(1), scale_(0.5), CLIPPER_OFFSET_SCALE, jtMiter, 5)),
+                offset2(subject, -scale_(1), scale_(0.5), CLIPPER_OFFSET_SCALE, jtMiter, 5)));
+            REQUIRE(same(clipper.expolygons(clipper.offset(subject_paths, scale_(0.4))), offset_ex(subject, scale_(0.4))));
+        }
+        THEN("the boolean operations are the same") {
+            for (bool safety : {false, true}) {
+                REQUIRE(same(ClipperContext::polygons(clipper.diff(subject_paths, clip_paths, safety)), diff(subject, clip, safety)));
+                REQUIRE(same(clipper.diff_ex(subject_paths, clip_paths, safety), diff_ex(subject, clip, safety)));
+                REQUIRE(same(ClipperContext::polygons(clipper.intersection(subject_paths, clip_paths, safety)), intersection(subject, clip, safety)));
+                REQUIRE(same(clipper.intersection_ex(subject_paths, clip_paths, safety), intersection_ex(subject, clip, safety)));
+                Polygons both = subject;
+                polygons_append(both, clip);
+                REQUIRE(same(ClipperContext::polygons(clipper.union_(ClipperContext::paths(both), safety)), union_(both, safety)));
+                REQUIRE(same(clipper.union_ex(ClipperContext::paths(both), safety), union_ex(both, safety)));
+            }
+        }
+        THEN("expolygons are converted with their holes") {
+            const ExPolygons expolygons = union_ex(subject);
+            REQUIRE(same(ClipperContext::polygons(ClipperContext::paths(expolygons)), to_polygons(expolygons)));
+        }
+        THEN("a context reused for a chain on each island gives the results of the wrappers") {
+            for (int k = 0; k < 4; ++k) {
+                const Polygons island {subject[2 * k], subject[2 * k + 1]};
+                REQUIRE(same(perimeter(clipper, island, scale_(0.45)), perimeter(island, scale_(0.45))));
+            }
+        }
+    }
+}
+
+#ifdef TEST_PERFORMANCE
+TEST_CASE("Chained Clipper operations throughput", "[benchmark]") {
+    const Polygons subject = shapes(200);
+    const coord_t spacing = scale_(0.45);
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<Polygons> legacy;
+    for (size_t k = 0; k < subject.size(); k += 2)
+        legacy.push_back(perimeter(Polygons{subject[k], subject[k + 1]}, spacing));
+    const double legacy_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    t0 = std::chrono::steady_clock::now();
+    ClipperContext clipper;
+    std::vector<Polygons> ours;
+    for (size_t k = 0; k < subject.size(); k += 2)
+        ours.push_back(perimeter(clipper, Polygons{subject[k], subject[k + 1]}, spacing));
+    const double ours_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    Slic3r::Log::info("ClipperContext") << legacy.size() << " islands: wrappers " << legacy_ms
+        << " ms, context " << ours_ms << " ms\n";
+    for (size_t k = 0; k < legacy.size(); ++k)
+        REQUIRE(same(ours[k], legacy[k]));
+}
+#endif // TEST_PERFORMANCE
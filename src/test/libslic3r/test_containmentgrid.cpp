@@ -0,0 +1,120 @@
+#include <catch.hpp>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "GCode/ContainmentGrid.hpp"
+#include "Log.hpp"
+
+using namespace Slic3r;
+
+namespace {
+
+/// Square islands with a square hole, the travels are checked against.
+ExPolygons
+islands(int count, coord_t size)
+{
+    ExPolygons islands;
+    for (int i = 0; i < count; ++i) {
+        for (int j = 0; j < count; ++j) {
+            const Point o(i * size * 3 / 2, j * size * 3 / 2);
+            ExPolygon island;
+            island.contour = Polygon(std::vector<Point>({o, Point(o.x + size, o.y), Point(o.x + size, o.y + size), Point(o.x, o.y + size)}));
+            island.holes.push_back(Polygon(std::vector<Point>({Point(o.x + size / 3, o.y + size / 3), Point(o.x + size / 3, o.y + size * 2 / 3),
+                Point(o.x + size * 2 / 3, o.y + size * 2 / 3), Point(o.x + size * 2 / 3, o.y + size / 3)})));
+            islands.push_back(island);
+        }
+    }
+    return islands;
+}
+
+Polyline
+polyline(const Points &points)
+{
+    Polyline polyline;
+    polyline.points = points;
+    return polyline;
+}
+
+bool
+any_contains(const ExPolygons &expolygons, const Polyline &polyline)
+{
+    for (const ExPolygon &expolygon : expolygons)
+        if (expolygon.contains(polyline)) return true;
+    return false;
+}
+
+}
+
+SCENARIO("ContainmentGrid tells whether any expolygon contains a polyline") {
+    GIVEN("A grid of islands with holes") {
+        const coord_t size {scale_(10)};
+        const ExPolygons expolygons {islands(4, size)};
+        const ContainmentGrid grid(expolygons);
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<coord_t> coord(-size / 2, size * 6);
+        std::uniform_int_distribution<coord_t> step(-size / 4, size / 4);
+        THEN("it answers like ExPolygon::contains() for random travels") {
+            for (int i = 0; i < 2000; ++i) {
+                Polyline travel;
+                travel.points.push_back(Point(coord(rng), coord(rng)));
+                for (int k = i % 3; k >= 0; --k)
+                    travel.points.push_back(Point(travel.points.back().x + step(rng), travel.points.back().y + step(rng)));
+                REQUIRE(grid.contains(travel) == any_contains(expolygons, travel));
+            }
+        }
+        THEN("it answers like ExPolygon::contains() on the edges and for points") {
+            // in sizes of islands
+            const auto at = [size] (double x, double y) { return Point(x * size, y * size); };
+            const std::vector<Polyline> travels {
+                polyline({at(0, 0), at(1, 0)}),
+                polyline({at(0, 0.5), at(1. / 3, 0.5)}),
+                polyline({at(0.1, 0.1), at(0.1, 0.9)}),
+                polyline({at(0.1, 0.1), at(0.9, 0.9)}),
+                polyline({at(0.1, 0.1), at(0.1, 0.1)}),
+                polyline({at(-1, -1), at(-1, -1)}),
+            };
+            for (const Polyline &travel : travels)
+                REQUIRE(grid.contains(travel) == any_contains(expolygons, travel));
+        }
+    }
+    GIVEN("No expolygons") {
+        const ContainmentGrid grid {ExPolygons()};
+        THEN("nothing is contained") {
+            REQUIRE(!grid.contains(polyline({Point(0, 0), Point(10, 10)})));
+        }
+    }
+}
+
+#ifdef TEST_PERFORMANCE
+TEST_CASE("Travel containment throughput", "[benchmark]") {
+    const coord_t size {scale_(5)};
+    const ExPolygons expolygons {islands(20, size)};
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<coord_t> coord(0, size * 30);
+    std::uniform_int_distribution<coord_t> step(-size / 4, size / 4);
+    Polylines travels;
+    for (int i = 0; i < 20000; ++i) {
+        const Point a(coord(rng), coord(rng));
+        travels.push_back(polyline(std::vector<Point>({a, Point(a.x + step(rng), a.y + step(rng))})));
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    size_t legacy {0};
+    for (const Polyline &travel : travels)
+        legacy += any_contains(expolygons, travel);
+    const double legacy_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    t0 = std::chrono::steady_clock::now();
+    const ContainmentGrid grid(expolygons);
+    size_t ours {0};
+    for (const Polyline &travel : travels)
+        ours += grid.contains(travel);
+    const double ours_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    Slic3r::Log::info("ContainmentGrid") << travels.size() << " travels over " << expolygons.size()
+        << " islands: ExPolygon::contains() " << legacy_ms << " ms, grid " << ours_ms << " ms\n";
+    REQUIRE(ours == legacy);
+    REQUIRE(ours_ms < legacy_ms);
+}
+#endif // TEST_PERFORMANCE
@@ -0,0 +1,181 @@
+#include <catch.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/filesystem.hpp>
+
+#include "GCodeReader.hpp"
+#include "Log.hpp"
+
+using namespace Slic3r;
+
+SCENARIO("GCodeReader tokenizes lines in place") {
+    GIVEN("A line with arguments and a comment") {
+        const std::string gcode {"G1 X10.5 Y-2 E0.12345 F1800 ; perimeter"};
+        GCodeReader reader;
+        std::vector<std::string> cmds, comments;
+        reader.parse(gcode, [&cmds, &comments] (GCodeReader& self, const GCodeReader::GCodeLine& line) {
+            cmds.push_back(line.cmd.to_string());
+            comments.push_back(line.comment.to_string());
+            REQUIRE(line.raw == "G1 X10.5 Y-2 E0.12345 F1800 ; perimeter");
+            REQUIRE(line.has('X'));
+            REQUIRE(!line.has('Z'));
+            REQUIRE(line.new_X() == 10.5f);
+            REQUIRE(line.new_Y() == -2.f);
+            REQUIRE(line.new_Z() == 0.f);
+            REQUIRE(line.get_float('E') == float(atof("0.12345")));
+            REQUIRE(line.extruding());
+            REQUIRE(self.X == 0.f);
+        });
+        THEN("the command and the comment are split off") {
+            REQUIRE(cmds == std::vector<std::string>{"G1"});
+            REQUIRE(comments == std::vector<std::string>{" perimeter"});
+        }
+        THEN("the position is updated after the line") {
+            REQUIRE(reader.X == 10.5f);
+            REQUIRE(reader.F == 1800.f);
+        }
+    }
+    GIVEN("Numbers that aren't plain decimals") {
+        const std::string gcode {"G1 X0x1A Y1e3 Z.5 E1e F12345678901234567 X2"};
+        GCodeReader reader;
+        reader.parse(gcode, {});
+        THEN("they are read like atof() reads them, and the first of repeated args wins") {
+            REQUIRE(reader.X == float(atof("0x1A")));
+            REQUIRE(reader.Y == 1000.f);
+            REQUIRE(reader.Z == 0.5f);
+            REQUIRE(reader.E == 1.f);
+            REQUIRE(reader.F == float(atof("12345678901234567")));
+        }
+    }
+    GIVEN("A Mach3 flavor, extruding on the A axis") {
+        GCodeConfig config;
+        config.set_defaults();
+        config.gcode_flavor.value = gcfMach3;
+        GCodeReader reader;
+        reader.apply_config(config);
+        reader.parse("G1 X1 A2.5\n", {});
+        THEN("A is read as E") {
+            REQUIRE(reader.E == 2.5f);
+        }
+    }
+}
+
+SCENARIO("GCodeReader iterates over lines without a callback") {
+    GIVEN("Three lines and no trailing newline") {
+        const std::string gcode {"G92 E0\nG1 X5 E1\n\nG1 X10 E2"};
+        WHEN("the lines are walked") {
+            GCodeReader reader;
+            std::vector<float> x_before;
+            size_t count {0};
+            for (const GCodeReader::GCodeLine &line : reader.lines(gcode)) {
+                x_before.push_back(reader.X);
+                ++count;
+                REQUIRE(line.reader == &reader);
+            }
+            THEN("every line is seen once, with the position before it") {
+                REQUIRE(count == 4);
+                REQUIRE(x_before == std::vector<float>{0.f, 0.f, 5.f, 5.f});
+            }
+            THEN("the last line is applied") {
+                REQUIRE(reader.X == 10.f);
+                REQUIRE(reader.E == 2.f);
+            }
+        }
+    }
+    GIVEN("A file larger than the chunks it is read by") {
+        const std::string path {(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.gcode")).string()};
+        {
+            std::ofstream out(path);
+            for (int i = 0; i < 200000; ++i)
+                out << "G1 X" << i << " Y" << i % 100 << " E" << i << " ; perimeter\n";
+            out << "G1 X-1";
+        }
+        WHEN("it is parsed") {
+            GCodeReader reader;
+            size_t lines {0};
+            bool in_order {true};
+            reader.parse_file(path, [&lines, &in_order] (GCodeReader& self, const GCodeReader::GCodeLine& line) {
+                if (lines < 200000 && line.new_X() != float(lines)) in_order = false;
+                ++lines;
+            });
+            boost::filesystem::remove(path);
+            THEN("no line is lost or cut") {
+                REQUIRE(lines == 200001);
+                REQUIRE(in_order);
+                REQUIRE(reader.X == -1.f);
+                REQUIRE(reader.E == 199999.f);
+            }
+        }
+    }
+}
+
+SCENARIO("GCodeLine::append_with sets an argument") {
+    GIVEN("Lines with and without Z") {
+        GCodeReader reader;
+        std::vector<std::string> output;
+        reader.parse("G1 Z0.300 F7800\nG1 X1 Y2 E3\nG1", [&output] (GCodeReader& self, const GCodeReader::GCodeLine& line) {
+            std::string gcode;
+            line.append_with(&gcode, 'Z', "0.450");
+            output.push_back(gcode);
+        });
+        THEN("Z is replaced, or inserted after the command") {
+            REQUIRE(output == std::vector<std::string>{"G1 Z0.450 F7800", "G1 Z0.450 X1 Y2 E3", "G1 Z0.450"});
+        }
+    }
+}
+
+#ifdef TEST_PERFORMANCE
+TEST_CASE("G-code parsing throughput", "[benchmark]") {
+    // about 500 MB of G-code
+    const std::string path {(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.gcode")).string()};
+    {
+        std::ofstream out(path);
+        std::string layer;
+        for (int i = 0; i < 100000; ++i) {
+            layer += "G1 X" + std::to_string(100 + (i % 997) * 0.013).substr(0, 7)
+                + " Y" + std::to_string(100 + (i % 991) * 0.011).substr(0, 7)
+                + " E" + std::to_string(i * 0.00123).substr(0, 7) + " ; perimeter\n";
+            if (i % 50 == 0) layer += "G1 F1800\n";
+        }
+        for (size_t size = 0; size < 500000000; size += layer.size())
+            out << "G1 Z0.300 F7800\n" << layer;
+    }
+    const double mbytes = boost::filesystem::file_size(path) / 1e6;
+
+    // the way the reader used to split and convert each line
+    auto t0 = std::chrono::steady_clock::now();
+    double legacy_E {0};
+    {
+        std::ifstream f(path);
+        std::string line;
+        while (std::getline(f, line)) {
+            const size_t pos = line.find(';');
+            if (pos != std::string::npos) line.erase(pos);
+            std::vector<std::string> args;
+            boost::split(args, line, boost::is_any_of(" "));
+            std::map<char, std::string> values;
+            for (size_t i = 1; i < args.size(); ++i)
+                if (args[i].size() >= 2) values.insert(std::make_pair(args[i][0], args[i].substr(1)));
+            if (values.count('E') > 0) legacy_E = float(atof(values.at('E').c_str()));
+        }
+    }
+    const double legacy_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    t0 = std::chrono::steady_clock::now();
+    GCodeReader reader;
+    reader.parse_file(path, {});
+    const double ours_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    boost::filesystem::remove(path);
+
+    Slic3r::Log::info("GCodeReader") << mbytes << " MB of G-code: getline and split " << legacy_ms << " ms ("
+        << mbytes / legacy_ms * 1e3 << " MB/s), in place " << ours_ms << " ms (" << mbytes / ours_ms * 1e3 << " MB/s)\n";
+    REQUIRE(reader.E == float(legacy_E));
+    REQUIRE(ours_ms < legacy_ms);
+}
+#endif // TEST_PERFORMANCE
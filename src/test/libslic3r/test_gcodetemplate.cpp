@@ -0,0 +1,99 @@
+#include <catch.hpp>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Config.hpp"
+#include "ConditionalGCode.hpp"
+#include "GCodeTemplate.hpp"
+#include "Log.hpp"
+#include "PlaceholderParser.hpp"
+
+using namespace Slic3r;
+
+namespace {
+
+const std::vector<std::string> variables {"layer_num", "layer_z"};
+
+/// What the G-code used to be processed with.
+std::string
+reference(const std::string &gcode, const PlaceholderParser &parser, const std::vector<int> &values)
+{
+    PlaceholderParser pp {parser};
+    for (size_t i = 0; i < variables.size(); ++i)
+        pp.set(variables[i], values[i]);
+    return apply_math(pp.process(gcode));
+}
+
+PlaceholderParser
+default_parser()
+{
+    PlaceholderParser parser;
+    parser.apply_config(Slic3r::Config::new_from_defaults()->config());
+    parser.set("temperature", std::vector<std::string> {"200", "210"});
+    return parser;
+}
+
+}
+
+SCENARIO("GCodeTemplate processes G-code like the placeholder parser and apply_math") {
+    const PlaceholderParser parser {default_parser()};
+    const std::vector<std::vector<int>> values {{0, 0}, {1, 0}, {2, 0}, {3, 1}, {10, 2}, {-1, 0}};
+    const std::vector<std::string> templates {
+        "; LAYER [layer_num] Z [layer_z]",
+        "{if [layer_num] % 2 == 0}M117 even [layer_num]\nG1 Z[layer_z]",
+        "{if{[layer_num] == 3}} string\nother",
+        "M104 S{[temperature_0] + [layer_num]}; [temperature_1] [temperature_3]",
+        "M104 S\\{a\\}; Sets temp to {4*[layer_num]}",
+        "{[layer_num]0} {2 ^ [layer_num]} {-[layer_num]*[layer_z]}",
+        "{if [layer_num] > 1}A{if [layer_num] > 2}B\nC\nD",
+        "[nozzle_diameter] [unknown] [layer_num[layer_z]] [temperature_01]",
+        "{ nope } {1+2",
+        "{if [layer_num] == 1}only on layer 1",
+        "",
+    };
+    for (const std::string &gcode : templates) {
+        GIVEN("The G-code \"" + gcode + "\"") {
+            const GCodeTemplate compiled(gcode, parser, variables);
+            THEN("it gives the same G-code for every value of the variables") {
+                REQUIRE(compiled.compiled());
+                for (const std::vector<int> &value : values)
+                    REQUIRE(compiled.process(value) == reference(gcode, parser, value));
+            }
+        }
+    }
+    GIVEN("A template compiled before the parser changes") {
+        PlaceholderParser changing {parser};
+        const GCodeTemplate compiled("M104 S[temperature_0] L[layer_num]", changing, variables);
+        changing.set("temperature", std::vector<std::string> {"180"});
+        THEN("it keeps the placeholders it was compiled with") {
+            REQUIRE(compiled.process({4, 0}) == "M104 S200 L4");
+        }
+    }
+}
+
+#ifdef TEST_PERFORMANCE
+TEST_CASE("Custom layer G-code throughput", "[benchmark]") {
+    const PlaceholderParser parser {default_parser()};
+    const std::string gcode {"; layer [layer_num] at [layer_z]\n{if [layer_num] % 10 == 0}M117 Layer [layer_num]\nM104 S{[temperature_0] + [layer_num] / 100}\n"};
+    const int layers {20000};
+
+    auto t0 = std::chrono::steady_clock::now();
+    size_t legacy_size {0};
+    for (int i = 0; i < layers; ++i)
+        legacy_size += reference(gcode, parser, {i, i / 5}).size();
+    const double legacy_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    t0 = std::chrono::steady_clock::now();
+    const GCodeTemplate compiled(gcode, parser, variables);
+    size_t ours_size {0};
+    for (int i = 0; i < layers; ++i)
+        ours_size += compiled.process({i, i / 5}).size();
+    const double ours_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    Slic3r::Log::info("GCodeTemplate") << layers << " layers: processed each time " << legacy_ms
+        << " ms, compiled " << ours_ms << " ms\n";
+    REQUIRE(ours_size == legacy_size);
+    REQUIRE(ours_ms < legacy_ms);
+}
+#endif // TEST_PERFORMANCE
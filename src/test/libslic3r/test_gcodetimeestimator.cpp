@@ -0,0 +1,147 @@
+#include <catch.hpp>
+#include <chrono>
+#include <string>
+
+#include "GCodeTimeEstimator.hpp"
+#include "Log.hpp"
+
+using namespace Slic3r;
+
+namespace {
+
+/// A printer with the default machine limits.
+GCodeTimeEstimator
+planner()
+{
+    GCodeConfig config;
+    config.set_defaults();
+    GCodeTimeEstimator estimator(GCodeTimeEstimator::emPlanner);
+    estimator.apply_config(config);
+    return estimator;
+}
+
+}
+
+SCENARIO("GCodeTimeEstimator plans moves like the firmware") {
+    GIVEN("A single long move along X") {
+        GCodeTimeEstimator estimator = planner();
+        estimator.parse("G1 X100 F6000\n");
+        THEN("it accelerates from the X jerk, cruises and decelerates to a stop") {
+            // 10 -> 100 mm/s and 100 -> 0.05 mm/s at 1500 mm/s²
+            const double accelerate = (100. - 10.) / 1500.;
+            const double decelerate = (100. - 0.05) / 1500.;
+            const double cruise = (100. - (100. * 100. - 10. * 10.) / 3000. - (100. * 100. - 0.05 * 0.05) / 3000.) / 100.;
+            REQUIRE(estimator.time == Approx(accelerate + cruise + decelerate));
+        }
+    }
+    GIVEN("The same move cut into ten") {
+        GCodeTimeEstimator single = planner(), split = planner();
+        single.parse("G1 X100 F6000\n");
+        std::string gcode;
+        for (int x = 10; x <= 100; x += 10)
+            gcode += "G1 X" + std::to_string(x) + " F6000\n";
+        split.parse(gcode);
+        THEN("it doesn't slow down between the segments") {
+            REQUIRE(split.time == Approx(single.time));
+        }
+    }
+    GIVEN("Two moves with a square corner between them") {
+        GCodeTimeEstimator straight = planner(), corner = planner();
+        straight.parse("G1 X20 F6000\nG1 X40\n");
+        corner.parse("G1 X20 F6000\nG1 Y20\n");
+        THEN("the corner is slower than going straight on") {
+            REQUIRE(corner.time > straight.time);
+        }
+    }
+    GIVEN("A Z move faster than the Z axis allows") {
+        GCodeTimeEstimator estimator = planner();
+        estimator.parse("G1 Z10 F6000\n");
+        THEN("it runs at the max Z feedrate") {
+            REQUIRE(estimator.time > 10. / 12.);
+            REQUIRE(estimator.time < 10. / 12. + 0.1);
+        }
+        WHEN("M203 raises the limit") {
+            GCodeTimeEstimator faster = planner();
+            faster.parse("M203 Z20\nG1 Z10 F6000\n");
+            THEN("the move is faster") {
+                REQUIRE(faster.time < estimator.time);
+                REQUIRE(faster.time > 10. / 20.);
+            }
+        }
+    }
+    GIVEN("A dwell") {
+        GCodeTimeEstimator estimator = planner();
+        estimator.parse("G4 P1500\nG4 S2\n");
+        THEN("its time is added as is") {
+            REQUIRE(estimator.time == Approx(3.5));
+            REQUIRE(estimator.role_times.at("dwell") == Approx(3.5));
+        }
+    }
+}
+
+SCENARIO("GCodeTimeEstimator breaks the time down") {
+    GIVEN("Two layers with commented extrusions") {
+        GCodeTimeEstimator estimator = planner();
+        estimator.parse(
+            "G1 Z0.3 F7800\n"
+            "G1 X10 Y10\n"
+            "G1 X20 E1 F1800 ; perimeter\n"
+            "G1 Y20 E2 ; perimeter\n"
+            "G1 X10 E3 ; infill\n"
+            "G1 E1 F2400\n"
+            "G1 Z0.5 F7800\n"
+            "G1 E3 F2400\n"
+            "G1 X20 E4 F1800 ; perimeter\n"
+            "G1 Y10 E5\n");
+        THEN("per layer, starting at the extrusions") {
+            REQUIRE(estimator.layer_times.size() == 2);
+            REQUIRE(estimator.layer_times[0].print_z == Approx(0.3));
+            REQUIRE(estimator.layer_times[1].print_z == Approx(0.5));
+            REQUIRE(estimator.layer_times[0].time + estimator.layer_times[1].time == Approx(estimator.time));
+        }
+        THEN("per role") {
+            REQUIRE(estimator.role_times.size() == 5);
+            REQUIRE(estimator.role_times.count("perimeter") == 1);
+            REQUIRE(estimator.role_times.count("infill") == 1);
+            REQUIRE(estimator.role_times.count("extrusion") == 1);
+            REQUIRE(estimator.role_times.count("travel") == 1);
+            REQUIRE(estimator.role_times.count("retraction") == 1);
+            double total {0};
+            for (const auto &role : estimator.role_times) total += role.second;
+            REQUIRE(total == Approx(estimator.time));
+        }
+    }
+    GIVEN("The simple mode") {
+        GCodeTimeEstimator estimator;
+        estimator.parse("G1 X100 F6000\nG4 S1\n");
+        THEN("it only gives the total") {
+            REQUIRE(estimator.time > 1.);
+            REQUIRE(estimator.layer_times.empty());
+            REQUIRE(estimator.role_times.empty());
+        }
+    }
+}
+
+#ifdef TEST_PERFORMANCE
+TEST_CASE("Planned time estimate throughput", "[benchmark]") {
+    std::string gcode;
+    for (int i = 0; i < 1000000; ++i) {
+        if (i % 10000 == 0) gcode += "G1 Z" + std::to_string(0.2 + i / 10000 * 0.2).substr(0, 5) + " F7800\n";
+        gcode += "G1 X" + std::to_string(100 + (i % 997) * 0.013).substr(0, 7)
+            + " Y" + std::to_string(100 + (i % 991) * 0.011).substr(0, 7)
+            + " E" + std::to_string(i * 0.00123).substr(0, 7) + (i % 3 == 0 ? " ; perimeter\n" : " ; infill\n");
+    }
+    GCodeTimeEstimator simple, planned(GCodeTimeEstimator::emPlanner);
+
+    auto t0 = std::chrono::steady_clock::now();
+    simple.parse(gcode);
+    const double simple_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    t0 = std::chrono::steady_clock::now();
+    planned.parse(gcode);
+    const double planned_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    Slic3r::Log::info("GCodeTimeEstimator") << "1M lines: simple " << simple_ms << " ms (" << simple.time
+        << " s), planned " << planned_ms << " ms (" << planned.time << " s, " << 1e3 / planned_ms << "M lines/s)\n";
+    REQUIRE(planned.layer_times.size() == 100);
+}
+#endif // TEST_PERFORMANCE
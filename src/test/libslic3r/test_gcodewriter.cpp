@@ -1,7 +1,15 @@
 #include <catch.hpp>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <limits>
 #include <memory>
+#include <random>
+#include <sstream>
 
+#include "GCodeEmitter.hpp"
 #include "GCodeWriter.hpp"
+#include "Log.hpp"
 #include "test_options.hpp"
 
 using namespace Slic3r;
@@ -98,3 +106,147 @@ SCENARIO("lift() is not ignored after unlift() at normal values of Z") {
         }
     }
 }
+
+SCENARIO("GCodeEmitter formats numbers like iostreams") {
+    auto fixed_stream = [] (double value, int precision) {
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(precision) << value;
+        return ss.str();
+    };
+    auto fixed_emitter = [] (double value, int precision) {
+        std::string out;
+        GCodeEmitter(&out) << GCodeEmitter::fixed(value, precision);
+        return out;
+    };
+    auto general_stream = [] (double value) {
+        std::ostringstream ss;
+        ss << value;
+        return ss.str();
+    };
+    auto general_emitter = [] (double value) {
+        std::string out;
+        GCodeEmitter(&out) << value;
+        return out;
+    };
+    GIVEN("Values on and around the ties of the rounding") {
+        std::vector<double> values {
+            0, -0.0, 1, -1, 0.0005, 0.0015, 0.0025, 1.2345, 2.5, 0.00005, 0.000015, -0.0001, -0.0004,
+            0.49999, 0.999999, 9.9995, 199.9995, 1800, 4800.5, 1e6, 1e7 - 0.0005, 1e7, 123456789.123,
+            9999.123456789, 9999999.123456789, 0.0000000005, 8e3 + 0.0000000005,
+            -1e-300, 1e300, std::numeric_limits<double>::infinity(), std::numeric_limits<double>::quiet_NaN()
+        };
+        THEN("fixed() gives the same text as std::fixed") {
+            for (double v : values)
+                for (int precision : {0, 3, 5, 9})
+                    REQUIRE(fixed_emitter(v, precision) == fixed_stream(v, precision));
+        }
+        THEN("a double gives the same text as the default formatting") {
+            for (double v : values)
+                REQUIRE(general_emitter(v) == general_stream(v));
+        }
+    }
+    GIVEN("Random coordinates, extrusion lengths and feedrates") {
+        std::mt19937 gen(1);
+        std::uniform_real_distribution<double> coordinate(-500, 500);
+        std::uniform_real_distribution<double> length(0, 20000);
+        std::uniform_int_distribution<int> steps(0, 1000000);
+        THEN("the text is the same as with iostreams") {
+            for (int i = 0; i < 100000; ++i) {
+                const double xy {coordinate(gen)};
+                const double e {length(gen)};
+                // coordinates on a 0.0005 grid hit the ties
+                const double on_grid {steps(gen) * 0.0005};
+                REQUIRE(fixed_emitter(xy, 3) == fixed_stream(xy, 3));
+                REQUIRE(fixed_emitter(e, 5) == fixed_stream(e, 5));
+                REQUIRE(fixed_emitter(on_grid, 3) == fixed_stream(on_grid, 3));
+                REQUIRE(general_emitter(e) == general_stream(e));
+                REQUIRE(general_emitter(std::round(e)) == general_stream(std::round(e)));
+            }
+        }
+    }
+}
+
+SCENARIO("GCodeWriter appends the same G-code it returns") {
+    GIVEN("Two writers with the same config") {
+        GCodeWriter returning, appending;
+        for (GCodeWriter* writer : {&returning, &appending}) {
+            writer->config.set_defaults();
+            writer->config.gcode_comments.value = true;
+            writer->config.retract_lift.values = {0.4};
+            writer->set_extruders(std::vector<unsigned int> {0});
+            writer->set_extruder(0);
+        }
+        WHEN("they are given the same moves") {
+            std::string returned, appended;
+            for (int i = 0; i < 10; ++i) {
+                returned += returning.travel_to_z(0.2 * i + 0.3, "move to next layer");
+                appending.travel_to_z(&appended, 0.2 * i + 0.3, "move to next layer");
+                returned += returning.unlift();
+                returned += returning.unretract();
+                returned += returning.set_speed(1800.5);
+                appending.unlift(&appended);
+                appending.unretract(&appended);
+                appending.set_speed(&appended, 1800.5);
+                returned += returning.set_acceleration(1000 + i % 2);
+                appending.set_acceleration(&appended, 1000 + i % 2);
+                for (int j = 0; j < 10; ++j) {
+                    const Pointf point(10.0 * j / 3, 100 - 7.0 * i / 3);
+                    returned += returning.extrude_to_xy(point, 0.0123 * j, "perimeter");
+                    appending.extrude_to_xy(&appended, point, 0.0123 * j, "perimeter");
+                }
+                returned += returning.retract();
+                returned += returning.reset_e();
+                returned += returning.lift();
+                appending.retract(&appended);
+                appending.reset_e(&appended);
+                appending.lift(&appended);
+                returned += returning.travel_to_xyz(Pointf3(5, 5, 0.2 * i + 0.5), "travel");
+                appending.travel_to_xyz(&appended, Pointf3(5, 5, 0.2 * i + 0.5), "travel");
+            }
+            THEN("the G-code is the same") {
+                REQUIRE(returned.size() > 0);
+                REQUIRE(appended == returned);
+            }
+        }
+    }
+}
+
+#ifdef TEST_PERFORMANCE
+TEST_CASE("G-code emitter throughput", "[benchmark]") {
+    GCodeWriter writer;
+    writer.config.set_defaults();
+    writer.config.gcode_comments.value = true;
+    writer.set_extruders(std::vector<unsigned int> {0});
+    writer.set_extruder(0);
+    const int moves {5000000};
+
+    // the way every writer method used to build its line
+    auto t0 = std::chrono::steady_clock::now();
+    std::string legacy;
+    {
+        double E {0};
+        for (int i = 0; i < moves; ++i) {
+            E += 0.0123;
+            std::ostringstream gcode;
+            gcode << "G1 X" << std::fixed << std::setprecision(3) << 0.001 * (i % 200000)
+                  <<   " Y" << std::fixed << std::setprecision(3) << 0.0007 * (i % 300000)
+                  <<    " E" << std::fixed << std::setprecision(5) << E << " ; perimeter\n";
+            legacy += gcode.str();
+        }
+    }
+    const double legacy_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    t0 = std::chrono::steady_clock::now();
+    std::string gcode;
+    for (int i = 0; i < moves; ++i)
+        writer.extrude_to_xy(&gcode, Pointf(0.001 * (i % 200000), 0.0007 * (i % 300000)), 0.0123, "perimeter");
+    const double ours_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    const double mbytes = gcode.size() / 1e6;
+    Slic3r::Log::info("GCodeWriter") << moves << " moves, " << mbytes << " MB of G-code: ostringstream "
+        << legacy_ms << " ms (" << mbytes / legacy_ms * 1e3 << " MB/s), GCodeEmitter "
+        << ours_ms << " ms (" << mbytes / ours_ms * 1e3 << " MB/s)\n";
+    REQUIRE(gcode.size() == legacy.size());
+    REQUIRE(ours_ms < legacy_ms);
+}
+#endif // TEST_PERFORMANCE
@@ -0,0 +1,406 @@
+#include <catch.hpp>
+
+#include "IO.hpp"
+#include "Model.hpp"
+#include "TextScanner.hpp"
+#include "TriangleMesh.hpp"
+#include "Log.hpp"
+#include "tiny_obj_loader.h"
+#include "Zip/ZipArchive.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <boost/filesystem.hpp>
+
+using namespace Slic3r;
+
+static void
+require_same_as_strtof(const std::string &text)
+{
+    INFO("Number: \"" << text << "\"");
+    // unlike strtof(), parse_float() expects the number right away
+    const char* begin = text.c_str() + strspn(text.c_str(), " ");
+    char* strtof_end;
+    const float expected = strtof(begin, &strtof_end);
+    float parsed = 12345.f;
+    const char* end = parse_float(begin, text.c_str() + text.size(), &parsed);
+    if (strtof_end == begin) {
+        REQUIRE(end == nullptr);
+        return;
+    }
+    REQUIRE(end == strtof_end);
+    REQUIRE(memcmp(&parsed, &expected, sizeof(float)) == 0);
+}
+
+SCENARIO("parse_float() reads numbers like strtof() in the C locale") {
+    GIVEN("Hand picked numbers") {
+        THEN("The floats and the ends of the numbers are the same") {
+            for (const char* text : { "0", "-0", "1", "-1.5", "+3", ".5", "5.", "-.25e1", "1e10", "1E-2", "2.5e-3",
+                "0.1", "0.000001", "100.5", "-1.23456789E+01", " 1.00000000E+00", "3.4028235e38", "1.17549435e-38",
+                "1e-40", "1e-50", "1e39", "-1e39", "16777217", "16777219", "0.30000001192092896",
+                "123456789012345678901234", "1.000000000000000000000001", "1e", "1e+", "2.5e-x", "12abc",
+                "-", "+", ".", "-.", "e5", "abc", "" })
+                require_same_as_strtof(text);
+        }
+    }
+    GIVEN("Random floats printed the ways STL and OBJ writers print them") {
+        std::mt19937 gen(42);
+        std::uniform_real_distribution<float> mantissa(-1.f, 1.f);
+        std::uniform_int_distribution<int> exponent(-12, 12);
+        THEN("The floats and the ends of the numbers are the same") {
+            char buf[64];
+            for (int i = 0; i < 20000; ++i) {
+                const float f = std::ldexp(mantissa(gen), 4 * exponent(gen));
+                for (const char* format : { "%f", "% .8E", "%.9g", "%.12g", "%.6g" }) {
+                    snprintf(buf, sizeof(buf), format, f);
+                    require_same_as_strtof(buf);
+                }
+            }
+        }
+    }
+}
+
+/// IO::OBJ::read() as it was before the parallel reader: every shape
+/// tiny_obj_loader reads is a volume.
+static void
+legacy_read_obj(const std::string &path, Model* model)
+{
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    std::ifstream ifs(path);
+    REQUIRE(tinyobj::LoadObj(&attrib, &shapes, &materials, &err, &ifs));
+    ModelObject* object = model->add_object();
+    for (const auto &shape : shapes) {
+        Pointf3s points;
+        for (size_t v = 0; v < attrib.vertices.size(); v += 3)
+            points.push_back(Pointf3(attrib.vertices[v], attrib.vertices[v+1], attrib.vertices[v+2]));
+        std::vector<Point3> facets;
+        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); ++f)
+            facets.push_back(Point3(shape.mesh.indices[f*3+0].vertex_index,
+                shape.mesh.indices[f*3+1].vertex_index, shape.mesh.indices[f*3+2].vertex_index));
+        TriangleMesh mesh(points, facets);
+        mesh.check_topology();
+        object->add_volume(mesh);
+    }
+}
+
+/// tiny_obj_loader doesn't round the numbers it parses correctly, so
+/// coordinates may be one float apart.
+static void
+require_same_as_tinyobj(const Model &model, const std::string &path)
+{
+    Model expected;
+    legacy_read_obj(path, &expected);
+    REQUIRE(model.objects.size() == 1);
+    const ModelObject &object = *model.objects.front();
+    REQUIRE(object.volumes.size() == expected.objects.front()->volumes.size());
+    for (size_t s = 0; s < object.volumes.size(); ++s) {
+        const stl_file &stl = object.volumes[s]->mesh.stl;
+        const stl_file &expected_stl = expected.objects.front()->volumes[s]->mesh.stl;
+        REQUIRE(stl.stats.number_of_facets == expected_stl.stats.number_of_facets);
+        for (int i = 0; i < stl.stats.number_of_facets; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                const stl_vertex &v = stl.facet_start[i].vertex[j];
+                const stl_vertex &e = expected_stl.facet_start[i].vertex[j];
+                REQUIRE(v.x == Approx(e.x).epsilon(1e-6).margin(1e-6));
+                REQUIRE(v.y == Approx(e.y).epsilon(1e-6).margin(1e-6));
+                REQUIRE(v.z == Approx(e.z).epsilon(1e-6).margin(1e-6));
+            }
+        }
+    }
+}
+
+static std::string
+temp_obj_path()
+{
+    return (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.obj")).string();
+}
+
+SCENARIO("OBJ files load like tiny_obj_loader loads them") {
+    GIVEN("A sphere saved as an OBJ file") {
+        auto sphere {TriangleMesh::make_sphere(10, PI / 30.0)};
+        const std::string path {temp_obj_path()};
+        sphere.WriteOBJFile(path);
+        WHEN("It is read with IO::OBJ::read()") {
+            Model model;
+            IO::OBJ::read(path, &model);
+            THEN("There is one volume with the facets tiny_obj_loader reads") {
+                require_same_as_tinyobj(model, path);
+                REQUIRE(model.objects.front()->volumes.size() == 1);
+            }
+        }
+        boost::filesystem::remove(path);
+    }
+    GIVEN("An OBJ file with groups, objects, relative indices and texture and normal indices") {
+        const std::string path {temp_obj_path()};
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << "# two tetrahedrons\r\n"
+                << "mtllib none.mtl\r\n"
+                << "o first\r\n"
+                << "v 0 0 0\r\nv 1 0 0\r\nv 0 1 0\r\n\tv 0 0 1 1.0\r\n"
+                << "vn 0 0 1\r\nvt 0 0\r\n"
+                << "usemtl none\r\n"
+                << "g empty\r\n"
+                << "g faces\r\n"
+                << "s off\r\n"
+                << "f 1 3 2\r\n"
+                << "f 1/1 2/1 4/1\r\n"
+                << "f 1//1 4//1 3//1\r\n"
+                << "f  2/1/1   3/1/1 4/1/1 \r\n"
+                << "o second\n"
+                << "v 2 0 0\nv 3 0 0\nv 2 1 0\nv 2 0 1\n"
+                << "f -4 -2 -3\n"
+                << "f -4 -3 -1\n"
+                << "f -4 -1 -2\n"
+                << "f -3 -2 -1\n";
+        }
+        WHEN("It is read with IO::OBJ::read()") {
+            Model model;
+            IO::OBJ::read(path, &model);
+            THEN("Each shape holding facets is a volume, as with tiny_obj_loader") {
+                require_same_as_tinyobj(model, path);
+                REQUIRE(model.objects.front()->volumes.size() == 2);
+            }
+        }
+        boost::filesystem::remove(path);
+    }
+    GIVEN("An OBJ file with a quad") {
+        const std::string path {temp_obj_path()};
+        {
+            std::ofstream out(path);
+            out << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 0 0 1\n"
+                << "f 1 4 3 2\nf 1 2 5\nf 2 3 5\nf 3 4 5\nf 4 1 5\n";
+        }
+        WHEN("It is read with IO::OBJ::read()") {
+            Model model;
+            IO::OBJ::read(path, &model);
+            THEN("The quad is triangulated by tiny_obj_loader") {
+                require_same_as_tinyobj(model, path);
+                REQUIRE(model.objects.front()->volumes.front()->mesh.facets_count() == 6);
+            }
+        }
+        boost::filesystem::remove(path);
+    }
+}
+
+static std::string
+temp_3mf_path()
+{
+    return (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.3mf")).string();
+}
+
+/// Write a 3MF package holding the given model XML through the streaming entry API.
+static void
+write_3mf(const std::string &path, const std::string &model_xml)
+{
+    ZipArchive zip(path, 'W');
+    REQUIRE(zip.z_stats());
+    REQUIRE(zip.open_entry("3D/3dmodel.model"));
+    {
+        ZipEntryBuffer buffer(zip);
+        std::ostream out(&buffer);
+        // write it in small pieces to go through the buffer refills
+        for (size_t i = 0; i < model_xml.size(); i += 7)
+            out << model_xml.substr(i, 7);
+    }
+    REQUIRE(zip.close_entry());
+    REQUIRE(zip.finalize());
+}
+
+SCENARIO("3MF files are written and read through streamed zip entries") {
+    GIVEN("A model with two objects, a modifier volume and configs") {
+        Model model;
+        ModelObject* first = model.add_object();
+        first->add_volume(TriangleMesh::make_sphere(10, PI / 20.0));
+        ModelVolume* modifier = first->add_volume(TriangleMesh::make_cube(5, 5, 5));
+        modifier->modifier = true;
+        modifier->config.set_deserialize("fill_density", "60%");
+        first->config.set_deserialize("perimeters", "5");
+        first->add_instance()->offset = Pointf(20, 30);
+        ModelObject* second = model.add_object();
+        second->add_volume(TriangleMesh::make_cube(20, 10, 5));
+        second->add_instance()->offset = Pointf(-20, 0);
+        second->add_instance()->offset = Pointf(-50, 0);
+        const std::string path {temp_3mf_path()};
+        WHEN("It is written and read back") {
+            REQUIRE(IO::TMF::write(model, path));
+            Model read;
+            REQUIRE(IO::TMF::read(path, &read));
+            THEN("The objects, volumes, configs and instances are the same") {
+                REQUIRE(read.objects.size() == 2);
+                for (size_t o = 0; o < 2; ++o) {
+                    const ModelObject &object = *model.objects[o];
+                    const ModelObject &read_object = *read.objects[o];
+                    REQUIRE(read_object.volumes.size() == object.volumes.size());
+                    REQUIRE(read_object.instances.size() == object.instances.size());
+                    for (size_t v = 0; v < object.volumes.size(); ++v) {
+                        const ModelVolume &volume = *object.volumes[v];
+                        const ModelVolume &read_volume = *read_object.volumes[v];
+                        REQUIRE(read_volume.modifier == volume.modifier);
+                        REQUIRE(read_volume.config.keys() == volume.config.keys());
+                        REQUIRE(read_volume.mesh.facets_count() == volume.mesh.facets_count());
+                        const BoundingBoxf3 bb = volume.mesh.bounding_box(), read_bb = read_volume.mesh.bounding_box();
+                        REQUIRE(read_bb.min.x == Approx(bb.min.x).margin(1e-4));
+                        REQUIRE(read_bb.max.z == Approx(bb.max.z).margin(1e-4));
+                    }
+                    for (size_t i = 0; i < object.instances.size(); ++i) {
+                        REQUIRE(read_object.instances[i]->offset.x == Approx(object.instances[i]->offset.x));
+                        REQUIRE(read_object.instances[i]->offset.y == Approx(object.instances[i]->offset.y));
+                    }
+                }
+                REQUIRE(read.objects[0]->config.serialize("perimeters") == "5");
+                REQUIRE(read.objects[0]->volumes[1]->config.serialize("fill_density") == "60%");
+            }
+        }
+        boost::filesystem::remove(path);
+    }
+    GIVEN("A hand written 3MF file with metadata, components and an object left out of the build") {
+        const std::string path {temp_3mf_path()};
+        write_3mf(path,
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<model unit=\"millimeter\" xmlns=\"http://schemas.microsoft.com/3dmanufacturing/core/2015/02\">\n"
+            " <metadata name=\"Title\">Two tetrahedrons</metadata>\n"
+            " <resources>\n"
+            "  <object id=\"1\" type=\"model\">\n"
+            "   <mesh>\n"
+            "    <vertices>\n"
+            "     <vertex x=\"0\" y=\"0\" z=\"0\"/><vertex x=\"10\" y=\"0\" z=\"0\"/>\n"
+            "     <vertex x=\"0\" y=\"10\" z=\"0\"/><vertex x=\" 0.0\" y=\"0.0\" z=\"1.0e1\"/>\n"
+            "    </vertices>\n"
+            "    <triangles>\n"
+            "     <triangle v1=\"0\" v2=\"2\" v3=\"1\"/><triangle v1=\"0\" v2=\"1\" v3=\"3\"/>\n"
+            "     <triangle v1=\"0\" v2=\"3\" v3=\"2\"/><triangle v1=\"1\" v2=\"2\" v3=\"3\"/>\n"
+            "    </triangles>\n"
+            "   </mesh>\n"
+            "  </object>\n"
+            "  <object id=\"2\" type=\"model\">\n"
+            "   <components>\n"
+            "    <component objectid=\"1\"/>\n"
+            "    <component objectid=\"1\" transform=\"1 0 0 0 1 0 0 0 1 20 0 0\"/>\n"
+            "   </components>\n"
+            "  </object>\n"
+            " </resources>\n"
+            " <build>\n"
+            "  <item objectid=\"2\"/>\n"
+            " </build>\n"
+            "</model>\n");
+        WHEN("It is read with IO::TMF::read()") {
+            Model model;
+            REQUIRE(IO::TMF::read(path, &model));
+            THEN("Only the built object is kept, with a volume per component") {
+                REQUIRE(model.metadata["Title"] == "Two tetrahedrons");
+                REQUIRE(model.objects.size() == 1);
+                const ModelObject &object = *model.objects.front();
+                REQUIRE(object.volumes.size() == 2);
+                REQUIRE(object.volumes[0]->mesh.facets_count() == 4);
+                REQUIRE(object.volumes[1]->mesh.facets_count() == 4);
+                const BoundingBoxf3 bb = object.raw_bounding_box();
+                REQUIRE(bb.min.x == Approx(0));
+                REQUIRE(bb.max.x == Approx(30));
+                REQUIRE(bb.max.z == Approx(10));
+            }
+        }
+        boost::filesystem::remove(path);
+    }
+    GIVEN("A 3MF file with a triangle referring to a missing vertex") {
+        const std::string path {temp_3mf_path()};
+        write_3mf(path,
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<model unit=\"millimeter\" xmlns=\"http://schemas.microsoft.com/3dmanufacturing/core/2015/02\">\n"
+            " <resources><object id=\"1\" type=\"model\"><mesh>\n"
+            "  <vertices><vertex x=\"0\" y=\"0\" z=\"0\"/><vertex x=\"1\" y=\"0\" z=\"0\"/><vertex x=\"0\" y=\"1\" z=\"0\"/></vertices>\n"
+            "  <triangles><triangle v1=\"0\" v2=\"1\" v3=\"7\"/></triangles>\n"
+            " </mesh></object></resources>\n"
+            " <build><item objectid=\"1\"/></build>\n"
+            "</model>\n");
+        THEN("IO::TMF::read() fails") {
+            Model model;
+            REQUIRE_FALSE(IO::TMF::read(path, &model));
+        }
+        boost::filesystem::remove(path);
+    }
+}
+
+#ifdef TEST_PERFORMANCE
+TEST_CASE("OBJ loading against tiny_obj_loader", "[benchmark]") {
+    // about 4M facets, 160 MB
+    const std::string path {temp_obj_path()};
+    size_t facets {0};
+    {
+        auto sphere {TriangleMesh::make_sphere(50, PI / 700.0)};
+        sphere.WriteOBJFile(path);
+        facets = sphere.facets_count();
+    }
+    const double mbytes = boost::filesystem::file_size(path) / 1e6;
+
+    // both read from the page cache, and build the same meshes
+    auto t0 = std::chrono::steady_clock::now();
+    double legacy_ms {0};
+    size_t legacy_facets {0};
+    {
+        Model model;
+        legacy_read_obj(path, &model);
+        legacy_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        legacy_facets = model.objects.front()->volumes.front()->mesh.facets_count();
+    }
+    t0 = std::chrono::steady_clock::now();
+    Model model;
+    IO::OBJ::read(path, &model);
+    const double ours_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    boost::filesystem::remove(path);
+
+    Slic3r::Log::info("IO") << facets << " facets, " << mbytes << " MB OBJ: tiny_obj_loader "
+        << legacy_ms << " ms, IO::OBJ::read " << ours_ms << " ms with "
+        << boost::thread::hardware_concurrency() << " threads\n";
+    REQUIRE(model.objects.front()->volumes.front()->mesh.facets_count() == legacy_facets);
+    REQUIRE(ours_ms < legacy_ms);
+}
+
+TEST_CASE("3MF saving and loading throughput", "[benchmark]") {
+    // four objects of about 360k facets each, about 300 MB of XML
+    Model model;
+    for (int i = 0; i < 4; ++i) {
+        ModelObject* object = model.add_object();
+        object->add_volume(TriangleMesh::make_sphere(30, PI / 300.0));
+        object->add_instance()->offset = Pointf(70 * i, 0);
+    }
+    size_t facets {0};
+    for (const auto object : model.objects)
+        facets += object->volumes.front()->mesh.facets_count();
+    const std::string path {temp_3mf_path()};
+
+    auto t0 = std::chrono::steady_clock::now();
+    REQUIRE(IO::TMF::write(model, path));
+    const double save_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    size_t xml_bytes {0};
+    {
+        ZipArchive zip(path, 'R');
+        REQUIRE(zip.extract_entry("3D/3dmodel.model", [&xml_bytes](const char*, size_t len) {
+            xml_bytes += len;
+            return true;
+        }));
+    }
+
+    t0 = std::chrono::steady_clock::now();
+    Model read;
+    REQUIRE(IO::TMF::read(path, &read));
+    const double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    const double zip_mbytes = boost::filesystem::file_size(path) / 1e6;
+    boost::filesystem::remove(path);
+
+    const double xml_mbytes = xml_bytes / 1e6;
+    Slic3r::Log::info("IO") << facets << " facets, " << xml_mbytes << " MB of XML in a "
+        << zip_mbytes << " MB 3MF: saved in " << save_ms << " ms (" << xml_mbytes / save_ms * 1e3
+        << " MB/s), loaded in " << load_ms << " ms (" << xml_mbytes / load_ms * 1e3 << " MB/s) with "
+        << boost::thread::hardware_concurrency() << " threads\n";
+    REQUIRE(read.objects.size() == model.objects.size());
+}
+#endif // TEST_PERFORMANCE
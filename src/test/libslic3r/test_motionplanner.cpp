@@ -0,0 +1,152 @@
+#include <catch.hpp>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "Log.hpp"
+#include "MotionPlanner.hpp"
+
+using namespace Slic3r;
+
+namespace {
+
+/// A square island of the given size with a square hole in its middle.
+ExPolygon
+ring(const Point &origin, coord_t size, coord_t hole)
+{
+    const coord_t margin {(size - hole) / 2};
+    ExPolygon ring;
+    ring.contour = Polygon(std::vector<Point>({origin, Point(origin.x + size, origin.y),
+        Point(origin.x + size, origin.y + size), Point(origin.x, origin.y + size)}));
+    Polygon h(std::vector<Point>({Point(origin.x + margin, origin.y + margin), Point(origin.x + margin, origin.y + margin + hole),
+        Point(origin.x + margin + hole, origin.y + margin + hole), Point(origin.x + margin + hole, origin.y + margin)}));
+    ring.holes.push_back(h);
+    return ring;
+}
+
+typedef std::vector<std::vector<std::pair<int, double>>> Edges;
+
+/// The nodes of the shortest path as the graph searched it before, going
+/// through all the nodes left for the nearest one.
+std::vector<int>
+reference_path(const Edges &edges, int from, int to)
+{
+    const int n = edges.size();
+    std::vector<double> dist(n, std::numeric_limits<double>::infinity());
+    std::vector<int> previous(n, -1);
+    dist[from] = 0;
+    std::set<int> Q;
+    for (int i = 0; i < n; ++i) Q.insert(i);
+    while (!Q.empty()) {
+        int u = -1;
+        double min_dist = -1;
+        for (int node : Q) {
+            if (dist[node] < min_dist || min_dist == -1) {
+                u = node;
+                min_dist = dist[node];
+            }
+        }
+        Q.erase(u);
+        if (u == to) break;
+        for (const auto &edge : edges[u]) {
+            if (Q.count(edge.first) == 0) continue;
+            const double alt = dist[u] + edge.second;
+            if (alt < dist[edge.first]) {
+                dist[edge.first] = alt;
+                previous[edge.first] = u;
+            }
+        }
+    }
+    std::vector<int> path;
+    for (int node = to; node != -1; node = previous[node]) path.push_back(node);
+    path.push_back(from);
+    return std::vector<int>(path.rbegin(), path.rend());
+}
+
+}
+
+SCENARIO("MotionPlannerGraph finds nodes and paths like a linear search") {
+    GIVEN("A graph of random nodes, some of them repeated, with edges of equal weights") {
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<coord_t> coord(0, 200);
+        MotionPlannerGraph graph;
+        for (int i = 0; i < 500; ++i) {
+            if (i > 0 && i % 7 == 0)
+                graph.nodes.push_back(graph.nodes[i / 2]);
+            else
+                graph.nodes.push_back(Point(coord(rng), coord(rng)));
+        }
+        Edges edges(graph.nodes.size());
+        std::uniform_int_distribution<int> node(0, graph.nodes.size() - 1);
+        for (int from = 0; from < static_cast<int>(graph.nodes.size()); ++from) {
+            for (int k = 0; k < 3; ++k) {
+                const int to {node(rng)};
+                // rounded so that many paths have the same length
+                const double weight {static_cast<double>(static_cast<int>(graph.nodes[from].distance_to(graph.nodes[to]) / 50))};
+                graph.add_edge(from, to, weight);
+                graph.add_edge(to, from, weight);
+                edges[from].push_back(std::make_pair(to, weight));
+                edges[to].push_back(std::make_pair(from, weight));
+            }
+        }
+        graph.index_nodes();
+        THEN("find_node() returns the node nearest_point_index() does") {
+            for (int i = 0; i < 2000; ++i) {
+                const Point point {i % 2 == 0 ? graph.nodes[node(rng)] : Point(coord(rng) - 20, coord(rng) + 20)};
+                REQUIRE(graph.find_node(point) == static_cast<size_t>(point.nearest_point_index(graph.nodes)));
+            }
+        }
+        THEN("shortest_path() goes through the same nodes") {
+            for (int i = 0; i < 100; ++i) {
+                const int from {node(rng)}, to {node(rng)};
+                Points expected;
+                for (int n : reference_path(edges, from, to)) expected.push_back(graph.nodes[n]);
+                REQUIRE(graph.shortest_path(from, to).points == expected);
+            }
+        }
+    }
+}
+
+SCENARIO("MotionPlanner avoids the holes of islands") {
+    GIVEN("An island with a hole between two points") {
+        MotionPlanner planner(ExPolygons { ring(Point(0, 0), scale_(50), scale_(20)) });
+        const Point from {scale_(5), scale_(25)}, to {scale_(45), scale_(25)};
+        const Polyline path {planner.shortest_path(from, to)};
+        THEN("the path goes around the hole, inside the island") {
+            REQUIRE(path.first_point().coincides_with(from));
+            REQUIRE(path.last_point().coincides_with(to));
+            REQUIRE(path.points.size() > 2);
+            REQUIRE(ring(Point(0, 0), scale_(50), scale_(20)).contains(path));
+        }
+    }
+}
+
+#ifdef TEST_PERFORMANCE
+TEST_CASE("Travel planning throughput on dense layers", "[benchmark]") {
+    // 400 islands with a hole each
+    ExPolygons islands;
+    for (int i = 0; i < 20; ++i)
+        for (int j = 0; j < 20; ++j)
+            islands.push_back(ring(Point(scale_(i * 12), scale_(j * 12)), scale_(10), scale_(4)));
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> island(0, islands.size() - 1);
+
+    const auto t0 = std::chrono::steady_clock::now();
+    MotionPlanner planner(islands);
+    size_t points {0};
+    const int travels {2000};
+    for (int i = 0; i < travels; ++i) {
+        const BoundingBox from {islands[island(rng)].contour.bounding_box()}, to {islands[island(rng)].contour.bounding_box()};
+        // on the outer side of the island, to the inner side of another one
+        points += planner.shortest_path(Point(from.min.x + scale_(0.5), from.min.y + scale_(5)),
+            Point(to.min.x + scale_(2.5), to.min.y + scale_(5))).points.size();
+    }
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    Slic3r::Log::info("MotionPlanner") << travels << " travels between " << islands.size() << " islands: "
+        << ms << " ms\n";
+    REQUIRE(points >= 2 * travels);
+}
+#endif // TEST_PERFORMANCE
@@ -2,6 +2,13 @@
 #include <string>
 #include "test_data.hpp"
 #include "libslic3r.h"
+#include "SliceCache.hpp"
+#include "Log.hpp"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <boost/filesystem.hpp>
 
 using namespace Slic3r::Test;
 using namespace std::literals;
@@ -38,6 +45,54 @@ SCENARIO("PrintObject: Perimeter generation") {
     }
 }
 
+SCENARIO("PrintObject: Perimeter generation across threads") {
+    GIVEN("An object made of 16 parts of different shapes") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        const TestMesh shapes[] { TestMesh::cube_with_hole, TestMesh::L, TestMesh::pyramid, TestMesh::cube_with_concave_hole };
+        TriangleMesh parts;
+        for (int i = 0; i < 16; ++i) {
+            TriangleMesh part {Slic3r::Test::mesh(shapes[i % 4])};
+            part.scale(0.25 + 0.05 * (i / 4));
+            part.align_to_origin();
+            part.translate(i % 4 * 15, i / 4 * 15, 0);
+            parts.merge(part);
+        }
+        parts.repair();
+
+        // the points of the perimeters, thin fills and fill surfaces of every layer
+        auto results {[&config, &parts] (int threads) {
+            config->set("threads", threads);
+            Slic3r::Model model;
+            auto print {Slic3r::Test::init_print({parts}, model, config)};
+            print->objects[0]->make_perimeters();
+            std::vector<Points> points;
+            for (auto* layer : print->objects[0]->layers) {
+                for (auto* layerm : layer->regions) {
+                    for (auto* entity : layerm->perimeters.flatten().entities)
+                        points.push_back(entity->as_polyline().points);
+                    for (auto* entity : layerm->thin_fills.flatten().entities)
+                        points.push_back(entity->as_polyline().points);
+                    for (const auto& surface : layerm->fill_surfaces.surfaces)
+                        points.push_back(surface.expolygon.contour.points);
+                }
+            }
+            return std::make_pair(print->objects[0]->layers.front()->regions[0]->perimeters.size(), points);
+        }};
+
+        WHEN("make_perimeters() is called with 1 and 4 threads") {
+            const auto serial {results(1)};
+            const auto parallel {results(4)};
+            THEN("the first layer has a collection of perimeters per part") {
+                REQUIRE(serial.first == 16);
+            }
+            THEN("the results are the same, in the same order") {
+                REQUIRE(parallel.first == serial.first);
+                REQUIRE(parallel.second == serial.second);
+            }
+        }
+    }
+}
+
 SCENARIO("Print: Skirt generation") {
     GIVEN("20mm cube and default config") {
         auto config {Slic3r::Config::new_from_defaults()};
@@ -96,3 +151,195 @@ SCENARIO("Print: Brim generation") {
         }
     }
 }
+
+SCENARIO("SliceCache: encoding") {
+    GIVEN("Layers with holes, negative coordinates and an empty layer") {
+        const auto dir {boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()};
+        Slic3r::SliceCache cache(dir.string());
+        Slic3r::ExPolygon square;
+        square.contour.points = { Slic3r::Point(-1000000, -1000000), Slic3r::Point(1000000, -1000000),
+            Slic3r::Point(1000000, 1000000), Slic3r::Point(-1000000, 1000000) };
+        square.holes.push_back(Slic3r::Polygon({ Slic3r::Point(-10, -10), Slic3r::Point(-10, 10),
+            Slic3r::Point(10, 10), Slic3r::Point(10, -10) }));
+        Slic3r::ExPolygon far_away;
+        const coord_t far {coord_t(1) << 40};
+        far_away.contour.points = { Slic3r::Point(far, coord_t(3)), Slic3r::Point(far + 5, coord_t(3)), Slic3r::Point(far, -far) };
+        const std::vector<Slic3r::ExPolygons> layers { { square, far_away }, {}, { square } };
+        Slic3r::SliceCache::Writer writer;
+        for (const auto &layer : layers)
+            writer.add_layer(layer);
+        Slic3r::SliceCache::key_t key;
+        key.hash = 42;
+        key.facets_count = 12;
+        std::fill(key.bounding_box, key.bounding_box + 6, 20.f);
+        WHEN("The layers are stored and loaded back") {
+            REQUIRE(cache.store(key, writer));
+            std::vector<Slic3r::ExPolygons> loaded;
+            REQUIRE(cache.load(key, layers.size(), &loaded));
+            THEN("They are the same") {
+                REQUIRE(loaded.size() == layers.size());
+                for (size_t i = 0; i < layers.size(); ++i) {
+                    REQUIRE(loaded[i].size() == layers[i].size());
+                    for (size_t j = 0; j < layers[i].size(); ++j) {
+                        REQUIRE(loaded[i][j].contour.points == layers[i][j].contour.points);
+                        REQUIRE(loaded[i][j].holes.size() == layers[i][j].holes.size());
+                        for (size_t k = 0; k < layers[i][j].holes.size(); ++k)
+                            REQUIRE(loaded[i][j].holes[k].points == layers[i][j].holes[k].points);
+                    }
+                }
+                REQUIRE(cache.hits() == 1);
+                REQUIRE(cache.misses() == 0);
+            }
+            THEN("Another key or another number of layers is a miss") {
+                auto other {key};
+                other.hash = 43;
+                REQUIRE_FALSE(cache.load(other, layers.size(), &loaded));
+                REQUIRE_FALSE(cache.load(key, layers.size() + 1, &loaded));
+                REQUIRE(cache.misses() == 2);
+            }
+            THEN("The same hash with another facet count or bounding box is a miss") {
+                auto other {key};
+                other.facets_count = 13;
+                REQUIRE_FALSE(cache.load(other, layers.size(), &loaded));
+                other = key;
+                other.bounding_box[5] = 20.5f;
+                REQUIRE_FALSE(cache.load(other, layers.size(), &loaded));
+                REQUIRE(cache.misses() == 2);
+            }
+        }
+        boost::filesystem::remove_all(dir);
+    }
+}
+
+SCENARIO("SliceCache: size limit") {
+    GIVEN("A slice cache with room for two entries") {
+        const auto dir {boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()};
+        Slic3r::ExPolygon square;
+        square.contour.points = { Slic3r::Point(0, 0), Slic3r::Point(1000000, 0),
+            Slic3r::Point(1000000, 1000000), Slic3r::Point(0, 1000000) };
+        Slic3r::SliceCache::Writer writer;
+        for (int i = 0; i < 100; ++i)
+            writer.add_layer({ square });
+        std::vector<Slic3r::SliceCache::key_t> keys(3);
+        for (size_t i = 0; i < keys.size(); ++i)
+            keys[i].hash = i + 1;
+        uint64_t entry_size = 0;
+        {
+            Slic3r::SliceCache probe((dir / "probe").string());
+            REQUIRE(probe.store(keys[0], writer));
+            for (boost::filesystem::directory_iterator it(dir / "probe"); it != boost::filesystem::directory_iterator(); ++it)
+                entry_size = boost::filesystem::file_size(it->path());
+        }
+        Slic3r::SliceCache cache(dir.string(), entry_size * 5 / 2);
+        // the modification times only have a precision of one second
+        auto age = [&dir](const Slic3r::SliceCache::key_t &key, std::time_t seconds) {
+            char name[32];
+            snprintf(name, sizeof(name), "%016llx.slices", (unsigned long long)key.hash);
+            boost::filesystem::last_write_time(dir / name, std::time(nullptr) - seconds);
+        };
+        REQUIRE(cache.store(keys[0], writer));
+        age(keys[0], 20);
+        REQUIRE(cache.store(keys[1], writer));
+        age(keys[1], 10);
+        WHEN("The older entry is used and a third one is stored") {
+            std::vector<Slic3r::ExPolygons> loaded;
+            REQUIRE(cache.load(keys[0], 100, &loaded));
+            REQUIRE(cache.store(keys[2], writer));
+            THEN("The least recently used entry is evicted") {
+                REQUIRE_FALSE(cache.load(keys[1], 100, &loaded));
+                REQUIRE(cache.load(keys[0], 100, &loaded));
+                REQUIRE(cache.load(keys[2], 100, &loaded));
+            }
+        }
+        boost::filesystem::remove_all(dir);
+    }
+}
+
+SCENARIO("SliceCache: reslicing unchanged objects") {
+    GIVEN("A cube with a hole sliced with a slice cache") {
+        const auto dir {boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()};
+        auto cache {std::make_shared<Slic3r::SliceCache>(dir.string())};
+        auto config {Slic3r::Config::new_from_defaults()};
+        auto slice = [&cache, &config]() {
+            Slic3r::Model model;
+            auto print {Slic3r::Test::init_print({TestMesh::cube_with_hole}, model, config)};
+            print->slice_cache = cache;
+            print->objects[0]->slice();
+            std::vector<Slic3r::Polygons> slices;
+            for (const auto* layer : print->objects[0]->layers)
+                slices.push_back(Slic3r::Polygons(layer->slices));
+            return slices;
+        };
+        const auto first {slice()};
+        THEN("The first slicing is a miss and fills the cache") {
+            REQUIRE(cache->hits() == 0);
+            REQUIRE(cache->misses() == 1);
+            REQUIRE(std::distance(boost::filesystem::directory_iterator(dir), boost::filesystem::directory_iterator()) == 1);
+        }
+        WHEN("It is sliced again with another speed") {
+            config->set("perimeter_speed", 13);
+            const auto second {slice()};
+            THEN("The slices come from the cache and are the same") {
+                REQUIRE(cache->hits() == 1);
+                REQUIRE(second.size() == first.size());
+                for (size_t i = 0; i < first.size(); ++i) {
+                    REQUIRE(second[i].size() == first[i].size());
+                    for (size_t j = 0; j < first[i].size(); ++j)
+                        REQUIRE(second[i][j].points == first[i][j].points);
+                }
+            }
+        }
+        WHEN("It is sliced again with another layer height") {
+            config->set("layer_height", 0.2);
+            slice();
+            THEN("It is a miss") {
+                REQUIRE(cache->hits() == 0);
+                REQUIRE(cache->misses() == 2);
+            }
+        }
+        WHEN("The cache file is damaged") {
+            for (boost::filesystem::directory_iterator it(dir); it != boost::filesystem::directory_iterator(); ++it)
+                boost::filesystem::resize_file(it->path(), boost::filesystem::file_size(it->path()) - 3);
+            const auto second {slice()};
+            THEN("It is a miss and the object is sliced again") {
+                REQUIRE(cache->hits() == 0);
+                REQUIRE(cache->misses() == 2);
+                REQUIRE(second.size() == first.size());
+            }
+        }
+        boost::filesystem::remove_all(dir);
+    }
+}
+
+#ifdef TEST_PERFORMANCE
+TEST_CASE("Perimeter generation of a wide plate", "[benchmark]") {
+    // 200 parts in one object, two layers high: the islands of a layer are
+    // all the parallelism there is
+    auto config {Slic3r::Config::new_from_defaults()};
+    TriangleMesh parts;
+    for (int i = 0; i < 200; ++i) {
+        TriangleMesh part {Slic3r::Test::mesh(i % 2 ? TestMesh::cube_with_hole : TestMesh::L)};
+        part.scale(Pointf3(0.25, 0.25, 0.065));
+        part.align_to_origin();
+        part.translate(i % 20 * 7, i / 20 * 7, 0);
+        parts.merge(part);
+    }
+    parts.repair();
+
+    double first_ms {0};
+    for (unsigned int threads = 1; threads <= std::max(2u, boost::thread::hardware_concurrency()); ++threads) {
+        config->set("threads", static_cast<int>(threads));
+        Slic3r::Model model;
+        auto print {Slic3r::Test::init_print({parts}, model, config)};
+        print->objects[0]->slice();
+        const auto t0 {std::chrono::steady_clock::now()};
+        print->objects[0]->make_perimeters();
+        const double ms {std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count()};
+        if (threads == 1) first_ms = ms;
+        Slic3r::Log::info("PerimeterGenerator") << print->objects[0]->layers.size() << " layers of "
+            << print->objects[0]->layers.front()->slices.expolygons.size() << " islands, " << threads
+            << " threads: " << ms << " ms (speedup " << first_ms / ms << "x)\n";
+        REQUIRE(print->objects[0]->layers.front()->regions[0]->perimeters.size() == 200);
+    }
+}
+#endif // TEST_PERFORMANCE
@@ -1,9 +1,15 @@
 #include <catch.hpp>
 
+#include <chrono>
 #include <regex>
+#include <thread>
 #include "test_data.hpp"
 #include "libslic3r.h"
 #include "GCodeReader.hpp"
+#include "Log.hpp"
+#include "GCode/CoolingBuffer.hpp"
+#include "GCode/LayerGCodeCache.hpp"
+#include "PrintGCode.hpp"
 
 using namespace Slic3r::Test;
 using namespace Slic3r;
@@ -211,3 +217,283 @@ SCENARIO( "PrintGCode basic functionality") {
         gcode.clear();
     }
 }
+
+SCENARIO( "PrintGCode output doesn't depend on the number of threads") {
+    // drop the lines expected to differ: the timestamp and the threads option
+    auto exported_with_threads { [] (config_ptr config, int threads) -> std::string {
+        config->set("threads", threads);
+        Slic3r::Model model;
+        auto print {Slic3r::Test::init_print({TestMesh::cube_20x20x20, TestMesh::ipadstand}, model, config)};
+        std::stringstream gcode;
+        Slic3r::Test::gcode(gcode, print);
+        std::string exported, line;
+        while (std::getline(gcode, line)) {
+            if (line.find("; generated by") == 0 || line.find("; threads =") == 0) continue;
+            exported += line + "\n";
+        }
+        return exported;
+    }};
+    GIVEN("Two objects with support material and a raft") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("support_material", true);
+        config->set("raft_layers", 2);
+        config->set("label_printed_objects", true);
+        WHEN("the G-code is exported with 1 and with 4 threads") {
+            auto single {exported_with_threads(config, 1)};
+            auto multi {exported_with_threads(config, 4)};
+            THEN("the output is identical") {
+                REQUIRE(single.size() > 0);
+                REQUIRE(single == multi);
+            }
+        }
+    }
+    GIVEN("Two objects printed one after the other") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("complete_objects", true);
+        config->set("between_objects_gcode", "M104 S200");
+        WHEN("the G-code is exported with 1 and with 4 threads") {
+            auto single {exported_with_threads(config, 1)};
+            auto multi {exported_with_threads(config, 4)};
+            THEN("the output is identical") {
+                REQUIRE(single.size() > 0);
+                REQUIRE(single == multi);
+            }
+        }
+    }
+}
+
+SCENARIO( "PrintGCode writes the layers generated ahead on other threads") {
+    auto exported_with_threads { [] (config_ptr config, int threads, size_t* speculated_layers) -> std::string {
+        config->set("threads", threads);
+        Slic3r::Model model;
+        auto print {Slic3r::Test::init_print({TestMesh::cube_20x20x20}, model, config)};
+        print->process();
+        std::stringstream gcode;
+        Slic3r::PrintGCode exporter(*print, gcode);
+        exporter.output();
+        *speculated_layers = exporter.speculated_layers();
+        std::string exported, line;
+        while (std::getline(gcode, line)) {
+            if (line.find("; generated by") == 0 || line.find("; threads =") == 0) continue;
+            exported += line + "\n";
+        }
+        return exported;
+    }};
+    GIVEN("A cube with relative E distances, whose layers start where the previous ones end") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("use_relative_e_distances", true);
+        config->set("layer_height", 0.1);
+        WHEN("the G-code is exported with 1 and with 4 threads") {
+            size_t single_speculated, multi_speculated;
+            auto single {exported_with_threads(config, 1, &single_speculated)};
+            auto multi {exported_with_threads(config, 4, &multi_speculated)};
+            THEN("most layers come from the other threads and the output is identical") {
+                INFO("layers written from the other threads: " << multi_speculated);
+                REQUIRE(single_speculated == 0);
+                REQUIRE(multi_speculated > 50);
+                REQUIRE(single == multi);
+            }
+        }
+    }
+    GIVEN("The same cube with absolute E distances, which add up over the layers") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("layer_height", 0.1);
+        WHEN("the G-code is exported with 1 and with 4 threads") {
+            size_t single_speculated, multi_speculated;
+            auto single {exported_with_threads(config, 1, &single_speculated)};
+            auto multi {exported_with_threads(config, 4, &multi_speculated)};
+            THEN("most layers come from the other threads, E written from the layers before, and the output is identical") {
+                INFO("layers written from the other threads: " << multi_speculated);
+                REQUIRE(single_speculated == 0);
+                REQUIRE(multi_speculated > 50);
+                REQUIRE(single == multi);
+            }
+        }
+    }
+    GIVEN("The same cube with absolute E distances reset on each retraction") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("layer_height", 0.1);
+        config->set("retract_length", 1);
+        config->set("retract_before_travel", 0);
+        WHEN("the G-code is exported with 1 and with 4 threads") {
+            size_t single_speculated, multi_speculated;
+            auto single {exported_with_threads(config, 1, &single_speculated)};
+            auto multi {exported_with_threads(config, 4, &multi_speculated)};
+            THEN("most layers come from the other threads and the output is identical") {
+                INFO("layers written from the other threads: " << multi_speculated);
+                REQUIRE(single.find("G92 E0") != std::string::npos);
+                REQUIRE(multi_speculated > 50);
+                REQUIRE(single == multi);
+            }
+        }
+    }
+}
+
+SCENARIO( "PrintGCode re-exports from a layer G-code cache") {
+    // drop the timestamp and the threads option
+    auto exported { [] (Slic3r::Print& print) -> std::string {
+        std::stringstream gcode;
+        print.export_gcode(gcode, true);
+        std::string exported, line;
+        while (std::getline(gcode, line)) {
+            if (line.find("; generated by") == 0 || line.find("; threads =") == 0) continue;
+            exported += line + "\n";
+        }
+        return exported;
+    }};
+    GIVEN("Two cubes exported with a cache") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("gcode_comments", true);
+        Slic3r::Model model;
+        auto print {Slic3r::Test::init_print({TestMesh::cube_20x20x20, TestMesh::cube_20x20x20}, model, config)};
+        auto cache {std::make_shared<Slic3r::LayerGCodeCache>()};
+        print->gcode_cache = cache;
+        const auto first {exported(*print)};
+        const auto layers {cache->misses()};
+        THEN("every layer is generated and stored") {
+            REQUIRE(layers > 0);
+            REQUIRE(cache->hits() == 0);
+            REQUIRE(cache->size() == layers);
+        }
+        WHEN("it is exported again") {
+            const auto second {exported(*print)};
+            THEN("every layer comes from the cache and the G-code is the same") {
+                REQUIRE(cache->hits() == layers);
+                REQUIRE(second == first);
+            }
+        }
+        WHEN("the top layer of one of the cubes changes") {
+            // as if the cube had been sliced again without top infill
+            for (auto* layerm : print->objects.at(1)->layers.back()->regions)
+                layerm->fills.clear();
+            const auto second {exported(*print)};
+            THEN("the G-code is the one of an export without the cache") {
+                print->gcode_cache = nullptr;
+                REQUIRE(second != first);
+                REQUIRE(second == exported(*print));
+            }
+            THEN("the layers below the change come from the cache") {
+                INFO("layers: " << layers << ", hits: " << cache->hits() << ", misses: " << cache->misses() - layers);
+                REQUIRE(cache->hits() >= layers - 2);
+                REQUIRE(cache->size() == layers);
+            }
+        }
+        WHEN("the top layer of one of the cubes changes and it is exported with 4 threads") {
+            for (auto* layerm : print->objects.at(1)->layers.back()->regions)
+                layerm->fills.clear();
+            print->config.threads.value = 4;
+            const auto second {exported(*print)};
+            THEN("the G-code is the one of an export with 1 thread and without the cache") {
+                print->gcode_cache = nullptr;
+                print->config.threads.value = 1;
+                REQUIRE(second == exported(*print));
+            }
+        }
+    }
+    GIVEN("Two cubes whose infill is printed by a second extruder, with a toolchange G-code") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("infill_extruder", 2);
+        config->set("toolchange_gcode", "; tool [next_extruder] [tool_label]");
+        Slic3r::Model model;
+        auto print {Slic3r::Test::init_print({TestMesh::cube_20x20x20, TestMesh::cube_20x20x20}, model, config)};
+        auto cache {std::make_shared<Slic3r::LayerGCodeCache>()};
+        print->gcode_cache = cache;
+        print->placeholder_parser.set("tool_label", "first");
+        const auto first {exported(*print)};
+        WHEN("a placeholder of the toolchange G-code changes outside of the config") {
+            print->placeholder_parser.set("tool_label", "second");
+            const auto second {exported(*print)};
+            THEN("the G-code is the one of an export without the cache") {
+                REQUIRE(first.find("; tool 1 first") != std::string::npos);
+                REQUIRE(second.find("; tool 1 first") == std::string::npos);
+                print->gcode_cache = nullptr;
+                REQUIRE(second == exported(*print));
+            }
+        }
+    }
+}
+
+SCENARIO( "CoolingBuffer slows down short layers") {
+    GIVEN("A layer printed in less than slowdown_below_layer_time") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("disable_fan_first_layers", 0);
+        PrintConfig print_config;
+        print_config.apply(config->config(), true);
+        GCode gcodegen;
+        gcodegen.apply_print_config(print_config);
+        gcodegen.set_extruders(std::vector<unsigned int>{0});
+        CoolingBuffer buffer(gcodegen);
+        const std::string layer {
+            "G1 X50 F2500\n"
+            "G1 F3000;_EXTRUDE_SET_SPEED\n"
+            "G1 X100 E1\n"
+            ";_BRIDGE_FAN_START\n"
+            "G1 F1200;_EXTRUDE_SET_SPEED\n"
+            "G1 X0 E2\n"
+            ";_BRIDGE_FAN_END\n"
+            "G1 F1800;_EXTRUDE_SET_SPEED;_EXTERNAL_PERIMETER\n"
+            "G1 E4 F400"
+        };
+        WHEN("the layer is flushed") {
+            gcodegen.elapsed_time = print_config.slowdown_below_layer_time - 1;
+            std::string gcode {buffer.append(layer, "0", 0, 0.4)};
+            gcode += buffer.flush();
+            THEN("extrusions are slowed down, except the bridges") {
+                REQUIRE(gcode.find("F3000") == std::string::npos);
+                REQUIRE(gcode.find("G1 F1200\n") != std::string::npos);
+            }
+            THEN("travel and extruder-only moves keep their speed") {
+                REQUIRE(gcode.find("G1 X50 F2500\n") != std::string::npos);
+                REQUIRE(gcode.find("G1 E4 F400\n") != std::string::npos);
+            }
+            THEN("the fan is turned on and the markers are removed") {
+                REQUIRE(gcode.find("M106 S255\n") == 0);
+                REQUIRE(gcode.find(";_") == std::string::npos);
+            }
+        }
+        WHEN("the layer is appended by several objects in pieces cut inside the lines and the markers") {
+            gcodegen.elapsed_time = print_config.slowdown_below_layer_time - 1;
+            std::string whole {buffer.append(layer, "0", 0, 0.4)};
+            whole += buffer.flush();
+            // another generator, as the writer skips a fan speed it has already set
+            GCode other_gcodegen;
+            other_gcodegen.apply_print_config(print_config);
+            other_gcodegen.set_extruders(std::vector<unsigned int>{0});
+            CoolingBuffer other_buffer(other_gcodegen);
+            std::string pieces;
+            for (size_t pos = 0; pos < layer.size(); pos += 7) {
+                other_gcodegen.elapsed_time = pos == 0 ? print_config.slowdown_below_layer_time - 1 : 0;
+                pieces += other_buffer.append(layer.substr(pos, 7), std::to_string(pos), 0, 0.4);
+            }
+            pieces += other_buffer.flush();
+            THEN("the output is the same") {
+                REQUIRE(pieces == whole);
+            }
+        }
+    }
+}
+
+#ifdef TEST_PERFORMANCE
+TEST_CASE("G-code export of a tall print with several islands", "[benchmark]") {
+    // the travels between the islands retract, which resets E: the layers
+    // generated ahead start from the same state as the written ones soon
+    auto config {Slic3r::Config::new_from_defaults()};
+    config->set("layer_height", 0.05);
+    double first_ms {0};
+    for (unsigned int threads = 1; threads <= std::max(2u, std::thread::hardware_concurrency()); ++threads) {
+        config->set("threads", static_cast<int>(threads));
+        Slic3r::Model model;
+        auto print {Slic3r::Test::init_print({TestMesh::cube_with_hole, TestMesh::ipadstand, TestMesh::L}, model, config)};
+        print->process();
+        std::stringstream gcode;
+        Slic3r::PrintGCode exporter(*print, gcode);
+        const auto t0 {std::chrono::steady_clock::now()};
+        exporter.output();
+        const double ms {std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count()};
+        if (threads == 1) first_ms = ms;
+        Slic3r::Log::info("PrintGCode") << threads << " threads: " << ms << " ms (speedup " << first_ms / ms << "x), "
+            << exporter.speculated_layers() << " layers generated ahead\n";
+        REQUIRE(gcode.str().size() > 0);
+    }
+}
+#endif // TEST_PERFORMANCE
@@ -1,4 +1,6 @@
 #include <catch.hpp>
+#include <chrono>
+#include <boost/thread.hpp>
 #include <libslic3r/IO.hpp>
 #include <libslic3r/GCodeReader.hpp>
 
@@ -6,6 +8,7 @@
 #include "TriangleMesh.hpp"
 #include "Model.hpp"
 #include "SupportMaterial.hpp"
+#include "Log.hpp"
 
 using namespace std;
 using namespace Slic3r;
@@ -293,3 +296,164 @@ bool test_6_checks(Print &print)
 
     return has_bridge_speed;
 }
+
+namespace {
+
+typedef pair<ZPolygons, ZPolygons> ContactOverhang;
+
+/// Contact and overhang areas of a sliced mesh, detected with the given threads.
+ContactOverhang contact_area(const TriangleMesh &mesh, int threads, bool buildplate_only = false, double *ms = nullptr)
+{
+    Model model = Model();
+    ModelObject *object = model.add_object();
+    object->add_volume(mesh);
+    model.add_default_instances();
+    model.align_instances_to_origin();
+
+    Print print = Print();
+    print.config.threads = threads;
+    print.default_object_config.support_material = 1;
+    print.default_object_config.support_material_buildplate_only = buildplate_only;
+    print.add_model_object(model.objects[0]);
+    print.objects.front()->_slice();
+    print.objects.front()->detect_surfaces_type();
+
+    SupportMaterial *support = print.objects.front()->_support_material();
+    const auto t0 = chrono::steady_clock::now();
+    ContactOverhang result = support->contact_area(print.objects.front());
+    if (ms != nullptr)
+        *ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    return result;
+}
+
+void require_same(const ZPolygons &a, const ZPolygons &b)
+{
+    REQUIRE(a.z == b.z);
+    REQUIRE(a.polygons.size() == b.polygons.size());
+    for (size_t i = 0; i < a.polygons.size(); i++) {
+        REQUIRE(a.polygons[i].size() == b.polygons[i].size());
+        for (size_t j = 0; j < a.polygons[i].size(); j++)
+            REQUIRE(a.polygons[i][j].points == b.polygons[i][j].points);
+    }
+}
+
+double total_area(const ZPolygons &layers)
+{
+    double area = 0;
+    for (const Polygons &polygons : layers.polygons)
+        for (const Polygon &polygon : polygons)
+            area += polygon.area();
+    return area;
+}
+
+}
+
+SCENARIO("SupportMaterial: layers sorted by Z")
+{
+    GIVEN("Layers set out of order") {
+        const Polygon square = Polygon::new_scale({Pointf(0, 0), Pointf(1, 0), Pointf(1, 1), Pointf(0, 1)});
+        ZPolygons layers;
+        layers.set(0.6, Polygons{square});
+        layers.set(0.2, Polygons());
+        layers.set(0.4, Polygons{square, square});
+        layers.set(0.6, Polygons{square, square, square});
+        THEN("they are sorted, with the last polygons set at each Z") {
+            REQUIRE(layers.z == vector<coordf_t>({0.2, 0.4, 0.6}));
+            REQUIRE(layers.polygons[1].size() == 2);
+            REQUIRE(layers.polygons[2].size() == 3);
+        }
+        THEN("they are found at their exact Z only") {
+            REQUIRE(layers.find(0.4) == &layers.polygons[1]);
+            REQUIRE(layers.find(0.5) == nullptr);
+            REQUIRE(layers.find(0.7) == nullptr);
+            REQUIRE(layers.upper_bound(0.4) == 2);
+            REQUIRE(layers.upper_bound(0.) == 0);
+        }
+    }
+    GIVEN("Support layers") {
+        Model model = Model();
+        ModelObject *object = model.add_object();
+        object->add_volume(TriangleMesh::make_cube(20, 20, 20));
+        model.add_default_instances();
+        Print print = Print();
+        print.add_model_object(model.objects[0]);
+        SupportMaterial *support = print.objects.front()->_support_material();
+        const vector<coordf_t> support_z {0.3, 0.6, 0.9, 1.4};
+        THEN("each one only overlaps with itself") {
+            auto overlapping = support->overlapping_layers(support_z);
+            REQUIRE(overlapping.size() == support_z.size());
+            for (size_t i = 0; i < support_z.size(); i++)
+                REQUIRE(overlapping[i] == make_pair(i, i + 1));
+        }
+        THEN("the base is the projection of the interface above, looked up by layer index") {
+            const Polygon square = Polygon::new_scale({Pointf(0, 0), Pointf(1, 0), Pointf(1, 1), Pointf(0, 1)});
+            vector<Polygons> _interface(support_z.size());
+            _interface[2] = Polygons{square};
+            vector<Polygons> base = support->generate_base_layers(support_z, ZPolygons(), _interface, ZPolygons());
+            REQUIRE(base.size() == support_z.size());
+            REQUIRE(base[3].empty());
+            REQUIRE(base[2].empty());
+            for (size_t i = 0; i < 2; i++) {
+                ZPolygons layer;
+                layer.set(support_z[i], Polygons(base[i]));
+                REQUIRE(total_area(layer) == Approx(square.area()));
+            }
+        }
+    }
+}
+
+SCENARIO("SupportMaterial: contact areas don't depend on the number of threads")
+{
+    GIVEN("A 20 mm sphere, overhanging all around its lower half") {
+        TriangleMesh sphere = TriangleMesh::make_sphere(10, PI / 30);
+        WHEN("its contact areas are detected with 1 and with 4 threads") {
+            ContactOverhang single = contact_area(sphere, 1);
+            ContactOverhang multi = contact_area(sphere, 4);
+            THEN("there are contact areas, and they are the same") {
+                REQUIRE(!single.first.empty());
+                require_same(single.first, multi.first);
+                require_same(single.second, multi.second);
+            }
+        }
+    }
+    GIVEN("A plate overhanging above a smaller cube") {
+        TriangleMesh mesh = TriangleMesh::make_cube(10, 10, 5);
+        TriangleMesh plate = TriangleMesh::make_cube(30, 30, 3);
+        plate.translate(-10, -10, 10);
+        mesh.merge(plate);
+        WHEN("its contact areas are detected from the build plate only, with 1 and with 4 threads") {
+            ContactOverhang single = contact_area(mesh, 1, true);
+            ContactOverhang multi = contact_area(mesh, 4, true);
+            THEN("the plate is not supported above the top of the cube, and the areas are the same") {
+                REQUIRE(!single.first.empty());
+                REQUIRE(total_area(single.first) < total_area(contact_area(mesh, 1).first));
+                require_same(single.first, multi.first);
+                require_same(single.second, multi.second);
+            }
+        }
+    }
+}
+
+#ifdef TEST_PERFORMANCE
+TEST_CASE("SupportMaterial contact area scaling over threads on a tall model", "[benchmark]")
+{
+    // a sphere stretched 200 mm high, overhanging on about 300 layers
+    TriangleMesh sphere = TriangleMesh::make_sphere(25, PI / 180);
+    sphere.scale(Pointf3(1, 1, 4));
+
+    const int max_threads = std::max(2u, boost::thread::hardware_concurrency());
+    ContactOverhang reference;
+    double single_ms {0};
+    for (int threads = 1; threads <= max_threads; ++threads) {
+        double ms {0};
+        ContactOverhang result = contact_area(sphere, threads, false, &ms);
+        if (threads == 1) {
+            single_ms = ms;
+            reference = result;
+        }
+        Slic3r::Log::info("SupportMaterial") << result.first.size() << " contact layers, " << threads
+            << " threads: " << ms << " ms (speedup " << single_ms / ms << ")\n";
+        require_same(result.first, reference.first);
+    }
+}
+#endif // TEST_PERFORMANCE
@@ -0,0 +1,141 @@
+#include <catch.hpp>
+
+#include "libslic3r.h"
+#include "ThreadPool.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+using namespace Slic3r;
+
+SCENARIO("parallelize() runs every item exactly once") {
+    GIVEN("A range of 10000 indices") {
+        const size_t count {10000};
+        for (int threads : {1, 2, 8}) {
+            WHEN("It is processed with " + std::to_string(threads) + " threads") {
+                std::vector<std::atomic<int>> hits(count);
+                for (auto& h : hits) h = 0;
+                parallelize<size_t>(0, count - 1, [&hits](size_t i) { ++hits[i]; }, threads);
+                THEN("Each index was visited once") {
+                    REQUIRE(std::all_of(hits.begin(), hits.end(), [](const std::atomic<int>& h) { return h == 1; }));
+                }
+            }
+        }
+    }
+    GIVEN("A queue of pointers") {
+        std::vector<int> values(500, 0);
+        std::queue<int*> queue;
+        for (auto& v : values) queue.push(&v);
+        WHEN("It is processed with 4 threads") {
+            parallelize<int*>(queue, [](int* v) { *v += 1; }, 4);
+            THEN("Each item was visited once") {
+                REQUIRE(std::count(values.begin(), values.end(), 1) == 500);
+            }
+        }
+    }
+    GIVEN("The range of an empty container") {
+        std::vector<int> empty;
+        WHEN("It is passed as 0..size()-1") {
+            size_t calls {0};
+            parallelize<size_t>(0, empty.size() - 1, [&calls](size_t) { ++calls; }, 4);
+            THEN("Nothing is called") {
+                REQUIRE(calls == 0);
+            }
+        }
+    }
+}
+
+SCENARIO("parallelize() can be nested and reports failures") {
+    GIVEN("An outer loop over 16 items, each running an inner loop over 1000 items") {
+        std::atomic<size_t> total {0};
+        parallelize<int>(0, 15, [&total](int) {
+            parallelize<int>(0, 999, [&total](int) { ++total; }, 4);
+        }, 4);
+        THEN("Every inner item ran") {
+            REQUIRE(total == 16000);
+        }
+    }
+    GIVEN("A body throwing on one item") {
+        auto body = [](size_t i) { if (i == 77) throw std::runtime_error("item 77"); };
+        THEN("The exception reaches the caller") {
+            REQUIRE_THROWS_AS(parallelize<size_t>(0, 999, body, 4), std::runtime_error);
+        }
+        THEN("The pool is still usable afterwards") {
+            std::atomic<size_t> total {0};
+            parallelize<size_t>(0, 999, [&total](size_t) { ++total; }, 4);
+            REQUIRE(total == 1000);
+        }
+    }
+}
+
+#ifdef TEST_PERFORMANCE
+namespace {
+    // The implementation parallelize<T>() had before the shared ThreadPool:
+    // a fresh thread group per call, one mutex-guarded queue entry per item.
+    template <class T> void
+    _legacy_parallelize_do(std::queue<T>* queue, boost::mutex* queue_mutex, boost::function<void(T)> func)
+    {
+        while (true) {
+            T i;
+            {
+                boost::lock_guard<boost::mutex> l(*queue_mutex);
+                if (queue->empty()) return;
+                i = queue->front();
+                queue->pop();
+            }
+            func(i);
+            boost::this_thread::interruption_point();
+        }
+    }
+
+    template <class T> void
+    legacy_parallelize(T start, T end, boost::function<void(T)> func, int threads_count)
+    {
+        std::queue<T> queue;
+        for (T i = start; i <= end; ++i) queue.push(i);
+        boost::mutex queue_mutex;
+        boost::thread_group workers;
+        for (int i = 0; i < std::min(threads_count, (int)queue.size()); i++)
+            workers.add_thread(new boost::thread(&_legacy_parallelize_do<T>, &queue, &queue_mutex, func));
+        workers.join_all();
+    }
+
+    template <class F> double
+    time_ms(F f)
+    {
+        const auto t0 = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+}
+
+TEST_CASE("ThreadPool benchmark against per-call thread spawning", "[benchmark]") {
+    const int threads = std::max(2u, boost::thread::hardware_concurrency());
+    std::vector<double> sink(2000000, 0.);
+    auto work = [&sink](size_t i) { sink[i] += std::sqrt(double(i)); };
+
+    // many short calls, like parallelize() once per object and per step
+    const size_t calls {2000};
+    const double legacy_calls = time_ms([&]() {
+        for (size_t c = 0; c < calls; ++c) legacy_parallelize<size_t>(0, 99, work, threads);
+    });
+    const double pool_calls = time_ms([&]() {
+        for (size_t c = 0; c < calls; ++c) parallelize<size_t>(0, 99, work, threads);
+    });
+
+    // one call over a facet-sized range
+    const double legacy_range = time_ms([&]() { legacy_parallelize<size_t>(0, sink.size() - 1, work, threads); });
+    const double pool_range   = time_ms([&]() { parallelize<size_t>(0, sink.size() - 1, work, threads); });
+
+    std::ostringstream ss;
+    ss << threads << " threads: "
+       << calls << " calls x 100 items: legacy " << legacy_calls << " ms, pool " << pool_calls << " ms; "
+       << sink.size() << " items: legacy " << legacy_range << " ms, pool " << pool_range << " ms";
+    Slic3r::Log::info("ThreadPool", ss.str());
+    REQUIRE(pool_calls < legacy_calls);
+}
+#endif // TEST_PERFORMANCE
@@ -13,6 +13,13 @@
 #include <algorithm>
 #include <future>
 #include <chrono>
+#include <fstream>
+#include <functional>
+#include <boost/filesystem.hpp>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 using namespace Slic3r;
 using namespace std;
@@ -225,6 +232,282 @@ SCENARIO( "TriangleMesh: slice behavior.") {
     }
 }
 
+SCENARIO( "TriangleMeshSlicer: slicing does not depend on the number of threads.") {
+    GIVEN( "A sphere with a few thousand facets") {
+        auto sphere {TriangleMesh::make_sphere(10, PI / 30.0)};
+        std::vector<float> z;
+        for (float h = -9.9f; h < 10.f; h += 0.2f) z.push_back(h);
+
+        WHEN( "It is sliced with 1 thread and with 8 threads") {
+            TriangleMeshSlicer<Z> slicer(&sphere);
+            std::vector<Polygons> single, multi;
+            slicer.threads = 1;
+            slicer.slice(z, &single);
+            slicer.threads = 8;
+            slicer.slice(z, &multi);
+            THEN( "Every layer holds the same polygons") {
+                REQUIRE(single.size() == z.size());
+                REQUIRE(multi.size() == z.size());
+                for (size_t i = 0; i < z.size(); ++i) {
+                    REQUIRE(single[i].size() == 1);
+                    REQUIRE(multi[i].size() == single[i].size());
+                    REQUIRE(multi[i].front().points == single[i].front().points);
+                }
+            }
+        }
+    }
+}
+
+SCENARIO( "TriangleMeshSlicer: the sweep engine matches the facet engine.") {
+    GIVEN( "A sphere with a few thousand facets") {
+        auto sphere {TriangleMesh::make_sphere(10, PI / 30.0)};
+        std::vector<float> z;
+        for (float h = -9.9f; h < 10.f; h += 0.2f) z.push_back(h);
+
+        WHEN( "It is sliced with both engines") {
+            TriangleMeshSlicer<Z> slicer(&sphere);
+            std::vector<Polygons> facets, sweep;
+            slicer.slice(z, &facets);
+            slicer.mode = smSweep;
+            slicer.slice(z, &sweep);
+            THEN( "Every layer holds the same polygons") {
+                REQUIRE(sweep.size() == facets.size());
+                for (size_t i = 0; i < z.size(); ++i) {
+                    REQUIRE(sweep[i].size() == facets[i].size());
+                    REQUIRE(sweep[i].front().points == facets[i].front().points);
+                }
+            }
+        }
+        WHEN( "It is swept in blocks of a few layers each") {
+            TriangleMeshSlicer<Z> slicer(&sphere);
+            std::vector<Polygons> facets, sweep;
+            slicer.slice(z, &facets);
+            slicer.mode = smSweep;
+            slicer.threads = 8;
+            slicer.slice(z, &sweep);
+            THEN( "Every block starts from the facets cut by its first layer") {
+                REQUIRE(sweep.size() == facets.size());
+                for (size_t i = 0; i < z.size(); ++i) {
+                    REQUIRE(sweep[i].size() == facets[i].size());
+                    REQUIRE(sweep[i].front().points == facets[i].front().points);
+                }
+            }
+        }
+    }
+    GIVEN( "A 20mm cube and an unsorted Z list") {
+        auto cube {TriangleMesh::make_cube(20, 20, 20)};
+        const std::vector<float> z { 0, 2, 4, 8, 6, 8, 10, 12, 14, 16, 18, 20 };
+        WHEN( "It is sliced with the sweep engine") {
+            TriangleMeshSlicer<Z> slicer(&cube);
+            slicer.mode = smSweep;
+            std::vector<Polygons> layers;
+            slicer.slice(z, &layers);
+            THEN( "Every layer is still cut") {
+                REQUIRE(layers.size() == z.size());
+                for (const Polygons &layer : layers) {
+                    REQUIRE(layer.size() == 1);
+                    REQUIRE(layer.front().area() == Approx(20.0*20/(std::pow(SCALING_FACTOR,2))));
+                }
+            }
+        }
+    }
+}
+
+SCENARIO( "TriangleMeshSlicer: streaming slices match the batch slices.") {
+    GIVEN( "Two merged spheres and a sorted Z list") {
+        auto sphere {TriangleMesh::make_sphere(10, PI / 30.0)};
+        auto other {TriangleMesh::make_sphere(5, PI / 20.0)};
+        other.translate(25, 0, 3);
+        sphere.merge(other);
+        std::vector<float> z;
+        for (float h = -9.9f; h < 10.f; h += 0.2f) z.push_back(h);
+
+        TriangleMeshSlicer<Z> slicer(&sphere);
+        std::vector<ExPolygons> batch;
+        slicer.slice(z, &batch);
+        WHEN( "It is streamed with windows of 1, 7 and 1000 layers") {
+            THEN( "The layers come in ascending order and hold exactly the batch slices") {
+                for (size_t window : { 1, 7, 1000 }) {
+                    std::vector<ExPolygons> streamed;
+                    std::vector<size_t> order;
+                    slicer.slice(z, window, [&streamed, &order](size_t layer_id, ExPolygons &&slices) {
+                        order.push_back(layer_id);
+                        streamed.push_back(std::move(slices));
+                    });
+                    REQUIRE(order.size() == z.size());
+                    for (size_t i = 0; i < order.size(); ++i)
+                        REQUIRE(order[i] == i);
+                    REQUIRE(streamed.size() == batch.size());
+                    for (size_t i = 0; i < batch.size(); ++i) {
+                        REQUIRE(streamed[i].size() == batch[i].size());
+                        for (size_t j = 0; j < batch[i].size(); ++j) {
+                            REQUIRE(streamed[i][j].contour.points == batch[i][j].contour.points);
+                            REQUIRE(streamed[i][j].holes.size() == batch[i][j].holes.size());
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Run admesh's and our exact facet check on copies of a mesh and compare the outcome.
+static void
+require_same_exact_check(const TriangleMesh &mesh, int threads)
+{
+    TriangleMesh admesh {mesh}, ours {mesh};
+    stl_check_facets_exact(&admesh.stl);
+    check_facets_exact(&ours.stl, threads);
+
+    const stl_stats &a = admesh.stl.stats, &b = ours.stl.stats;
+    REQUIRE(b.number_of_facets == a.number_of_facets);
+    REQUIRE(b.degenerate_facets == a.degenerate_facets);
+    REQUIRE(b.facets_removed == a.facets_removed);
+    REQUIRE(b.connected_edges == a.connected_edges);
+    REQUIRE(b.connected_facets_1_edge == a.connected_facets_1_edge);
+    REQUIRE(b.connected_facets_2_edge == a.connected_facets_2_edge);
+    REQUIRE(b.connected_facets_3_edge == a.connected_facets_3_edge);
+    REQUIRE(b.shortest_edge == a.shortest_edge);
+    for (int i = 0; i < a.number_of_facets; ++i) {
+        REQUIRE(memcmp(&ours.stl.facet_start[i], &admesh.stl.facet_start[i], SIZEOF_STL_FACET) == 0);
+        for (int j = 0; j < 3; ++j) {
+            REQUIRE(ours.stl.neighbors_start[i].neighbor[j] == admesh.stl.neighbors_start[i].neighbor[j]);
+            if (admesh.stl.neighbors_start[i].neighbor[j] != -1)
+                REQUIRE(ours.stl.neighbors_start[i].which_vertex_not[j] == admesh.stl.neighbors_start[i].which_vertex_not[j]);
+        }
+    }
+}
+
+SCENARIO( "check_facets_exact() connects facets like admesh does.") {
+    GIVEN( "A closed sphere") {
+        auto sphere {TriangleMesh::make_sphere(10, PI / 30.0)};
+        THEN( "The outcome matches admesh with 1 and 4 threads") {
+            require_same_exact_check(sphere, 1);
+            require_same_exact_check(sphere, 4);
+        }
+    }
+    GIVEN( "A cube with degenerate, duplicated and flipped facets and negative zeros") {
+        const Pointf3s vertices { Pointf3(20,20,0), Pointf3(20,0,0), Pointf3(-0.,-0.,-0.), Pointf3(0,20,0), Pointf3(20,20,20), Pointf3(0,20,20), Pointf3(0,0,20), Pointf3(20,0,20), Pointf3(0,0,0) };
+        const std::vector<Point3> facets {
+            Point3(0,1,2), Point3(0,8,3), Point3(4,5,6), Point3(4,6,7), Point3(0,4,7), Point3(0,7,1),
+            Point3(1,6,7), Point3(1,6,8), Point3(8,6,5), Point3(2,5,3), Point3(4,0,3), Point3(4,3,5),
+            // degenerate
+            Point3(2,8,3), Point3(4,4,5),
+            // duplicates
+            Point3(4,5,6), Point3(0,4,7), Point3(7,4,0)
+        };
+        TriangleMesh mesh(vertices, facets);
+        THEN( "The outcome matches admesh") {
+            require_same_exact_check(mesh, 1);
+            require_same_exact_check(mesh, 4);
+        }
+    }
+}
+
+// Load a file through admesh alone, as ReadSTLFile() used to.
+static TriangleMesh
+read_stl_admesh(const std::string &path)
+{
+    TriangleMesh mesh;
+    stl_open(&mesh.stl, path.c_str());
+    return mesh;
+}
+
+static void
+require_same_stl(const TriangleMesh &a, const TriangleMesh &b)
+{
+    REQUIRE(a.stl.stats.type == b.stl.stats.type);
+    REQUIRE(a.stl.stats.number_of_facets == b.stl.stats.number_of_facets);
+    REQUIRE(a.stl.stats.original_num_facets == b.stl.stats.original_num_facets);
+    REQUIRE(memcmp(&a.stl.stats.min, &b.stl.stats.min, sizeof(stl_vertex)) == 0);
+    REQUIRE(memcmp(&a.stl.stats.max, &b.stl.stats.max, sizeof(stl_vertex)) == 0);
+    REQUIRE(a.stl.stats.shortest_edge == b.stl.stats.shortest_edge);
+    REQUIRE(a.stl.stats.bounding_diameter == b.stl.stats.bounding_diameter);
+    // admesh leaves the attribute bytes of ASCII facets uninitialized
+    const size_t facet_size = (a.stl.stats.type == ascii) ? offsetof(stl_facet, extra) : SIZEOF_STL_FACET;
+    for (int i = 0; i < a.stl.stats.number_of_facets; ++i)
+        REQUIRE(memcmp(&a.stl.facet_start[i], &b.stl.facet_start[i], facet_size) == 0);
+}
+
+SCENARIO( "TriangleMesh: STL files load like admesh loads them.") {
+    GIVEN( "A sphere saved as a binary STL") {
+        auto sphere {TriangleMesh::make_sphere(10, PI / 30.0)};
+        const std::string path {(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.stl")).string()};
+        sphere.write_binary(path);
+
+        WHEN( "It is read with ReadSTLFile()") {
+            TriangleMesh mesh;
+            mesh.ReadSTLFile(path);
+            THEN( "Facets and stats are the ones admesh reads") {
+                require_same_stl(mesh, read_stl_admesh(path));
+                REQUIRE(mesh.stl.stats.type == binary);
+            }
+        }
+        WHEN( "The file is truncated") {
+            boost::filesystem::resize_file(path, boost::filesystem::file_size(path) - 10);
+            THEN( "ReadSTLFile() fails") {
+                TriangleMesh mesh;
+                REQUIRE_THROWS(mesh.ReadSTLFile(path));
+            }
+        }
+        boost::filesystem::remove(path);
+    }
+    GIVEN( "An ASCII STL") {
+        const std::string path {std::string(testfile_dir) + "test_trianglemesh/4486/10_000.stl"};
+        WHEN( "It is read with ReadSTLFile()") {
+            TriangleMesh mesh;
+            mesh.ReadSTLFile(path);
+            THEN( "Facets and stats are the ones admesh reads") {
+                require_same_stl(mesh, read_stl_admesh(path));
+                REQUIRE(mesh.stl.stats.type == ascii);
+            }
+        }
+    }
+    GIVEN( "A sphere saved as an ASCII STL") {
+        auto sphere {TriangleMesh::make_sphere(10, PI / 30.0)};
+        const std::string path {(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.stl")).string()};
+        sphere.write_ascii(path);
+
+        WHEN( "It is read with ReadSTLFile()") {
+            TriangleMesh mesh;
+            mesh.ReadSTLFile(path);
+            THEN( "Facets and stats are the ones admesh reads") {
+                require_same_stl(mesh, read_stl_admesh(path));
+                REQUIRE(mesh.stl.stats.number_of_facets == sphere.stl.stats.number_of_facets);
+            }
+        }
+        boost::filesystem::remove(path);
+    }
+    GIVEN( "An ASCII STL with CRLF line breaks, odd spacing and two solids") {
+        const std::string path {(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.stl")).string()};
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << "solid first one\r\n";
+            for (int i = 0; i < 12; ++i) {
+                if (i == 6) out << "endsolid\r\nsolid second\r\n";
+                out << "facet normal 0 0 " << (i % 2 ? "-1" : "1") << "\r\n"
+                    << "\touter loop\r\n"
+                    << "  vertex " << i << " 0 -0.0\r\n"
+                    << "  vertex\t" << i << ".5 1.25e0 +3\r\n"
+                    << "  vertex " << i + 1 << " .5 1E-2\r\n"
+                    << "\tendloop\r\n"
+                    << "endfacet\r\n";
+            }
+            out << "endsolid second\r\n";
+        }
+        WHEN( "It is read with ReadSTLFile()") {
+            TriangleMesh mesh;
+            mesh.ReadSTLFile(path);
+            THEN( "Facets and stats are the ones admesh reads") {
+                require_same_stl(mesh, read_stl_admesh(path));
+                REQUIRE(mesh.stl.stats.number_of_facets == 12);
+                REQUIRE(std::string(mesh.stl.stats.header) == "solid first one\r");
+            }
+        }
+        boost::filesystem::remove(path);
+    }
+}
+
 SCENARIO( "make_xxx functions produce meshes.") {
     GIVEN("make_cube() function") {
         WHEN("make_cube() is called with arguments 20,20,20") {
@@ -325,6 +608,58 @@ SCENARIO( "TriangleMesh: split functionality.") {
     }
 }
 
+SCENARIO( "TriangleMesh: compacted meshes work from the indexed mesh.") {
+    GIVEN( "A repaired sphere and a compacted copy of it") {
+        auto sphere {TriangleMesh::make_sphere(10, PI / 36.0)};
+        sphere.repair();
+        auto compacted {sphere};
+        compacted.compact();
+        THEN( "The facet soup is freed and the indexed mesh holds every facet") {
+            REQUIRE(compacted.stl.facet_start == nullptr);
+            REQUIRE(compacted.stl.neighbors_start == nullptr);
+            REQUIRE(compacted.indexed.facets_count() == sphere.facets_count());
+            REQUIRE(compacted.facets_count() == sphere.facets_count());
+        }
+        THEN( "Both slice the same") {
+            const std::vector<float> z { -9.5f, -5.f, 0.f, 0.1f, 5.f, 9.5f };
+            std::vector<Polygons> from_soup, from_indexed;
+            TriangleMeshSlicer<Z>(&sphere).slice(z, &from_soup);
+            TriangleMeshSlicer<Z>(&compacted).slice(z, &from_indexed);
+            for (size_t i = 0; i < z.size(); ++i) {
+                REQUIRE(from_indexed[i].size() == from_soup[i].size());
+                REQUIRE(from_indexed[i].front().points == from_soup[i].front().points);
+            }
+        }
+        WHEN( "The facet soup of the compacted copy is rebuilt") {
+            compacted.scale(1.0);
+            THEN( "The facets get their vertices and neighbors back") {
+                REQUIRE(compacted.stl.facet_start != nullptr);
+                for (int i = 0; i < sphere.stl.stats.number_of_facets; ++i) {
+                    REQUIRE(memcmp(compacted.stl.facet_start[i].vertex, sphere.stl.facet_start[i].vertex, sizeof(stl_facet::vertex)) == 0);
+                    for (int j = 0; j <= 2; ++j) {
+                        REQUIRE(compacted.stl.neighbors_start[i].neighbor[j] == sphere.stl.neighbors_start[i].neighbor[j]);
+                        REQUIRE(compacted.stl.neighbors_start[i].which_vertex_not[j] == sphere.stl.neighbors_start[i].which_vertex_not[j]);
+                    }
+                }
+            }
+        }
+        WHEN( "It is merged with a shifted copy and split") {
+            auto other {compacted};
+            other.translate(30, 0, 0);
+            other.compact();
+            compacted.merge(other);
+            compacted.repair();
+            auto meshes {compacted.split()};
+            THEN( "Both spheres come out") {
+                REQUIRE(meshes.size() == 2);
+                REQUIRE(meshes.at(0)->facets_count() == sphere.facets_count());
+                REQUIRE(meshes.at(0)->facets_count() + meshes.at(1)->facets_count() == compacted.facets_count());
+            }
+            for (TriangleMesh* mesh : meshes) delete mesh;
+        }
+    }
+}
+
 SCENARIO( "TriangleMesh: Mesh merge functions") {
     GIVEN( "Two 20mm cubes, each with one corner on the origin") {
         const Pointf3s vertices { Pointf3(20,20,0), Pointf3(20,0,0), Pointf3(0,0,0), Pointf3(0,20,0), Pointf3(20,20,20), Pointf3(0,20,20), Pointf3(0,0,20), Pointf3(20,0,20) };
@@ -401,6 +736,259 @@ TEST_CASE("Regression test for issue #4486 - files take forever to slice") {
     REQUIRE(timedout == false);
 
 }
+
+TEST_CASE("TriangleMeshSlicer scaling over threads on a large mesh", "[benchmark]") {
+    // about 2M facets
+    auto sphere {TriangleMesh::make_sphere(50, PI / 500.0)};
+    std::vector<float> z;
+    for (float h = -49.95f; h < 50.f; h += 0.1f) z.push_back(h);
+
+    const int max_threads = std::max(2u, boost::thread::hardware_concurrency());
+    TriangleMeshSlicer<Z> slicer(&sphere);
+    std::vector<Polygons> reference;
+    double single_ms {0};
+    for (int threads = 1; threads <= max_threads; ++threads) {
+        std::vector<Polygons> layers;
+        slicer.threads = threads;
+        const auto t0 = std::chrono::steady_clock::now();
+        slicer.slice(z, &layers);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        if (threads == 1) {
+            single_ms = ms;
+            reference = layers;
+        }
+        Slic3r::Log::info("TriangleMeshSlicer") << sphere.facets_count() << " facets, " << z.size() << " layers, "
+            << threads << " threads: " << ms << " ms (speedup " << single_ms / ms << ")\n";
+        REQUIRE(layers.size() == reference.size());
+        for (size_t i = 0; i < layers.size(); ++i)
+            REQUIRE(layers[i].size() == reference[i].size());
+    }
+}
+
+TEST_CASE("TriangleMeshSlicer sweep engine against the facet engine on a tall mesh", "[benchmark]") {
+    // about 1M facets, 6000 layers
+    auto sphere {TriangleMesh::make_sphere(150, PI / 360.0)};
+    std::vector<float> z;
+    for (float h = -149.975f; h < 150.f; h += 0.05f) z.push_back(h);
+
+    TriangleMeshSlicer<Z> slicer(&sphere);
+    for (SlicingMode mode : { smFacets, smSweep }) {
+        std::vector<Polygons> layers;
+        slicer.mode = mode;
+        const auto t0 = std::chrono::steady_clock::now();
+        slicer.slice(z, &layers);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        Slic3r::Log::info("TriangleMeshSlicer") << sphere.facets_count() << " facets, " << z.size() << " layers, "
+            << (mode == smSweep ? "sweep" : "facets") << " engine: " << ms << " ms\n";
+        REQUIRE(layers.size() == z.size());
+    }
+}
+
+TEST_CASE("TriangleMeshSlicer streaming against batch slicing time on many layers", "[benchmark]") {
+    // about 2M facets in a 300mm stack of small spheres, 6000 layers: each
+    // layer cuts few of the facets, so the time goes into the sweep itself
+    TriangleMesh stack;
+    for (int i = 0; i < 300; ++i) {
+        auto sphere {TriangleMesh::make_sphere(0.5, PI / 30.0)};
+        sphere.translate(0, 0, i);
+        stack.merge(sphere);
+    }
+    stack.repair();
+    std::vector<float> z;
+    for (float h = -0.475f; h < 299.5f; h += 0.05f) z.push_back(h);
+    TriangleMeshSlicer<Z> slicer(&stack);
+    slicer.mode = smSweep;
+    slicer.threads = 8;
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<ExPolygons> batch;
+    slicer.slice(z, &batch);
+    const double batch_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    for (size_t window : { 32, 64, 1000 }) {
+        size_t streamed_layers {0};
+        t0 = std::chrono::steady_clock::now();
+        slicer.slice(z, window, [&streamed_layers](size_t, ExPolygons &&) { ++streamed_layers; });
+        const double streamed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        Slic3r::Log::info("TriangleMeshSlicer") << stack.facets_count() << " facets, " << z.size() << " layers: "
+            << "streaming in windows of " << window << " layers " << streamed_ms << " ms, batch " << batch_ms << " ms\n";
+        REQUIRE(streamed_layers == batch.size());
+        // the windows carry the sweep on, so their number doesn't add up
+        REQUIRE(streamed_ms < 2 * batch_ms);
+    }
+}
+
+#ifdef __linux__
+// A memory figure of the process in kB, as reported by the kernel:
+// VmRSS for the resident set size, VmHWM for its peak.
+static long
+proc_status_kb(const std::string &field)
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+        if (line.compare(0, field.size() + 1, field + ":") == 0) return std::stol(line.substr(field.size() + 1));
+    return 0;
+}
+
+static long
+peak_rss_kb()
+{
+    return proc_status_kb("VmHWM");
+}
+
+// Let the peak start over from the current resident set size.
+static void
+reset_peak_rss()
+{
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+TEST_CASE("TriangleMeshSlicer streaming against batch slicing peak memory", "[benchmark]") {
+    // about 1M facets, 6000 layers
+    auto sphere {TriangleMesh::make_sphere(150, PI / 360.0)};
+    std::vector<float> z;
+    for (float h = -149.975f; h < 150.f; h += 0.05f) z.push_back(h);
+    TriangleMeshSlicer<Z> slicer(&sphere);
+    size_t streamed_layers {0}, batch_layers {0};
+
+    // the slices are kept in both cases, as PrintObject does
+    reset_peak_rss();
+    long base_kb = peak_rss_kb();
+    {
+        std::vector<ExPolygons> streamed(z.size());
+        slicer.slice(z, 64, [&streamed](size_t layer_id, ExPolygons &&slices) { streamed[layer_id] = std::move(slices); });
+        streamed_layers = streamed.size();
+    }
+    const long streamed_kb = peak_rss_kb() - base_kb;
+
+    reset_peak_rss();
+    base_kb = peak_rss_kb();
+    {
+        std::vector<ExPolygons> batch;
+        slicer.slice(z, &batch);
+        batch_layers = batch.size();
+    }
+    const long batch_kb = peak_rss_kb() - base_kb;
+
+    Slic3r::Log::info("TriangleMeshSlicer") << sphere.facets_count() << " facets, " << z.size() << " layers: "
+        << "peak RSS growth streaming " << streamed_kb << " kB, batch " << batch_kb << " kB\n";
+    REQUIRE(streamed_layers == batch_layers);
+}
+
+TEST_CASE("TriangleMesh memory per million facets", "[benchmark]") {
+    // about 2M facets
+    const long base_kb = proc_status_kb("VmRSS");
+    auto sphere {TriangleMesh::make_sphere(50, PI / 500.0)};
+    sphere.repair();
+    const double mfacets = sphere.facets_count() / 1e6;
+    const long soup_kb = proc_status_kb("VmRSS") - base_kb;
+    
+    // as PrintObject does before slicing
+    sphere.compact();
+    const long indexed_kb = proc_status_kb("VmRSS") - base_kb;
+    {
+        TriangleMeshSlicer<Z> slicer(&sphere);
+        const long ready_kb = proc_status_kb("VmRSS") - base_kb;
+
+        std::vector<Polygons> layers;
+        const std::vector<float> z { -25.f, 0.f, 25.f };
+        reset_peak_rss();
+        const long before_slice_kb = proc_status_kb("VmRSS");
+        slicer.slice(z, &layers);
+        const long slice_kb = peak_rss_kb() - before_slice_kb;
+
+        Slic3r::Log::info("TriangleMesh") << "per million facets: repaired facet soup " << soup_kb / mfacets
+            << " kB, compacted " << indexed_kb / mfacets << " kB, with the slicer " << ready_kb / mfacets
+            << " kB, peak while slicing " << z.size() << " layers " << slice_kb / mfacets << " kB\n";
+        REQUIRE(layers.size() == z.size());
+    }
+}
+
+TEST_CASE("Binary STL loading, cold and warm", "[benchmark]") {
+    // about 2M facets, 100 MB
+    const std::string path {(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.stl")).string()};
+    size_t facets {0};
+    {
+        auto sphere {TriangleMesh::make_sphere(50, PI / 500.0)};
+        sphere.write_binary(path);
+        facets = sphere.facets_count();
+    }
+    // drop the file from the page cache
+    const auto evict = [&path]() {
+        const int fd = open(path.c_str(), O_RDONLY);
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    };
+    const auto time_ms = [](std::function<void()> f) {
+        const auto t0 = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    };
+    const auto load_admesh = [&path]() { read_stl_admesh(path); };
+    const auto load_mapped = [&path]() { TriangleMesh mesh; mesh.ReadSTLFile(path); };
+
+    evict();
+    const double admesh_cold = time_ms(load_admesh);
+    const double admesh_warm = time_ms(load_admesh);
+    evict();
+    const double mapped_cold = time_ms(load_mapped);
+    const double mapped_warm = time_ms(load_mapped);
+    boost::filesystem::remove(path);
+
+    Slic3r::Log::info("TriangleMesh") << facets << " facets binary STL: admesh cold " << admesh_cold << " ms, warm "
+        << admesh_warm << " ms; mapped cold " << mapped_cold << " ms, warm " << mapped_warm << " ms\n";
+    REQUIRE(mapped_warm < admesh_warm);
+}
+#endif // __linux__
+
+TEST_CASE("ASCII STL loading against admesh", "[benchmark]") {
+    // about 2M facets, 570 MB
+    const std::string path {(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.stl")).string()};
+    size_t facets {0};
+    {
+        auto sphere {TriangleMesh::make_sphere(50, PI / 500.0)};
+        sphere.write_ascii(path);
+        facets = sphere.facets_count();
+    }
+    const double mbytes = boost::filesystem::file_size(path) / 1e6;
+
+    // both read from the page cache
+    auto t0 = std::chrono::steady_clock::now();
+    TriangleMesh admesh {read_stl_admesh(path)};
+    const double admesh_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    t0 = std::chrono::steady_clock::now();
+    TriangleMesh ours;
+    ours.ReadSTLFile(path);
+    const double ours_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    boost::filesystem::remove(path);
+
+    Slic3r::Log::info("TriangleMesh") << facets << " facets, " << mbytes << " MB ASCII STL: admesh "
+        << admesh_ms << " ms, ReadSTLFile " << ours_ms << " ms (" << mbytes / (ours_ms / 1000.) << " MB/s) with "
+        << boost::thread::hardware_concurrency() << " threads\n";
+    REQUIRE(ours.stl.stats.number_of_facets == admesh.stl.stats.number_of_facets);
+    REQUIRE(ours_ms < admesh_ms);
+}
+
+TEST_CASE("check_facets_exact() against admesh on a large mesh", "[benchmark]") {
+    // about 2M facets
+    auto sphere {TriangleMesh::make_sphere(50, PI / 500.0)};
+    TriangleMesh admesh {sphere}, ours {sphere};
+
+    auto t0 = std::chrono::steady_clock::now();
+    stl_check_facets_exact(&admesh.stl);
+    const double admesh_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    t0 = std::chrono::steady_clock::now();
+    check_facets_exact(&ours.stl);
+    const double ours_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    Slic3r::Log::info("TriangleMesh") << sphere.facets_count() << " facets, exact edge check: admesh "
+        << admesh_ms << " ms, check_facets_exact " << ours_ms << " ms with "
+        << boost::thread::hardware_concurrency() << " threads\n";
+    REQUIRE(ours.stl.stats.connected_edges == admesh.stl.stats.connected_edges);
+    REQUIRE(ours.stl.stats.connected_facets_3_edge == admesh.stl.stats.connected_facets_3_edge);
+}
 #endif // TEST_PERFORMANCE
 
 #ifdef BUILD_PROFILE
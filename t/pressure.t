@@ -1,4 +1,4 @@
-use Test::More tests => 1;
+use Test::More tests => 4;
 use strict;
 use warnings;
 
@@ -33,5 +33,42 @@ use Slic3r::Test;
     ok abs($retracted) < 0.01, 'all retractions are compensated';
 }
 
+{
+    my $config = Slic3r::Config->new_from_defaults;
+    $config->set('pressure_advance', 10);
+    $config->set('retract_length', [1]);
+    $config->set('gcode_arcs', 1);
+    
+    my $model = Slic3r::Model->new;
+    my $object = $model->add_object;
+    $object->add_volume(mesh => Slic3r::TriangleMesh::make_cylinder(10, 5));
+    $object->add_instance(offset => Slic3r::Pointf->new(0,0));
+    
+    my $print = Slic3r::Test::init_print($model, config => $config, duplicate => 2);
+    my $retracted = $config->retract_length->[0];
+    my $advanced = 0;       # an advance is applied
+    my $arcs = 0;
+    my $arcs_without_advance = 0;
+    Slic3r::GCode::Reader->new->parse(Slic3r::Test::gcode($print), sub {
+        my ($self, $cmd, $args, $info) = @_;
+        
+        if ($info->{extruding} && !$info->{dist_XY}) {
+            $retracted += $info->{dist_E};
+        } elsif ($info->{retracting}) {
+            $retracted += $info->{dist_E};
+        }
+        $advanced = 1 if ($info->{comment} // '') =~ /pressure advance/;
+        $advanced = 0 if ($info->{comment} // '') =~ /pressure discharge/;
+        if ($cmd =~ /^G[23]$/ && $info->{extruding} && $info->{dist_XY} > 0) {
+            $arcs++;
+            $arcs_without_advance++ if !$advanced;
+        }
+    });
+    
+    ok $arcs > 0, 'arcs are written';
+    is $arcs_without_advance, 0, 'pressure is advanced before printing arcs';
+    ok abs($retracted) < 0.01, 'all retractions are compensated with arcs';
+}
+
 
 __END__
@@ -1,8 +1,23 @@
 #include "miniz/miniz.h"
 #include "Zip/ZipArchive.hpp"
+#include <ctime>
 
 namespace Slic3r {
 
+/// The state of an entry being deflated by ZipArchive::write_entry(). It follows
+/// mz_zip_writer_add_file(), with the data coming from the caller instead of a file.
+struct ZipArchive::EntryWriter
+{
+    std::string name;
+    mz_uint64 local_dir_header_ofs;
+    mz_uint32 crc;
+    mz_uint64 uncomp_size;
+    mz_uint16 dos_time;
+    mz_uint16 dos_date;
+    mz_zip_writer_add_state state;
+    tdefl_compressor compressor;
+};
+
 ZipArchive::ZipArchive (std::string zip_archive_name, char zip_mode) : archive(mz_zip_archive()), zip_name(zip_archive_name), mode(zip_mode), stats(0), finalized(false)
 {
     // Initialize the miniz zip archive struct.
@@ -45,10 +60,113 @@ ZipArchive::extract_entry (std::string entry_path, std::string file_path)
     return stats;
 }
 
+mz_bool
+ZipArchive::open_entry(std::string entry_path)
+{
+    stats = 0;
+    // Check if it's in the write mode, with no other entry being written.
+    if (mode != 'W' || entry_writer)
+        return stats;
+    if (!mz_zip_writer_validate_archive_name(entry_path.c_str()) || entry_path.size() > 0xFFFF)
+        return stats;
+
+    const mz_uint num_alignment_padding_bytes = mz_zip_writer_compute_padding_needed_for_file_alignment(&archive);
+    // no zip64 support in miniz
+    if ((archive.m_total_files == 0xFFFF) || ((archive.m_archive_size + num_alignment_padding_bytes + MZ_ZIP_LOCAL_DIR_HEADER_SIZE + MZ_ZIP_CENTRAL_DIR_HEADER_SIZE + entry_path.size()) > 0xFFFFFFFF))
+        return stats;
+
+    // Leave room for the local header, written by close_entry() once the sizes are known.
+    mz_uint64 cur_archive_file_ofs = archive.m_archive_size;
+    if (!mz_zip_writer_write_zeros(&archive, cur_archive_file_ofs, num_alignment_padding_bytes + MZ_ZIP_LOCAL_DIR_HEADER_SIZE))
+        return stats;
+    std::unique_ptr<EntryWriter> writer(new EntryWriter());
+    writer->name = entry_path;
+    writer->local_dir_header_ofs = cur_archive_file_ofs + num_alignment_padding_bytes;
+    cur_archive_file_ofs += num_alignment_padding_bytes + MZ_ZIP_LOCAL_DIR_HEADER_SIZE;
+    if (archive.m_pWrite(archive.m_pIO_opaque, cur_archive_file_ofs, entry_path.c_str(), entry_path.size()) != entry_path.size())
+        return stats;
+    cur_archive_file_ofs += entry_path.size();
+
+    writer->crc = MZ_CRC32_INIT;
+    writer->uncomp_size = 0;
+    mz_zip_time_to_dos_time(time(nullptr), &writer->dos_time, &writer->dos_date);
+    writer->state.m_pZip = &archive;
+    writer->state.m_cur_archive_file_ofs = cur_archive_file_ofs;
+    writer->state.m_comp_size = 0;
+    if (tdefl_init(&writer->compressor, mz_zip_writer_add_put_buf_callback, &writer->state, tdefl_create_comp_flags_from_zip_params(ZIP_DEFLATE_COMPRESSION, -15, MZ_DEFAULT_STRATEGY)) != TDEFL_STATUS_OKAY)
+        return stats;
+
+    entry_writer = std::move(writer);
+    stats = 1;
+    return stats;
+}
+
+mz_bool
+ZipArchive::write_entry(const void* data, size_t size)
+{
+    stats = 0;
+    if (!entry_writer)
+        return stats;
+    entry_writer->crc = (mz_uint32)mz_crc32(entry_writer->crc, (const mz_uint8 *)data, size);
+    entry_writer->uncomp_size += size;
+    stats = tdefl_compress_buffer(&entry_writer->compressor, data, size, TDEFL_NO_FLUSH) == TDEFL_STATUS_OKAY;
+    return stats;
+}
+
+mz_bool
+ZipArchive::close_entry()
+{
+    stats = 0;
+    if (!entry_writer)
+        return stats;
+    std::unique_ptr<EntryWriter> writer = std::move(entry_writer);
+    if (tdefl_compress_buffer(&writer->compressor, nullptr, 0, TDEFL_FINISH) != TDEFL_STATUS_DONE)
+        return stats;
+
+    const mz_uint64 comp_size = writer->state.m_comp_size;
+    const mz_uint64 cur_archive_file_ofs = writer->state.m_cur_archive_file_ofs;
+    // no zip64 support in miniz
+    if ((writer->uncomp_size > 0xFFFFFFFF) || (comp_size > 0xFFFFFFFF) || (cur_archive_file_ofs > 0xFFFFFFFF))
+        return stats;
+
+    const mz_uint16 name_size = (mz_uint16)writer->name.size();
+    mz_uint8 local_dir_header[MZ_ZIP_LOCAL_DIR_HEADER_SIZE];
+    if (!mz_zip_writer_create_local_dir_header(&archive, local_dir_header, name_size, 0, writer->uncomp_size, comp_size, writer->crc, MZ_DEFLATED, 0, writer->dos_time, writer->dos_date))
+        return stats;
+    if (archive.m_pWrite(archive.m_pIO_opaque, writer->local_dir_header_ofs, local_dir_header, sizeof(local_dir_header)) != sizeof(local_dir_header))
+        return stats;
+    if (!mz_zip_writer_add_to_central_dir(&archive, writer->name.c_str(), name_size, nullptr, 0, nullptr, 0, writer->uncomp_size, comp_size, writer->crc, MZ_DEFLATED, 0, writer->dos_time, writer->dos_date, writer->local_dir_header_ofs, 0))
+        return stats;
+
+    archive.m_total_files++;
+    archive.m_archive_size = cur_archive_file_ofs;
+    stats = 1;
+    return stats;
+}
+
+mz_bool
+ZipArchive::extract_entry (std::string entry_path, const std::function<bool(const char*, size_t)> &callback)
+{
+    stats = 0;
+    // Check if it's in the read mode.
+    if (mode != 'R')
+        return stats;
+    // miniz stops inflating when fewer bytes than it passed are reported as written.
+    auto write = [](void* opaque, mz_uint64, const void* buf, size_t n) -> size_t {
+        const auto &cb = *static_cast<const std::function<bool(const char*, size_t)>*>(opaque);
+        return cb(static_cast<const char*>(buf), n) ? n : 0;
+    };
+    stats = mz_zip_reader_extract_file_to_callback(&archive, entry_path.c_str(), write, const_cast<std::function<bool(const char*, size_t)>*>(&callback), 0);
+    return stats;
+}
+
 mz_bool
 ZipArchive::finalize()
 {
     stats = 0;
+    // Complete an entry left open.
+    if (entry_writer)
+        this->close_entry();
     // Finalize the archive and end writing if it's in the write mode.
     if(mode == 'W') {
         stats = mz_zip_writer_finalize_archive(&archive);
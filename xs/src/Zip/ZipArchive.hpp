@@ -4,8 +4,12 @@
 #define MINIZ_HEADER_FILE_ONLY
 #define ZIP_DEFLATE_COMPRESSION 8
 
+#include <functional>
+#include <memory>
 #include <string>
 #include <iostream>
+#include <streambuf>
+#include <vector>
 #include "miniz/miniz.h"
 
 namespace Slic3r {
@@ -36,6 +40,27 @@ public:
     /// \return mz_bool 0: failure 1: success.
     mz_bool extract_entry (std::string entry_path, std::string file_path);
 
+    /// Start a new deflated entry in the zip archive. Its content is passed to write_entry()
+    /// piece by piece and compressed on the fly, so it never has to be held in memory or
+    /// in a temporary file. close_entry() completes the entry.
+    /// \param entry_path string the path of the entry in the zip archive.
+    /// \return mz_bool 0: failure 1: success.
+    mz_bool open_entry(std::string entry_path);
+
+    /// Append data to the entry started by open_entry().
+    /// \return mz_bool 0: failure 1: success.
+    mz_bool write_entry(const void* data, size_t size);
+
+    /// Complete the entry started by open_entry().
+    /// \return mz_bool 0: failure 1: success.
+    mz_bool close_entry();
+
+    /// Inflate a zip entry, handing its content to callback piece by piece.
+    /// \param entry_path string the path of the entry in the zip archive.
+    /// \param callback function called with each inflated piece, returning false to stop the extraction.
+    /// \return mz_bool 0: failure or stopped by callback 1: success.
+    mz_bool extract_entry (std::string entry_path, const std::function<bool(const char*, size_t)> &callback);
+
     /// Finalize the archive and free any allocated memory.
     /// \return mz_bool 0: failure 1: success.
     mz_bool finalize();
@@ -49,6 +74,44 @@ private:
     mz_bool stats; ///< The status of the recently executed operation on the zip archive.
     bool finalized; ///< Whether the zip archive is finalized or not. Used during the destructor of the object.
 
+    struct EntryWriter;
+    std::unique_ptr<EntryWriter> entry_writer; ///< The state of the entry being written by write_entry(), if any.
+
+};
+
+/// A stream buffer writing into the entry opened by ZipArchive::open_entry(), so that
+/// the entry can be written through a std::ostream.
+class ZipEntryBuffer : public std::streambuf
+{
+public:
+    ZipEntryBuffer(ZipArchive &zip_archive) : archive(zip_archive), buffer(64 * 1024)
+    {
+        this->setp(this->buffer.data(), this->buffer.data() + this->buffer.size());
+    }
+
+    ~ZipEntryBuffer() { this->sync(); }
+
+protected:
+    int_type overflow(int_type ch) override
+    {
+        if (this->sync() != 0) return traits_type::eof();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *this->pptr() = traits_type::to_char_type(ch);
+            this->pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override
+    {
+        const size_t size = this->pptr() - this->pbase();
+        this->setp(this->buffer.data(), this->buffer.data() + this->buffer.size());
+        return (size == 0 || this->archive.write_entry(this->buffer.data(), size)) ? 0 : -1;
+    }
+
+private:
+    ZipArchive &archive; ///< The archive receiving the data.
+    std::vector<char> buffer; ///< Data not yet compressed.
 };
 
 }
@@ -389,7 +389,9 @@ stl_initialize_facet_check_nearby(stl_file *stl) {
   /*  tolerance = STL_MAX((stl->stats.bounding_diameter / 500000.0), tolerance);*/
   /*  tolerance *= 0.5;*/
 
-  stl->M = 81397;
+  /* Size the table by the unconnected edges, which are the ones to be
+     inserted, so that the chains stay short on large meshes. */
+  stl->M = STL_MAX(81397, stl->stats.number_of_facets * 3 - stl->stats.connected_edges);
 
   stl->heads = (stl_hash_edge**)calloc(stl->M, sizeof(*stl->heads));
   if(stl->heads == NULL) perror("stl_initialize_facet_check_nearby");
@@ -2,13 +2,101 @@
 #include "ClipperUtils.hpp"
 #include "Geometry.hpp"
 #include <algorithm>
+#include <cmath>
 
 namespace Slic3r {
 
+namespace {
+
+/// A ring of a polygon, with its bounding box.
+struct Ring {
+    Pointfs points;
+    double min_x, max_x, min_y, max_y;
+    
+    explicit Ring(Pointfs &&_points) : points(std::move(_points)),
+        min_x(INFINITY), max_x(-INFINITY), min_y(INFINITY), max_y(-INFINITY)
+    {
+        for (const Pointf &p : this->points) {
+            this->min_x = std::min(this->min_x, p.x);
+            this->max_x = std::max(this->max_x, p.x);
+            this->min_y = std::min(this->min_y, p.y);
+            this->max_y = std::max(this->max_y, p.y);
+        }
+    }
+    
+    /// Signed area, positive for counter-clockwise rings.
+    double area() const
+    {
+        double area = 0;
+        for (size_t i = 0, j = this->points.size() - 1; i < this->points.size(); j = i ++)
+            area += (this->points[j].x + this->points[i].x) * (this->points[i].y - this->points[j].y);
+        return area / 2;
+    }
+};
+
+/// One step of Sutherland-Hodgman: the part of ring on the side of the line
+/// x = at (or y = at) where the coordinate is not above at, or not below it.
+Pointfs
+clip(const Pointfs &ring, bool x, double at, bool below)
+{
+    Pointfs clipped;
+    const auto coord  = [x] (const Pointf &p) { return x ? p.x : p.y; };
+    const auto inside = [&] (const Pointf &p) { return below ? coord(p) <= at : coord(p) >= at; };
+    for (size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i ++) {
+        const Pointf &a = ring[j], &b = ring[i];
+        if (inside(a) != inside(b)) {
+            const double t = (at - coord(a)) / (coord(b) - coord(a));
+            clipped.push_back(x
+                ? Pointf(at, a.y + t * (b.y - a.y))
+                : Pointf(a.x + t * (b.x - a.x), at));
+        }
+        if (inside(b)) clipped.push_back(b);
+    }
+    return clipped;
+}
+
+/// The rings of the clip area cut by the band a scan line covers, so that
+/// the lines clipped on the same scan line share the cut.
+std::vector<Ring>
+band(const std::vector<Ring> &rings, double min_y, double max_y)
+{
+    std::vector<Ring> band;
+    for (const Ring &ring : rings) {
+        if (ring.max_y <= min_y || ring.min_y >= max_y) continue;
+        Pointfs points = ring.points;
+        if (ring.min_y < min_y) points = clip(points, false, min_y, false);
+        if (ring.max_y > max_y) points = clip(points, false, max_y, true);
+        if (points.size() >= 3) band.push_back(Ring(std::move(points)));
+    }
+    return band;
+}
+
+/// The area of the band between min_x and max_x.
+double
+band_area(const std::vector<Ring> &band, double min_x, double max_x)
+{
+    double area = 0;
+    for (const Ring &ring : band) {
+        if (ring.max_x <= min_x || ring.min_x >= max_x) continue;
+        if (ring.min_x >= min_x && ring.max_x <= max_x) {
+            area += ring.area();
+            continue;
+        }
+        Pointfs points = ring.points;
+        if (ring.min_x < min_x) points = clip(points, true, min_x, false);
+        if (ring.max_x > max_x) points = clip(points, true, max_x, true);
+        if (points.size() >= 3) area += Ring(std::move(points)).area();
+    }
+    return area;
+}
+
+}
+
 BridgeDetector::BridgeDetector(const ExPolygon &_expolygon, const ExPolygonCollection &_lower_slices,
     coord_t _extrusion_width)
     : expolygon(_expolygon), extrusion_width(_extrusion_width),
-        resolution(PI/36.0), angle(-1)
+        resolution(PI/36.0), angle(-1),
+        threads(boost::thread::hardware_concurrency())
 {
     /*  outset our bridge by an arbitrary amout; we'll use this outer margin
         for detecting anchors */
@@ -106,58 +194,23 @@ BridgeDetector::detect_angle()
             candidates.push_back(BridgeDirection(angle));
     }
     
-    const coord_t line_increment = this->extrusion_width;
-    bool have_coverage = false;
-    for (BridgeDirection &candidate : candidates) {
-        Polygons my_clip_area = clip_area;
-        ExPolygons my_anchors = this->_anchors;
-        
-        // rotate everything - the center point doesn't matter
-        for (Polygon &p : my_clip_area)
-            p.rotate(-candidate.angle, Point(0,0));
-        for (ExPolygon &e : my_anchors)
-            e.rotate(-candidate.angle, Point(0,0));
-    
-        // generate lines in this direction
-        BoundingBox bb;
-        for (const ExPolygon &e : my_anchors)
-            bb.merge(e.bounding_box());
-        
-        Lines lines;
-        for (coord_t y = bb.min.y; y <= bb.max.y; y += line_increment)
-            lines.push_back(Line(Point(bb.min.x, y), Point(bb.max.x, y)));
-        
-        const Lines clipped_lines = intersection_ln(lines, my_clip_area);
-        
-        for (const Line &line : clipped_lines) {
-            // skip any line not having both endpoints within anchors
-            if (!Slic3r::Geometry::contains(my_anchors, line.a)
-                || !Slic3r::Geometry::contains(my_anchors, line.b))
-                continue;
-            
-            candidate.max_length = std::max(candidate.max_length, line.length());
-            // Calculate coverage as actual covered area, because length of centerlines
-            // is not accurate enough when such lines are slightly skewed and not parallel
-            // to the sides; calculating area will compute them as triangles.
-            // TODO: use a faster algorithm for computing covered area by using a sweep line
-            // instead of intersecting many lines.
-            candidate.coverage += Slic3r::Geometry::area(intersection(
-                my_clip_area,
-                offset((Polyline)line, +this->extrusion_width/2)
-            ));
-        }
-        if (candidate.coverage > 0) have_coverage = true;
-        
-        #if 0
+    // the candidates only read the clip area and the anchors
+    parallelize<size_t>(0, candidates.size() - 1, [this, &candidates, &clip_area] (size_t i) {
+        this->_score(clip_area, &candidates[i]);
+    }, this->threads);
+    
+    #if 0
+    for (const BridgeDirection &candidate : candidates)
         std::cout << "angle = "  << Slic3r::Geometry::rad2deg(candidate.angle)
             << "; coverage = "   << candidate.coverage
             << "; max_length = " << candidate.max_length
             << std::endl;
-        #endif
-    }
+    #endif
     
     // if no direction produced coverage, then there's no bridge direction
-    if (!have_coverage) return false;
+    if (std::none_of(candidates.begin(), candidates.end(),
+        [] (const BridgeDirection &candidate) { return candidate.coverage > 0; }))
+        return false;
     
     // sort directions by coverage - most coverage first
     std::sort(candidates.begin(), candidates.end());
@@ -180,6 +233,71 @@ BridgeDetector::detect_angle()
     return true;
 }
 
+void
+BridgeDetector::_score(const Polygons &clip_area, BridgeDirection* candidate) const
+{
+    Polygons my_clip_area = clip_area;
+    ExPolygons my_anchors = this->_anchors;
+    
+    // rotate everything - the center point doesn't matter
+    for (Polygon &p : my_clip_area)
+        p.rotate(-candidate->angle, Point(0,0));
+    for (ExPolygon &e : my_anchors)
+        e.rotate(-candidate->angle, Point(0,0));
+    
+    // generate lines in this direction
+    BoundingBox bb;
+    std::vector<BoundingBox> anchor_bbs;
+    for (const ExPolygon &e : my_anchors) {
+        anchor_bbs.push_back(e.contour.bounding_box());
+        bb.merge(anchor_bbs.back());
+    }
+    const auto in_anchors = [&my_anchors, &anchor_bbs] (const Point &point) {
+        for (size_t i = 0; i < my_anchors.size(); ++i)
+            if (anchor_bbs[i].contains(point) && my_anchors[i].contains(point)) return true;
+        return false;
+    };
+    
+    Lines lines;
+    for (coord_t y = bb.min.y; y <= bb.max.y; y += this->extrusion_width)
+        lines.push_back(Line(Point(bb.min.x, y), Point(bb.max.x, y)));
+    
+    // the lines of the same scan line next to each other
+    Lines clipped_lines = intersection_ln(lines, my_clip_area);
+    std::sort(clipped_lines.begin(), clipped_lines.end(), [] (const Line &l1, const Line &l2) {
+        return l1.a.y < l2.a.y || (l1.a.y == l2.a.y && std::min(l1.a.x, l1.b.x) < std::min(l2.a.x, l2.b.x));
+    });
+    
+    std::vector<Ring> rings;
+    for (const Polygon &p : my_clip_area) {
+        Pointfs points;
+        for (const Point &point : p.points)
+            points.push_back(Pointf(point.x, point.y));
+        rings.push_back(Ring(std::move(points)));
+    }
+    
+    const double half_width = this->extrusion_width/2;
+    std::vector<Ring> line_band;
+    coord_t line_band_y = 0;
+    for (const Line &line : clipped_lines) {
+        // skip any line not having both endpoints within anchors
+        if (!in_anchors(line.a) || !in_anchors(line.b))
+            continue;
+        
+        candidate->max_length = std::max(candidate->max_length, line.length());
+        // Calculate coverage as actual covered area, because length of centerlines
+        // is not accurate enough when such lines are slightly skewed and not parallel
+        // to the sides; calculating area will compute them as triangles.
+        // The line covers the rectangle its butt offset would, so its area is
+        // taken from the clip area cut by its scan line.
+        if (line_band.empty() || line.a.y != line_band_y) {
+            line_band   = band(rings, line.a.y - half_width, line.a.y + half_width);
+            line_band_y = line.a.y;
+        }
+        candidate->coverage += band_area(line_band, std::min(line.a.x, line.b.x), std::max(line.a.x, line.b.x));
+    }
+}
+
 Polygons
 BridgeDetector::coverage() const
 {
@@ -20,6 +20,8 @@ public:
     double resolution;
     /// The final optimal angle.
     double angle;
+    /// Number of threads scoring the candidate angles.
+    int threads;
     
     BridgeDetector(const ExPolygon &_expolygon, const ExPolygonCollection &_lower_slices, coord_t _extrusion_width);
     bool detect_angle();
@@ -48,6 +50,9 @@ private:
         double coverage;
         double max_length;
     };
+    
+    /// Sum the coverage and find the longest line of the candidate direction.
+    void _score(const Polygons &clip_area, BridgeDirection* candidate) const;
 };
 
 }
@@ -566,4 +566,157 @@ void safety_offset(ClipperLib::Paths* paths)
     scaleClipperPolygons(*paths, 1.0/CLIPPER_OFFSET_SCALE);
 }
 
+ClipperLib::Paths
+ClipperContext::paths(const Polygons &polygons)
+{
+    return Slic3rMultiPoints_to_ClipperPaths(polygons);
+}
+
+ClipperLib::Paths
+ClipperContext::paths(const ExPolygons &expolygons)
+{
+    ClipperLib::Paths retval;
+    for (const ExPolygon &expolygon : expolygons) {
+        retval.push_back(Slic3rMultiPoint_to_ClipperPath(expolygon.contour));
+        for (const Polygon &hole : expolygon.holes)
+            retval.push_back(Slic3rMultiPoint_to_ClipperPath(hole));
+    }
+    return retval;
+}
+
+Polygons
+ClipperContext::polygons(const ClipperLib::Paths &paths)
+{
+    return ClipperPaths_to_Slic3rMultiPoints<Polygons>(paths);
+}
+
+ExPolygons
+ClipperContext::expolygons(const ClipperLib::Paths &paths)
+{
+    this->_clipper.Clear();
+    this->_clipper.AddPaths(paths, ClipperLib::ptSubject, true);
+    ClipperLib::PolyTree polytree;
+    this->_clipper.Execute(ClipperLib::ctUnion, polytree, ClipperLib::pftEvenOdd, ClipperLib::pftEvenOdd);
+    return PolyTreeToExPolygons(polytree);
+}
+
+ClipperLib::Paths
+ClipperContext::offset(ClipperLib::Paths paths, const float delta,
+    double scale, ClipperLib::JoinType joinType, double miterLimit)
+{
+    scaleClipperPolygons(paths, scale);
+    this->_offset(&paths, delta, scale, joinType, miterLimit);
+    scaleClipperPolygons(paths, 1/scale);
+    return paths;
+}
+
+ClipperLib::Paths
+ClipperContext::offset2(ClipperLib::Paths paths, const float delta1, const float delta2,
+    double scale, ClipperLib::JoinType joinType, double miterLimit)
+{
+    scaleClipperPolygons(paths, scale);
+    this->_offset(&paths, delta1, scale, joinType, miterLimit);
+    this->_offset(&paths, delta2, scale, joinType, miterLimit);
+    scaleClipperPolygons(paths, 1/scale);
+    return paths;
+}
+
+ClipperLib::Paths
+ClipperContext::diff(const ClipperLib::Paths &subject, const ClipperLib::Paths &clip,
+    bool safety_offset_)
+{
+    ClipperLib::Paths retval;
+    this->_clip(ClipperLib::ctDifference, subject, clip, safety_offset_, &retval);
+    return retval;
+}
+
+ExPolygons
+ClipperContext::diff_ex(const ClipperLib::Paths &subject, const ClipperLib::Paths &clip,
+    bool safety_offset_)
+{
+    return this->_clip_ex(ClipperLib::ctDifference, subject, clip, safety_offset_);
+}
+
+ClipperLib::Paths
+ClipperContext::intersection(const ClipperLib::Paths &subject, const ClipperLib::Paths &clip,
+    bool safety_offset_)
+{
+    ClipperLib::Paths retval;
+    this->_clip(ClipperLib::ctIntersection, subject, clip, safety_offset_, &retval);
+    return retval;
+}
+
+ExPolygons
+ClipperContext::intersection_ex(const ClipperLib::Paths &subject, const ClipperLib::Paths &clip,
+    bool safety_offset_)
+{
+    return this->_clip_ex(ClipperLib::ctIntersection, subject, clip, safety_offset_);
+}
+
+ClipperLib::Paths
+ClipperContext::union_(const ClipperLib::Paths &subject, bool safety_offset_)
+{
+    ClipperLib::Paths retval;
+    this->_clip(ClipperLib::ctUnion, subject, ClipperLib::Paths(), safety_offset_, &retval);
+    return retval;
+}
+
+ExPolygons
+ClipperContext::union_ex(const ClipperLib::Paths &subject, bool safety_offset_)
+{
+    return this->_clip_ex(ClipperLib::ctUnion, subject, ClipperLib::Paths(), safety_offset_);
+}
+
+void
+ClipperContext::_offset(ClipperLib::Paths* paths, float delta, double scale,
+    ClipperLib::JoinType joinType, double miterLimit)
+{
+    // the defaults of a new ClipperOffset for the setting that isn't given
+    this->_co.MiterLimit   = joinType == jtRound ? 2.0  : miterLimit;
+    this->_co.ArcTolerance = joinType == jtRound ? miterLimit : 0.25;
+    this->_co.Clear();
+    this->_co.AddPaths(*paths, joinType, ClipperLib::etClosedPolygon);
+    this->_co.Execute(*paths, (delta*scale));
+}
+
+void
+ClipperContext::_clip(ClipperLib::ClipType clipType, const ClipperLib::Paths &subject,
+    const ClipperLib::Paths &clip, bool safety_offset_, ClipperLib::Paths* output)
+{
+    // grow a copy of the subject for unions and of the clip otherwise,
+    // as safety_offset() does
+    const ClipperLib::Paths* input_subject = &subject;
+    const ClipperLib::Paths* input_clip    = &clip;
+    if (safety_offset_) {
+        if (clipType == ClipperLib::ctUnion) {
+            this->_grown  = subject;
+            input_subject = &this->_grown;
+        } else {
+            this->_grown  = clip;
+            input_clip    = &this->_grown;
+        }
+        scaleClipperPolygons(this->_grown, CLIPPER_OFFSET_SCALE);
+        this->_offset(&this->_grown, 10.0, CLIPPER_OFFSET_SCALE, jtMiter, 2);
+        scaleClipperPolygons(this->_grown, 1.0/CLIPPER_OFFSET_SCALE);
+    }
+    
+    this->_clipper.Clear();
+    this->_clipper.AddPaths(*input_subject, ClipperLib::ptSubject, true);
+    this->_clipper.AddPaths(*input_clip,    ClipperLib::ptClip,    true);
+    this->_clipper.Execute(clipType, *output, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+}
+
+ExPolygons
+ClipperContext::_clip_ex(ClipperLib::ClipType clipType, const ClipperLib::Paths &subject,
+    const ClipperLib::Paths &clip, bool safety_offset_)
+{
+    // two passes as in _clipper_do_polytree2()
+    this->_clip(clipType, subject, clip, safety_offset_, &this->_paths);
+    this->_clipper.Clear();
+    this->_clipper.AddPaths(this->_paths, ClipperLib::ptSubject, true);
+    ClipperLib::PolyTree polytree;
+    this->_clipper.Execute(ClipperLib::ctUnion, polytree, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+    return PolyTreeToExPolygons(polytree);
+}
+
 }
@@ -220,6 +220,56 @@ Slic3r::ExPolygons simplify_polygons_ex(const Slic3r::Polygons &subject, bool pr
 
 void safety_offset(ClipperLib::Paths* paths);
 
+/// Runs chains of Clipper operations on paths kept in Clipper form, so that
+/// the polygons are converted once on the way in and once on the way out
+/// instead of around every operation like the wrappers above do. The
+/// operations give the same results as the wrappers of the same name.
+/// The Clipper and ClipperOffset objects and the scratch paths are reused
+/// by all the operations, so a context must not be shared by threads.
+class ClipperContext {
+    public:
+    static ClipperLib::Paths paths(const Polygons &polygons);
+    static ClipperLib::Paths paths(const ExPolygons &expolygons);
+    static Polygons polygons(const ClipperLib::Paths &paths);
+    /// Like offset_ex(), the result of an offset as ExPolygons.
+    ExPolygons expolygons(const ClipperLib::Paths &paths);
+    
+    /// The paths are taken by value, so that the ones that aren't needed
+    /// any more can be moved in and offset in place.
+    ClipperLib::Paths offset(ClipperLib::Paths paths, const float delta,
+        double scale = CLIPPER_OFFSET_SCALE, ClipperLib::JoinType joinType = ClipperLib::jtMiter,
+        double miterLimit = 3);
+    ClipperLib::Paths offset2(ClipperLib::Paths paths, const float delta1, const float delta2,
+        double scale = CLIPPER_OFFSET_SCALE, ClipperLib::JoinType joinType = ClipperLib::jtMiter,
+        double miterLimit = 3);
+    
+    ClipperLib::Paths diff(const ClipperLib::Paths &subject, const ClipperLib::Paths &clip,
+        bool safety_offset_ = false);
+    ExPolygons diff_ex(const ClipperLib::Paths &subject, const ClipperLib::Paths &clip,
+        bool safety_offset_ = false);
+    ClipperLib::Paths intersection(const ClipperLib::Paths &subject, const ClipperLib::Paths &clip,
+        bool safety_offset_ = false);
+    ExPolygons intersection_ex(const ClipperLib::Paths &subject, const ClipperLib::Paths &clip,
+        bool safety_offset_ = false);
+    ClipperLib::Paths union_(const ClipperLib::Paths &subject, bool safety_offset_ = false);
+    ExPolygons union_ex(const ClipperLib::Paths &subject, bool safety_offset_ = false);
+    
+    private:
+    ClipperLib::Clipper _clipper;
+    ClipperLib::ClipperOffset _co;
+    /// Copy of the paths grown by the safety offset.
+    ClipperLib::Paths _grown;
+    /// Output of the first pass of the operations giving ExPolygons.
+    ClipperLib::Paths _paths;
+    
+    void _offset(ClipperLib::Paths* paths, float delta, double scale,
+        ClipperLib::JoinType joinType, double miterLimit);
+    void _clip(ClipperLib::ClipType clipType, const ClipperLib::Paths &subject,
+        const ClipperLib::Paths &clip, bool safety_offset_, ClipperLib::Paths* output);
+    ExPolygons _clip_ex(ClipperLib::ClipType clipType, const ClipperLib::Paths &subject,
+        const ClipperLib::Paths &clip, bool safety_offset_);
+};
+
 }
 
 #endif
@@ -30,6 +30,10 @@ namespace Slic3r {
 /// Any statements that resolve to {if0} will remove everything on the same line.
 std::string expression(const std::string& input, const int depth = 0);
 
+/// Evaluate the contents of a {} expression with exprtk. Returns the input in
+/// \x80 \x81 brackets if exprtk can't parse it.
+std::string evaluate(const std::string& expression_string);
+
 /// External access function to begin replac
 std::string apply_math(const std::string& input);
 
@@ -1,4 +1,5 @@
 #include "Extruder.hpp"
+#include <limits>
 
 namespace Slic3r {
 
@@ -27,15 +28,26 @@ Extruder::reset()
     this->restart_extra = 0;
 }
 
+void
+Extruder::reset_E()
+{
+    this->E = 0;
+    if (this->record_steps) this->E_steps.push_back(std::numeric_limits<double>::quiet_NaN());
+}
+
 double
 Extruder::extrude(double dE)
 {
     // in case of relative E distances we always reset to 0 before any output
     if (this->config->use_relative_e_distances)
-        this->E = 0;
+        this->reset_E();
 
     this->E += dE;
     this->absolute_E += dE;
+    if (this->record_steps) {
+        this->E_steps.push_back(dE);
+        this->absolute_E_steps.push_back(dE);
+    }
     return dE;
 }
 
@@ -52,12 +64,16 @@ Extruder::retract(double length, double restart_extra)
 {
     // in case of relative E distances we always reset to 0 before any output
     if (this->config->use_relative_e_distances)
-        this->E = 0;
+        this->reset_E();
     
     double to_retract = length - this->retracted;
     if (to_retract > 0) {
         this->E -= to_retract;
         this->absolute_E -= to_retract;
+        if (this->record_steps) {
+            this->E_steps.push_back(-to_retract);
+            this->absolute_E_steps.push_back(-to_retract);
+        }
         this->retracted += to_retract;
         this->restart_extra = restart_extra;
         return to_retract;
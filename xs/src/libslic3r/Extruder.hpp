@@ -4,6 +4,7 @@
 #include "libslic3r.h"
 #include "Point.hpp"
 #include "PrintConfig.hpp"
+#include <vector>
 
 namespace Slic3r {
 
@@ -18,10 +19,19 @@ class Extruder
     double restart_extra;
     double e_per_mm3;
     double retract_speed_mm_min;
+    /// If set, the amounts absolute_E changes by are appended to
+    /// absolute_E_steps, so that they can be added in the same order to
+    /// another absolute_E and give the same sum. The same goes for E in
+    /// E_steps, where a reset of E to 0 is a NaN.
+    bool record_steps {false};
+    std::vector<double> absolute_E_steps;
+    std::vector<double> E_steps;
     
     Extruder(unsigned int id, GCodeConfig *config);
     virtual ~Extruder() {}
     void reset();
+    /// Count E from 0 again, as after a G92 E0.
+    void reset_E();
     /// Calculate the amount extruded for relative or absolute moves.
     double extrude(double dE);
     double retract(double length, double restart_extra);
@@ -1,5 +1,6 @@
 #include "GCode.hpp"
 #include "ExtrusionEntity.hpp"
+#include "GCode/ArcFitting.hpp"
 #include <algorithm>
 #include <cstdlib>
 #include <math.h>
@@ -180,8 +181,9 @@ Wipe::wipe(GCode &gcodegen, bool toolchange)
             /*  Reduce retraction length a bit to avoid effective retraction speed to be greater than the configured one
                 due to rounding (TODO: test and/or better math for this)  */
             double dE = length * (segment_length / wipe_dist) * 0.95;
-            gcode += gcodegen.writer.set_speed(wipe_speed*60, "", gcodegen.enable_cooling_markers ? ";_WIPE" : "");
-            gcode += gcodegen.writer.extrude_to_xy(
+            gcodegen.writer.set_speed(&gcode, wipe_speed*60, "", gcodegen.enable_cooling_markers ? ";_WIPE" : "");
+            gcodegen.writer.extrude_to_xy(
+                &gcode,
                 gcodegen.point_to_gcode(line->b),
                 -dE,
                 "wipe and retract"
@@ -203,7 +205,7 @@ GCode::GCode()
     : placeholder_parser(NULL), enable_loop_clipping(true), enable_cooling_markers(false), layer_count(0),
         layer_index(-1), layer(NULL), first_layer(false), elapsed_time(0.0),
         elapsed_time_bridges(0.0), elapsed_time_external(0.0), volumetric_speed(0),
-        _last_pos_defined(false)
+        arc_segments(0), arcs(0), _last_pos_defined(false), _internal_slices_layer(NULL), _support_islands_layer(NULL)
 {
 }
 
@@ -271,6 +273,8 @@ GCode::change_layer(const Layer &layer)
 {
     this->layer = &layer;
     this->layer_index++;
+    this->_internal_slices_layer = NULL;
+    this->_support_islands_layer = NULL;
     this->first_layer = (layer.id() == 0);
     
     // avoid computing islands and overhangs if they're not needed
@@ -300,6 +304,14 @@ GCode::change_layer(const Layer &layer)
 
 std::string
 GCode::extrude(ExtrusionLoop loop, std::string description, double speed)
+{
+    std::string gcode;
+    this->extrude(&gcode, std::move(loop), description, speed);
+    return gcode;
+}
+
+void
+GCode::extrude(std::string* gcode, ExtrusionLoop loop, std::string description, double speed)
 {
     // get a copy; don't modify the orientation of the original loop object otherwise
     // next copies (if any) would not detect the correct orientation
@@ -402,7 +414,7 @@ GCode::extrude(ExtrusionLoop loop, std::string description, double speed)
     // get paths
     ExtrusionPaths paths;
     loop.clip_end(clip_length, &paths);
-    if (paths.empty()) return "";
+    if (paths.empty()) return;
     
     // apply the small perimeter speed
     if (paths.front().is_perimeter()
@@ -416,12 +428,11 @@ GCode::extrude(ExtrusionLoop loop, std::string description, double speed)
         description = std::string("external ") + description;
 
     // extrude along the path
-    std::string gcode;
     for (ExtrusionPaths::const_iterator path = paths.begin(); path != paths.end(); ++path)
-        gcode += this->_extrude(*path, description, speed);
+        this->_extrude(gcode, *path, description, speed);
     
     // reset acceleration
-    gcode += this->writer.set_acceleration(this->config.default_acceleration.value);
+    this->writer.set_acceleration(gcode, this->config.default_acceleration.value);
     
     if (this->wipe.enable)
         this->wipe.path = paths.front().polyline;  // TODO: don't limit wipe to last path
@@ -457,46 +468,57 @@ GCode::extrude(ExtrusionLoop loop, std::string description, double speed)
         point.rotate(angle, first_segment.a);
         
         // generate the travel move
-        gcode += this->writer.travel_to_xy(this->point_to_gcode(point), "move inwards before travel");
+        this->writer.travel_to_xy(gcode, this->point_to_gcode(point), "move inwards before travel");
     }
-    
-    return gcode;
 }
 
 std::string
 GCode::extrude(const ExtrusionEntity &entity, std::string description, double speed)
+{
+    std::string gcode;
+    this->extrude(&gcode, entity, description, speed);
+    return gcode;
+}
+
+void
+GCode::extrude(std::string* gcode, const ExtrusionEntity &entity, std::string description, double speed)
 {
     if (const ExtrusionPath* path = dynamic_cast<const ExtrusionPath*>(&entity)) {
-        return this->extrude(*path, description, speed);
+        this->extrude(gcode, *path, description, speed);
     } else if (const ExtrusionLoop* loop = dynamic_cast<const ExtrusionLoop*>(&entity)) {
-        return this->extrude(*loop, description, speed);
+        this->extrude(gcode, *loop, description, speed);
     } else {
         CONFESS("Invalid argument supplied to extrude()");
-        return "";
     }
 }
 
 std::string
 GCode::extrude(const ExtrusionPath &path, std::string description, double speed)
 {
-    std::string gcode = this->_extrude(path, description, speed);
+    std::string gcode;
+    this->extrude(&gcode, path, description, speed);
+    return gcode;
+}
+
+void
+GCode::extrude(std::string* gcode, const ExtrusionPath &path, std::string description, double speed)
+{
+    this->_extrude(gcode, path, description, speed);
     
     // reset acceleration
-    gcode += this->writer.set_acceleration(this->config.default_acceleration.value);
-    
-    return gcode;
+    this->writer.set_acceleration(gcode, this->config.default_acceleration.value);
 }
 
-std::string
-GCode::_extrude(ExtrusionPath path, std::string description, double speed)
+void
+GCode::_extrude(std::string* gcode, ExtrusionPath path, std::string description, double speed)
 {
     path.simplify(SCALED_RESOLUTION);
-    std::string gcode;
     description = path.is_bridge() ? description + " (bridge)" : description;
     
     // go to first point of extrusion path
     if (!this->_last_pos_defined || !this->_last_pos.coincides_with(path.first_point())) {
-        gcode += this->travel_to(
+        this->travel_to(
+            gcode,
             path.first_point(),
             path.role,
             "move to first " + description + " point"
@@ -504,7 +526,7 @@ GCode::_extrude(ExtrusionPath path, std::string description, double speed)
     }
     
     // compensate retraction
-    gcode += this->unretract();
+    this->unretract(gcode);
     
     // adjust acceleration
     {
@@ -520,7 +542,7 @@ GCode::_extrude(ExtrusionPath path, std::string description, double speed)
         } else {
             acceleration = this->config.default_acceleration.value;
         }
-        gcode += this->writer.set_acceleration(acceleration);
+        this->writer.set_acceleration(gcode, acceleration);
     }
     
     // calculate extrusion length per distance unit
@@ -571,20 +593,50 @@ GCode::_extrude(ExtrusionPath path, std::string description, double speed)
     
     // extrude arc or line
     if (path.is_bridge() && this->enable_cooling_markers)
-        gcode += ";_BRIDGE_FAN_START\n";
-    std::string comment = ";_EXTRUDE_SET_SPEED";
-    if (path.role == erExternalPerimeter) comment += ";_EXTERNAL_PERIMETER";
-    gcode += this->writer.set_speed(F, "", this->enable_cooling_markers ? comment : "");
+        gcode->append(";_BRIDGE_FAN_START\n");
+    {
+        static const std::string no_marker;
+        static const std::string marker = ";_EXTRUDE_SET_SPEED";
+        static const std::string external_marker = ";_EXTRUDE_SET_SPEED;_EXTERNAL_PERIMETER";
+        const std::string &comment = !this->enable_cooling_markers ? no_marker
+            : path.role == erExternalPerimeter ? external_marker : marker;
+        this->writer.set_speed(gcode, F, no_marker, comment);
+    }
     double path_length = 0;
     {
-        std::string comment = this->config.gcode_comments ? description : "";
-        Lines lines = path.polyline.lines();
-        for (Lines::const_iterator line = lines.begin(); line != lines.end(); ++line) {
-            const double line_length = line->length() * SCALING_FACTOR;
+        static const std::string no_comment;
+        const std::string &comment = this->config.gcode_comments ? description : no_comment;
+        const Points &points = path.polyline.points;
+        // SpiralVase raises Z along the G1 moves only
+        std::vector<ArcFitting::Arc> arcs;
+        if (this->config.gcode_arcs && !this->config.spiral_vase)
+            arcs = ArcFitting(scale_(this->config.gcode_arcs_tolerance.value)).fit(points);
+        auto arc = arcs.cbegin();
+        for (size_t i = 1; i < points.size(); ++i) {
+            if (arc != arcs.cend() && arc->first == i-1) {
+                const double arc_length = arc->length * SCALING_FACTOR;
+                path_length += arc_length;
+                
+                this->writer.extrude_arc_to_xy(
+                    gcode,
+                    this->point_to_gcode(points[arc->last]),
+                    Pointf(unscale(arc->center.x - points[i-1].x), unscale(arc->center.y - points[i-1].y)),
+                    arc->ccw,
+                    e_per_mm * arc_length,
+                    comment
+                );
+                this->arc_segments += arc->last - arc->first;
+                ++this->arcs;
+                i = arc->last;
+                ++arc;
+                continue;
+            }
+            const double line_length = points[i-1].distance_to(points[i]) * SCALING_FACTOR;
             path_length += line_length;
             
-            gcode += this->writer.extrude_to_xy(
-                this->point_to_gcode(line->b),
+            this->writer.extrude_to_xy(
+                gcode,
+                this->point_to_gcode(points[i]),
                 e_per_mm * line_length,
                 comment
             );
@@ -595,7 +647,7 @@ GCode::_extrude(ExtrusionPath path, std::string description, double speed)
         this->wipe.path.reverse();
     }
     if (path.is_bridge() && this->enable_cooling_markers)
-        gcode += ";_BRIDGE_FAN_END\n";
+        gcode->append(";_BRIDGE_FAN_END\n");
     
     this->set_last_pos(path.last_point());
     
@@ -605,13 +657,19 @@ GCode::_extrude(ExtrusionPath path, std::string description, double speed)
         if (path.is_bridge()) this->elapsed_time_bridges += t;
         if (path.role == erExternalPerimeter) this->elapsed_time_external += t;
     }
-    
-    return gcode;
 }
 
 // This method accepts &point in print coordinates.
 std::string
 GCode::travel_to(const Point &point, ExtrusionRole role, std::string comment)
+{
+    std::string gcode;
+    this->travel_to(&gcode, point, role, comment);
+    return gcode;
+}
+
+void
+GCode::travel_to(std::string* gcode, const Point &point, ExtrusionRole role, const std::string &comment)
 {    
     /*  Define the travel move as a line between current position and the taget point.
         This is expressed in print coordinates, so it will need to be translated by
@@ -640,13 +698,11 @@ GCode::travel_to(const Point &point, ExtrusionRole role, std::string comment)
     this->avoid_crossing_perimeters.use_external_mp_once = false;
     
     // generate G-code for the travel move
-    std::string gcode;
-    if (needs_retraction) gcode += this->retract();
+    if (needs_retraction) this->retract(gcode);
     
     // use G1 because we rely on paths being straight (G0 may make round paths)
-    Lines lines = travel.lines();
-    for (Lines::const_iterator line = lines.begin(); line != lines.end(); ++line)
-        gcode += this->writer.travel_to_xy(this->point_to_gcode(line->b), comment);
+    for (size_t i = 1; i < travel.points.size(); ++i)
+        this->writer.travel_to_xy(gcode, this->point_to_gcode(travel.points[i]), comment);
     
     /*  While this makes the estimate more accurate, CoolingBuffer calculates the slowdown
         factor on the whole elapsed time but only alters non-travel moves, thus the resulting
@@ -655,8 +711,6 @@ GCode::travel_to(const Point &point, ExtrusionRole role, std::string comment)
     if (this->config.cooling)
         this->elapsed_time += unscale(travel.length()) / this->config.get_abs_value("travel_speed");
     */
-    
-    return gcode;
 }
 
 bool
@@ -669,15 +723,29 @@ GCode::needs_retraction(const Polyline &travel, ExtrusionRole role)
     
     if (role == erSupportMaterial) {
         const SupportLayer* support_layer = dynamic_cast<const SupportLayer*>(this->layer);
-        if (support_layer != NULL && support_layer->support_islands.contains(travel)) {
+        if (support_layer != NULL && this->_support_islands_layer != this->layer) {
+            this->_support_islands = ContainmentGrid(support_layer->support_islands.expolygons);
+            this->_support_islands_layer = this->layer;
+        }
+        if (support_layer != NULL && this->_support_islands.contains(travel)) {
             // skip retraction if this is a travel move inside a support material island
             return false;
         }
     }
     
     if (this->config.only_retract_when_crossing_perimeters && this->layer != NULL) {
+        if (this->config.fill_density.value > 0 && this->_internal_slices_layer != this->layer) {
+            // what Layer::any_internal_region_slice_contains() checks
+            ExPolygons internal;
+            FOREACH_LAYERREGION(this->layer, layerm) {
+                for (const Surface &surface : (*layerm)->slices.surfaces)
+                    if (surface.is_internal()) internal.push_back(surface.expolygon);
+            }
+            this->_internal_slices = ContainmentGrid(internal);
+            this->_internal_slices_layer = this->layer;
+        }
         if (this->config.fill_density.value > 0
-            && this->layer->any_internal_region_slice_contains(travel)) {
+            && this->_internal_slices.contains(travel)) {
             /*  skip retraction if travel is contained in an internal slice *and*
                 internal infill is enabled (so that stringing is entirely not visible)  */
             return false;
@@ -692,37 +760,50 @@ std::string
 GCode::retract(bool toolchange)
 {
     std::string gcode;
-    
+    this->retract(&gcode, toolchange);
+    return gcode;
+}
+
+void
+GCode::retract(std::string* gcode, bool toolchange)
+{
     if (this->writer.extruder() == NULL)
-        return gcode;
+        return;
     
     // wipe (if it's enabled for this extruder and we have a stored wipe path)
     if (EXTRUDER_CONFIG(wipe) && this->wipe.has_path()) {
-        gcode += this->wipe.wipe(*this, toolchange);
+        gcode->append(this->wipe.wipe(*this, toolchange));
     }
     
     /*  The parent class will decide whether we need to perform an actual retraction
         (the extruder might be already retracted fully or partially). We call these 
         methods even if we performed wipe, since this will ensure the entire retraction
         length is honored in case wipe path was too short.  */
-    gcode += toolchange ? this->writer.retract_for_toolchange() : this->writer.retract();
+    if (toolchange)
+        this->writer.retract_for_toolchange(gcode);
+    else
+        this->writer.retract(gcode);
     if (!(FLAVOR_IS(gcfSmoothie) && this->config.use_firmware_retraction))
-        gcode += this->writer.reset_e();
+        this->writer.reset_e(gcode);
     if (this->writer.extruder()->retract_length() > 0 || this->config.use_firmware_retraction)
-        gcode += this->writer.lift();
-    
-    return gcode;
+        this->writer.lift(gcode);
 }
 
 std::string
 GCode::unretract()
 {
     std::string gcode;
-    gcode += this->writer.unlift();
-    gcode += this->writer.unretract();
+    this->unretract(&gcode);
     return gcode;
 }
 
+void
+GCode::unretract(std::string* gcode)
+{
+    this->writer.unlift(gcode);
+    this->writer.unretract(gcode);
+}
+
 std::string
 GCode::set_extruder(unsigned int extruder_id)
 {
@@ -740,12 +821,22 @@ GCode::set_extruder(unsigned int extruder_id)
     
     // append custom toolchange G-code
     if (this->writer.extruder() != NULL && !this->config.toolchange_gcode.value.empty()) {
-        PlaceholderParser pp = *this->placeholder_parser;
-        pp.set("previous_extruder", this->writer.extruder()->id);
-        pp.set("next_extruder",     extruder_id);
-        pp.set("previous_retraction", this->writer.extruder()->retracted);
-        pp.set("next_retraction", this->writer.extruders.find(extruder_id)->second.retracted);
-        gcode += Slic3r::apply_math(pp.process(this->config.toolchange_gcode.value))  + '\n';
+        if (this->toolchange_template.compiled()) {
+            gcode += this->toolchange_template.process({
+                static_cast<int>(this->writer.extruder()->id),
+                static_cast<int>(extruder_id),
+                static_cast<int>(this->writer.extruder()->retracted),
+                static_cast<int>(this->writer.extruders.find(extruder_id)->second.retracted),
+                static_cast<int>(extruder_id),
+            }) + '\n';
+        } else {
+            PlaceholderParser pp = *this->placeholder_parser;
+            pp.set("previous_extruder", this->writer.extruder()->id);
+            pp.set("next_extruder",     extruder_id);
+            pp.set("previous_retraction", this->writer.extruder()->retracted);
+            pp.set("next_retraction", this->writer.extruders.find(extruder_id)->second.retracted);
+            gcode += Slic3r::apply_math(pp.process(this->config.toolchange_gcode.value))  + '\n';
+        }
     }
     
     // if ooze prevention is enabled, park current extruder in the nearest
@@ -3,6 +3,8 @@
 
 #include "libslic3r.h"
 #include "ExPolygon.hpp"
+#include "GCode/ContainmentGrid.hpp"
+#include "GCodeTemplate.hpp"
 #include "GCodeWriter.hpp"
 #include "Layer.hpp"
 #include "MotionPlanner.hpp"
@@ -75,6 +77,9 @@ class GCode {
     FullPrintConfig config;
     GCodeWriter writer;
     PlaceholderParser* placeholder_parser;
+    /// toolchange_gcode compiled for the export, with the variables of
+    /// set_extruder(). The G-code is processed every time when it isn't.
+    GCodeTemplate toolchange_template;
     OozePrevention ooze_prevention;
     Wipe wipe;
     AvoidCrossingPerimeters avoid_crossing_perimeters;
@@ -94,6 +99,9 @@ class GCode {
     // second it does not account for the velocity profiles of the printer.
     float elapsed_time, elapsed_time_bridges, elapsed_time_external; // seconds
     double volumetric_speed;
+    /// G1 segments written as G2/G3 arcs instead, and the arcs they made,
+    /// when gcode_arcs is enabled.
+    size_t arc_segments, arcs;
     
     GCode();
     const Point& last_pos() const;
@@ -135,13 +143,27 @@ class GCode {
     bool needs_retraction(const Polyline &travel, ExtrusionRole role = erNone);
     std::string retract(bool toolchange = false);
     std::string unretract();
+
+    /// Append the G-code to gcode instead of returning it, see GCodeWriter.
+    void extrude(std::string* gcode, const ExtrusionEntity &entity, std::string description = "", double speed = -1);
+    void extrude(std::string* gcode, ExtrusionLoop loop, std::string description = "", double speed = -1);
+    void extrude(std::string* gcode, const ExtrusionPath &path, std::string description = "", double speed = -1);
+    void travel_to(std::string* gcode, const Point &point, ExtrusionRole role, const std::string &comment);
+    void retract(std::string* gcode, bool toolchange = false);
+    void unretract(std::string* gcode);
     std::string set_extruder(unsigned int extruder_id);
     Pointf point_to_gcode(const Point &point);
     
     private:
     Point _last_pos;
     bool _last_pos_defined;
-    std::string _extrude(ExtrusionPath path, std::string description = "", double speed = -1);
+    /// The internal slices and the support islands of the layer that
+    /// needs_retraction() checks the travels against, built on the first
+    /// travel of the layer they were built for.
+    ContainmentGrid _internal_slices, _support_islands;
+    const Layer* _internal_slices_layer;
+    const Layer* _support_islands_layer;
+    void _extrude(std::string* gcode, ExtrusionPath path, std::string description = "", double speed = -1);
 };
 
 }
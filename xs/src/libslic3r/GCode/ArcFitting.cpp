@@ -0,0 +1,111 @@
+#include "ArcFitting.hpp"
+#include "Geometry.hpp"
+#include <cmath>
+
+namespace Slic3r {
+
+namespace {
+
+double
+distance(const Pointf &a, const Pointf &b)
+{
+    return std::hypot(a.x - b.x, a.y - b.y);
+}
+
+}
+
+std::vector<ArcFitting::Arc>
+ArcFitting::fit(const Points &points) const
+{
+    std::vector<Arc> arcs;
+    for (size_t first = 0; first + this->min_segments < points.size(); ) {
+        Arc arc;
+        size_t last = first + this->min_segments;
+        if (!this->_fit(points, first, last, &arc)) {
+            ++first;
+            continue;
+        }
+        // Grow the arc by doubling steps, then find its end between the last
+        // run that fits and the first one that doesn't, so that long arcs
+        // aren't fitted again for every point they get.
+        size_t step = this->min_segments;
+        size_t bad = points.size();
+        while (last + 1 < points.size()) {
+            const size_t next = std::min(last + step, points.size() - 1);
+            Arc longer;
+            if (!this->_fit(points, first, next, &longer)) {
+                bad = next;
+                break;
+            }
+            arc = longer;
+            last = next;
+            step *= 2;
+        }
+        while (bad - last > 1) {
+            const size_t middle = last + (bad - last) / 2;
+            Arc longer;
+            if (this->_fit(points, first, middle, &longer)) {
+                arc = longer;
+                last = middle;
+            } else {
+                bad = middle;
+            }
+        }
+        arcs.push_back(arc);
+        first = last;
+    }
+    return arcs;
+}
+
+bool
+ArcFitting::_fit(const Points &points, size_t first, size_t last, Arc* arc) const
+{
+    // all the segments turn the same way, which also keeps the straight
+    // runs away from the fit
+    for (size_t i = first + 1; i < last; ++i) {
+        const double turn = double(points[i].x - points[i-1].x) * double(points[i+1].y - points[i].y)
+            - double(points[i].y - points[i-1].y) * double(points[i+1].x - points[i].x);
+        if (turn == 0 || (i > first + 1 && (turn > 0) != arc->ccw)) return false;
+        arc->ccw = turn > 0;
+    }
+
+    // the fit works in mm
+    Pointfs run;
+    run.reserve(last - first + 1);
+    for (size_t i = first; i <= last; ++i)
+        run.push_back(Pointf::new_unscale(points[i]));
+    Pointf center = Geometry::circle_taubin_newton(run);
+    if (!std::isfinite(center.x) || !std::isfinite(center.y)) return false;
+    center.scale(1 / SCALING_FACTOR);
+    for (size_t i = first; i <= last; ++i)
+        run[i - first] = Pointf(points[i].x, points[i].y);
+
+    // the firmware takes the radius from the start point
+    const double radius = distance(center, run.front());
+    if (radius > this->max_radius) return false;
+
+    double angle = 0;
+    for (size_t i = 0; i < run.size(); ++i) {
+        if (std::abs(distance(center, run[i]) - radius) > this->tolerance) return false;
+        if (i == 0) continue;
+
+        // the segments go around the center the way they turn, by less than
+        // half a turn, and don't cut the arc by more than the tolerance
+        const Pointf a(run[i-1].x - center.x, run[i-1].y - center.y);
+        const Pointf b(run[i].x - center.x, run[i].y - center.y);
+        const double turn = std::atan2(a.x * b.y - a.y * b.x, a.x * b.x + a.y * b.y);
+        if (turn == 0 || (turn > 0) != arc->ccw) return false;
+        const double half_chord = distance(run[i-1], run[i]) / 2;
+        if (radius - std::sqrt(std::max(radius * radius - half_chord * half_chord, 0.)) > this->tolerance) return false;
+        angle += std::abs(turn);
+    }
+    if (angle > this->max_angle) return false;
+
+    arc->first  = first;
+    arc->last   = last;
+    arc->center = center;
+    arc->length = radius * angle;
+    return true;
+}
+
+}
@@ -0,0 +1,47 @@
+#ifndef slic3r_ArcFitting_hpp_
+#define slic3r_ArcFitting_hpp_
+
+#include "libslic3r.h"
+#include "Point.hpp"
+#include <vector>
+
+namespace Slic3r {
+
+/// Finds the runs of points of an extrusion path that lie on a circle, so
+/// that GCode can write each of them as a single G2/G3 move instead of a G1
+/// per segment.
+class ArcFitting
+{
+    public:
+    /// The points from points[first] to points[last] replaced by an arc.
+    struct Arc {
+        size_t first, last;
+        Pointf center;
+        bool ccw;
+        double length;
+    };
+
+    /// How far from the points and the segments between them the arcs may
+    /// pass, in scaled units.
+    double tolerance;
+    /// Runs of fewer segments are written as they are.
+    size_t min_segments {3};
+    /// Arcs of a larger radius are written as segments, as their center
+    /// can't be written precisely.
+    double max_radius {scale_(1000.)};
+    /// Arcs turning more are split, so that the firmware can't mistake one
+    /// ending near its start for a tiny arc.
+    double max_angle {1.5 * PI};
+
+    explicit ArcFitting(double tolerance) : tolerance(tolerance) {};
+    /// The arcs of the points, in order. The next arc may start where the
+    /// previous one ends.
+    std::vector<Arc> fit(const Points &points) const;
+
+    private:
+    bool _fit(const Points &points, size_t first, size_t last, Arc* arc) const;
+};
+
+}
+
+#endif
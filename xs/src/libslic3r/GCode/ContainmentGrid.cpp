@@ -0,0 +1,146 @@
+#include "ContainmentGrid.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace Slic3r {
+
+namespace {
+
+/// Label of the cells not labelled yet while building the grid.
+const int unlabelled = -3;
+
+}
+
+ContainmentGrid::ContainmentGrid(const ExPolygons &expolygons)
+    : _expolygons(expolygons)
+{
+    if (this->_expolygons.empty()) return;
+    size_t points = 0;
+    for (const ExPolygon &expolygon : this->_expolygons) {
+        this->_bboxes.push_back(expolygon.contour.bounding_box());
+        this->_bbox.merge(this->_bboxes.back());
+        points += expolygon.contour.points.size();
+        for (const Polygon &hole : expolygon.holes)
+            points += hole.points.size();
+    }
+
+    // a few cells per vertex, with a cell of margin around the expolygons
+    const double width  = std::max<double>(this->_bbox.max.x - this->_bbox.min.x, 1);
+    const double height = std::max<double>(this->_bbox.max.y - this->_bbox.min.y, 1);
+    const double cells  = std::min<double>(std::max<double>(4 * points, 1024), 1 << 20);
+    this->_cell_size = std::max({ std::sqrt(width * height / cells), std::max(width, height) / 4096, 1. });
+    this->_origin  = Point(this->_bbox.min.x - this->_cell_size, this->_bbox.min.y - this->_cell_size);
+    this->_columns = static_cast<size_t>(width / this->_cell_size) + 3;
+    this->_rows    = static_cast<size_t>(height / this->_cell_size) + 3;
+    this->_cells.assign(this->_columns * this->_rows, unlabelled);
+
+    for (const ExPolygon &expolygon : this->_expolygons) {
+        for (const Line &line : expolygon.lines())
+            this->_cells_along(line.a, line.b, [this] (size_t cell) { this->_cells[cell] = edge; });
+    }
+
+    // The cells connected without crossing an edge are on the same side of
+    // all the expolygons: label each group by the center of one of its cells.
+    std::vector<size_t> group;
+    for (size_t first = 0; first < this->_cells.size(); ++first) {
+        if (this->_cells[first] != unlabelled) continue;
+        const Point center(
+            this->_origin.x + ((first % this->_columns) + 0.5) * this->_cell_size,
+            this->_origin.y + ((first / this->_columns) + 0.5) * this->_cell_size);
+        int label = outside;
+        for (size_t i = 0; i < this->_expolygons.size(); ++i) {
+            if (this->_bboxes[i].contains(center) && this->_expolygons[i].contains(center)) {
+                label = i;
+                break;
+            }
+        }
+        this->_cells[first] = label;
+        group.assign(1, first);
+        while (!group.empty()) {
+            const size_t cell = group.back();
+            group.pop_back();
+            const size_t column = cell % this->_columns;
+            for (size_t next : { cell - 1, cell + 1, cell - this->_columns, cell + this->_columns }) {
+                if ((next == cell - 1 && column == 0) || (next == cell + 1 && column + 1 == this->_columns)
+                    || next >= this->_cells.size() || this->_cells[next] != unlabelled)
+                    continue;
+                this->_cells[next] = label;
+                group.push_back(next);
+            }
+        }
+    }
+}
+
+bool
+ContainmentGrid::contains(const Polyline &polyline) const
+{
+    if (this->_expolygons.empty()) return false;
+    const Points &points = polyline.points;
+
+    // A polyline that doesn't go anywhere is left to ExPolygon::contains().
+    // Any other one isn't contained if one of its points is outside of all
+    // the expolygons, a part of it next to that point would be too.
+    const bool moves = std::any_of(points.begin(), points.end(),
+        [&points] (const Point &point) { return !point.coincides_with(points.front()); });
+    if (moves) {
+        for (const Point &point : points) {
+            if (!this->_bbox.contains(point) || this->_cells[this->_cell(point)] == outside)
+                return false;
+        }
+        const int label = this->_cells[this->_cell(points.front())];
+        bool inside = label >= 0;
+        for (size_t i = 1; inside && i < points.size(); ++i)
+            this->_cells_along(points[i - 1], points[i], [this, label, &inside] (size_t cell) {
+                if (this->_cells[cell] != label) inside = false;
+            });
+        if (inside) return true;
+    }
+
+    // the ones that don't go anywhere are contained by Clipper wherever they are
+    const BoundingBox bbox(points);
+    for (size_t i = 0; i < this->_expolygons.size(); ++i) {
+        if ((!moves || (this->_bboxes[i].contains(bbox.min) && this->_bboxes[i].contains(bbox.max)))
+            && this->_expolygons[i].contains(polyline))
+            return true;
+    }
+    return false;
+}
+
+template <class F>
+void
+ContainmentGrid::_cells_along(const Point &a, const Point &b, F f) const
+{
+    const auto column_of = [this] (double x) {
+        return static_cast<size_t>(std::min<double>(std::max<double>(std::floor((x - this->_origin.x) / this->_cell_size), 0), this->_columns - 1));
+    };
+    const auto row_of = [this] (double y) {
+        return static_cast<size_t>(std::min<double>(std::max<double>(std::floor((y - this->_origin.y) / this->_cell_size), 0), this->_rows - 1));
+    };
+
+    const double min_x = std::min(a.x, b.x), max_x = std::max(a.x, b.x);
+    const size_t last_column = column_of(max_x + 1);
+    for (size_t column = column_of(min_x - 1); column <= last_column; ++column) {
+        // the part of the segment over the column, and one unit around it
+        const double x0 = std::max(min_x, this->_origin.x + column * this->_cell_size - 1);
+        const double x1 = std::min(max_x, this->_origin.x + (column + 1) * this->_cell_size + 1);
+        double y0 = a.y, y1 = b.y;
+        if (a.x != b.x) {
+            const double slope = double(b.y - a.y) / double(b.x - a.x);
+            y0 = a.y + (x0 - a.x) * slope;
+            y1 = a.y + (x1 - a.x) * slope;
+        }
+        const size_t last_row = row_of(std::max(y0, y1) + 1);
+        for (size_t row = row_of(std::min(y0, y1) - 1); row <= last_row; ++row)
+            f(row * this->_columns + column);
+    }
+}
+
+size_t
+ContainmentGrid::_cell(const Point &point) const
+{
+    const size_t column = std::min<size_t>(std::max<double>(std::floor((point.x - this->_origin.x) / this->_cell_size), 0), this->_columns - 1);
+    const size_t row    = std::min<size_t>(std::max<double>(std::floor((point.y - this->_origin.y) / this->_cell_size), 0), this->_rows - 1);
+    return row * this->_columns + column;
+}
+
+}
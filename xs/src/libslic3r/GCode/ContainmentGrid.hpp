@@ -0,0 +1,49 @@
+#ifndef slic3r_ContainmentGrid_hpp_
+#define slic3r_ContainmentGrid_hpp_
+
+#include "libslic3r.h"
+#include "BoundingBox.hpp"
+#include "ExPolygon.hpp"
+#include "Polyline.hpp"
+#include <vector>
+
+namespace Slic3r {
+
+/// Tells whether any of a set of expolygons contains a polyline, like
+/// ExPolygon::contains() on each of them, fast enough for the travel moves of
+/// a layer, which GCode::needs_retraction() checks against its slices.
+///
+/// A grid over the expolygons has the cells crossed by their edges marked,
+/// and the others labelled with the expolygon they are inside of, or as
+/// outside of all of them. A polyline whose cells are inside the same
+/// expolygon is contained, one with a point outside of all of them isn't;
+/// the others cross an edge and are checked against the expolygons whose
+/// bounding box contains them.
+class ContainmentGrid
+{
+    public:
+    ContainmentGrid() {};
+    explicit ContainmentGrid(const ExPolygons &expolygons);
+    bool contains(const Polyline &polyline) const;
+
+    private:
+    /// Labels of the cells besides the index of an expolygon.
+    static const int edge = -1;
+    static const int outside = -2;
+
+    ExPolygons _expolygons;
+    std::vector<BoundingBox> _bboxes;
+    BoundingBox _bbox;  ///< of all the expolygons
+    Point _origin;
+    double _cell_size {0};
+    size_t _columns {0}, _rows {0};
+    std::vector<int> _cells;
+
+    /// Call f on the index of the cells within one unit of the segment.
+    template <class F> void _cells_along(const Point &a, const Point &b, F f) const;
+    size_t _cell(const Point &point) const;
+};
+
+}
+
+#endif
@@ -1,10 +1,38 @@
 #include "CoolingBuffer.hpp"
-#include <boost/algorithm/string/predicate.hpp>
-#include <boost/algorithm/string/replace.hpp>
-#include <iostream>
+#include "../GCodeEmitter.hpp"
+#include <cstdlib>
+#include <cstring>
 
 namespace Slic3r {
 
+namespace {
+
+const char set_speed_marker[]    = ";_EXTRUDE_SET_SPEED";
+const char external_marker[]     = ";_EXTERNAL_PERIMETER";
+const char wipe_marker[]         = ";_WIPE";
+const char bridge_start_marker[] = ";_BRIDGE_FAN_START";
+const char bridge_end_marker[]   = ";_BRIDGE_FAN_END";
+
+/// Whether marker starts at p, before end.
+template <size_t N>
+inline bool
+marker_at(const char* p, const char* end, const char (&marker)[N])
+{
+    return size_t(end - p) >= N - 1 && memcmp(p, marker, N - 1) == 0;
+}
+
+/// Whether marker is found in [begin, end).
+template <size_t N>
+inline bool
+contains_marker(const char* begin, const char* end, const char (&marker)[N])
+{
+    for (const char* p = begin; (p = static_cast<const char*>(memchr(p, ';', end - p))) != nullptr; ++p)
+        if (marker_at(p, end, marker)) return true;
+    return false;
+}
+
+}
+
 std::string
 CoolingBuffer::append(const std::string &gcode, std::string obj_id, size_t layer_id, float print_z)
 {
@@ -17,6 +45,7 @@ CoolingBuffer::append(const std::string &gcode, std::string obj_id, size_t layer
     this->_layer_id = layer_id;
     this->_last_z[obj_id] = print_z;
     this->_gcode += gcode;
+    this->_scan(false);
     // This is a very rough estimate of the print time, 
     // not taking into account the acceleration curves generated by the printer firmware.
     this->_elapsed_time          += this->_gcodegen->elapsed_time;
@@ -30,41 +59,102 @@ CoolingBuffer::append(const std::string &gcode, std::string obj_id, size_t layer
 }
 
 void
-apply_speed_factor(std::string &line, float speed_factor, float min_print_speed)
+CoolingBuffer::_scan(bool final)
 {
-    // find pos of F
-    size_t pos = line.find_first_of('F');
-    size_t last_pos = line.find_first_of(' ', pos+1);
-    
-    // extract current speed
-    float speed;
-    {
-        std::istringstream iss(line.substr(pos+1, last_pos));
-        iss >> speed;
+    const char* data = this->_gcode.data();
+    const size_t size = this->_gcode.size();
+    size_t pos = this->_scanned;
+    while ((pos = this->_gcode.find(";_", pos)) != std::string::npos) {
+        const size_t newline = this->_gcode.rfind('\n', pos);
+        const size_t begin = (newline == std::string::npos || newline < this->_scanned) ? this->_scanned : newline + 1;
+        size_t end = this->_gcode.find('\n', pos);
+        if (end == std::string::npos) {
+            if (!final) {
+                this->_scanned = begin;
+                return;
+            }
+            end = size;
+        }
+
+        MarkedLine line {};
+        line.begin = begin;
+        line.end = end;
+        const char* b = data + begin;
+        const char* e = data + end;
+        line.bridge_start = marker_at(b, e, bridge_start_marker);
+        line.after_bridge_start = !this->_marked_lines.empty()
+            && this->_marked_lines.back().bridge_start
+            && this->_marked_lines.back().end + 1 == begin;
+        line.set_speed = marker_at(b, e, "G1")
+            && contains_marker(b, e, set_speed_marker)
+            && !contains_marker(b, e, wipe_marker);
+        if (line.set_speed) {
+            // the first F of the line, as written by GCodeWriter::set_speed()
+            const char* f = static_cast<const char*>(memchr(b, 'F', e - b));
+            if (f == nullptr) {
+                line.set_speed = false;
+            } else {
+                line.speed_pos = f - data;
+                line.speed = strtof(f + 1, nullptr);
+                line.external = contains_marker(b, e, external_marker);
+            }
+        }
+        this->_marked_lines.push_back(line);
+        pos = this->_scanned = std::min(end + 1, size);
     }
-    
-    // change speed
-    speed *= speed_factor;
-    speed = std::max(speed, min_print_speed);
-    
-    // replace speed in string
-    {
-        std::ostringstream oss;
-        oss << speed;
-        line.replace(pos+1, (last_pos-pos), oss.str());
+    // no marker in the rest, but keep its last line, which might get one
+    const size_t newline = this->_gcode.rfind('\n');
+    if (newline != std::string::npos && newline + 1 > this->_scanned)
+        this->_scanned = newline + 1;
+}
+
+void
+CoolingBuffer::_append_line(std::string* out, const char* begin, const char* end,
+    const std::string &bridge_fan_start, const std::string &bridge_fan_end) const
+{
+    const char* p = begin;
+    const char* copied = begin;
+    while ((p = static_cast<const char*>(memchr(p, ';', end - p))) != nullptr) {
+        const std::string* replacement = nullptr;
+        size_t length = 0;
+        static const std::string removed;
+        if (marker_at(p, end, bridge_start_marker)) {
+            replacement = &bridge_fan_start;
+            length = sizeof(bridge_start_marker) - 1;
+        } else if (marker_at(p, end, bridge_end_marker)) {
+            replacement = &bridge_fan_end;
+            length = sizeof(bridge_end_marker) - 1;
+        } else if (marker_at(p, end, wipe_marker)) {
+            replacement = &removed;
+            length = sizeof(wipe_marker) - 1;
+        } else if (marker_at(p, end, set_speed_marker)) {
+            replacement = &removed;
+            length = sizeof(set_speed_marker) - 1;
+        } else if (marker_at(p, end, external_marker)) {
+            replacement = &removed;
+            length = sizeof(external_marker) - 1;
+        }
+        if (replacement == nullptr) {
+            ++p;
+            continue;
+        }
+        out->append(copied, p);
+        out->append(*replacement);
+        p += length;
+        copied = p;
     }
+    out->append(copied, end);
 }
 
 std::string
 CoolingBuffer::flush()
 {
     GCode &gg = *this->_gcodegen;
-    std::string gcode = this->_gcode;
+    this->_scan(true);
     
     int fan_speed           = gg.config.fan_always_on ? gg.config.min_fan_speed.value : 0;
     float speed_factor      = 1.0;
     bool slowdown_external  = true;
-    
     if (gg.config.cooling) {
         #ifdef SLIC3R_DEBUG
         printf("Layer %zu estimated printing time: %f seconds\n", this->_layer_id, this->_elapsed_time);
@@ -100,51 +190,62 @@ CoolingBuffer::flush()
         printf("  fan = %d%%, speed = %f%%\n", fan_speed, speed_factor * 100);
         #endif
         
-        if (speed_factor < 1.0) {
-            // Adjust feed rate of G1 commands marked with an _EXTRUDE_SET_SPEED
-            // as long as they are not _WIPE moves (they cannot if they are _EXTRUDE_SET_SPEED)
-            // and they are not preceded directly by _BRIDGE_FAN_START (do not adjust bridging speed).
-            std::string new_gcode;
-            std::istringstream ss(gcode);
-            std::string line;
-            bool bridge_fan_start = false;
-            while (std::getline(ss, line)) {
-                if (boost::starts_with(line, "G1")
-                    && boost::contains(line, ";_EXTRUDE_SET_SPEED")
-                    && !boost::contains(line, ";_WIPE")
-                    && !bridge_fan_start
-                    && (slowdown_external || !boost::contains(line, ";_EXTERNAL_PERIMETER"))) {
-                    apply_speed_factor(line, speed_factor, this->_min_print_speed);
-                    boost::replace_first(line, ";_EXTRUDE_SET_SPEED", "");
-                }
-                bridge_fan_start = boost::starts_with(line, ";_BRIDGE_FAN_START");
-                new_gcode += line + '\n';
-            }
-            gcode = new_gcode;
-        }
     }
-    if (this->_layer_id < gg.config.disable_fan_first_layers)
+    // a negative count disables the fan on no layer
+    const int disable_fan_first_layers = gg.config.disable_fan_first_layers;
+    const bool fan_disabled = disable_fan_first_layers > 0
+        && this->_layer_id < size_t(disable_fan_first_layers);
+    if (fan_disabled)
         fan_speed = 0;
     
-    gcode = gg.writer.set_fan(fan_speed) + gcode;
+    std::string gcode = gg.writer.set_fan(fan_speed);
+    gcode.reserve(gcode.size() + this->_gcode.size() + 64 * this->_marked_lines.size());
     
     // bridge fan speed
-    if (!gg.config.cooling || gg.config.bridge_fan_speed == 0 || this->_layer_id < gg.config.disable_fan_first_layers) {
-        boost::replace_all(gcode, ";_BRIDGE_FAN_START", "");
-        boost::replace_all(gcode, ";_BRIDGE_FAN_END", "");
-    } else {
-        boost::replace_all(gcode, ";_BRIDGE_FAN_START", gg.writer.set_fan(gg.config.bridge_fan_speed, true));
-        boost::replace_all(gcode, ";_BRIDGE_FAN_END",   gg.writer.set_fan(fan_speed, true));
+    std::string bridge_fan_start, bridge_fan_end;
+    if (gg.config.cooling && gg.config.bridge_fan_speed != 0 && !fan_disabled) {
+        bridge_fan_start = gg.writer.set_fan(gg.config.bridge_fan_speed, true);
+        bridge_fan_end   = gg.writer.set_fan(fan_speed, true);
+    }
+    
+    // Adjust feed rate of G1 commands marked with an _EXTRUDE_SET_SPEED
+    // as long as they are not _WIPE moves (they cannot if they are _EXTRUDE_SET_SPEED)
+    // and they are not preceded directly by _BRIDGE_FAN_START (do not adjust bridging speed).
+    // The markers of all the lines are replaced or removed.
+    const bool slowdown = gg.config.cooling && speed_factor < 1.0;
+    const char* data = this->_gcode.data();
+    size_t copied = 0;
+    std::string line;
+    for (const MarkedLine &marked : this->_marked_lines) {
+        gcode.append(data + copied, data + marked.begin);
+        copied = marked.end;
+        if (slowdown && marked.set_speed && !marked.after_bridge_start
+            && (slowdown_external || !marked.external)) {
+            // The new speed replaces everything after the F up to the
+            // following space, which goes too, or the end of the line.
+            const float speed = std::max(marked.speed * speed_factor, this->_min_print_speed);
+            line.assign(data + marked.begin, data + marked.speed_pos + 1);
+            GCodeEmitter::append_general(&line, speed);
+            const char* space = static_cast<const char*>(
+                memchr(data + marked.speed_pos + 1, ' ', marked.end - marked.speed_pos - 1));
+            if (space != nullptr) line.append(space + 1, data + marked.end);
+            this->_append_line(&gcode, line.data(), line.data() + line.size(), bridge_fan_start, bridge_fan_end);
+        } else {
+            this->_append_line(&gcode, data + marked.begin, data + marked.end, bridge_fan_start, bridge_fan_end);
+        }
     }
-    boost::replace_all(gcode, ";_WIPE", "");
-    boost::replace_all(gcode, ";_EXTRUDE_SET_SPEED", "");
-    boost::replace_all(gcode, ";_EXTERNAL_PERIMETER", "");
+    gcode.append(data + copied, data + this->_gcode.size());
+    // a layer that was slowed down always ends with a newline
+    if (slowdown && !this->_gcode.empty() && this->_gcode.back() != '\n')
+        gcode += '\n';
     
     // Reset the buffer.
     this->_elapsed_time          = 0;
     this->_elapsed_time_bridges  = 0;
     this->_elapsed_time_external = 0;
-    this->_gcode = "";
+    this->_gcode.clear();
+    this->_marked_lines.clear();
+    this->_scanned = 0;
     this->_last_z.clear(); // reset the whole table otherwise we would compute overlapping times
     
     return gcode;
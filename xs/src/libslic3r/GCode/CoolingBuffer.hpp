@@ -5,6 +5,7 @@
 #include "GCode.hpp"
 #include <map>
 #include <string>
+#include <vector>
 
 namespace Slic3r {
 
@@ -18,15 +19,28 @@ class CoolingBuffer {
     public:
     CoolingBuffer(GCode &gcodegen)
         : _gcodegen(&gcodegen), _elapsed_time(0.), _elapsed_time_bridges(0.),
-          _elapsed_time_external(0.), _layer_id(0)
+          _elapsed_time_external(0.), _layer_id(0), _scanned(0)
     {
         this->_min_print_speed = this->_gcodegen->config.min_print_speed * 60;
     };
     std::string append(const std::string &gcode, std::string obj_id, size_t layer_id, float print_z);
     std::string flush();
     GCode* gcodegen() { return this->_gcodegen; };
-    
+
     private:
+    /// A line of the buffer carrying cooling markers. append() finds them as
+    /// the text comes in, so that flush() edits these lines only and copies
+    /// the rest of the layer once.
+    struct MarkedLine {
+        size_t begin, end;          ///< offsets in _gcode, end at the newline
+        bool set_speed;             ///< G1 line with _EXTRUDE_SET_SPEED and no _WIPE
+        bool external;              ///< also marked _EXTERNAL_PERIMETER
+        bool after_bridge_start;    ///< follows a _BRIDGE_FAN_START line
+        bool bridge_start;          ///< is a _BRIDGE_FAN_START line
+        size_t speed_pos;           ///< offset of the F of a set_speed line
+        float speed;                ///< its feedrate
+    };
+
     GCode*                      _gcodegen;
     std::string                 _gcode;
     float                       _elapsed_time;
@@ -35,6 +49,15 @@ class CoolingBuffer {
     size_t                      _layer_id;
     std::map<std::string,float> _last_z;
     float                       _min_print_speed;
+    std::vector<MarkedLine>     _marked_lines;
+    size_t                      _scanned;   ///< start of the first line not scanned yet
+
+    /// Record the marked lines of _gcode from _scanned on. Unless final, a
+    /// last line without its newline is left for the next call.
+    void _scan(bool final);
+    /// Append line to out with the markers replaced by the fan commands or removed.
+    void _append_line(std::string* out, const char* begin, const char* end,
+        const std::string &bridge_fan_start, const std::string &bridge_fan_end) const;
 };
 
 }
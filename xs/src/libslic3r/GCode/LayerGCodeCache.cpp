@@ -0,0 +1,126 @@
+#ifndef SLIC3RXS
+#include "LayerGCodeCache.hpp"
+#include "ExtrusionEntityCollection.hpp"
+#include <utility>
+
+namespace Slic3r {
+
+void
+LayerGCodeCache::Key::add(const void* data, size_t size)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        this->value ^= p[i];
+        this->value *= 0x100000001b3ull;
+    }
+}
+
+void
+LayerGCodeCache::Key::add_string(const std::string &value)
+{
+    this->add(value.size());
+    this->add(value.data(), value.size());
+}
+
+void
+LayerGCodeCache::Key::add_points(const Points &points)
+{
+    this->add(points.size());
+    for (const Point &point : points) {
+        this->add(point.x);
+        this->add(point.y);
+    }
+}
+
+void
+LayerGCodeCache::Key::add_expolygons(const ExPolygons &expolygons)
+{
+    this->add(expolygons.size());
+    for (const ExPolygon &expolygon : expolygons) {
+        this->add_points(expolygon.contour.points);
+        this->add(expolygon.holes.size());
+        for (const Polygon &hole : expolygon.holes)
+            this->add_points(hole.points);
+    }
+}
+
+void
+LayerGCodeCache::Key::add_entity(const ExtrusionEntity &entity)
+{
+    if (const ExtrusionPath* path = dynamic_cast<const ExtrusionPath*>(&entity)) {
+        this->add('p');
+        this->add(path->role);
+        this->add(path->mm3_per_mm);
+        this->add(path->width);
+        this->add(path->height);
+        this->add_points(path->polyline.points);
+    } else if (const ExtrusionLoop* loop = dynamic_cast<const ExtrusionLoop*>(&entity)) {
+        this->add('l');
+        this->add(loop->role);
+        this->add(loop->paths.size());
+        for (const ExtrusionPath &path : loop->paths)
+            this->add_entity(path);
+    } else if (const ExtrusionEntityCollection* collection = dynamic_cast<const ExtrusionEntityCollection*>(&entity)) {
+        this->add('c');
+        this->add(collection->no_sort);
+        this->add(collection->entities.size());
+        for (const ExtrusionEntity* child : collection->entities)
+            this->add_entity(*child);
+    }
+}
+
+void
+LayerGCodeCache::Key::add_config(const ConfigBase &config)
+{
+    this->add_config(config, config.keys());
+}
+
+void
+LayerGCodeCache::Key::add_config(const ConfigBase &config, const t_config_option_keys &keys)
+{
+    for (const t_config_option_key &key : keys) {
+        this->add_string(key);
+        this->add_string(config.serialize(key));
+    }
+}
+
+void
+LayerGCodeCache::begin_export()
+{
+    ++this->_generation;
+}
+
+void
+LayerGCodeCache::end_export()
+{
+    for (auto it = this->_entries.begin(); it != this->_entries.end(); ) {
+        if (it->second.generation != this->_generation)
+            it = this->_entries.erase(it);
+        else
+            ++it;
+    }
+}
+
+const LayerGCodeCache::Entry*
+LayerGCodeCache::find(key_t key)
+{
+    const auto it = this->_entries.find(key);
+    if (it == this->_entries.end()) {
+        ++this->_misses;
+        return nullptr;
+    }
+    ++this->_hits;
+    it->second.generation = this->_generation;
+    return &it->second.entry;
+}
+
+void
+LayerGCodeCache::store(key_t key, Entry entry)
+{
+    Slot &slot = this->_entries[key];
+    slot.entry = std::move(entry);
+    slot.generation = this->_generation;
+}
+
+}
+#endif // SLIC3RXS
@@ -0,0 +1,109 @@
+#ifndef SLIC3RXS
+#ifndef slic3r_LayerGCodeCache_hpp_
+#define slic3r_LayerGCodeCache_hpp_
+
+#include "libslic3r.h"
+#include "ConfigBase.hpp"
+#include "ExPolygon.hpp"
+#include "ExtrusionEntity.hpp"
+#include "GCodeWriter.hpp"
+#include "Point.hpp"
+#include "Polyline.hpp"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Slic3r {
+
+/// In-memory cache of the G-code PrintGCode::process_layer() writes for each
+/// layer of each object, so that exporting a print again after a change only
+/// generates the layers the change touched.
+///
+/// An entry is keyed by a hash of everything the G-code of the layer depends
+/// on: its extrusions and slices, the configs that apply to it, and the state
+/// the generator was in when it started the layer (position, extruders,
+/// retraction...). A layer whose key is found is spliced from the cache and
+/// the generator is put in the state the layer left it in, so the G-code is
+/// the same as if it had been generated. After a changed layer, the next one
+/// usually starts from another position and is generated again, the layers
+/// after it are found again as soon as the state matches.
+class LayerGCodeCache
+{
+public:
+    typedef uint64_t key_t;
+
+    /// Builds the keys: a 64 bit FNV-1a of what is added to it.
+    class Key
+    {
+    public:
+        void add(const void* data, size_t size);
+        template <class T> void add(const T &value) { this->add(&value, sizeof(T)); }
+        void add_string(const std::string &value);
+        void add_points(const Points &points);
+        void add_expolygons(const ExPolygons &expolygons);
+        /// The paths of an extrusion entity, recursing into loops and collections.
+        void add_entity(const ExtrusionEntity &entity);
+        /// The values of all the options of config.
+        void add_config(const ConfigBase &config);
+        /// The values of some of them.
+        void add_config(const ConfigBase &config, const t_config_option_keys &keys);
+
+        key_t value {0xcbf29ce484222325ull};
+    };
+
+    /// The G-code of a layer, and the state of the generator after it.
+    struct Entry {
+        std::string gcode;
+        GCodeWriter::State writer;
+        /// Extruder::absolute_E_steps of each extruder during the layer.
+        std::map<unsigned int, std::vector<double>> absolute_E_steps;
+        Pointf origin;
+        bool last_pos_defined;
+        Point last_pos;
+        Polyline wipe_path;
+        bool use_external_mp, use_external_mp_once, disable_once;
+        bool enable_cooling_markers;
+        bool first_layer;
+        int layer_index;
+        double volumetric_speed;
+        /// Added by the layer, for the cooling buffer.
+        float elapsed_time, elapsed_time_bridges, elapsed_time_external;
+        /// Added by the layer, for the statistics of the export.
+        size_t arcs, arc_segments;
+        bool has_seam_position;
+        Point seam_position;
+        /// Region whose config was applied last, SIZE_MAX if none was.
+        size_t last_region_id;
+        bool skirt_done, brim_done, second_layer_things_done;
+        std::pair<Point, bool> last_obj_copy;
+    };
+
+    /// Start an export: the entries it doesn't use are dropped by end_export().
+    void begin_export();
+    void end_export();
+
+    /// The entry stored for key, or nullptr. Counts a hit or a miss.
+    const Entry* find(key_t key);
+    void store(key_t key, Entry entry);
+
+    size_t hits() const { return this->_hits; };
+    size_t misses() const { return this->_misses; };
+    size_t size() const { return this->_entries.size(); };
+
+private:
+    struct Slot {
+        Entry entry;
+        size_t generation;  ///< of the last export that used the entry
+    };
+    std::unordered_map<key_t, Slot> _entries;
+    size_t _generation {0};
+    size_t _hits {0};
+    size_t _misses {0};
+};
+
+}
+
+#endif // slic3r_LayerGCodeCache_hpp_
+#endif // SLIC3RXS
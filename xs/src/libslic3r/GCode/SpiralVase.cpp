@@ -33,13 +33,12 @@ SpiralVase::process_layer(const std::string &gcode)
     // Get total XY length for this layer by summing all extrusion moves.
     float total_layer_length = 0;
     float layer_height = 0;
-    float z;
+    float z = this->_reader.Z;  // in case the layer has no Z move
     bool set_z = false;
     
     {
         GCodeReader r = this->_reader;  // clone
-        r.parse(gcode, [&total_layer_length, &layer_height, &z, &set_z]
-            (GCodeReader &, const GCodeReader::GCodeLine &line) {
+        for (const GCodeReader::GCodeLine &line : r.lines(gcode)) {
             if (line.cmd == "G1") {
                 if (line.extruding()) {
                     total_layer_length += line.dist_XY();
@@ -51,32 +50,32 @@ SpiralVase::process_layer(const std::string &gcode)
                     }
                 }
             }
-        });
+        }
     }
     
     // Remove layer height from initial Z.
     z -= layer_height;
     
     std::string new_gcode;
-    this->_reader.parse(gcode, [&new_gcode, &z, &layer_height, &total_layer_length]
-        (GCodeReader &, GCodeReader::GCodeLine line) {
+    new_gcode.reserve(gcode.size() + gcode.size() / 8);
+    for (const GCodeReader::GCodeLine &line : this->_reader.lines(gcode)) {
         if (line.cmd == "G1") {
             if (line.has('Z')) {
                 // If this is the initial Z move of the layer, replace it with a
                 // (redundant) move to the last Z of previous layer.
-                line.set('Z', _format_z(z));
-                new_gcode += line.raw + '\n';
-                return;
+                line.append_with(&new_gcode, 'Z', _format_z(z));
+                new_gcode += '\n';
+                continue;
             } else {
                 float dist_XY = line.dist_XY();
                 if (dist_XY > 0) {
                     // horizontal move
                     if (line.extruding()) {
                         z += dist_XY * layer_height / total_layer_length;
-                        line.set('Z', _format_z(z));
-                        new_gcode += line.raw + '\n';
+                        line.append_with(&new_gcode, 'Z', _format_z(z));
+                        new_gcode += '\n';
                     }
-                    return;
+                    continue;
                 
                     /*  Skip travel moves: the move to first perimeter point will
                         cause a visible seam when loops are not aligned in XY; by skipping
@@ -86,8 +85,9 @@ SpiralVase::process_layer(const std::string &gcode)
                 }
             }
         }
-        new_gcode += line.raw + '\n';
-    });
+        new_gcode.append(line.raw.data(), line.raw.size());
+        new_gcode += '\n';
+    }
     
     return new_gcode;
 }
@@ -0,0 +1,88 @@
+#include "GCodeEmitter.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+namespace Slic3r {
+
+namespace {
+
+const uint64_t powers_of_10[] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull, 1000000000ull
+};
+
+/// Write the digits of value, left-padded with zeros to width.
+void
+append_digits(std::string* out, uint64_t value, int width = 1)
+{
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = char('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (n < width) digits[n++] = '0';
+    while (n > 0) out->push_back(digits[--n]);
+}
+
+void
+append_printf(std::string* out, const char* format, int precision, double value)
+{
+    char buffer[512];
+    const int n = snprintf(buffer, sizeof(buffer), format, precision, value);
+    if (n > 0) out->append(buffer, std::min<size_t>(n, sizeof(buffer) - 1));
+}
+
+}
+
+void
+GCodeEmitter::append_integer(std::string* out, long long value)
+{
+    if (value < 0) {
+        out->push_back('-');
+        append_digits(out, uint64_t(0) - uint64_t(value));
+    } else {
+        append_digits(out, uint64_t(value));
+    }
+}
+
+void
+GCodeEmitter::append_fixed(std::string* out, double value, int precision)
+{
+    // The product is rounded once, by at most 2^-53 of itself. Below 8e12
+    // that is under 1e-3, so a rounding that isn't within 1e-3 of a tie goes
+    // the same way as printf's, which rounds the exact binary value. Larger
+    // products, infinity and NaN fail the comparison and go to snprintf.
+    if (precision >= 0 && precision <= 9) {
+        const double scaled = std::abs(value) * powers_of_10[precision];
+        const double integral = std::floor(scaled);
+        const double fraction = scaled - integral;
+        if (scaled < 8e12 && std::abs(fraction - 0.5) > 1e-3) {
+            const uint64_t rounded = uint64_t(integral) + (fraction > 0.5 ? 1 : 0);
+            // printf keeps the sign of negative values rounded to zero
+            if (std::signbit(value)) out->push_back('-');
+            append_digits(out, rounded / powers_of_10[precision]);
+            if (precision > 0) {
+                out->push_back('.');
+                append_digits(out, rounded % powers_of_10[precision], precision);
+            }
+            return;
+        }
+    }
+    append_printf(out, "%.*f", precision, value);
+}
+
+void
+GCodeEmitter::append_general(std::string* out, double value)
+{
+    // %g switches to exponents from 1e6 on
+    if (std::abs(value) < 1e6 && value == std::floor(value)) {
+        if (std::signbit(value)) out->push_back('-');
+        append_digits(out, uint64_t(std::abs(value)));
+        return;
+    }
+    append_printf(out, "%.*g", 6, value);
+}
+
+}
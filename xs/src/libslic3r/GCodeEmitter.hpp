@@ -0,0 +1,50 @@
+#ifndef slic3r_GCodeEmitter_hpp_
+#define slic3r_GCodeEmitter_hpp_
+
+#include "libslic3r.h"
+#include <string>
+
+namespace Slic3r {
+
+/// Appends G-code to a string, formatting the numbers without going through
+/// iostreams. A buffer that is cleared and reused keeps its capacity, so once
+/// it has grown to fit a layer nothing is allocated any more.
+///
+/// The text is the one std::ostream gives with the classic locale: fixed()
+/// matches std::fixed with the given precision, a plain double matches the
+/// default formatting (%g).
+class GCodeEmitter {
+public:
+    /// A number printed with a fixed count of decimals.
+    struct Fixed {
+        double value;
+        int precision;
+    };
+
+    explicit GCodeEmitter(std::string* out) : out(out) {};
+
+    static Fixed fixed(double value, int precision) { return Fixed { value, precision }; };
+
+    GCodeEmitter& operator<<(char c) { this->out->push_back(c); return *this; };
+    GCodeEmitter& operator<<(const char* s) { this->out->append(s); return *this; };
+    GCodeEmitter& operator<<(const std::string &s) { this->out->append(s); return *this; };
+    GCodeEmitter& operator<<(int value) { append_integer(this->out, value); return *this; };
+    GCodeEmitter& operator<<(unsigned int value) { append_integer(this->out, value); return *this; };
+    GCodeEmitter& operator<<(double value) { append_general(this->out, value); return *this; };
+    GCodeEmitter& operator<<(const Fixed &f) { append_fixed(this->out, f.value, f.precision); return *this; };
+
+    static void append_integer(std::string* out, long long value);
+    /// Like printf("%.*f"). The digits come from an integer rounded from
+    /// value, which gives the same text unless value is huge or lies next to
+    /// a tie, where snprintf is used.
+    static void append_fixed(std::string* out, double value, int precision);
+    /// Like printf("%g"); integral values are written directly.
+    static void append_general(std::string* out, double value);
+
+private:
+    std::string* out;
+};
+
+} // namespace Slic3r
+
+#endif // slic3r_GCodeEmitter_hpp_
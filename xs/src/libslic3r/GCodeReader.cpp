@@ -1,11 +1,79 @@
 #include "GCodeReader.hpp"
-#include <boost/algorithm/string/classification.hpp>
-#include <boost/algorithm/string/split.hpp>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 
 namespace Slic3r {
 
+namespace {
+
+const double exact_powers_of_10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/// atof() of [begin, end), which needn't be null-terminated.
+/// Numbers of up to 15 digits with a small exponent, which is what G-code
+/// holds, are exact in doubles and a single multiplication or division
+/// rounds them like strtod() does. Anything else goes through strtod().
+double
+parse_number(const char* begin, const char* end)
+{
+    const char* p = begin;
+    const bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) ++p;
+
+    uint64_t mantissa = 0;
+    int significant_digits = 0;
+    int exponent = 0;
+    bool any_digit = false;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        any_digit = true;
+        if (mantissa > 0 || *p != '0') ++significant_digits;
+        mantissa = mantissa * 10 + (*p - '0');
+        if (significant_digits > 15) break;
+    }
+    if (p < end && *p == '.' && significant_digits <= 15) {
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p) {
+            any_digit = true;
+            if (mantissa > 0 || *p != '0') ++significant_digits;
+            mantissa = mantissa * 10 + (*p - '0');
+            --exponent;
+            if (significant_digits > 15) break;
+        }
+    }
+    if (any_digit && p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        const bool negative_exponent = q < end && *q == '-';
+        if (q < end && (*q == '-' || *q == '+')) ++q;
+        int value = 0;
+        const char* digits = q;
+        for (; q < end && *q >= '0' && *q <= '9' && q - digits < 4; ++q)
+            value = value * 10 + (*q - '0');
+        if (q > digits) {
+            exponent += negative_exponent ? -value : value;
+            p = q;
+        }
+    }
+
+    if (any_digit && p == end && significant_digits <= 15 && exponent >= -22 && exponent <= 22) {
+        const double value = exponent < 0
+            ? double(mantissa) / exact_powers_of_10[-exponent]
+            : double(mantissa) * exact_powers_of_10[exponent];
+        return negative ? -value : value;
+    }
+
+    char buffer[64];
+    if (size_t(end - begin) < sizeof(buffer)) {
+        memcpy(buffer, begin, end - begin);
+        buffer[end - begin] = '\0';
+        return atof(buffer);
+    }
+    return atof(std::string(begin, end).c_str());
+}
+
+}
+
 void
 GCodeReader::apply_config(const PrintConfigBase &config)
 {
@@ -16,8 +84,8 @@ GCodeReader::apply_config(const PrintConfigBase &config)
 void
 GCodeReader::parse(const std::string &gcode, callback_t callback)
 {
-    std::istringstream ss(gcode);
-    this->parse_stream(ss, callback);
+    for (const GCodeLine &line : this->lines(gcode))
+        if (callback) callback(*this, line);
 }
 
 void GCodeReader::parse_stream(std::istream &gcode, callback_t callback)
@@ -28,87 +96,163 @@ void GCodeReader::parse_stream(std::istream &gcode, callback_t callback)
 }
 
 void
-GCodeReader::parse_line(std::string line, callback_t callback)
+GCodeReader::parse_line(boost::string_ref line, callback_t callback)
 {
     GCodeLine gline(this);
-    gline.raw = line;
+    this->_tokenize(line, &gline);
+    if (callback) callback(*this, gline);
+    this->_update(gline);
+}
+
+void
+GCodeReader::parse_file(const std::string &file, callback_t callback)
+{
+    // parse the complete lines of each chunk, carry the last one over
+    const size_t chunk_size = 1 << 20;
+    std::ifstream f(file);
+    std::string buffer;
+    while (f) {
+        const size_t kept = buffer.size();
+        buffer.resize(kept + chunk_size);
+        f.read(&buffer[kept], chunk_size);
+        buffer.resize(kept + f.gcount());
+        const size_t last_newline = buffer.rfind('\n');
+        if (last_newline == std::string::npos || last_newline < kept) continue;
+        for (const GCodeLine &line : this->lines(boost::string_ref(buffer.data(), last_newline + 1)))
+            if (callback) callback(*this, line);
+        buffer.erase(0, last_newline + 1);
+    }
+    for (const GCodeLine &line : this->lines(buffer))
+        if (callback) callback(*this, line);
+}
+
+void
+GCodeReader::_tokenize(boost::string_ref raw, GCodeLine* line)
+{
+    line->raw = raw;
+    line->_mask = 0;
     if (this->verbose)
-        std::cout << line << std::endl;
-    
+        std::cout << raw << std::endl;
+
+    const char* p = raw.data();
+    const char* end = p + raw.size();
+
     // strip comment
-    {
-        size_t pos = line.find(';');
-        if (pos != std::string::npos) {
-            gline.comment = line.substr(pos+1);
-            line.erase(pos);
-        }
+    const char* semicolon = static_cast<const char*>(memchr(p, ';', end - p));
+    if (semicolon != nullptr) {
+        line->comment = boost::string_ref(semicolon + 1, end - semicolon - 1);
+        end = semicolon;
+    } else {
+        line->comment = boost::string_ref();
     }
-    
-    // command and args
-    {
-        std::vector<std::string> args;
-        boost::split(args, line, boost::is_any_of(" "));
-        
-        // first one is cmd
-        gline.cmd = args.front();
-        args.erase(args.begin());
-        
-        for (std::string &arg : args) {
-            if (arg.size() < 2) continue;
-            gline.args.insert(std::make_pair(arg[0], arg.substr(1)));
+
+    // command and args, separated by single spaces
+    const char* space = static_cast<const char*>(memchr(p, ' ', end - p));
+    const char* token_end = space != nullptr ? space : end;
+    line->cmd = boost::string_ref(p, token_end - p);
+    while (token_end < end) {
+        const char* token = token_end + 1;
+        space = static_cast<const char*>(memchr(token, ' ', end - token));
+        token_end = space != nullptr ? space : end;
+        // the first of repeated args wins
+        const uint32_t bit = GCodeLine::_bit(*token);
+        if (token_end - token >= 2 && bit != 0 && (line->_mask & bit) == 0) {
+            line->_values[*token - 'A'] = float(parse_number(token + 1, token_end));
+            line->_mask |= bit;
         }
     }
-    
+
     // convert extrusion axis
-    if (this->_extrusion_axis != 'E') {
-        const auto it = gline.args.find(this->_extrusion_axis);
-        if (it != gline.args.end()) {
-            std::swap(gline.args['E'], it->second);
-            gline.args.erase(it);
-        }
+    if (this->_extrusion_axis != 'E' && line->has(this->_extrusion_axis)) {
+        line->_values['E' - 'A'] = line->_values[this->_extrusion_axis - 'A'];
+        line->_mask |= GCodeLine::_bit('E');
+        line->_mask &= ~GCodeLine::_bit(this->_extrusion_axis);
     }
-    
-    if (gline.has('E') && this->_config.use_relative_e_distances)
+
+    if (line->has('E') && this->_config.use_relative_e_distances)
         this->E = 0;
-    
-    if (callback) callback(*this, gline);
-    
-    // update coordinates
-    if (gline.cmd == "G0" || gline.cmd == "G1" || gline.cmd == "G92") {
-        this->X = gline.new_X();
-        this->Y = gline.new_Y();
-        this->Z = gline.new_Z();
-        this->E = gline.new_E();
-        this->F = gline.new_F();
+}
+
+void
+GCodeReader::_update(const GCodeLine &line)
+{
+    if (line.cmd == "G0" || line.cmd == "G1" || line.cmd == "G2" || line.cmd == "G3" || line.cmd == "G92") {
+        this->X = line.new_X();
+        this->Y = line.new_Y();
+        this->Z = line.new_Z();
+        this->E = line.new_E();
+        this->F = line.new_F();
     }
 }
 
+float
+GCodeReader::GCodeLine::dist_arc() const
+{
+    const double i = this->get_float('I');
+    const double j = this->get_float('J');
+    // angles of the start and end points around the center
+    const double start = atan2(-j, -i);
+    const double end = atan2(this->new_Y() - (this->reader->Y + j), this->new_X() - (this->reader->X + i));
+    double angle = this->cmd == "G3" ? end - start : start - end;
+    // an arc ending where it starts is a full circle
+    if (angle <= 0) angle += 2 * PI;
+    return sqrt(i*i + j*j) * angle;
+}
+
+GCodeReader::LineIterator::LineIterator(GCodeReader* reader, const char* begin, const char* end)
+    : _reader(reader), _line(reader), _next(begin), _end(end)
+{
+    this->_read_line();
+}
+
+GCodeReader::LineIterator&
+GCodeReader::LineIterator::operator++()
+{
+    this->_reader->_update(this->_line);
+    this->_read_line();
+    return *this;
+}
+
 void
-GCodeReader::parse_file(const std::string &file, callback_t callback)
+GCodeReader::LineIterator::_read_line()
 {
-    std::ifstream f(file);
-    std::string line;
-    while (std::getline(f, line))
-        this->parse_line(line, callback);
+    // lines as std::getline() splits them: no empty line after the last newline
+    if (this->_next == this->_end) {
+        this->_reader = nullptr;
+        this->_line.raw = boost::string_ref();
+        return;
+    }
+    const char* newline = static_cast<const char*>(memchr(this->_next, '\n', this->_end - this->_next));
+    const char* line_end = newline != nullptr ? newline : this->_end;
+    this->_reader->_tokenize(boost::string_ref(this->_next, line_end - this->_next), &this->_line);
+    this->_next = newline != nullptr ? newline + 1 : this->_end;
 }
 
 void
-GCodeReader::GCodeLine::set(char arg, std::string value)
+GCodeReader::GCodeLine::append_with(std::string* out, char arg, const std::string &value) const
 {
-    const std::string space(" ");
-    if (this->has(arg)) {
-        size_t pos = this->raw.find(space + arg)+2;
-        size_t end = this->raw.find(' ', pos+1);
-        this->raw = this->raw.replace(pos, end-pos, value);
-    } else {
-        size_t pos = this->raw.find(' ');
-        if (pos == std::string::npos) {
-            this->raw += space + arg + value;
-        } else {
-            this->raw = this->raw.replace(pos, 0, space + arg + value);
+    const char key[] = { ' ', arg };
+    const size_t pos = this->has(arg) ? this->raw.find(boost::string_ref(key, 2)) : boost::string_ref::npos;
+    if (pos != boost::string_ref::npos) {
+        // the value runs to the next space, or to the end of the line
+        const size_t value_pos = pos + 2;
+        size_t value_end = this->raw.size();
+        if (value_pos + 1 < this->raw.size()) {
+            const size_t space = this->raw.substr(value_pos + 1).find(' ');
+            if (space != boost::string_ref::npos) value_end = value_pos + 1 + space;
         }
+        out->append(this->raw.data(), value_pos);
+        *out += value;
+        out->append(this->raw.data() + value_end, this->raw.size() - value_end);
+    } else {
+        const size_t space = this->raw.find(' ');
+        const size_t insert_pos = space != boost::string_ref::npos ? space : this->raw.size();
+        out->append(this->raw.data(), insert_pos);
+        *out += ' ';
+        *out += arg;
+        *out += value;
+        out->append(this->raw.data() + insert_pos, this->raw.size() - insert_pos);
     }
-    this->args[arg] = value;
 }
 
 }
@@ -3,9 +3,12 @@
 
 #include "libslic3r.h"
 #include <cmath>
-#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <iterator>
 #include <string>
+#include <boost/utility/string_ref.hpp>
 #include "PrintConfig.hpp"
 
 namespace Slic3r {
@@ -13,24 +16,27 @@ namespace Slic3r {
 class GCodeReader;
 class GCodeReader {
     public:
-    
+
+    /// A line of G-code, tokenized in place: raw, cmd and comment point into
+    /// the text being parsed, which must outlive the line. The arguments are
+    /// converted once, into a slot per letter from A to Z, other arguments
+    /// are ignored.
     class GCodeLine {
         public:
         GCodeReader* reader;
-        std::string raw;
-        std::string cmd;
-        std::string comment;
-        std::map<char,std::string> args;
-        
-        GCodeLine(GCodeReader* _reader) : reader(_reader) {};
-        
-        bool has(char arg) const { return this->args.count(arg) > 0; };
-        float get_float(char arg) const { return atof(this->args.at(arg).c_str()); };
-        float new_X() const { return this->has('X') ? atof(this->args.at('X').c_str()) : this->reader->X; };
-        float new_Y() const { return this->has('Y') ? atof(this->args.at('Y').c_str()) : this->reader->Y; };
-        float new_Z() const { return this->has('Z') ? atof(this->args.at('Z').c_str()) : this->reader->Z; };
-        float new_E() const { return this->has('E') ? atof(this->args.at('E').c_str()) : this->reader->E; };
-        float new_F() const { return this->has('F') ? atof(this->args.at('F').c_str()) : this->reader->F; };
+        boost::string_ref raw;      ///< without the newline
+        boost::string_ref cmd;
+        boost::string_ref comment;  ///< after the ';'
+
+        GCodeLine(GCodeReader* _reader) : reader(_reader), _mask(0) {};
+
+        bool has(char arg) const { return (this->_mask & _bit(arg)) != 0; };
+        float get_float(char arg) const { return this->has(arg) ? this->_values[arg - 'A'] : 0; };
+        float new_X() const { return this->has('X') ? this->_values['X' - 'A'] : this->reader->X; };
+        float new_Y() const { return this->has('Y') ? this->_values['Y' - 'A'] : this->reader->Y; };
+        float new_Z() const { return this->has('Z') ? this->_values['Z' - 'A'] : this->reader->Z; };
+        float new_E() const { return this->has('E') ? this->_values['E' - 'A'] : this->reader->E; };
+        float new_F() const { return this->has('F') ? this->_values['F' - 'A'] : this->reader->F; };
         float dist_X() const { return this->new_X() - this->reader->X; };
         float dist_Y() const { return this->new_Y() - this->reader->Y; };
         float dist_Z() const { return this->new_Z() - this->reader->Z; };
@@ -40,27 +46,92 @@ class GCodeReader {
             float y = this->dist_Y();
             return sqrt(x*x + y*y);
         };
+        /// Length of the arc of a G2 or G3, whose I and J are relative to
+        /// the start point.
+        float dist_arc() const;
         bool extruding() const { return this->cmd == "G1" && this->dist_E() > 0; };
         bool retracting() const { return this->cmd == "G1" && this->dist_E() < 0; };
         bool travel() const { return this->cmd == "G1" && !this->has('E'); };
-        void set(char arg, std::string value);
+        /// Append raw to out with the value of arg replaced, or with arg
+        /// inserted after the command if the line hasn't got it.
+        void append_with(std::string* out, char arg, const std::string &value) const;
+
+        private:
+        float _values[26];
+        uint32_t _mask;     ///< bit n set if _values[n] was read
+
+        static uint32_t _bit(char arg) { return (arg >= 'A' && arg <= 'Z') ? (uint32_t(1) << (arg - 'A')) : 0; };
+        friend class GCodeReader;
     };
     typedef std::function<void(GCodeReader&, const GCodeLine&)> callback_t;
-    
+
+    /// Walks the lines of a text, for reading G-code without a callback:
+    ///     for (const GCodeReader::GCodeLine &line : reader.lines(gcode)) ...
+    /// Like in a callback, the position of the reader is the one before the
+    /// current line. The line is applied when moving to the next one.
+    class LineIterator {
+        public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef GCodeLine value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const GCodeLine* pointer;
+        typedef const GCodeLine& reference;
+
+        LineIterator() : _reader(nullptr), _line(nullptr), _next(nullptr), _end(nullptr) {};
+        LineIterator(GCodeReader* reader, const char* begin, const char* end);
+
+        const GCodeLine& operator*() const { return this->_line; };
+        const GCodeLine* operator->() const { return &this->_line; };
+        LineIterator& operator++();
+        bool operator==(const LineIterator &other) const {
+            return this->_reader == other._reader && this->_line.raw.data() == other._line.raw.data();
+        };
+        bool operator!=(const LineIterator &other) const { return !(*this == other); };
+
+        private:
+        GCodeReader* _reader;   ///< null past the last line
+        GCodeLine _line;
+        const char* _next;
+        const char* _end;
+
+        void _read_line();
+    };
+
+    /// The lines of gcode, which must outlive the iteration.
+    class Lines {
+        public:
+        Lines(GCodeReader* reader, boost::string_ref gcode) : _reader(reader), _gcode(gcode) {};
+        LineIterator begin() const { return LineIterator(this->_reader, this->_gcode.data(), this->_gcode.data() + this->_gcode.size()); };
+        LineIterator end() const { return LineIterator(); };
+
+        private:
+        GCodeReader* _reader;
+        boost::string_ref _gcode;
+    };
+
     float X, Y, Z, E, F;
     bool verbose;
-    callback_t callback; 
-    
+    callback_t callback;
+
     GCodeReader() : X(0), Y(0), Z(0), E(0), F(0), verbose(false), _extrusion_axis('E') {};
     void apply_config(const PrintConfigBase &config);
+    Lines lines(boost::string_ref gcode) { return Lines(this, gcode); };
     void parse(const std::string &gcode, callback_t callback);
     void parse_stream(std::istream &gcode, callback_t callback);
-    void parse_line(std::string line, callback_t callback);
+    void parse_line(boost::string_ref line, callback_t callback);
+    /// Reads the file by chunks, its size doesn't matter.
     void parse_file(const std::string &file, callback_t callback);
-    
-    private:
+
+    protected:
     GCodeConfig _config;
+
+    private:
     char _extrusion_axis;
+
+    /// Split raw into line and convert its arguments.
+    void _tokenize(boost::string_ref raw, GCodeLine* line);
+    /// Move to the position at the end of line.
+    void _update(const GCodeLine &line);
 };
 
 } /* namespace Slic3r */
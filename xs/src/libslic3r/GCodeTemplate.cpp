@@ -0,0 +1,313 @@
+#include "GCodeTemplate.hpp"
+#include "ConditionalGCode.hpp"
+#include <algorithm>
+#include <sstream>
+#include <exprtk/exprtk.hpp>
+
+namespace Slic3r {
+
+namespace {
+
+/// Marks the place of a variable in the text being compiled, followed by a
+/// letter for the index of the variable.
+const char variable_mark = '\x02';
+const size_t max_variables = 26;
+
+/// A piece of text, or the value of a variable.
+struct Piece {
+    std::string text;
+    int variable;   ///< -1 for text
+};
+typedef std::vector<Piece> Pieces;
+
+void
+replace_all(std::string* str, const std::string &from, const std::string &to)
+{
+    for (size_t pos = 0; (pos = str->find(from, pos)) != std::string::npos; pos += to.length())
+        str->replace(pos, from.length(), to);
+}
+
+/// What apply_math() does to the brackets it escaped or couldn't evaluate.
+std::string
+unescape(std::string str)
+{
+    replace_all(&str, "\x80", "{");
+    replace_all(&str, "\x81", "}");
+    return str;
+}
+
+Pieces
+split_variables(const std::string &text)
+{
+    Pieces pieces;
+    size_t start = 0;
+    for (size_t pos = text.find(variable_mark); pos != std::string::npos; pos = text.find(variable_mark, start)) {
+        if (pos > start) pieces.push_back(Piece { text.substr(start, pos - start), -1 });
+        pieces.push_back(Piece { std::string(), text[pos + 1] - 'A' });
+        start = pos + 2;
+    }
+    if (start < text.size()) pieces.push_back(Piece { text.substr(start), -1 });
+    return pieces;
+}
+
+void
+append(std::string* out, const Pieces &pieces, const std::vector<int> &values)
+{
+    for (const Piece &piece : pieces) {
+        if (piece.variable < 0)
+            *out += piece.text;
+        else
+            *out += std::to_string(values.at(piece.variable));
+    }
+}
+
+/// Whether the variable at pos in the content of an expression is a number
+/// by itself for exprtk, between operators, so that it can be bound to an
+/// exprtk variable: "2[layer_num]" or "[layer_num](" aren't.
+bool
+is_operand(const std::string &content, size_t pos)
+{
+    if (content.find('\'') != std::string::npos) return false;
+    const size_t before {content.find_last_not_of(" \t", pos - 1)};
+    if (pos > 0 && before != std::string::npos && std::string("+-*/%^<>=!&|,(").find(content[before]) == std::string::npos)
+        return false;
+    const size_t after {content.find_first_not_of(" \t", pos + 2)};
+    return after == std::string::npos || std::string("+-*/%^<>=!&|,)").find(content[after]) != std::string::npos;
+}
+
+std::string
+variable_symbol(int variable)
+{
+    return "slic3r_variable_" + std::to_string(variable);
+}
+
+}
+
+struct GCodeTemplate::Program {
+    /// A {} expression, or an {if} when conditional.
+    struct Group {
+        bool conditional;
+        bool constant;
+        std::string result;     ///< of a constant group, before unescape()
+        Pieces content;
+        /// The content compiled with the variables bound to values. When
+        /// exprtk can't compile it, it is evaluated as text.
+        bool compiled {false};
+        std::vector<double> values;
+        exprtk::symbol_table<double> symbols;
+        exprtk::expression<double> expression;
+
+        std::string evaluate(const std::vector<int> &variables);
+    };
+
+    /// The G-code is processed as before, with a copy of parser, when it
+    /// can't be compiled exactly.
+    bool fallback {false};
+    std::string gcode;
+    PlaceholderParser parser;
+    std::vector<std::string> variables;
+
+    /// texts[0], groups[0], texts[1], groups[1]... texts[n].
+    std::vector<Pieces> texts;
+    std::vector<std::unique_ptr<Group>> groups;
+};
+
+std::string
+GCodeTemplate::Program::Group::evaluate(const std::vector<int> &variables)
+{
+    if (this->constant) return this->result;
+
+    bool bound {this->compiled};
+    for (const Piece &piece : this->content) {
+        // exprtk doesn't parse a negative number like a unary minus applied
+        // to a variable
+        if (piece.variable >= 0 && variables.at(piece.variable) < 0) bound = false;
+    }
+    if (bound) {
+        for (const Piece &piece : this->content)
+            if (piece.variable >= 0) this->values[piece.variable] = variables.at(piece.variable);
+        // formatted like Slic3r::evaluate()
+        std::stringstream result;
+        result << this->expression.value();
+        return result.str();
+    }
+    std::string text;
+    append(&text, this->content, variables);
+    return Slic3r::evaluate(text);
+}
+
+GCodeTemplate::GCodeTemplate(const std::string &gcode, const PlaceholderParser &parser, const std::vector<std::string> &variables)
+    : _program(std::make_shared<Program>())
+{
+    Program &program = *this->_program;
+    program.variables = variables;
+
+    // Substitute the placeholders the way PlaceholderParser::process() does,
+    // in a single pass. It replaces one placeholder after the other in the
+    // whole text, so a value that makes another placeholder is replaced again:
+    // those are left to the fallback.
+    bool exact {gcode.find(variable_mark) == std::string::npos && variables.size() <= max_variables};
+    std::string text;
+    for (size_t pos = 0; exact && pos < gcode.size(); ) {
+        const size_t open {gcode.find('[', pos)};
+        const size_t close {open == std::string::npos ? open : gcode.find_first_of("[]", open + 1)};
+        if (close == std::string::npos) {
+            text.append(gcode, pos, std::string::npos);
+            break;
+        }
+        text.append(gcode, pos, open - pos);
+        if (gcode[close] == '[') {
+            // [ in the name: the placeholder starts at the next one
+            text.append(gcode, open, close - open);
+            pos = close;
+            continue;
+        }
+        const std::string name {gcode.substr(open + 1, close - open - 1)};
+        pos = close + 1;
+        const bool enclosed {(open > 0 && gcode[open - 1] == '[') || (pos < gcode.size() && gcode[pos] == ']')};
+
+        const std::string* value {nullptr};
+        const auto variable = std::find(variables.begin(), variables.end(), name);
+        const auto single = parser._single.find(name);
+        if (variable != variables.end()) {
+            if (enclosed) exact = false;
+            text += variable_mark;
+            text += static_cast<char>('A' + (variable - variables.begin()));
+            continue;
+        } else if (single != parser._single.end()) {
+            value = &single->second;
+        } else {
+            // [key_i] for a placeholder with multiple values, the first value
+            // when i is past the end and all the previous ones were there
+            const size_t underscore {name.rfind('_')};
+            if (underscore != std::string::npos && underscore + 1 < name.size()
+                && name.find_first_not_of("0123456789", underscore + 1) == std::string::npos) {
+                const std::string key {name.substr(0, underscore)};
+                const std::string digits {name.substr(underscore + 1)};
+                const auto multiple = parser._multiple.find(key);
+                if (multiple != parser._multiple.end() && digits.size() < 10 && (digits == "0" || digits[0] != '0')
+                    && std::find(variables.begin(), variables.end(), key) == variables.end()) {
+                    const std::vector<std::string> &values = multiple->second;
+                    const size_t index {std::stoul(digits)};
+                    bool found {index < values.size()};
+                    for (size_t i = values.size() - 1; !found && i < index; ++i) {
+                        if (gcode.find("[" + key + "_" + std::to_string(i) + "]") == std::string::npos) break;
+                        if (i + 1 == index) found = true;
+                    }
+                    if (found) value = index < values.size() ? &values[index] : &values.front();
+                }
+            }
+        }
+        if (value == nullptr) {
+            text.append(gcode, open, pos - open);
+        } else {
+            if (enclosed || value->find_first_of(std::string("[]") + variable_mark) != std::string::npos) exact = false;
+            text += *value;
+        }
+    }
+    if (!exact) {
+        program.fallback = true;
+        program.gcode = gcode;
+        program.parser = parser;
+        return;
+    }
+
+    // What apply_math() and expression() do, for {} that aren't nested. They
+    // start from the last one, and an {if} that is false drops the rest of the
+    // line as it is by then.
+    const std::string substituted {text};
+    replace_all(&text, "\\{", "\x80");
+    replace_all(&text, "\\}", "\x81");
+    const bool has_variables {text.find(variable_mark) != std::string::npos};
+    if (std::count(text.begin(), text.end(), '{') != std::count(text.begin(), text.end(), '}')) {
+        // left as is
+        program.texts.push_back(split_variables(unescape(text)));
+        return;
+    }
+    bool flat {true};
+    for (size_t pos = 0; flat && pos < text.size(); ) {
+        const size_t open {text.find_first_of("{}", pos)};
+        if (open == std::string::npos) break;
+        const size_t close {text.find_first_of("{}\n", open + 1)};
+        flat = text[open] == '{' && close != std::string::npos && text[close] == '}';
+        pos = close + 1;
+    }
+    if (!flat) {
+        if (has_variables) {
+            program.fallback = true;
+            program.gcode = gcode;
+            program.parser = parser;
+        } else {
+            program.texts.push_back(Pieces { Piece { apply_math(substituted), -1 } });
+        }
+        return;
+    }
+
+    size_t start {0};
+    for (size_t open = text.find('{'); open != std::string::npos; open = text.find('{', start)) {
+        const size_t close {text.find('}', open)};
+        program.texts.push_back(split_variables(unescape(text.substr(start, open - start))));
+        start = close + 1;
+
+        program.groups.emplace_back(new Program::Group());
+        Program::Group &group = *program.groups.back();
+        group.conditional = text.compare(open, 3, "{if") == 0;
+        const size_t begin {open + (group.conditional ? 3 : 1)};
+        const std::string content {text.substr(begin, close - begin)};
+        group.constant = content.find(variable_mark) == std::string::npos;
+        if (group.constant) {
+            group.result = Slic3r::evaluate(content);
+            continue;
+        }
+        group.content = split_variables(content);
+
+        // the variables as exprtk variables, where they are numbers by themselves
+        bool bindable {true};
+        for (size_t pos = content.find(variable_mark); bindable && pos != std::string::npos; pos = content.find(variable_mark, pos + 2))
+            bindable = is_operand(content, pos);
+        if (!bindable) continue;
+        std::string expression;
+        for (const Piece &piece : group.content)
+            expression += piece.variable < 0 ? piece.text : variable_symbol(piece.variable);
+        group.values.assign(variables.size(), 0.);
+        group.symbols.add_constants();
+        for (const Piece &piece : group.content)
+            if (piece.variable >= 0 && !group.symbols.symbol_exists(variable_symbol(piece.variable)))
+                group.symbols.add_variable(variable_symbol(piece.variable), group.values[piece.variable]);
+        group.expression.register_symbol_table(group.symbols);
+        exprtk::parser<double> exprtk_parser;
+        group.compiled = exprtk_parser.compile(expression, group.expression);
+    }
+    program.texts.push_back(split_variables(unescape(text.substr(start))));
+}
+
+std::string
+GCodeTemplate::process(const std::vector<int> &values) const
+{
+    Program &program = *this->_program;
+    if (program.fallback) {
+        PlaceholderParser parser {program.parser};
+        for (size_t i = 0; i < program.variables.size(); ++i)
+            parser.set(program.variables[i], values.at(i));
+        return apply_math(parser.process(program.gcode));
+    }
+
+    std::string gcode;
+    append(&gcode, program.texts.back(), values);
+    for (size_t i = program.groups.size(); i-- > 0; ) {
+        Program::Group &group = *program.groups[i];
+        const std::string result {group.evaluate(values)};
+        if (!group.conditional) {
+            gcode.insert(0, unescape(result));
+        } else if (result == "0") {
+            const size_t newline {gcode.find('\n')};
+            gcode.erase(0, newline == std::string::npos ? newline : newline + 1);
+        }
+        std::string text;
+        append(&text, program.texts[i], values);
+        gcode.insert(0, text);
+    }
+    return gcode;
+}
+
+}
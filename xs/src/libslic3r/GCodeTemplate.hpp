@@ -0,0 +1,42 @@
+#ifndef slic3r_GCodeTemplate_hpp_
+#define slic3r_GCodeTemplate_hpp_
+
+#include "libslic3r.h"
+#include "PlaceholderParser.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Slic3r {
+
+/// Custom G-code compiled once to be expanded many times, like layer_gcode on
+/// every layer. Processing it gives the same as apply_math(parser.process())
+/// on a copy of the parser where the variables are set, without copying the
+/// parser nor scanning the G-code for each of its placeholders every time:
+/// the placeholders other than the variables are substituted when compiling,
+/// the {} expressions without variables are computed then and the others are
+/// compiled by exprtk with the variables bound to them.
+class GCodeTemplate
+{
+    public:
+    GCodeTemplate() {};
+    /// Compile gcode with the placeholders parser has now, except the
+    /// variables, whose values are given to process().
+    GCodeTemplate(const std::string &gcode, const PlaceholderParser &parser, const std::vector<std::string> &variables);
+
+    bool compiled() const { return this->_program != nullptr; };
+
+    /// Expand the template with the values of the variables, in order. They
+    /// are integers, like PlaceholderParser::set(key, int) takes them.
+    /// The values are bound to the compiled expressions, so a template can't
+    /// be processed by several threads at once.
+    std::string process(const std::vector<int> &values) const;
+
+    private:
+    struct Program;
+    std::shared_ptr<Program> _program;
+};
+
+}
+
+#endif
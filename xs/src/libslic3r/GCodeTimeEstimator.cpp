@@ -1,27 +1,112 @@
 #include "GCodeTimeEstimator.hpp"
 #include <boost/bind.hpp>
+#include <algorithm>
 #include <cmath>
 
 namespace Slic3r {
 
+namespace {
+
+/// The planner never plans below this speed at the ends of the moves (Marlin's MINIMUM_PLANNER_SPEED).
+const double minimum_planner_speed = 0.05;
+/// Speed of the moves before the first F, in mm/s, as in Marlin.
+const double default_feedrate = 25;
+
+/// Time to cover distance accelerating from entry_speed to nominal_speed,
+/// cruising, then decelerating to exit_speed. A move too short to reach the
+/// nominal speed peaks where the acceleration and the deceleration meet.
+double
+trapezoid_time(double distance, double entry_speed, double nominal_speed, double exit_speed, double acceleration)
+{
+    if (acceleration <= 0)
+        return distance / nominal_speed;
+    const double inverse_acceleration = 1. / acceleration;
+    // distance taken to accelerate to the nominal speed and to decelerate from it
+    const double ramps_distance = (2. * nominal_speed * nominal_speed - entry_speed * entry_speed - exit_speed * exit_speed)
+        * 0.5 * inverse_acceleration;
+    if (ramps_distance <= distance)
+        return (2. * nominal_speed - entry_speed - exit_speed) * inverse_acceleration
+            + (distance - ramps_distance) / nominal_speed;
+    const double peak_speed = std::max(std::max(entry_speed, exit_speed),
+        std::sqrt((2. * acceleration * distance + entry_speed * entry_speed + exit_speed * exit_speed) * 0.5));
+    return (2. * peak_speed - entry_speed - exit_speed) * inverse_acceleration;
+}
+
+}
+
+GCodeTimeEstimator::GCodeTimeEstimator(Mode mode)
+    : mode(mode), _first_block(0), _blocks_count(0),
+      _previous_nominal_speed(0), _previous_safe_speed(0), _total_time(0),
+      _layer_has_extrusion(false)
+{
+    for (double &speed : this->_previous_speed) speed = 0;
+    this->_role_extrusion  = this->_role("extrusion");
+    this->_role_travel     = this->_role("travel");
+    this->_role_retraction = this->_role("retraction");
+    this->_role_dwell      = this->_role("dwell");
+    this->_comment_role    = this->_role_extrusion;
+    this->_apply_limits();
+}
+
+void
+GCodeTimeEstimator::apply_config(const PrintConfigBase &config)
+{
+    GCodeReader::apply_config(config);
+    this->_apply_limits();
+}
+
+void
+GCodeTimeEstimator::_apply_limits()
+{
+    const GCodeConfig &c = this->_config;
+    this->_max_feedrate[X] = c.machine_max_feedrate_x;
+    this->_max_feedrate[Y] = c.machine_max_feedrate_y;
+    this->_max_feedrate[Z] = c.machine_max_feedrate_z;
+    this->_max_feedrate[E] = c.machine_max_feedrate_e;
+    this->_max_acceleration[X] = c.machine_max_acceleration_x;
+    this->_max_acceleration[Y] = c.machine_max_acceleration_y;
+    this->_max_acceleration[Z] = c.machine_max_acceleration_z;
+    this->_max_acceleration[E] = c.machine_max_acceleration_e;
+    this->_max_jerk[X] = c.machine_max_jerk_x;
+    this->_max_jerk[Y] = c.machine_max_jerk_y;
+    this->_max_jerk[Z] = c.machine_max_jerk_z;
+    this->_max_jerk[E] = c.machine_max_jerk_e;
+    this->_acceleration_extruding  = c.machine_max_acceleration_extruding;
+    this->_acceleration_retracting = c.machine_max_acceleration_retracting;
+    this->_acceleration_travel     = c.machine_max_acceleration_travel;
+}
+
 void
 GCodeTimeEstimator::parse(const std::string &gcode)
 {
-    GCodeReader::parse(gcode, boost::bind(&GCodeTimeEstimator::_parser, this, _1, _2));
+    if (this->mode == emSimple) {
+        GCodeReader::parse(gcode, boost::bind(&GCodeTimeEstimator::_parser, this, _1, _2));
+        return;
+    }
+    for (const GCodeLine &line : this->lines(gcode))
+        this->_plan(line);
+    this->_synchronize();
+    this->_publish_times();
 }
 
 void
 GCodeTimeEstimator::parse_file(const std::string &file)
 {
-    GCodeReader::parse_file(file, boost::bind(&GCodeTimeEstimator::_parser, this, _1, _2));
+    if (this->mode == emSimple) {
+        GCodeReader::parse_file(file, boost::bind(&GCodeTimeEstimator::_parser, this, _1, _2));
+        return;
+    }
+    GCodeReader::parse_file(file, [this](GCodeReader&, const GCodeLine &line) { this->_plan(line); });
+    this->_synchronize();
+    this->_publish_times();
 }
 
 void
 GCodeTimeEstimator::_parser(GCodeReader&, const GCodeReader::GCodeLine &line)
 {
     // std::cout << "[" << this->time << "] " << line.raw << std::endl;
-    if (line.cmd == "G1") {
-        const float dist_XY = line.dist_XY();
+    if (line.cmd == "G1" || line.cmd == "G2" || line.cmd == "G3") {
+        const float dist_XY = line.cmd == "G1" ? line.dist_XY() : line.dist_arc();
         const float new_F = line.new_F();
         
         if (dist_XY > 0) {
@@ -71,4 +156,238 @@ GCodeTimeEstimator::_accelerated_move(double length, double v, double accelerati
     return 2.0*t; // cut in half before, so double to get full time spent.
 }
 
+void
+GCodeTimeEstimator::_plan(const GCodeReader::GCodeLine &line)
+{
+    const boost::string_ref &cmd = line.cmd;
+    if (cmd == "G1" || cmd == "G0" || cmd == "G2" || cmd == "G3") {
+        this->_queue_move(line);
+    } else if (cmd == "G4") {
+        // dwells wait for the moves to end
+        this->_synchronize();
+        const double seconds = line.has('S') ? line.get_float('S') : line.get_float('P') / 1000.;
+        this->_add_time(seconds, this->layer_times.empty() ? 0 : this->layer_times.size() - 1, this->_role_dwell);
+    } else if (cmd == "M109" || cmd == "M190") {
+        // so do waits for temperatures, which take no time here
+        this->_synchronize();
+    } else if (cmd == "M204") {
+        // S sets both the printing and the travel accelerations
+        if (line.has('S')) this->_acceleration_extruding = this->_acceleration_travel = line.get_float('S');
+        if (line.has('P')) this->_acceleration_extruding = line.get_float('P');
+        if (line.has('R')) this->_acceleration_retracting = line.get_float('R');
+        if (line.has('T')) this->_acceleration_travel = line.get_float('T');
+    } else if (cmd == "M201" || cmd == "M203" || cmd == "M205" || cmd == "M566") {
+        // per axis acceleration, feedrate and jerk; RepRapFirmware's M566 jerk is in mm/min
+        double* limits = cmd == "M201" ? this->_max_acceleration : cmd == "M203" ? this->_max_feedrate : this->_max_jerk;
+        const double factor = cmd == "M566" ? 1. / 60. : 1.;
+        const char axes[NUM_AXES] = { 'X', 'Y', 'Z', 'E' };
+        for (int axis = 0; axis < NUM_AXES; ++axis)
+            if (line.has(axes[axis])) limits[axis] = line.get_float(axes[axis]) * factor;
+    }
+}
+
+void
+GCodeTimeEstimator::_queue_move(const GCodeReader::GCodeLine &line)
+{
+    const double delta[NUM_AXES] = { line.dist_X(), line.dist_Y(), line.dist_Z(), line.dist_E() };
+    const bool extruder_only = delta[X] == 0 && delta[Y] == 0 && delta[Z] == 0;
+    if (extruder_only && delta[E] == 0) return;
+
+    Block block;
+    // arcs go along their length, with the speeds of the axes taken along
+    // their chord
+    const double dist_XY = (line.cmd == "G2" || line.cmd == "G3") ? line.dist_arc()
+        : std::sqrt(delta[X] * delta[X] + delta[Y] * delta[Y]);
+    block.distance = extruder_only
+        ? std::abs(delta[E])
+        : std::sqrt(dist_XY * dist_XY + delta[Z] * delta[Z]);
+
+    // limit the speed so that no axis goes over its max feedrate
+    double speed = line.new_F() / 60.;
+    if (speed <= 0) speed = default_feedrate;
+    const double inverse_distance = 1. / block.distance;
+    double current_speed[NUM_AXES];
+    double speed_factor = 1;
+    for (int axis = 0; axis < NUM_AXES; ++axis) {
+        current_speed[axis] = delta[axis] * speed * inverse_distance;
+        if (this->_max_feedrate[axis] > 0 && std::abs(current_speed[axis]) > this->_max_feedrate[axis])
+            speed_factor = std::min(speed_factor, this->_max_feedrate[axis] / std::abs(current_speed[axis]));
+    }
+    if (speed_factor < 1) {
+        speed *= speed_factor;
+        for (double &s : current_speed) s *= speed_factor;
+    }
+    block.nominal_speed = speed;
+
+    // and so that no axis goes over its max acceleration
+    double acceleration = extruder_only ? this->_acceleration_retracting
+        : delta[E] != 0 ? this->_acceleration_extruding : this->_acceleration_travel;
+    for (int axis = 0; axis < NUM_AXES; ++axis)
+        if (delta[axis] != 0 && this->_max_acceleration[axis] > 0
+            && acceleration * std::abs(delta[axis]) * inverse_distance > this->_max_acceleration[axis])
+            acceleration = this->_max_acceleration[axis] * block.distance / std::abs(delta[axis]);
+    block.acceleration = acceleration;
+    block.speed_change_sqr = 2. * acceleration * block.distance;
+
+    // speed at which the move can start from and end to a stop
+    double safe_speed = speed;
+    bool limited = false;
+    for (int axis = 0; axis < NUM_AXES; ++axis) {
+        const double jerk = std::abs(current_speed[axis]);
+        const double max_jerk = this->_max_jerk[axis];
+        if (jerk > max_jerk) {
+            if (limited) {
+                if (jerk * safe_speed > max_jerk * speed) safe_speed = max_jerk * speed / jerk;
+            } else {
+                limited = true;
+                safe_speed = max_jerk;
+            }
+        }
+    }
+
+    // highest speed at the junction with the previous move that keeps the
+    // speed change of every axis within its jerk
+    double max_junction_speed = safe_speed;
+    if (this->_blocks_count > 0 && this->_previous_nominal_speed > 0) {
+        max_junction_speed = std::min(speed, this->_previous_nominal_speed);
+        const double smaller_speed_factor = max_junction_speed / this->_previous_nominal_speed;
+        double v_factor = 1;
+        limited = false;
+        for (int axis = 0; axis < NUM_AXES; ++axis) {
+            double v_exit = this->_previous_speed[axis] * smaller_speed_factor;
+            double v_entry = current_speed[axis];
+            if (limited) {
+                v_exit *= v_factor;
+                v_entry *= v_factor;
+            }
+            // coasting on, reversing, or coming to a stop
+            const double jerk = v_exit > v_entry
+                ? ((v_entry > 0 || v_exit < 0) ? v_exit - v_entry : std::max(v_exit, -v_entry))
+                : ((v_entry < 0 || v_exit > 0) ? v_entry - v_exit : std::max(-v_exit, v_entry));
+            if (jerk > this->_max_jerk[axis]) {
+                v_factor *= this->_max_jerk[axis] / jerk;
+                limited = true;
+            }
+        }
+        if (limited) max_junction_speed *= v_factor;
+        // separate stops and starts may be faster than a shared junction speed
+        const double threshold = max_junction_speed * 0.99;
+        if (this->_previous_safe_speed > threshold && safe_speed > threshold)
+            max_junction_speed = safe_speed;
+    }
+    // and from which it can stop within its length
+    block.max_entry_speed_sqr = max_junction_speed * max_junction_speed;
+    const double allowable_speed_sqr = minimum_planner_speed * minimum_planner_speed + block.speed_change_sqr;
+    block.entry_speed_sqr = std::min(block.max_entry_speed_sqr, allowable_speed_sqr);
+    block.nominal_length = speed * speed <= allowable_speed_sqr;
+
+    const bool extruding = !extruder_only && delta[E] > 0;
+    block.layer = this->_layer(line, extruding);
+    // the extrusions of a feature come in a row, with the same comment
+    if (extruding && line.comment != this->_comment) {
+        this->_comment.assign(line.comment.data(), line.comment.size());
+        this->_comment_role = this->_role(line.comment);
+    }
+    block.role = extruding ? this->_comment_role
+        : delta[E] != 0 ? this->_role_retraction : this->_role_travel;
+
+    std::copy(current_speed, current_speed + NUM_AXES, this->_previous_speed);
+    this->_previous_nominal_speed = speed;
+    this->_previous_safe_speed = safe_speed;
+
+    if (this->_blocks_count == planner_buffer_size)
+        this->_execute_block();
+    this->_block(this->_blocks_count++) = block;
+
+    // Reverse pass: the new block lets the ones before it end faster. The
+    // first block is left alone, it starts at the end speed of the last
+    // executed one. An unchanged block leaves the ones before it unchanged.
+    for (size_t i = this->_blocks_count - 1; i-- > 1; ) {
+        Block &current = this->_block(i);
+        const Block &next = this->_block(i + 1);
+        if (current.entry_speed_sqr == current.max_entry_speed_sqr) break;
+        const double entry_speed_sqr = (!current.nominal_length && current.max_entry_speed_sqr > next.entry_speed_sqr)
+            ? std::min(current.max_entry_speed_sqr, next.entry_speed_sqr + current.speed_change_sqr)
+            : current.max_entry_speed_sqr;
+        if (entry_speed_sqr == current.entry_speed_sqr) break;
+        current.entry_speed_sqr = entry_speed_sqr;
+    }
+}
+
+void
+GCodeTimeEstimator::_execute_block()
+{
+    const Block &block = this->_block(0);
+    double exit_speed = minimum_planner_speed;
+    if (this->_blocks_count > 1) {
+        // forward pass: the next block can't start faster than this one can accelerate to
+        Block &next = this->_block(1);
+        if (!block.nominal_length && block.entry_speed_sqr < next.entry_speed_sqr)
+            next.entry_speed_sqr = std::min(next.entry_speed_sqr, block.entry_speed_sqr + block.speed_change_sqr);
+        exit_speed = std::sqrt(next.entry_speed_sqr);
+    }
+    this->_add_time(trapezoid_time(block.distance, std::sqrt(block.entry_speed_sqr), block.nominal_speed, exit_speed, block.acceleration),
+        block.layer, block.role);
+    this->_first_block = (this->_first_block + 1) % planner_buffer_size;
+    --this->_blocks_count;
+}
+
+void
+GCodeTimeEstimator::_synchronize()
+{
+    while (this->_blocks_count > 0)
+        this->_execute_block();
+}
+
+void
+GCodeTimeEstimator::_add_time(double seconds, size_t layer, size_t role)
+{
+    this->_total_time += seconds;
+    if (layer < this->layer_times.size())
+        this->layer_times[layer].time += seconds;
+    this->_role_time[role] += seconds;
+}
+
+size_t
+GCodeTimeEstimator::_role(boost::string_ref name)
+{
+    while (!name.empty() && name.front() == ' ') name.remove_prefix(1);
+    while (!name.empty() && name.back() == ' ') name.remove_suffix(1);
+    if (name.empty()) return this->_role_extrusion;
+    // the same few roles come over and over
+    for (size_t i = 0; i < this->_roles.size(); ++i)
+        if (this->_roles[i] == name) return i;
+    this->_roles.push_back(name.to_string());
+    this->_role_time.push_back(0);
+    return this->_roles.size() - 1;
+}
+
+size_t
+GCodeTimeEstimator::_layer(const GCodeReader::GCodeLine &line, bool extruding)
+{
+    if (this->layer_times.empty()) {
+        this->layer_times.push_back(LayerTime { line.new_Z(), 0 });
+        this->_layer_has_extrusion = false;
+    }
+    if (extruding) {
+        const float z = line.new_Z();
+        if (!this->_layer_has_extrusion) {
+            this->layer_times.back().print_z = z;
+            this->_layer_has_extrusion = true;
+        } else if (std::abs(z - this->layer_times.back().print_z) > EPSILON) {
+            this->layer_times.push_back(LayerTime { z, 0 });
+        }
+    }
+    return this->layer_times.size() - 1;
+}
+
+void
+GCodeTimeEstimator::_publish_times()
+{
+    this->time = float(this->_total_time);
+    for (size_t i = 0; i < this->_roles.size(); ++i)
+        if (this->_role_time[i] > 0)
+            this->role_times[this->_roles[i]] = this->_role_time[i];
+}
+
 }
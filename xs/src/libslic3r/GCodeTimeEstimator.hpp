@@ -3,20 +3,100 @@
 
 #include "libslic3r.h"
 #include "GCodeReader.hpp"
+#include <map>
+#include <string>
+#include <vector>
 
 namespace Slic3r {
 
 class GCodeTimeEstimator : public GCodeReader {
     public:
+    enum Mode {
+        /// Each move on its own, at the last M204 acceleration.
+        emSimple,
+        /// The moves go through a look-ahead planner like the one of Marlin
+        /// and RepRapFirmware, within the machine_max_* limits of the config
+        /// and the M201, M203, M204 and M205 commands of the G-code.
+        emPlanner,
+    };
+
+    struct LayerTime {
+        float print_z;
+        double time;    ///< seconds
+    };
+
     float time = 0;  // in seconds
-    
+    Mode mode = emSimple;
+    /// With emPlanner, the time spent on each layer, in printing order. A
+    /// layer starts with the first extrusion at a new Z.
+    std::vector<LayerTime> layer_times;
+    /// With emPlanner, the time spent per role: the comment of the
+    /// extrusions as written with gcode_comments, "extrusion" without a
+    /// comment, "travel", "retraction" and "dwell".
+    std::map<std::string, double> role_times;
+
+    GCodeTimeEstimator(Mode mode = emSimple);
+    void apply_config(const PrintConfigBase &config);
     void parse(const std::string &gcode);
     void parse_file(const std::string &file);
-    
+
     protected:
     float acceleration = 9000;
     void _parser(GCodeReader&, const GCodeReader::GCodeLine &line);
     static float _accelerated_move(double length, double v, double acceleration);
+
+    private:
+    enum Axis { X, Y, Z, E, NUM_AXES };
+
+    /// A move in the planner buffer. The entry speeds are kept squared, so
+    /// that planning them takes no square root.
+    struct Block {
+        double distance;        ///< mm, along XYZ or along E for extruder-only moves
+        double nominal_speed;   ///< mm/s
+        double acceleration;    ///< mm/s²
+        double speed_change_sqr;        ///< 2 * acceleration * distance
+        double max_entry_speed_sqr;     ///< allowed by the jerk at the junction with the previous block
+        double entry_speed_sqr;
+        bool nominal_length;    ///< the nominal speed is reached even from a stop
+        size_t layer;
+        size_t role;
+    };
+
+    // limits, per axis
+    double _max_feedrate[NUM_AXES];
+    double _max_acceleration[NUM_AXES];
+    double _max_jerk[NUM_AXES];
+    double _acceleration_extruding, _acceleration_retracting, _acceleration_travel;
+
+    /// Number of moves the firmware plans ahead (Marlin's BLOCK_BUFFER_SIZE).
+    static const size_t planner_buffer_size = 16;
+    /// Ring buffer of the planned moves, _blocks_count of them from _first_block.
+    Block _blocks[planner_buffer_size];
+    size_t _first_block, _blocks_count;
+    double _previous_speed[NUM_AXES];   ///< of the last block queued, per axis
+    double _previous_nominal_speed;
+    double _previous_safe_speed;
+    double _total_time;
+    std::vector<std::string> _roles;
+    std::vector<double> _role_time;
+    size_t _role_extrusion, _role_travel, _role_retraction, _role_dwell;
+    std::string _comment;   ///< of the last extrusion
+    size_t _comment_role;
+    bool _layer_has_extrusion;
+
+    void _apply_limits();
+    Block& _block(size_t i) { return this->_blocks[(this->_first_block + i) % planner_buffer_size]; };
+    void _plan(const GCodeReader::GCodeLine &line);
+    /// Queue a move, executing the oldest block if the buffer is full.
+    void _queue_move(const GCodeReader::GCodeLine &line);
+    /// Execute the oldest block, with the plan of the blocks after it.
+    void _execute_block();
+    /// Execute all the blocks, the last one ending with a stop.
+    void _synchronize();
+    void _add_time(double seconds, size_t layer, size_t role);
+    size_t _role(boost::string_ref name);
+    size_t _layer(const GCodeReader::GCodeLine &line, bool extruding);
+    void _publish_times();
 };
 
 } /* namespace Slic3r */
@@ -1,19 +1,22 @@
 #include "GCodeWriter.hpp"
+#include "GCodeEmitter.hpp"
 #include "utils.hpp"
 #include <algorithm>
-#include <iomanip>
-#include <iostream>
+#include <cmath>
 #include <map>
 
 #define FLAVOR_IS(val) this->config.gcode_flavor == val
 #define FLAVOR_IS_NOT(val) this->config.gcode_flavor != val
 #define COMMENT(comment) if (this->config.gcode_comments && !comment.empty()) gcode << " ; " << comment;
-#define PRECISION(val, precision) std::fixed << std::setprecision(precision) << val
+#define PRECISION(val, precision) GCodeEmitter::fixed(val, precision)
 #define XYZF_NUM(val) PRECISION(val, 3)
 #define E_NUM(val) PRECISION(val, 5)
 
 namespace Slic3r {
 
+/// Stands for an E value left out with relocatable_E, a byte no command has.
+static const std::string relocated_E_mark {"\x01"};
+
 void
 GCodeWriter::apply_print_config(const PrintConfig &print_config)
 {
@@ -24,7 +27,8 @@ GCodeWriter::apply_print_config(const PrintConfig &print_config)
 std::string
 GCodeWriter::notes() 
 {
-    std::ostringstream gcode;
+    std::string out;
+    GCodeEmitter gcode(&out);
 
     // Write the contents of the three notes sections
     // a semicolon at the beginning of each line.
@@ -57,14 +61,15 @@ GCodeWriter::notes()
         gcode << "; \n";
     }
 
-    return gcode.str();
+    return out;
 }
 
 
 std::string
 GCodeWriter::preamble()
 {
-    std::ostringstream gcode;
+    std::string out;
+    GCodeEmitter gcode(&out);
 
     if (FLAVOR_IS_NOT(gcfMakerWare)) {
         gcode << "G21 ; set units to millimeters\n";
@@ -76,20 +81,21 @@ GCodeWriter::preamble()
         } else {
             gcode << "M82 ; use absolute distances for extrusion\n";
         }
-        gcode << this->reset_e(true);
+        this->reset_e(&out, true);
     }
 
 
-    return gcode.str();
+    return out;
 }
 
 std::string
 GCodeWriter::postamble() const
 {
-    std::ostringstream gcode;
+    std::string out;
+    GCodeEmitter gcode(&out);
     if (FLAVOR_IS(gcfMachinekit))
           gcode << "M2 ; end of program\n";
-    return gcode.str();
+    return out;
 }
 
 std::string
@@ -105,7 +111,8 @@ GCodeWriter::set_temperature(unsigned int temperature, bool wait, int tool) cons
         comment = "set temperature";
     }
     
-    std::ostringstream gcode;
+    std::string out;
+    GCodeEmitter gcode(&out);
     gcode << code << " ";
     if (FLAVOR_IS(gcfMach3) || FLAVOR_IS(gcfMachinekit)) {
         gcode << "P";
@@ -124,7 +131,7 @@ GCodeWriter::set_temperature(unsigned int temperature, bool wait, int tool) cons
     if (wait && tool !=-1 && (FLAVOR_IS(gcfMakerWare) || FLAVOR_IS(gcfSailfish)))
         gcode << "M6 T" << tool << " ; wait for temperature to be reached\n";
     
-    return gcode.str();
+    return out;
 }
 
 std::string
@@ -144,7 +151,8 @@ GCodeWriter::set_bed_temperature(unsigned int temperature, bool wait) const
         comment = "set bed temperature";
     }
     
-    std::ostringstream gcode;
+    std::string out;
+    GCodeEmitter gcode(&out);
     gcode << code << " ";
     if (FLAVOR_IS(gcfMach3) || FLAVOR_IS(gcfMachinekit)) {
         gcode << "P";
@@ -156,13 +164,14 @@ GCodeWriter::set_bed_temperature(unsigned int temperature, bool wait) const
     if (FLAVOR_IS(gcfTeacup) && wait)
         gcode << "M116 ; wait for bed temperature to be reached\n";
     
-    return gcode.str();
+    return out;
 }
 
 std::string
 GCodeWriter::set_fan(unsigned int speed, bool dont_save)
 {
-    std::ostringstream gcode;
+    std::string out;
+    GCodeEmitter gcode(&out);
     if (this->_last_fan_speed != speed || dont_save) {
         if (!dont_save) this->_last_fan_speed = speed;
         
@@ -192,18 +201,18 @@ GCodeWriter::set_fan(unsigned int speed, bool dont_save)
             gcode << "\n";
         }
     }
-    return gcode.str();
+    return out;
 }
 
-std::string
-GCodeWriter::set_acceleration(unsigned int acceleration)
+void
+GCodeWriter::set_acceleration(std::string* out, unsigned int acceleration)
 {
     if (acceleration == 0 || acceleration == this->_last_acceleration)
-        return "";
+        return;
     
     this->_last_acceleration = acceleration;
     
-    std::ostringstream gcode;
+    GCodeEmitter gcode(out);
     if (FLAVOR_IS(gcfRepetier) || (FLAVOR_IS(gcfRepRap))) {
         gcode << "M201 X" << acceleration << " Y" << acceleration;
         if (this->config.gcode_comments) gcode << " ; adjust acceleration";
@@ -218,31 +227,29 @@ GCodeWriter::set_acceleration(unsigned int acceleration)
     }
     if (this->config.gcode_comments) gcode << " ; adjust acceleration";
     gcode << "\n";
-    
-    return gcode.str();
 }
 
-std::string
-GCodeWriter::reset_e(bool force)
+void
+GCodeWriter::reset_e(std::string* out, bool force)
 {
     if (FLAVOR_IS(gcfMach3)
         || FLAVOR_IS(gcfMakerWare)
         || FLAVOR_IS(gcfSailfish))
-        return "";
+        return;
     
     if (this->_extruder != NULL) {
-        if (this->_extruder->E == 0 && !force) return "";
-        this->_extruder->E = 0;
+        if (!force && this->relocatable_E)
+            this->relocated_E.push_back(RelocatedE { this->_extruder->id, this->_extruder->E_steps.size(),
+                this->_extruder->E == 0 ? RelocatedE::IsZero : RelocatedE::IsNotZero });
+        if (this->_extruder->E == 0 && !force) return;
+        this->_extruder->reset_E();
     }
     
     if (!this->_extrusion_axis.empty() && !this->config.use_relative_e_distances) {
-        std::ostringstream gcode;
+        GCodeEmitter gcode(out);
         gcode << "G92 " << this->_extrusion_axis << "0";
         if (this->config.gcode_comments) gcode << " ; reset extrusion distance";
         gcode << "\n";
-        return gcode.str();
-    } else {
-        return "";
     }
 }
 
@@ -255,11 +262,12 @@ GCodeWriter::update_progress(unsigned int num, unsigned int tot, bool allow_100)
     unsigned int percent = 100.0 * num / tot;
     if (!allow_100) percent = std::min(percent, (unsigned int)99);
     
-    std::ostringstream gcode;
+    std::string out;
+    GCodeEmitter gcode(&out);
     gcode << "M73 P" << percent;
     if (this->config.gcode_comments) gcode << " ; update progress";
     gcode << "\n";
-    return gcode.str();
+    return out;
 }
 
 bool
@@ -279,13 +287,14 @@ GCodeWriter::set_extruder(unsigned int extruder_id)
 std::string
 GCodeWriter::toolchange(unsigned int extruder_id)
 {
-    std::ostringstream gcode;
+    std::string out;
+    GCodeEmitter gcode(&out);
     
     // set the new extruder
     this->_extruder = &this->extruders.find(extruder_id)->second;
     
     //first thing to do : reset E (because a new item is now printed or with a new extruder)
-    gcode << this->reset_e(true);
+    this->reset_e(&out, true);
     
     // return the toolchange command
     // if we are running a single-extruder setup, just set the extruder and return nothing
@@ -301,38 +310,36 @@ GCodeWriter::toolchange(unsigned int extruder_id)
         if (this->config.gcode_comments) gcode << " ; change extruder";
         gcode << "\n";
     }
-    return gcode.str();
+    return out;
 }
 
-std::string
-GCodeWriter::set_speed(double F, const std::string &comment,
+void
+GCodeWriter::set_speed(std::string* out, double F, const std::string &comment,
                        const std::string &cooling_marker) const
 {
-    std::ostringstream gcode;
+    GCodeEmitter gcode(out);
     gcode << "G1 F" << F;
     COMMENT(comment);
     gcode << cooling_marker;
     gcode << "\n";
-    return gcode.str();
 }
 
-std::string
-GCodeWriter::travel_to_xy(const Pointf &point, const std::string &comment)
+void
+GCodeWriter::travel_to_xy(std::string* out, const Pointf &point, const std::string &comment)
 {
     this->_pos.x = point.x;
     this->_pos.y = point.y;
     
-    std::ostringstream gcode;
+    GCodeEmitter gcode(out);
     gcode << "G1 X" << XYZF_NUM(point.x)
           <<   " Y" << XYZF_NUM(point.y)
           <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
     COMMENT(comment);
     gcode << "\n";
-    return gcode.str();
 }
 
-std::string
-GCodeWriter::travel_to_xyz(const Pointf3 &point, const std::string &comment)
+void
+GCodeWriter::travel_to_xyz(std::string* out, const Pointf3 &point, const std::string &comment)
 {
     /*  If target Z is lower than current Z but higher than nominal Z we
         don't perform the Z move but we only move in the XY plane and
@@ -341,7 +348,8 @@ GCodeWriter::travel_to_xyz(const Pointf3 &point, const std::string &comment)
     if (!this->will_move_z(point.z)) {
         double nominal_z = this->_pos.z - this->_lifted;
         this->_lifted = this->_lifted - (point.z - nominal_z);
-        return this->travel_to_xy(point);
+        this->travel_to_xy(out, point);
+        return;
     }
     
     /*  In all the other cases, we perform an actual XYZ move and cancel
@@ -349,18 +357,17 @@ GCodeWriter::travel_to_xyz(const Pointf3 &point, const std::string &comment)
     this->_lifted = 0;
     this->_pos = point;
     
-    std::ostringstream gcode;
+    GCodeEmitter gcode(out);
     gcode << "G1 X" << XYZF_NUM(point.x)
           <<   " Y" << XYZF_NUM(point.y)
           <<   " Z" << XYZF_NUM(point.z)
           <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
     COMMENT(comment);
     gcode << "\n";
-    return gcode.str();
 }
 
-std::string
-GCodeWriter::travel_to_z(double z, const std::string &comment)
+void
+GCodeWriter::travel_to_z(std::string* out, double z, const std::string &comment)
 {
     /*  If target Z is lower than current Z but higher than nominal Z
         we don't perform the move but we only adjust the nominal Z by
@@ -368,26 +375,25 @@ GCodeWriter::travel_to_z(double z, const std::string &comment)
     if (!this->will_move_z(z)) {
         double nominal_z = this->_pos.z - this->_lifted;
         this->_lifted -= (z - nominal_z);
-        return "";
+        return;
     }
     
     /*  In all the other cases, we perform an actual Z move and cancel
         the lift. */
     this->_lifted = 0;
-    return this->_travel_to_z(z, comment);
+    this->_travel_to_z(out, z, comment);
 }
 
-std::string
-GCodeWriter::_travel_to_z(double z, const std::string &comment)
+void
+GCodeWriter::_travel_to_z(std::string* out, double z, const std::string &comment)
 {
     this->_pos.z = z;
     
-    std::ostringstream gcode;
+    GCodeEmitter gcode(out);
     gcode << "G1 Z" << XYZF_NUM(z)
           <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
     COMMENT(comment);
     gcode << "\n";
-    return gcode.str();
 }
 
 bool
@@ -403,53 +409,121 @@ GCodeWriter::will_move_z(double z) const
     return true;
 }
 
-std::string
-GCodeWriter::extrude_to_xy(const Pointf &point, double dE, const std::string &comment)
+void
+GCodeWriter::_write_E(GCodeEmitter &gcode)
+{
+    if (this->relocatable_E) {
+        gcode << relocated_E_mark;
+        this->relocated_E.push_back(RelocatedE { this->_extruder->id, this->_extruder->E_steps.size(), RelocatedE::Write });
+    } else {
+        gcode << E_NUM(this->_extruder->E);
+    }
+}
+
+bool
+GCodeWriter::relocate_E(const std::string &gcode, const std::vector<RelocatedE> &relocated_E,
+    const std::map<unsigned int, std::vector<double>> &E_steps, std::map<unsigned int, double>* E, std::string* out)
+{
+    // replay the steps of an extruder up to count, in the order it did them
+    std::map<unsigned int, size_t> replayed;
+    auto replay = [&E_steps, E, &replayed](unsigned int extruder_id, size_t count) {
+        double &value = E->at(extruder_id);
+        const std::vector<double> &steps = E_steps.at(extruder_id);
+        for (size_t &i = replayed[extruder_id]; i < count; ++i)
+            value = std::isnan(steps[i]) ? 0 : value + steps[i];
+        return value;
+    };
+
+    out->clear();
+    out->reserve(gcode.size() + relocated_E.size() * 8);
+    GCodeEmitter emitter(out);
+    size_t from = 0;
+    for (const RelocatedE &use : relocated_E) {
+        const double value = replay(use.extruder_id, use.steps);
+        if (use.use == RelocatedE::Write) {
+            const size_t mark = gcode.find(relocated_E_mark, from);
+            if (mark == std::string::npos) return false;
+            out->append(gcode, from, mark - from);
+            emitter << E_NUM(value);
+            from = mark + relocated_E_mark.size();
+        } else if ((value == 0) != (use.use == RelocatedE::IsZero)) {
+            return false;
+        }
+    }
+    if (gcode.find(relocated_E_mark, from) != std::string::npos) return false;
+    out->append(gcode, from, std::string::npos);
+    for (const auto &steps : E_steps)
+        replay(steps.first, steps.second.size());
+    return true;
+}
+
+void
+GCodeWriter::extrude_to_xy(std::string* out, const Pointf &point, double dE, const std::string &comment)
 {
     this->_pos.x = point.x;
     this->_pos.y = point.y;
     this->_extruder->extrude(dE);
     
-    std::ostringstream gcode;
+    GCodeEmitter gcode(out);
     gcode << "G1 X" << XYZF_NUM(point.x)
           <<   " Y" << XYZF_NUM(point.y)
-          <<    " " << this->_extrusion_axis << E_NUM(this->_extruder->E);
+          <<    " " << this->_extrusion_axis;
+    this->_write_E(gcode);
     COMMENT(comment);
     gcode << "\n";
-    return gcode.str();
 }
 
-std::string
-GCodeWriter::extrude_to_xyz(const Pointf3 &point, double dE, const std::string &comment)
+void
+GCodeWriter::extrude_to_xyz(std::string* out, const Pointf3 &point, double dE, const std::string &comment)
 {
     this->_pos = point;
     this->_lifted = 0;
     this->_extruder->extrude(dE);
     
-    std::ostringstream gcode;
+    GCodeEmitter gcode(out);
     gcode << "G1 X" << XYZF_NUM(point.x)
           <<   " Y" << XYZF_NUM(point.y)
           <<   " Z" << XYZF_NUM(point.z)
-          <<    " " << this->_extrusion_axis << E_NUM(this->_extruder->E);
+          <<    " " << this->_extrusion_axis;
+    this->_write_E(gcode);
     COMMENT(comment);
     gcode << "\n";
-    return gcode.str();
 }
 
-std::string
-GCodeWriter::retract()
+void
+GCodeWriter::extrude_arc_to_xy(std::string* out, const Pointf &point, const Pointf &center_offset, bool ccw, double dE, const std::string &comment)
 {
-    return this->_retract(
+    this->_pos.x = point.x;
+    this->_pos.y = point.y;
+    this->_extruder->extrude(dE);
+    
+    GCodeEmitter gcode(out);
+    gcode << (ccw ? "G3 X" : "G2 X") << XYZF_NUM(point.x)
+          <<   " Y" << XYZF_NUM(point.y)
+          <<   " I" << XYZF_NUM(center_offset.x)
+          <<   " J" << XYZF_NUM(center_offset.y)
+          <<    " " << this->_extrusion_axis;
+    this->_write_E(gcode);
+    COMMENT(comment);
+    gcode << "\n";
+}
+
+void
+GCodeWriter::retract(std::string* out)
+{
+    this->_retract(
+        out,
         this->_extruder->retract_length(),
         this->_extruder->retract_restart_extra(),
         "retract"
     );
 }
 
-std::string
-GCodeWriter::retract_for_toolchange()
+void
+GCodeWriter::retract_for_toolchange(std::string* out)
 {
-    return this->_retract(
+    this->_retract(
+        out,
         this->_extruder->retract_length_toolchange(),
         this->_extruder->retract_restart_extra_toolchange(),
         "retract for toolchange",
@@ -457,13 +531,11 @@ GCodeWriter::retract_for_toolchange()
     );
 }
 
-std::string
-GCodeWriter::_retract(double length, double restart_extra, const std::string &comment, bool long_retract)
+void
+GCodeWriter::_retract(std::string* out, double length, double restart_extra, const std::string &comment, bool long_retract)
 {
-    std::ostringstream gcode;
-    std::ostringstream outcomment;
-
-    outcomment << comment;
+    GCodeEmitter gcode(out);
+    std::string outcomment {comment};
     
     /*  If firmware retraction is enabled, we use a fake value of 1
         since we ignore the actual configured retract_length which 
@@ -480,7 +552,7 @@ GCodeWriter::_retract(double length, double restart_extra, const std::string &co
 
     double dE = this->_extruder->retract(length, restart_extra);
     if (dE != 0) {
-        outcomment << " extruder " << this->_extruder->id;
+        outcomment += " extruder " + std::to_string(this->_extruder->id);
         if (this->config.use_firmware_retraction) {
             if (FLAVOR_IS(gcfMachinekit))
                 gcode << "G22";
@@ -489,23 +561,23 @@ GCodeWriter::_retract(double length, double restart_extra, const std::string &co
             else
                 gcode << "G10";
         } else {
-            gcode << "G1 " << this->_extrusion_axis << E_NUM(this->_extruder->E)
-                           << " F" << this->_extruder->retract_speed_mm_min;
+            // the feedrate keeps the 5 decimals it got from std::fixed in the stream days
+            gcode << "G1 " << this->_extrusion_axis;
+            this->_write_E(gcode);
+            gcode << " F" << E_NUM(this->_extruder->retract_speed_mm_min);
         }
-        COMMENT(outcomment.str());
+        COMMENT(outcomment);
         gcode << "\n";
     }
     
     if (FLAVOR_IS(gcfMakerWare))
         gcode << "M103 ; extruder off\n";
-    
-    return gcode.str();
 }
 
-std::string
-GCodeWriter::unretract()
+void
+GCodeWriter::unretract(std::string* out)
 {
-    std::ostringstream gcode;
+    GCodeEmitter gcode(out);
     
     if (FLAVOR_IS(gcfMakerWare))
         gcode << "M101 ; extruder on\n";
@@ -519,24 +591,23 @@ GCodeWriter::unretract()
                  gcode << "G11";
             if (this->config.gcode_comments) gcode << " ; unretract extruder " << this->_extruder->id;
             gcode << "\n";
-            gcode << this->reset_e();
+            this->reset_e(out);
         } else {
             // use G1 instead of G0 because G0 will blend the restart with the previous travel move
-            gcode << "G1 " << this->_extrusion_axis << E_NUM(this->_extruder->E)
-                           << " F" << this->_extruder->retract_speed_mm_min;
+            gcode << "G1 " << this->_extrusion_axis;
+            this->_write_E(gcode);
+            gcode << " F" << E_NUM(this->_extruder->retract_speed_mm_min);
             if (this->config.gcode_comments) gcode << " ; unretract extruder " << this->_extruder->id;
             gcode << "\n";
         }
     }
-    
-    return gcode.str();
 }
 
 /*  If this method is called more than once before calling unlift(),
     it will not perform subsequent lifts, even if Z was raised manually
     (i.e. with travel_to_z()) and thus _lifted was reduced. */
-std::string
-GCodeWriter::lift()
+void
+GCodeWriter::lift(std::string* out)
 {
     // check whether the above/below conditions are met
     double target_lift = 0;
@@ -552,21 +623,52 @@ GCodeWriter::lift()
     // exactly zero
     if (std::abs(this->_lifted) < EPSILON && target_lift > 0) {
         this->_lifted = target_lift;
-        return this->_travel_to_z(this->_pos.z + target_lift, "lift Z");
+        this->_travel_to_z(out, this->_pos.z + target_lift, "lift Z");
     }
-    
-    return "";
 }
 
-std::string
-GCodeWriter::unlift()
+void
+GCodeWriter::unlift(std::string* out)
 {
-    std::string gcode;
     if (this->_lifted > 0) {
-        gcode += this->_travel_to_z(this->_pos.z - this->_lifted, "restore layer Z");
+        this->_travel_to_z(out, this->_pos.z - this->_lifted, "restore layer Z");
         this->_lifted = 0;
     }
-    return gcode;
+}
+
+GCodeWriter::State
+GCodeWriter::state() const
+{
+    State state;
+    state.extruder_id = this->_extruder != NULL ? int(this->_extruder->id) : -1;
+    state.last_acceleration = this->_last_acceleration;
+    state.last_fan_speed = this->_last_fan_speed;
+    state.lifted = this->_lifted;
+    state.pos = this->_pos;
+    state.extruders.reserve(this->extruders.size());
+    for (const auto &pair : this->extruders) {
+        const Extruder &extruder = pair.second;
+        state.extruders.push_back(State::ExtruderState { extruder.id,
+            extruder.E, extruder.absolute_E, extruder.retracted, extruder.restart_extra });
+    }
+    return state;
+}
+
+void
+GCodeWriter::restore(const State &state)
+{
+    this->_extruder = state.extruder_id >= 0 ? &this->extruders.at(state.extruder_id) : NULL;
+    this->_last_acceleration = state.last_acceleration;
+    this->_last_fan_speed = state.last_fan_speed;
+    this->_lifted = state.lifted;
+    this->_pos = state.pos;
+    for (const State::ExtruderState &saved : state.extruders) {
+        Extruder &extruder = this->extruders.at(saved.id);
+        extruder.E = saved.E;
+        extruder.absolute_E = saved.absolute_E;
+        extruder.retracted = saved.retracted;
+        extruder.restart_extra = saved.restart_extra;
+    }
 }
 
 }
@@ -3,17 +3,34 @@
 
 #include "libslic3r.h"
 #include <string>
+#include <vector>
 #include "Extruder.hpp"
 #include "Point.hpp"
 #include "PrintConfig.hpp"
 
 namespace Slic3r {
 
+class GCodeEmitter;
+
 class GCodeWriter {
 public:
     GCodeConfig config;
     std::map<unsigned int,Extruder> extruders;
     bool multiple_extruders;
+
+    /// Where a command written with relocatable_E uses E: it writes the
+    /// value, or depends on whether it is 0.
+    struct RelocatedE {
+        unsigned int extruder_id;
+        size_t steps;       ///< Extruder::E_steps done by then
+        enum { Write, IsZero, IsNotZero } use;
+    };
+    /// If set, the E values are left out of the commands and listed in
+    /// relocated_E, together with the tests of E the commands depend on, for
+    /// relocate_E() to write them once the E they start from is known. The
+    /// extruders have to record_steps.
+    bool relocatable_E {false};
+    std::vector<RelocatedE> relocated_E;
     
     GCodeWriter()
         : multiple_extruders(false), _extrusion_axis("E"), _extruder(NULL),
@@ -49,25 +66,79 @@ public:
     std::string set_temperature(unsigned int temperature, bool wait = false, int tool = -1) const;
     std::string set_bed_temperature(unsigned int temperature, bool wait = false) const;
     std::string set_fan(unsigned int speed, bool dont_save = false);
-    std::string set_acceleration(unsigned int acceleration);
-    std::string reset_e(bool force = false);
+    std::string set_acceleration(unsigned int acceleration) { std::string gcode; this->set_acceleration(&gcode, acceleration); return gcode; };
+    std::string reset_e(bool force = false) { std::string gcode; this->reset_e(&gcode, force); return gcode; };
     std::string update_progress(unsigned int num, unsigned int tot, bool allow_100 = false) const;
     bool need_toolchange(unsigned int extruder_id) const;
     std::string set_extruder(unsigned int extruder_id);
     std::string toolchange(unsigned int extruder_id);
-    std::string set_speed(double F, const std::string &comment = std::string(), const std::string &cooling_marker = std::string()) const;
-    std::string travel_to_xy(const Pointf &point, const std::string &comment = std::string());
-    std::string travel_to_xyz(const Pointf3 &point, const std::string &comment = std::string());
-    std::string travel_to_z(double z, const std::string &comment = std::string());
+    std::string set_speed(double F, const std::string &comment = std::string(), const std::string &cooling_marker = std::string()) const
+        { std::string gcode; this->set_speed(&gcode, F, comment, cooling_marker); return gcode; };
+    std::string travel_to_xy(const Pointf &point, const std::string &comment = std::string())
+        { std::string gcode; this->travel_to_xy(&gcode, point, comment); return gcode; };
+    std::string travel_to_xyz(const Pointf3 &point, const std::string &comment = std::string())
+        { std::string gcode; this->travel_to_xyz(&gcode, point, comment); return gcode; };
+    std::string travel_to_z(double z, const std::string &comment = std::string())
+        { std::string gcode; this->travel_to_z(&gcode, z, comment); return gcode; };
     bool will_move_z(double z) const;
-    std::string extrude_to_xy(const Pointf &point, double dE, const std::string &comment = std::string());
-    std::string extrude_to_xyz(const Pointf3 &point, double dE, const std::string &comment = std::string());
-    std::string retract();
-    std::string retract_for_toolchange();
-    std::string unretract();
-    std::string lift();
-    std::string unlift();
+    std::string extrude_to_xy(const Pointf &point, double dE, const std::string &comment = std::string())
+        { std::string gcode; this->extrude_to_xy(&gcode, point, dE, comment); return gcode; };
+    std::string extrude_to_xyz(const Pointf3 &point, double dE, const std::string &comment = std::string())
+        { std::string gcode; this->extrude_to_xyz(&gcode, point, dE, comment); return gcode; };
+    std::string extrude_arc_to_xy(const Pointf &point, const Pointf &center_offset, bool ccw, double dE, const std::string &comment = std::string())
+        { std::string gcode; this->extrude_arc_to_xy(&gcode, point, center_offset, ccw, dE, comment); return gcode; };
+    std::string retract() { std::string gcode; this->retract(&gcode); return gcode; };
+    std::string retract_for_toolchange() { std::string gcode; this->retract_for_toolchange(&gcode); return gcode; };
+    std::string unretract() { std::string gcode; this->unretract(&gcode); return gcode; };
+    std::string lift() { std::string gcode; this->lift(&gcode); return gcode; };
+    std::string unlift() { std::string gcode; this->unlift(&gcode); return gcode; };
+
+    /// The same commands appended to gcode, which is the way to go for the
+    /// moves: a buffer reused across calls saves an allocation per line.
+    void set_acceleration(std::string* gcode, unsigned int acceleration);
+    void reset_e(std::string* gcode, bool force = false);
+    void set_speed(std::string* gcode, double F, const std::string &comment = std::string(), const std::string &cooling_marker = std::string()) const;
+    void travel_to_xy(std::string* gcode, const Pointf &point, const std::string &comment = std::string());
+    void travel_to_xyz(std::string* gcode, const Pointf3 &point, const std::string &comment = std::string());
+    void travel_to_z(std::string* gcode, double z, const std::string &comment = std::string());
+    void extrude_to_xy(std::string* gcode, const Pointf &point, double dE, const std::string &comment = std::string());
+    void extrude_to_xyz(std::string* gcode, const Pointf3 &point, double dE, const std::string &comment = std::string());
+    /// Extrude along an arc to point with a G2, or a G3 if ccw. center_offset
+    /// is the center relative to the current position.
+    void extrude_arc_to_xy(std::string* gcode, const Pointf &point, const Pointf &center_offset, bool ccw, double dE, const std::string &comment = std::string());
+    void retract(std::string* gcode);
+    void retract_for_toolchange(std::string* gcode);
+    void unretract(std::string* gcode);
+    void lift(std::string* gcode);
+    void unlift(std::string* gcode);
     Pointf3 get_position() const { return this->_pos; }
+
+    /// What the commands written so far leave behind: the position, the
+    /// extruders and the settings that aren't written again when unchanged.
+    struct State {
+        struct ExtruderState {
+            unsigned int id;
+            double E, absolute_E, retracted, restart_extra;
+        };
+        int extruder_id;    ///< -1 before the first extruder is selected
+        unsigned int last_acceleration;
+        unsigned int last_fan_speed;
+        double lifted;
+        Pointf3 pos;
+        std::vector<ExtruderState> extruders;
+    };
+    State state() const;
+    /// Carry on from a state() saved earlier, as if the commands that led to
+    /// it had been written again.
+    void restore(const State &state);
+
+    /// Write the E values left out of gcode, which was written with
+    /// relocatable_E, as if each extruder had started from the E it has in
+    /// E: its E_steps are replayed from there, leaving the E it ends at in
+    /// E. Returns false if a test of E turns out otherwise, as the commands
+    /// would then be other ones.
+    static bool relocate_E(const std::string &gcode, const std::vector<RelocatedE> &relocated_E,
+        const std::map<unsigned int, std::vector<double>> &E_steps, std::map<unsigned int, double>* E, std::string* out);
 private:
     std::string _extrusion_axis;
     Extruder* _extruder;
@@ -76,8 +147,9 @@ private:
     double _lifted;
     Pointf3 _pos;
     
-    std::string _travel_to_z(double z, const std::string &comment);
-    std::string _retract(double length, double restart_extra, const std::string &comment, bool long_retract = false);
+    void _travel_to_z(std::string* gcode, double z, const std::string &comment);
+    void _write_E(GCodeEmitter &gcode);
+    void _retract(std::string* gcode, double length, double restart_extra, const std::string &comment, bool long_retract = false);
 };
 
 } /* namespace Slic3r */
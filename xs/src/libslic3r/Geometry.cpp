@@ -450,8 +450,8 @@ circle_taubin_newton(const Pointfs::const_iterator& input_begin, const Pointfs::
 
 /*
 == Perl implementations for methods tested in geometry.t but not translated.  ==
-== The first three are unreachable in the current perl code and the fourth is ==
-== only called from ArcFitting which currently dies before reaching the call. ==
+== The first three are unreachable in the current perl code and the fourth   ==
+== was only called from the perl ArcFitting, which has been removed.          ==
 sub point_in_segment {
     my ($point, $line) = @_;
 
@@ -1,8 +1,15 @@
 #include "IO.hpp"
+#include "TextScanner.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <limits>
 #include <stdexcept>
 #include <fstream>
 #include <iostream>
 #include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <boost/nowide/fstream.hpp>
 
 #define TINYOBJLOADER_IMPLEMENTATION
@@ -71,39 +78,181 @@ OBJ::read(std::string input_file, TriangleMesh* mesh)
     return true;
 }
 
+namespace {
+    /// The content of a chunk of an OBJ file, as read by parse_obj_lines().
+    struct OBJChunk {
+        /// x, y, z of every 'v' line.
+        std::vector<float> vertices;
+        /// Zero based vertex indices, three per 'f' line.
+        std::vector<int> facets;
+        /// Positions in facets of the negative (relative) indices, which are
+        /// stored relative to the first vertex of the chunk.
+        std::vector<size_t> relative;
+        /// Number of facets read before each 'g' or 'o' line.
+        std::vector<size_t> breaks;
+    };
+    
+    /// Parse the lines of [p, end) like tiny_obj_loader does, ignoring what does
+    /// not contribute to the mesh. Returns false on what this reader does not
+    /// handle (faces other than triangles, malformed numbers), leaving the
+    /// file to tiny_obj_loader.
+    bool
+    parse_obj_lines(const char* p, const char* end, OBJChunk* chunk)
+    {
+        for (; p < end; ++p) {
+            p = skip_blanks(p, end);
+            const char* line_end = find_line_end(p, end);
+            if (line_end - p < 2 || !is_blank(p[1])) {
+                p = line_end;
+                continue;
+            }
+            const char* q = p + 2;
+            if (*p == 'v') {
+                float v[3];
+                for (int i = 0; i < 3; ++i) {
+                    q = parse_float(skip_blanks(q, line_end), line_end, v + i);
+                    if (q == nullptr || (q < line_end && !is_blank(*q))) return false;
+                }
+                chunk->vertices.insert(chunk->vertices.end(), v, v + 3);
+            } else if (*p == 'f') {
+                const int local_vertices = int(chunk->vertices.size() / 3);
+                int corners = 0;
+                while ((q = skip_blanks(q, line_end)) < line_end) {
+                    if (++corners > 3) return false;
+                    const bool negative = (*q == '-');
+                    if (*q == '-' || *q == '+') ++q;
+                    int idx = 0;
+                    const char* digits = q;
+                    for (; q < line_end && static_cast<unsigned int>(*q - '0') <= 9; ++q)
+                        if (idx < 100000000) idx = idx * 10 + (*q - '0');
+                    if (q == digits || idx == 0 || (q < line_end && !is_blank(*q) && *q != '/'))
+                        return false;
+                    // texture and normal indices don't matter here
+                    while (q < line_end && !is_blank(*q)) ++q;
+                    if (negative) {
+                        chunk->relative.push_back(chunk->facets.size());
+                        chunk->facets.push_back(local_vertices - idx);
+                    } else {
+                        chunk->facets.push_back(idx - 1);
+                    }
+                }
+                if (corners != 3) return false;
+            } else if (*p == 'g' || *p == 'o') {
+                chunk->breaks.push_back(chunk->facets.size() / 3);
+            }
+            p = line_end;
+        }
+        return true;
+    }
+    
+    /// Read the vertices of an OBJ file and the facets of each of its shapes,
+    /// parsing chunks of lines in parallel. Returns false if the file cannot be
+    /// mapped or holds something parse_obj_lines() leaves to tiny_obj_loader.
+    bool
+    read_obj_mapped(const std::string &input_file, Pointf3s* points, std::vector<std::vector<Point3>>* shapes)
+    {
+        boost::interprocess::file_mapping file;
+        boost::interprocess::mapped_region region;
+        try {
+            file = boost::interprocess::file_mapping(input_file.c_str(), boost::interprocess::read_only);
+            region = boost::interprocess::mapped_region(file, boost::interprocess::read_only);
+        } catch (const boost::interprocess::interprocess_exception &) {
+            return false;
+        }
+        const char* data = static_cast<const char*>(region.get_address());
+        const size_t file_size = region.get_size();
+        
+        const int threads_count = std::max(1u, boost::thread::hardware_concurrency());
+        const std::vector<const char*> cuts = split_at_lines(data, data + file_size,
+            std::max<size_t>(1, file_size / (4 << 20)) * threads_count);
+        const size_t chunks = cuts.size() - 1;
+        std::vector<OBJChunk> parsed(chunks);
+        std::atomic<bool> failed(false);
+        ThreadPool::instance().parallel_for(chunks, [&](size_t from, size_t to) {
+            for (size_t c = from; c < to; ++c)
+                if (!failed && !parse_obj_lines(cuts[c], cuts[c+1], &parsed[c]))
+                    failed = true;
+        }, threads_count, 1);
+        if (failed) return false;
+        
+        // first vertex and first facet of every chunk
+        std::vector<size_t> vertex_offsets(chunks + 1, 0), facet_offsets(chunks + 1, 0);
+        for (size_t c = 0; c < chunks; ++c) {
+            vertex_offsets[c+1] = vertex_offsets[c] + parsed[c].vertices.size() / 3;
+            facet_offsets[c+1]  = facet_offsets[c]  + parsed[c].facets.size() / 3;
+        }
+        const size_t vertices_count = vertex_offsets.back();
+        if (vertices_count > size_t(std::numeric_limits<int>::max())) return false;
+        
+        points->assign(vertices_count, Pointf3());
+        std::vector<Point3> facets(facet_offsets.back());
+        ThreadPool::instance().parallel_for(chunks, [&](size_t from, size_t to) {
+            for (size_t c = from; c < to; ++c) {
+                OBJChunk &chunk = parsed[c];
+                for (size_t i = 0; i < chunk.vertices.size(); i += 3)
+                    (*points)[vertex_offsets[c] + i / 3] = Pointf3(chunk.vertices[i], chunk.vertices[i+1], chunk.vertices[i+2]);
+                for (size_t pos : chunk.relative)
+                    chunk.facets[pos] += int(vertex_offsets[c]);
+                // tiny_obj_loader keeps out of range indices, which the mesh can't use
+                if (std::any_of(chunk.facets.begin(), chunk.facets.end(),
+                    [vertices_count](int idx) { return idx < 0 || size_t(idx) >= vertices_count; })) {
+                    failed = true;
+                    return;
+                }
+                for (size_t i = 0; i < chunk.facets.size(); i += 3)
+                    facets[facet_offsets[c] + i / 3] = Point3(chunk.facets[i], chunk.facets[i+1], chunk.facets[i+2]);
+                std::vector<float>().swap(chunk.vertices);
+                std::vector<int>().swap(chunk.facets);
+            }
+        }, threads_count, 1);
+        if (failed) return false;
+        
+        // Like tiny_obj_loader, start a new shape at each group or object
+        // that follows some facets.
+        shapes->clear();
+        size_t shape_start = 0;
+        for (size_t c = 0; c <= chunks; ++c) {
+            std::vector<size_t> breaks;
+            if (c < chunks)
+                for (size_t b : parsed[c].breaks) breaks.push_back(facet_offsets[c] + b);
+            else
+                breaks.push_back(facets.size());
+            for (size_t b : breaks) {
+                if (b > shape_start)
+                    shapes->push_back(std::vector<Point3>(facets.begin() + shape_start, facets.begin() + b));
+                shape_start = b;
+            }
+        }
+        return true;
+    }
+}
+
 bool
 OBJ::read(std::string input_file, Model* model)
 {
     // TODO: encode file name
     // TODO: check that file exists
     
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string err;
-	boost::nowide::ifstream ifs(input_file);
-    bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, &ifs);
-    
-    if (!err.empty()) { // `err` may contain warning message.
-        std::cerr << err << std::endl;
-    }
-    
-    if (!ret)
-        throw std::runtime_error("Error while reading OBJ file");
-    
-    ModelObject* object = model->add_object();
-    object->name        = boost::filesystem::path(input_file).filename().string();
-    object->input_file  = input_file;
-    
-    // Loop over shapes and add a volume for each one.
-    for (std::vector<tinyobj::shape_t>::const_iterator shape = shapes.begin();
-        shape != shapes.end(); ++shape) {
+    Pointf3s points;
+    std::vector<std::vector<Point3>> shapes;
+    if (!read_obj_mapped(input_file, &points, &shapes)) {
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> tiny_shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string err;
+        boost::nowide::ifstream ifs(input_file);
+        bool ret = tinyobj::LoadObj(&attrib, &tiny_shapes, &materials, &err, &ifs);
+        
+        if (!err.empty()) { // `err` may contain warning message.
+            std::cerr << err << std::endl;
+        }
         
-        Pointf3s points;
-        std::vector<Point3> facets;
+        if (!ret)
+            throw std::runtime_error("Error while reading OBJ file");
         
         // Read vertices.
         assert((attrib.vertices.size() % 3) == 0);
+        points.clear();
         for (size_t v = 0; v < attrib.vertices.size(); v += 3) {
             points.push_back(Pointf3(
                 attrib.vertices[v],
@@ -112,18 +261,32 @@ OBJ::read(std::string input_file, Model* model)
             ));
         }
         
-        // Loop over facets of the current shape.
-        for (size_t f = 0; f < shape->mesh.num_face_vertices.size(); ++f) {
-            // tiny_obj_loader should triangulate any facet with more than 3 vertices
-            assert((shape->mesh.num_face_vertices[f] % 3) == 0);
+        // Loop over facets of each shape.
+        shapes.clear();
+        for (std::vector<tinyobj::shape_t>::const_iterator shape = tiny_shapes.begin();
+            shape != tiny_shapes.end(); ++shape) {
             
-            facets.push_back(Point3(
-                shape->mesh.indices[f*3+0].vertex_index,
-                shape->mesh.indices[f*3+1].vertex_index,
-                shape->mesh.indices[f*3+2].vertex_index
-            ));
+            std::vector<Point3> facets;
+            for (size_t f = 0; f < shape->mesh.num_face_vertices.size(); ++f) {
+                // tiny_obj_loader should triangulate any facet with more than 3 vertices
+                assert((shape->mesh.num_face_vertices[f] % 3) == 0);
+                
+                facets.push_back(Point3(
+                    shape->mesh.indices[f*3+0].vertex_index,
+                    shape->mesh.indices[f*3+1].vertex_index,
+                    shape->mesh.indices[f*3+2].vertex_index
+                ));
+            }
+            shapes.push_back(facets);
         }
-        
+    }
+    
+    ModelObject* object = model->add_object();
+    object->name        = boost::filesystem::path(input_file).filename().string();
+    object->input_file  = input_file;
+    
+    // Add a volume for each shape.
+    for (const std::vector<Point3> &facets : shapes) {
         TriangleMesh mesh(points, facets);
         mesh.check_topology();
         ModelVolume* volume = object->add_volume(mesh);
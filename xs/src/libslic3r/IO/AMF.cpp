@@ -542,8 +542,8 @@ AMF::write(Model& model, std::string output_file)
         for (ModelVolume *volume : object->volumes) {
             volume->mesh.require_shared_vertices();
             vertices_offsets.push_back(num_vertices);
-            const auto &stl = volume->mesh.stl;
-            for (size_t i = 0; i < stl.stats.shared_vertices; ++i)
+            const auto &vertices = volume->mesh.indexed.vertices;
+            for (size_t i = 0; i < vertices.size(); ++i)
                 // Subtract origin_translation in order to restore the coordinates of the parts
                 // before they were imported. Otherwise, when this AMF file is reimported parts
                 // will be placed in the plater correctly, but we will have lost origin_translation
@@ -552,13 +552,13 @@ AMF::write(Model& model, std::string output_file)
                 // below.
                 file << "         <vertex>" << endl
                      << "           <coordinates>" << endl
-                     << "             <x>" << (stl.v_shared[i].x - object->origin_translation.x) << "</x>" << endl
-                     << "             <y>" << (stl.v_shared[i].y - object->origin_translation.y) << "</y>" << endl
-                     << "             <z>" << (stl.v_shared[i].z - object->origin_translation.z) << "</z>" << endl
+                     << "             <x>" << (vertices[i].x - object->origin_translation.x) << "</x>" << endl
+                     << "             <y>" << (vertices[i].y - object->origin_translation.y) << "</y>" << endl
+                     << "             <z>" << (vertices[i].z - object->origin_translation.z) << "</z>" << endl
                      << "           </coordinates>" << endl
                      << "         </vertex>" << endl;
             
-            num_vertices += stl.stats.shared_vertices;
+            num_vertices += vertices.size();
         }
         file << "      </vertices>" << endl;
         
@@ -585,7 +585,7 @@ AMF::write(Model& model, std::string output_file)
                 file << "        <triangle>" << endl;
                 for (int j = 0; j < 3; ++ j)
                     file << "          <v" << (j+1) << ">"
-                         << (volume->mesh.stl.v_indices[i].vertex[j] + vertices_offset)
+                         << (volume->mesh.indexed.indices[i * 3 + j] + vertices_offset)
                          << "</v" << (j+1) << ">" << endl;
                 file << "        </triangle>" << endl;
             }
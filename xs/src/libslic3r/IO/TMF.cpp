@@ -1,109 +1,118 @@
 #include "TMF.hpp"
+#include "../TextScanner.hpp"
+#include <atomic>
+#include <sstream>
 
 namespace Slic3r { namespace IO {
 
 bool
 TMFEditor::write_types()
 {
-    // Create a new .[Content_Types].xml file to add to the zip file later.
-    boost::nowide::ofstream fout(".[Content_Types].xml", std::ios::out | std::ios::trunc);
-    if(!fout.is_open())
-        return false;
-
-    // Write 3MF Types.
-    fout << "<?xml version=\"1.0\" encoding=\"UTF-8\"?> \n";
-    fout << "<Types xmlns=\"" << namespaces.at("content_types") << "\">\n";
-    fout << "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>\n";
-    fout << "<Default Extension=\"model\" ContentType=\"application/vnd.ms-package.3dmanufacturing-3dmodel+xml\"/>\n";
-    fout << "</Types>\n";
-    fout.close();
-
     // Create [Content_Types].xml in the zip archive.
-    if(!zip_archive->add_entry("[Content_Types].xml", ".[Content_Types].xml"))
-        return false;
-
-    // Remove the created .[Content_Types].xml file.
-    if (remove(".[Content_Types].xml") != 0)
+    if(!zip_archive->open_entry("[Content_Types].xml"))
         return false;
-
-    return true;
+    {
+        ZipEntryBuffer buffer(*zip_archive);
+        std::ostream fout(&buffer);
+
+        // Write 3MF Types.
+        fout << "<?xml version=\"1.0\" encoding=\"UTF-8\"?> \n";
+        fout << "<Types xmlns=\"" << namespaces.at("content_types") << "\">\n";
+        fout << "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>\n";
+        fout << "<Default Extension=\"model\" ContentType=\"application/vnd.ms-package.3dmanufacturing-3dmodel+xml\"/>\n";
+        fout << "</Types>\n";
+        if(!fout.flush())
+            return false;
+    }
+    return zip_archive->close_entry();
 }
 
 bool
 TMFEditor::write_relationships()
 {
-    // Create a new .rels file to add to the zip file later.
-    boost::nowide::ofstream fout(".rels", std::ios::out | std::ios::trunc);
-    if(!fout.is_open())
-        return false;
-
-    // Write the primary 3dmodel relationship.
-    fout << "<?xml version=\"1.0\" encoding=\"UTF-8\"?> \n"
-                          << "<Relationships xmlns=\"" << namespaces.at("relationships") <<
-                  "\">\n<Relationship Id=\"rel0\" Target=\"/3D/3dmodel.model\" Type=\"http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel\" /></Relationships>\n";
-    fout.close();
-
     // Create .rels in "_rels" folder in the zip archive.
-    if(!zip_archive->add_entry("_rels/.rels", ".rels"))
+    if(!zip_archive->open_entry("_rels/.rels"))
         return false;
-
-    // Remove the created .rels file.
-    if (remove(".rels") != 0)
-        return false;
-
-    return true;
+    {
+        ZipEntryBuffer buffer(*zip_archive);
+        std::ostream fout(&buffer);
+
+        // Write the primary 3dmodel relationship.
+        fout << "<?xml version=\"1.0\" encoding=\"UTF-8\"?> \n"
+                              << "<Relationships xmlns=\"" << namespaces.at("relationships") <<
+                      "\">\n<Relationship Id=\"rel0\" Target=\"/3D/3dmodel.model\" Type=\"http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel\" /></Relationships>\n";
+        if(!fout.flush())
+            return false;
+    }
+    return zip_archive->close_entry();
 }
 
 bool
 TMFEditor::write_model()
 {
-    // Create a new .3dmodel.model file to add to the zip file later.
-    boost::nowide::ofstream fout(".3dmodel.model", std::ios::out | std::ios::trunc);
-    if(!fout.is_open())
+    // Share the vertices of all the volumes up front, in parallel.
+    std::vector<ModelVolume*> volumes;
+    for (const auto object : model->objects)
+        volumes.insert(volumes.end(), object->volumes.begin(), object->volumes.end());
+    parallelize<size_t>(0, volumes.size() - 1, [&volumes](size_t i) {
+        volumes[i]->mesh.require_shared_vertices();
+    });
+
+    // Create .3dmodel.model in "3D" folder in the zip archive. The XML is deflated
+    // as it is written.
+    if(!zip_archive->open_entry("3D/3dmodel.model"))
         return false;
+    {
+        ZipEntryBuffer buffer(*zip_archive);
+        std::ostream fout(&buffer);
+
+        // Add the XML document header.
+        fout << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+
+        // Write the model element. Append any necessary namespaces.
+        fout << "<model unit=\"millimeter\" xml:lang=\"en-US\"";
+        fout << " xmlns=\"" << namespaces.at("3mf") << "\"";
+        fout << " xmlns:slic3r=\"" << namespaces.at("slic3r") << "\"> \n";
+
+        // Write metadata.
+        write_metadata(fout);
+
+        // Write resources.
+        fout << "    <resources> \n";
+
+        // Write objects. A batch of objects is printed in parallel, one per thread, then
+        // deflated in order, so only that batch is ever held in memory.
+        const size_t batch_size = std::max(1u, boost::thread::hardware_concurrency());
+        std::vector<std::string> objects_xml(batch_size);
+        for (size_t first = 0; first < model->objects.size(); first += batch_size) {
+            const size_t count = std::min(batch_size, model->objects.size() - first);
+            parallelize<size_t>(0, count - 1, [this, first, &objects_xml](size_t i) {
+                std::ostringstream object_xml;
+                write_object(object_xml, model->objects[first + i], int(first + i));
+                objects_xml[i] = object_xml.str();
+            });
+            for (size_t i = 0; i < count; ++i) {
+                fout.write(objects_xml[i].data(), objects_xml[i].size());
+                std::string().swap(objects_xml[i]);
+            }
+        }
 
-    // Add the XML document header.
-    fout << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
-
-    // Write the model element. Append any necessary namespaces.
-    fout << "<model unit=\"millimeter\" xml:lang=\"en-US\"";
-    fout << " xmlns=\"" << namespaces.at("3mf") << "\"";
-    fout << " xmlns:slic3r=\"" << namespaces.at("slic3r") << "\"> \n";
-
-    // Write metadata.
-    write_metadata(fout);
-
-    // Write resources.
-    fout << "    <resources> \n";
-
-    // Write Object
-    int object_index = 0;
-    for(const auto object : model->objects)
-        write_object(fout, object, object_index++);
-
-    // Close resources
-    fout << "    </resources> \n";
-
-    // Write build element.
-    write_build(fout);
-
-    // Close the model element.
-    fout << "</model>\n";
-    fout.close();
-
-    // Create .3dmodel.model in "3D" folder in the zip archive.
-    if(!zip_archive->add_entry("3D/3dmodel.model", ".3dmodel.model"))
-        return false;
+        // Close resources
+        fout << "    </resources> \n";
 
-    // Remove the created .rels file.
-    if (remove(".3dmodel.model") != 0)
-        return false;
+        // Write build element.
+        write_build(fout);
 
-    return true;
+        // Close the model element.
+        fout << "</model>\n";
+        if(!fout.flush())
+            return false;
+    }
+    return zip_archive->close_entry();
 }
 
 bool
-TMFEditor::write_metadata(boost::nowide::ofstream& fout)
+TMFEditor::write_metadata(std::ostream& fout)
 {
     // Write the model metadata.
     for (const auto metadata : model->metadata){
@@ -117,7 +126,7 @@ TMFEditor::write_metadata(boost::nowide::ofstream& fout)
 }
 
 bool
-TMFEditor::write_object(boost::nowide::ofstream& fout, const ModelObject* object, int index)
+TMFEditor::write_object(std::ostream& fout, const ModelObject* object, int index)
 {
     // Create the new object element.
     fout << "        <object id=\"" << (index + object_id) << "\" type=\"model\"";
@@ -149,8 +158,8 @@ TMFEditor::write_object(boost::nowide::ofstream& fout, const ModelObject* object
         volume->mesh.require_shared_vertices();
 
         vertices_offsets.push_back(num_vertices);
-        const auto &stl = volume->mesh.stl;
-        for (int i = 0; i < stl.stats.shared_vertices; ++i)
+        const auto &vertices = volume->mesh.indexed.vertices;
+        for (size_t i = 0; i < vertices.size(); ++i)
         {
 
             // Subtract origin_translation in order to restore the coordinates of the parts
@@ -160,11 +169,11 @@ TMFEditor::write_object(boost::nowide::ofstream& fout, const ModelObject* object
             // In order to do this we compensate for this translation in the instance placement
             // below.
             fout << "                    <vertex";
-            fout << " x=\"" << (stl.v_shared[i].x - object->origin_translation.x) << "\"";
-            fout << " y=\"" << (stl.v_shared[i].y - object->origin_translation.y) << "\"";
-            fout << " z=\"" << (stl.v_shared[i].z - object->origin_translation.z) << "\"/>\n";
+            fout << " x=\"" << (vertices[i].x - object->origin_translation.x) << "\"";
+            fout << " y=\"" << (vertices[i].y - object->origin_translation.y) << "\"";
+            fout << " z=\"" << (vertices[i].z - object->origin_translation.z) << "\"/>\n";
         }
-        num_vertices += stl.stats.shared_vertices;
+        num_vertices += vertices.size();
     }
 
     // Close the vertices element.
@@ -186,7 +195,7 @@ TMFEditor::write_object(boost::nowide::ofstream& fout, const ModelObject* object
         for (int i = 0; i < volume->mesh.stl.stats.number_of_facets; ++i){
             fout << "                    <triangle";
             for (int j = 0; j < 3; j++){
-                fout << " v" << (j+1) << "=\"" << (volume->mesh.stl.v_indices[i].vertex[j] + vertices_offset) << "\"";
+                fout << " v" << (j+1) << "=\"" << (volume->mesh.indexed.indices[i * 3 + j] + vertices_offset) << "\"";
             }
             fout << "/>\n";
             num_triangles++;
@@ -234,7 +243,7 @@ TMFEditor::write_object(boost::nowide::ofstream& fout, const ModelObject* object
 }
 
 bool
-TMFEditor::write_build(boost::nowide::ofstream& fout)
+TMFEditor::write_build(std::ostream& fout)
 {
     // Create build element.
     fout << "    <build> \n";
@@ -284,56 +293,43 @@ TMFEditor::write_build(boost::nowide::ofstream& fout)
 bool
 TMFEditor::read_model()
 {
-    // Extract 3dmodel.model entry.
-    if(!zip_archive->extract_entry("3D/3dmodel.model", "3dmodel.model"))
-        return false;
-
-    // Read 3D/3dmodel.model file.
+    // Read 3D/3dmodel.model.
     XML_Parser parser = XML_ParserCreate(NULL);
     if (! parser) {
         std::cout << ("Couldn't allocate memory for parser\n");
         return false;
     }
 
-    boost::nowide::ifstream fin("3dmodel.model", std::ios::in);
-    if (!fin.is_open()) {
-        boost::nowide::cerr << "Cannot open file: " << "3dmodel.model" << std::endl;
-        return false;
-    }
-
     // Create model parser.
     TMFParserContext ctx(parser, model);
     XML_SetUserData(parser, (void*)&ctx);
     XML_SetElementHandler(parser, TMFParserContext::startElement, TMFParserContext::endElement);
     XML_SetCharacterDataHandler(parser, TMFParserContext::characters);
 
-    char buff[8192];
-    bool result = false;
-    while (!fin.eof()) {
-        fin.read(buff, sizeof(buff));
-        if (fin.bad()) {
-            printf("3MF model parser: Read error\n");
-            break;
-        }
-        if (XML_Parse(parser, buff, fin.gcount(), fin.eof()) == XML_STATUS_ERROR) {
+    // Parse the 3dmodel.model entry as it is inflated.
+    bool parse_error = false;
+    auto parse = [&parser, &parse_error](const char* buff, size_t len) {
+        if (XML_Parse(parser, buff, int(len), 0) == XML_STATUS_ERROR) {
             printf("3MF model parser: Parse error at line %lu:\n%s\n",
                    XML_GetCurrentLineNumber(parser),
                    XML_ErrorString(XML_GetErrorCode(parser)));
-            break;
-        }
-        if (fin.eof()) {
-            result = true;
-            break;
+            parse_error = true;
+            return false;
         }
+        return true;
+    };
+    bool result = zip_archive->extract_entry("3D/3dmodel.model", parse);
+    if (!result && !parse_error)
+        printf("3MF model parser: Read error\n");
+    if (result && XML_Parse(parser, nullptr, 0, 1) == XML_STATUS_ERROR) {
+        printf("3MF model parser: Parse error at line %lu:\n%s\n",
+               XML_GetCurrentLineNumber(parser),
+               XML_ErrorString(XML_GetErrorCode(parser)));
+        result = false;
     }
 
-    // Free the parser and close the file.
+    // Free the parser.
     XML_ParserFree(parser);
-    fin.close();
-
-    // Remove the extracted 3dmodel.model file.
-    if (remove("3dmodel.model") != 0)
-        return false;
 
     if (result)
         ctx.endDocument();
@@ -562,6 +558,9 @@ TMFParserContext::startElement(const char *name, const char **atts)
                 const char* object_id = get_attribute(atts, "objectid");
                 if(!object_id)
                     this->stop();
+                // The mesh of the component object is needed now.
+                if(!this->build_volumes())
+                    this->stop();
                 ModelObject* component_object = m_model.objects[m_objects_indices[object_id]];
                 // Append it to the parent (current m_object) as a mesh since Slic3r doesn't support an object inside another.
                 // after applying 3d matrix transformation if found.
@@ -605,9 +604,13 @@ TMFParserContext::startElement(const char *name, const char **atts)
                 const char* z = get_attribute(atts, "z");
                 if ( !x || !y || !z)
                     this->stop();
-                m_object_vertices.push_back(atof(x));
-                m_object_vertices.push_back(atof(y));
-                m_object_vertices.push_back(atof(z));
+                for (const char* coordinate : {x, y, z}) {
+                    const char* end = coordinate + strlen(coordinate);
+                    float value = 0.f;
+                    if (!parse_float(skip_whitespace(coordinate, end), end, &value))
+                        this->stop();
+                    m_object_vertices.push_back(value);
+                }
                 node_type_new = NODE_TYPE_VERTEX;
             } else if (strcmp(name, "triangle") == 0) {
                 const char* v1 = get_attribute(atts, "v1");
@@ -681,12 +684,17 @@ TMFParserContext::endElement()
         case NODE_TYPE_OBJECT:
             if(!m_object)
                 this->stop();
-            m_object_vertices.clear();
-            m_volume_facets.clear();
+            // Keep the vertices and facets until the volumes are built.
+            m_pending_objects.push_back(PendingObject());
+            m_pending_objects.back().vertices.swap(m_object_vertices);
+            m_pending_objects.back().facets.swap(m_volume_facets);
+            m_pending_objects.back().volumes.swap(m_pending_volumes);
             m_object = nullptr;
             break;
         case NODE_TYPE_MODEL:
         {
+            if(!this->build_volumes())
+                this->stop();
             size_t deleted_objects_count = 0;
             // According to 3MF spec. we must output objects found in item.
             for (size_t i = 0; i < m_output_objects.size(); i++) {
@@ -863,29 +871,58 @@ TMFParserContext::add_volume(int start_offset, int end_offset, bool modifier)
 {
     ModelVolume* m_volume = nullptr;
 
-    // Add a new volume.
+    // Add a new volume. Its triangles are added by build_volumes().
     m_volume = m_object->add_volume(TriangleMesh());
     if(!m_volume || (end_offset < start_offset)) return nullptr;
-
-    // Add the triangles.
-    stl_file &stl = m_volume->mesh.stl;
-    stl.stats.type = inmemory;
-    stl.stats.number_of_facets = (1 + end_offset - start_offset) / 3;
-    stl.stats.original_num_facets = stl.stats.number_of_facets;
-    stl_allocate(&stl);
-    int i_facet = 0;
-    for (int i = start_offset; i <= end_offset ;) {
-        stl_facet &facet = stl.facet_start[i_facet / 3];
-        for (unsigned int v = 0; v < 3; ++v) {
-            memcpy(&facet.vertex[v].x, &m_object_vertices[m_volume_facets[i++] * 3], 3 * sizeof(float));
-            i_facet++;
-        }
-    }
-    stl_get_size(&stl);
-    m_volume->mesh.repair();
     m_volume->modifier = modifier;
+    m_pending_volumes.push_back(PendingVolume{m_volume, start_offset, end_offset});
 
     return m_volume;
 }
 
+bool
+TMFParserContext::build_volumes()
+{
+    std::vector<std::pair<const PendingObject*, const PendingVolume*>> volumes;
+    for (const auto &object : m_pending_objects)
+        for (const auto &volume : object.volumes)
+            volumes.push_back(std::make_pair(&object, &volume));
+
+    std::atomic<bool> valid(true);
+    parallelize<size_t>(0, volumes.size() - 1, [&volumes, &valid](size_t i) {
+        const PendingObject &object = *volumes[i].first;
+        const PendingVolume &volume = *volumes[i].second;
+        if (volume.end_offset >= int(object.facets.size()) || (1 + volume.end_offset - volume.start_offset) % 3 != 0) {
+            valid = false;
+            return;
+        }
+
+        // Add the triangles.
+        stl_file &stl = volume.volume->mesh.stl;
+        stl.stats.type = inmemory;
+        stl.stats.number_of_facets = (1 + volume.end_offset - volume.start_offset) / 3;
+        stl.stats.original_num_facets = stl.stats.number_of_facets;
+        stl_allocate(&stl);
+        const int num_vertices = int(object.vertices.size() / 3);
+        int i_facet = 0;
+        for (int i = volume.start_offset; i <= volume.end_offset ;) {
+            stl_facet &facet = stl.facet_start[i_facet / 3];
+            for (unsigned int v = 0; v < 3; ++v) {
+                const int vertex = object.facets[i++];
+                if (vertex < 0 || vertex >= num_vertices) {
+                    valid = false;
+                    return;
+                }
+                memcpy(&facet.vertex[v].x, &object.vertices[vertex * 3], 3 * sizeof(float));
+                i_facet++;
+            }
+        }
+        stl_get_size(&stl);
+        volume.volume->mesh.repair();
+    });
+    m_pending_objects.clear();
+
+    return valid;
+}
+
 } }
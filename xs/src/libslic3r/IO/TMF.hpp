@@ -10,6 +10,7 @@
 #include <vector>
 #include <algorithm>
 #include <cmath>
+#include <ostream>
 #include <boost/move/move.hpp>
 #include <boost/nowide/fstream.hpp>
 #include <boost/nowide/iostream.hpp>
@@ -58,17 +59,17 @@ private:
     bool write_model();
 
     /// Write the metadata of the model. This function is called by writeModel() function.
-    bool write_metadata(boost::nowide::ofstream& fout);
+    bool write_metadata(std::ostream& fout);
 
     /// Write object of the current model. This function is called by writeModel() function.
-    /// \param fout boost::nowide::ofstream& fout output stream.
+    /// \param fout std::ostream& fout output stream.
     /// \param object ModelObject* a pointer to the object to be written.
     /// \param index int the index of the object to be read
     /// \return bool 1: write operation is successful , otherwise not.
-    bool write_object(boost::nowide::ofstream& fout, const ModelObject* object, int index);
+    bool write_object(std::ostream& fout, const ModelObject* object, int index);
 
     /// Write the build element.
-    bool write_build(boost::nowide::ofstream& fout);
+    bool write_build(std::ostream& fout);
 
     /// Read the Model.
     bool read_model();
@@ -131,6 +132,27 @@ struct TMFParserContext{
     std::string m_value[3];
     ///< Generic string buffer for metadata, etc.
 
+    struct PendingVolume {
+        ModelVolume *volume;
+        int start_offset;
+        int end_offset;
+    };
+    ///< A volume whose mesh is not built yet, with its range in the facets of its object.
+
+    struct PendingObject {
+        std::vector<float> vertices;
+        std::vector<int> facets;
+        std::vector<PendingVolume> volumes;
+    };
+    ///< The vertices and facets of a parsed object, kept until its volumes are built.
+
+    std::vector<PendingVolume> m_pending_volumes;
+    ///< Volumes added to the current m_object.
+
+    std::vector<PendingObject> m_pending_objects;
+    ///< Parsed objects whose volumes are not built yet. They are built together on the
+    ///< thread pool by build_volumes().
+
     static void XMLCALL startElement(void *userData, const char *name, const char **atts);
     static void XMLCALL endElement(void *userData, const char *name);
     static void XMLCALL characters(void *userData, const XML_Char *s, int len); /* s is not 0 terminated. */
@@ -148,13 +170,17 @@ struct TMFParserContext{
     /// \return vector<double> a vector contains [translation, scale factor, xRotation, yRotation, zRotation].
     bool get_transformations(std::string matrix, std::vector<double>& transformations);
 
-    /// Add a new volume to the current object.
+    /// Add a new volume to the current object. Its mesh is built later by build_volumes().
     /// \param start_offset size_t the start index in the m_volume_facets vector.
     /// \param end_offset size_t the end index in the m_volume_facets vector.
     /// \param modifier bool whether the volume is modifier or not.
     /// \return ModelVolume* a pointer to the newly added volume.
     ModelVolume* add_volume(int start_offset, int end_offset, bool modifier);
 
+    /// Build the meshes of the pending volumes of all parsed objects in parallel.
+    /// \return bool false if a volume refers to missing facets or vertices.
+    bool build_volumes();
+
     /// Apply scale, rotate & translate to the given object.
     /// \param object ModelObject*
     /// \param transfornmations vector<int>
@@ -157,6 +157,61 @@ Layer::any_bottom_region_slice_contains(const T &item) const
 }
 template bool Layer::any_bottom_region_slice_contains<Polyline>(const Polyline &item) const;
 
+namespace {
+
+/// Makes the perimeters of a group of compatible regions, which only writes
+/// to those regions.
+void
+make_group_perimeters(const LayerRegionPtrs &layerms)
+{
+    if (layerms.size() == 1) {  // optimization
+        layerms.front()->fill_surfaces.surfaces.clear();
+        layerms.front()->make_perimeters(layerms.front()->slices, &layerms.front()->fill_surfaces);
+    } else {
+        // group slices (surfaces) according to number of extra perimeters
+        std::map<unsigned short,Surfaces> slices;  // extra_perimeters => [ surface, surface... ]
+        for (LayerRegionPtrs::const_iterator l = layerms.begin(); l != layerms.end(); ++l) {
+            for (Surfaces::iterator s = (*l)->slices.surfaces.begin(); s != (*l)->slices.surfaces.end(); ++s) {
+                slices[s->extra_perimeters].push_back(*s);
+            }
+        }
+        
+        // merge the surfaces assigned to each group
+        SurfaceCollection new_slices;
+        for (const auto &it : slices) {
+            ExPolygons expp = union_ex(it.second, true);
+            for (ExPolygon &ex : expp) {
+                Surface s = it.second.front();  // clone type and extra_perimeters
+                s.expolygon = ex;
+                new_slices.surfaces.push_back(s);
+            }
+        }
+        
+        // make perimeters
+        SurfaceCollection fill_surfaces;
+        layerms.front()->make_perimeters(new_slices, &fill_surfaces);
+        
+        // assign fill_surfaces to each layer
+        if (!fill_surfaces.surfaces.empty()) {
+            for (LayerRegionPtrs::const_iterator l = layerms.begin(); l != layerms.end(); ++l) {
+                ExPolygons expp = intersection_ex(
+                    (Polygons) fill_surfaces,
+                    (Polygons) (*l)->slices
+                );
+                (*l)->fill_surfaces.surfaces.clear();
+                
+                for (ExPolygons::iterator ex = expp.begin(); ex != expp.end(); ++ex) {
+                    Surface s = fill_surfaces.surfaces.front();  // clone type and extra_perimeters
+                    s.expolygon = *ex;
+                    (*l)->fill_surfaces.surfaces.push_back(s);
+                }
+            }
+        }
+    }
+}
+
+}
+
 /// The perimeter paths and the thin fills (ExtrusionEntityCollection) are assigned to the first compatible layer region.
 /// The resulting fill surface is split back among the originating regions.
 void
@@ -168,6 +223,7 @@ Layer::make_perimeters()
     
     // keep track of regions whose perimeters we have already generated
     std::set<size_t> done;
+    std::vector<LayerRegionPtrs> groups;
     
     FOREACH_LAYERREGION(this, layerm) {
         size_t region_id = layerm - this->regions.begin();
@@ -176,7 +232,8 @@ Layer::make_perimeters()
         const PrintRegionConfig &config = (*layerm)->region()->config;
         
         // find compatible regions
-        LayerRegionPtrs layerms;
+        groups.emplace_back();
+        LayerRegionPtrs &layerms = groups.back();
         layerms.push_back(*layerm);
         for (LayerRegionPtrs::const_iterator it = layerm + 1; it != this->regions.end(); ++it) {
             LayerRegion* other_layerm = *it;
@@ -194,52 +251,15 @@ Layer::make_perimeters()
                 done.insert(it - this->regions.begin());
             }
         }
-        
-        if (layerms.size() == 1) {  // optimization
-            (*layerm)->fill_surfaces.surfaces.clear();
-            (*layerm)->make_perimeters((*layerm)->slices, &(*layerm)->fill_surfaces);
-        } else {
-            // group slices (surfaces) according to number of extra perimeters
-            std::map<unsigned short,Surfaces> slices;  // extra_perimeters => [ surface, surface... ]
-            for (LayerRegionPtrs::iterator l = layerms.begin(); l != layerms.end(); ++l) {
-                for (Surfaces::iterator s = (*l)->slices.surfaces.begin(); s != (*l)->slices.surfaces.end(); ++s) {
-                    slices[s->extra_perimeters].push_back(*s);
-                }
-            }
-            
-            // merge the surfaces assigned to each group
-            SurfaceCollection new_slices;
-            for (const auto &it : slices) {
-                ExPolygons expp = union_ex(it.second, true);
-                for (ExPolygon &ex : expp) {
-                    Surface s = it.second.front();  // clone type and extra_perimeters
-                    s.expolygon = ex;
-                    new_slices.surfaces.push_back(s);
-                }
-            }
-            
-            // make perimeters
-            SurfaceCollection fill_surfaces;
-            (*layerm)->make_perimeters(new_slices, &fill_surfaces);
-            
-            // assign fill_surfaces to each layer
-            if (!fill_surfaces.surfaces.empty()) {
-                for (LayerRegionPtrs::iterator l = layerms.begin(); l != layerms.end(); ++l) {
-                    ExPolygons expp = intersection_ex(
-                        (Polygons) fill_surfaces,
-                        (Polygons) (*l)->slices
-                    );
-                    (*l)->fill_surfaces.surfaces.clear();
-                    
-                    for (ExPolygons::iterator ex = expp.begin(); ex != expp.end(); ++ex) {
-                        Surface s = fill_surfaces.surfaces.front();  // clone type and extra_perimeters
-                        s.expolygon = *ex;
-                        (*l)->fill_surfaces.surfaces.push_back(s);
-                    }
-                }
-            }
-        }
     }
+    
+    // the groups don't share regions, so they are processed in parallel
+    parallelize<size_t>(
+        0,
+        groups.size()-1,
+        [&groups](size_t i) { make_group_perimeters(groups[i]); },
+        this->object()->print()->config.threads.value
+    );
 }
 
 /// Iterates over all of the LayerRegion and invokes LayerRegion->make_fill()
@@ -129,6 +129,7 @@ LayerRegion::process_external_surfaces()
                 this->layer()->lower_layer->slices,
                 this->flow(frInfill, true).scaled_width()
             );
+            bd.threads = this->layer()->object()->print()->config.threads.value;
             
             #ifdef SLIC3R_DEBUG
             printf("Processing bridge at layer %zu (z = %f):\n", this->layer()->id(), this->layer()->print_z);
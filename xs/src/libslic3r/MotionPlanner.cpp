@@ -1,6 +1,9 @@
 #include "BoundingBox.hpp"
 #include "MotionPlanner.hpp"
+#include <algorithm>
+#include <functional>
 #include <limits> // for numeric_limits
+#include <queue>
 #include <assert.h>
 
 #include "boost/polygon/voronoi.hpp"
@@ -90,6 +93,7 @@ MotionPlanner::shortest_path(const Point &from, const Point &to)
     // Are both points in the same island?
     int island_idx = -1;
     for (std::vector<MotionPlannerEnv>::const_iterator island = this->islands.begin(); island != this->islands.end(); ++island) {
+        if (!island->bounding_box.contains(from) || !island->bounding_box.contains(to)) continue;
         if (island->island.contains(from) && island->island.contains(to)) {
             // since both points are in the same island, is a direct move possible?
             // if so, we avoid generating the visibility environment
@@ -105,7 +109,7 @@ MotionPlanner::shortest_path(const Point &from, const Point &to)
     this->initialize();
     
     // get environment
-    MotionPlannerEnv env = this->get_env(island_idx);
+    const MotionPlannerEnv &env = this->get_env(island_idx);
     if (env.env.expolygons.empty()) {
         // if this environment is empty (probably because it's too small), perform straight move
         // and avoid running the algorithms on empty dataset
@@ -142,7 +146,7 @@ MotionPlanner::shortest_path(const Point &from, const Point &to)
     {
         // grow our environment slightly in order for simplify_by_visibility()
         // to work best by considering moves on boundaries valid as well
-        ExPolygonCollection grown_env(offset_ex((Polygons)env.env, +SCALED_EPSILON));
+        const ExPolygonCollection &grown_env = graph->grown_env;
         
         if (island_idx == -1) {
             /*  If 'from' or 'to' are not inside our env, they were connected using the 
@@ -218,7 +222,7 @@ MotionPlanner::init_graph(int island_idx)
         t_vd_vertices vd_vertices;
         
         // get boundaries as lines
-        MotionPlannerEnv env = this->get_env(island_idx);
+        const MotionPlannerEnv &env = this->get_env(island_idx);
         Lines lines = env.env.lines();
         boost::polygon::construct_voronoi(lines.begin(), lines.end(), &vd);
         
@@ -256,6 +260,8 @@ MotionPlanner::init_graph(int island_idx)
             double dist = graph->nodes[v0_idx].distance_to(graph->nodes[v1_idx]);
             graph->add_edge(v0_idx, v1_idx, dist);
         }
+        graph->index_nodes();
+        graph->grown_env = ExPolygonCollection(offset_ex((Polygons)env.env, +SCALED_EPSILON));
         
         return graph;
     }
@@ -292,23 +298,34 @@ MotionPlannerEnv::nearest_env_point(const Point &from, const Point &to) const
         }
     }
     
+    /*  Sort the points in the order nearest_waypoint_index() would find them
+        closest to both 'from' and 'to' if they were discarded one after the other:
+        the first one coinciding with both, or the last one of those at the
+        minimum distance. */
+    std::vector<double> distances;
+    distances.reserve(pp.size());
+    for (const Point &p : pp)
+        distances.push_back((pow(from.x - p.x, 2) + pow(from.y - p.y, 2)) + (pow(p.x - to.x, 2) + pow(p.y - to.y, 2)));
+    std::vector<size_t> order(pp.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&distances] (size_t a, size_t b) {
+        const bool a_coincides = distances[a] < EPSILON, b_coincides = distances[b] < EPSILON;
+        if (a_coincides != b_coincides) return a_coincides;
+        if (a_coincides) return a < b;
+        if (distances[a] != distances[b]) return distances[a] < distances[b];
+        return a > b;
+    });
+    
     /*  Find the candidate result and check that it doesn't cross too many boundaries. */
-    while (pp.size() >= 2) {
-        // find the point in pp that is closest to both 'from' and 'to'
-        size_t result = from.nearest_waypoint_index(pp, to);
-        
+    for (size_t i = 0; i + 1 < order.size(); ++i) {
         // as we assume 'from' is outside env, any node will require at least one crossing
-        if (intersection_ln(Line(from, pp[result]), this->island).size() > 1) {
-            // discard result
-            pp.erase(pp.begin() + result);
-        } else {
-            return pp[result];
-        }
+        if (intersection_ln(Line(from, pp[order[i]]), this->island).size() <= 1)
+            return pp[order[i]];
     }
     
     // if we're here, return last point if any (better than nothing)
     if (!pp.empty()) {
-        return pp.front();
+        return pp[order.back()];
     }
     
     // if we have no points at all, then we have an empty environment and we
@@ -326,15 +343,48 @@ MotionPlannerGraph::add_edge(node_t from, node_t to, double weight)
     this->adjacency_list[from].push_back(neighbor(to, weight));
 }
 
+void
+MotionPlannerGraph::index_nodes()
+{
+    this->nodes_by_x.resize(this->nodes.size());
+    for (size_t i = 0; i < this->nodes.size(); ++i) this->nodes_by_x[i] = i;
+    std::sort(this->nodes_by_x.begin(), this->nodes_by_x.end(), [this] (node_t a, node_t b) {
+        return this->nodes[a].x < this->nodes[b].x;
+    });
+}
+
 size_t
 MotionPlannerGraph::find_node(const Point &point) const
 {
-    /*
-    for (Points::const_iterator p = this->nodes.begin(); p != this->nodes.end(); ++p) {
-        if (p->coincides_with(point)) return p - this->nodes.begin();
+    if (this->nodes_by_x.size() != this->nodes.size())
+        return point.nearest_point_index(this->nodes);
+    
+    /*  Walk away from the x of point on both sides until the x distance alone
+        is more than the best distance. Of the nodes at the same distance,
+        nearest_point_index() returns the first one that coincides with point,
+        or else the last one. */
+    int best = -1;
+    double best_distance = -1;
+    const auto consider = [this, &point, &best, &best_distance] (node_t node) {
+        const double d = pow(point.x - this->nodes[node].x, 2) + pow(point.y - this->nodes[node].y, 2);
+        if (best == -1 || d < best_distance
+            || (d == best_distance && (best_distance < EPSILON ? node < best : node > best))) {
+            best = node;
+            best_distance = d;
+        }
+    };
+    const auto right = std::lower_bound(this->nodes_by_x.begin(), this->nodes_by_x.end(), point.x,
+        [this] (node_t node, coord_t x) { return this->nodes[node].x < x; });
+    for (auto it = right; it != this->nodes_by_x.end(); ++it) {
+        if (best != -1 && pow(this->nodes[*it].x - point.x, 2) > best_distance) break;
+        consider(*it);
     }
-    */
-    return point.nearest_point_index(this->nodes);
+    for (auto it = right; it != this->nodes_by_x.begin(); ) {
+        --it;
+        if (best != -1 && pow(point.x - this->nodes[*it].x, 2) > best_distance) break;
+        consider(*it);
+    }
+    return best;
 }
 
 Polyline
@@ -357,25 +407,25 @@ MotionPlannerGraph::shortest_path(node_t from, node_t to)
         dist[from] = 0;  // distance from 'from' to itself
         previous.clear();
         previous.resize(n, -1);
+        std::vector<bool> visited(n, false);
         
-        // initialize the Q with all nodes
-        std::set<node_t> Q;
-        for (node_t i = 0; i < n; ++i) Q.insert(i);
+        // the nodes reached so far by their distance, then their index, the
+        // order they used to be taken from the set of all nodes in; the nodes
+        // never reached can't shorten any distance
+        typedef std::pair<weight_t, node_t> queued_t;
+        std::priority_queue<queued_t, std::vector<queued_t>, std::greater<queued_t> > Q;
+        Q.push(queued_t(0, from));
         
         while (!Q.empty()) 
         {
             // get node in Q having the minimum dist ('from' in the first loop)
-            node_t u;
-            {
-                double min_dist = -1;
-                for (std::set<node_t>::const_iterator n = Q.begin(); n != Q.end(); ++n) {
-                    if (dist[*n] < min_dist || min_dist == -1) {
-                        u = *n;
-                        min_dist = dist[*n];
-                    }
-                }
-            }
-            Q.erase(u);
+            const node_t u = Q.top().second;
+            const weight_t u_dist = Q.top().first;
+            Q.pop();
+            
+            // skip it if it was queued again with a shorter distance
+            if (visited[u] || u_dist > dist[u]) continue;
+            visited[u] = true;
             
             // stop searching if we reached our destination
             if (u == to) break;
@@ -390,7 +440,7 @@ MotionPlannerGraph::shortest_path(node_t from, node_t to)
                 node_t v = neighbor_iter->target;
                 
                 // skip if we already visited this
-                if (Q.find(v) == Q.end()) continue;
+                if (v >= n || visited[v]) continue;
                 
                 // calculate total distance
                 weight_t alt = dist[u] + neighbor_iter->weight;
@@ -400,6 +450,7 @@ MotionPlannerGraph::shortest_path(node_t from, node_t to)
                 if (alt < dist[v]) {
                     dist[v]     = alt;
                     previous[v] = u;
+                    Q.push(queued_t(alt, v));
                 }
 
             }
@@ -2,6 +2,7 @@
 #define slic3r_MotionPlanner_hpp_
 
 #include "libslic3r.h"
+#include "BoundingBox.hpp"
 #include "ClipperUtils.hpp"
 #include "ExPolygonCollection.hpp"
 #include "Polyline.hpp"
@@ -22,9 +23,10 @@ class MotionPlannerEnv
     
     public:
     ExPolygon island;
+    BoundingBox bounding_box;   ///< of island, to skip it quickly
     ExPolygonCollection env;
     MotionPlannerEnv() {};
-    MotionPlannerEnv(const ExPolygon &island) : island(island) {};
+    MotionPlannerEnv(const ExPolygon &island) : island(island), bounding_box(island.contour.bounding_box()) {};
     Point nearest_env_point(const Point &from, const Point &to) const;
 };
 
@@ -43,11 +45,20 @@ class MotionPlannerGraph
     };
     typedef std::vector< std::vector<neighbor> > adjacency_list_t;
     adjacency_list_t adjacency_list;
+    /// The nodes sorted by x, for find_node(). Built by index_nodes().
+    std::vector<node_t> nodes_by_x;
+    /// The env of the graph grown by SCALED_EPSILON, which the paths are
+    /// simplified within.
+    ExPolygonCollection grown_env;
     
     public:
     Points nodes;
     //std::map<std::pair<size_t,size_t>, double> edges;
     void add_edge(node_t from, node_t to, double weight);
+    /// Index the nodes once they are all added.
+    void index_nodes();
+    /// The node nearest to point, the one Point::nearest_point_index() would
+    /// find in nodes.
     size_t find_node(const Point &point) const;
     Polyline shortest_path(node_t from, node_t to);
 };
@@ -11,18 +11,60 @@ PerimeterGenerator::process()
 {
     // other perimeters
     this->_mm3_per_mm           = this->perimeter_flow.mm3_per_mm();
+    
+    // external perimeters
+    this->_ext_mm3_per_mm       = this->ext_perimeter_flow.mm3_per_mm();
+    
+    // overhang perimeters
+    this->_mm3_per_mm_overhang  = this->overhang_flow.mm3_per_mm();
+    
+    // prepare grown lower layer slices for overhang detection
+    if (this->lower_slices != NULL && this->config->overhangs) {
+        // We consider overhang any part where the entire nozzle diameter is not supported by the
+        // lower layer, so we take lower slices and offset them by half the nozzle diameter used 
+        // in the current layer
+        double nozzle_diameter = this->print_config->nozzle_diameter.get_at(this->config->perimeter_extruder-1);
+        
+        this->_lower_slices_p = offset(*this->lower_slices, scale_(+nozzle_diameter/2));
+    }
+    
+    // we need to process each island separately because we might have different
+    // extra perimeters for each one; the islands only read the generator, so
+    // they are processed in parallel and their outputs appended in slice order
+    const Surfaces &surfaces = this->slices->surfaces;
+    std::vector<ExtrusionEntityCollection> loops(surfaces.size()), gap_fill(surfaces.size());
+    std::vector<SurfaceCollection> fill_surfaces(surfaces.size());
+    parallelize<size_t>(
+        0,
+        surfaces.size()-1,
+        [this, &surfaces, &loops, &gap_fill, &fill_surfaces](size_t i) {
+            this->_process_island(surfaces[i], &loops[i], &gap_fill[i], &fill_surfaces[i]);
+        },
+        this->print_config->threads.value
+    );
+    
+    for (size_t i = 0; i < surfaces.size(); ++i) {
+        // append perimeters for this slice as a collection
+        if (!loops[i].empty())
+            this->loops->append(loops[i]);
+        this->gap_fill->append(gap_fill[i].entities);
+        this->fill_surfaces->append(fill_surfaces[i]);
+    }
+}
+
+void
+PerimeterGenerator::_process_island(const Surface &surface, ExtrusionEntityCollection* island_loops,
+    ExtrusionEntityCollection* island_gap_fill, SurfaceCollection* island_fill_surfaces) const
+{
+    // other perimeters
     coord_t pwidth              = this->perimeter_flow.scaled_width();
     coord_t pspacing            = this->perimeter_flow.scaled_spacing();
     
     // external perimeters
-    this->_ext_mm3_per_mm       = this->ext_perimeter_flow.mm3_per_mm();
     coord_t ext_pwidth          = this->ext_perimeter_flow.scaled_width();
     coord_t ext_pspacing        = this->ext_perimeter_flow.scaled_spacing();
     coord_t ext_pspacing2       = this->ext_perimeter_flow.scaled_spacing(this->perimeter_flow);
     
-    // overhang perimeters
-    this->_mm3_per_mm_overhang  = this->overhang_flow.mm3_per_mm();
-    
     // solid infill
     coord_t ispacing            = this->solid_infill_flow.scaled_spacing();
     
@@ -42,310 +84,298 @@ PerimeterGenerator::process()
     // minimum shell thickness
     coord_t min_shell_thickness = scale_(this->config->min_shell_thickness);
     
-    // prepare grown lower layer slices for overhang detection
-    if (this->lower_slices != NULL && this->config->overhangs) {
-        // We consider overhang any part where the entire nozzle diameter is not supported by the
-        // lower layer, so we take lower slices and offset them by half the nozzle diameter used 
-        // in the current layer
-        double nozzle_diameter = this->print_config->nozzle_diameter.get_at(this->config->perimeter_extruder-1);
-        
-        this->_lower_slices_p = offset(*this->lower_slices, scale_(+nozzle_diameter/2));
-    }
+    // the offsets and boolean operations of the island are chained in Clipper form
+    ClipperContext clipper;
     
-    // we need to process each island separately because we might have different
-    // extra perimeters for each one
-    for (Surfaces::const_iterator surface = this->slices->surfaces.begin();
-        surface != this->slices->surfaces.end(); ++surface) {
-        // detect how many perimeters must be generated for this island
-        int loops = this->config->perimeters + surface->extra_perimeters;
+    // detect how many perimeters must be generated for this island
+    int loops = this->config->perimeters + surface.extra_perimeters;
 
-        // If the user has defined a minimum shell thickness compute the number of loops needed to satisfy
-        if (min_shell_thickness > 0) {
-            int min_loops = 1;
+    // If the user has defined a minimum shell thickness compute the number of loops needed to satisfy
+    if (min_shell_thickness > 0) {
+        int min_loops = 1;
 
-            min_loops += ceil(((float)min_shell_thickness-ext_pwidth)/pwidth);
+        min_loops += ceil(((float)min_shell_thickness-ext_pwidth)/pwidth);
 
-            if (loops < min_loops)
-                loops = min_loops;
-        }
+        if (loops < min_loops)
+            loops = min_loops;
+    }
 
-        const int loop_number = loops-1;  // 0-indexed loops
-        
+    const int loop_number = loops-1;  // 0-indexed loops
+    
 
-        Polygons gaps;
+    ClipperLib::Paths gaps;
+    
+    ClipperLib::Paths last = ClipperContext::paths(surface.expolygon.simplify_p(SCALED_RESOLUTION));
+    if (loop_number >= 0) {  // no loops = -1
         
-        Polygons last = surface->expolygon.simplify_p(SCALED_RESOLUTION);
-        if (loop_number >= 0) {  // no loops = -1
-            
-            std::vector<PerimeterGeneratorLoops> contours(loop_number+1);    // depth => loops
-            std::vector<PerimeterGeneratorLoops> holes(loop_number+1);       // depth => loops
-            ThickPolylines thin_walls;
-            
-            // we loop one time more than needed in order to find gaps after the last perimeter was applied
-            for (int i = 0; i <= loop_number+1; ++i) {  // outer loop is 0
-                Polygons offsets;
-                if (i == 0) {
-                    // the minimum thickness of a single loop is:
-                    // ext_width/2 + ext_spacing/2 + spacing/2 + width/2
-                    if (this->config->thin_walls) {
-                        offsets = offset2(
-                            last,
-                            -(ext_pwidth/2 + ext_min_spacing/2 - 1),
-                            +(ext_min_spacing/2 - 1)
-                        );
-                    } else {
-                        offsets = offset(last, -ext_pwidth/2);
-                    }
+        std::vector<PerimeterGeneratorLoops> contours(loop_number+1);    // depth => loops
+        std::vector<PerimeterGeneratorLoops> holes(loop_number+1);       // depth => loops
+        ThickPolylines thin_walls;
+        
+        // we loop one time more than needed in order to find gaps after the last perimeter was applied
+        for (int i = 0; i <= loop_number+1; ++i) {  // outer loop is 0
+            ClipperLib::Paths offsets;
+            if (i == 0) {
+                // the minimum thickness of a single loop is:
+                // ext_width/2 + ext_spacing/2 + spacing/2 + width/2
+                if (this->config->thin_walls) {
+                    offsets = clipper.offset2(
+                        last,
+                        -(ext_pwidth/2 + ext_min_spacing/2 - 1),
+                        +(ext_min_spacing/2 - 1)
+                    );
+                } else {
+                    offsets = clipper.offset(last, -ext_pwidth/2);
+                }
+                
+                // look for thin walls
+                if (this->config->thin_walls) {
+                    const ClipperLib::Paths no_thin_zone = clipper.offset(offsets, +ext_pwidth/2);
+                    ClipperLib::Paths diffpp = clipper.diff(
+                        last,
+                        no_thin_zone,
+                        true  // medial axis requires non-overlapping geometry
+                    );
                     
-                    // look for thin walls
-                    if (this->config->thin_walls) {
-                        Polygons no_thin_zone = offset(offsets, +ext_pwidth/2);
-                        Polygons diffpp = diff(
-                            last,
-                            no_thin_zone,
-                            true  // medial axis requires non-overlapping geometry
-                        );
-                        
-                        // the following offset2 ensures almost nothing in @thin_walls is narrower than $min_width
-                        // (actually, something larger than that still may exist due to mitering or other causes)
-                        coord_t min_width = scale_(this->ext_perimeter_flow.nozzle_diameter / 3);
-                        ExPolygons expp = offset2_ex(diffpp, -min_width/2, +min_width/2);
+                    // the following offset2 ensures almost nothing in @thin_walls is narrower than $min_width
+                    // (actually, something larger than that still may exist due to mitering or other causes)
+                    coord_t min_width = scale_(this->ext_perimeter_flow.nozzle_diameter / 3);
+                    ExPolygons expp = clipper.expolygons(clipper.offset2(std::move(diffpp), -min_width/2, +min_width/2));
 						
-                         // compute a bit of overlap to anchor thin walls inside the print.
-                        ExPolygons anchor = intersection_ex(to_polygons(offset_ex(expp, (float)(ext_pwidth / 2))), no_thin_zone, true);
-                        
-                        // the maximum thickness of our thin wall area is equal to the minimum thickness of a single loop
-                        for (ExPolygons::const_iterator ex = expp.begin(); ex != expp.end(); ++ex) {
-                            ExPolygons bounds = _clipper_ex(ClipperLib::ctUnion, (Polygons)*ex, to_polygons(anchor), true);
+                     // compute a bit of overlap to anchor thin walls inside the print.
+                    ExPolygons anchor = clipper.intersection_ex(
+                        ClipperContext::paths(clipper.expolygons(clipper.offset(ClipperContext::paths(expp), (float)(ext_pwidth / 2)))),
+                        no_thin_zone, true);
+                    
+                    // the maximum thickness of our thin wall area is equal to the minimum thickness of a single loop
+                    for (ExPolygons::const_iterator ex = expp.begin(); ex != expp.end(); ++ex) {
+                        ExPolygons bounds = _clipper_ex(ClipperLib::ctUnion, (Polygons)*ex, to_polygons(anchor), true);
 							//search our bound
-                            for (ExPolygon &bound : bounds) {
-                                if (!intersection_ex(*ex, bound).empty()) {
-                                    // the maximum thickness of our thin wall area is equal to the minimum thickness of a single loop
-                                    ex->medial_axis(bound, ext_pwidth + ext_pspacing2, min_width, &thin_walls);
-                                    continue;
-                                }
+                        for (ExPolygon &bound : bounds) {
+                            if (!intersection_ex(*ex, bound).empty()) {
+                                // the maximum thickness of our thin wall area is equal to the minimum thickness of a single loop
+                                ex->medial_axis(bound, ext_pwidth + ext_pspacing2, min_width, &thin_walls);
+                                continue;
                             }
                         }
-                        #ifdef DEBUG
-                        printf("  %zu thin walls detected\n", thin_walls.size());
-                        #endif
-                        
-                        /*
-                        if (false) {
-                            require "Slic3r/SVG.pm";
-                            Slic3r::SVG::output(
-                                "medial_axis.svg",
-                                no_arrows       => 1,
-                                #expolygons      => \@expp,
-                                polylines       => \@thin_walls,
-                            );
-                        }
-                        */
                     }
-                } else {
-                    //FIXME Is this offset correct if the line width of the inner perimeters differs
-                    // from the line width of the infill?
-                    coord_t distance = (i == 1) ? ext_pspacing2 : pspacing;
+                    #ifdef DEBUG
+                    printf("  %zu thin walls detected\n", thin_walls.size());
+                    #endif
                     
-                    if (this->config->thin_walls) {
-                        // This path will ensure, that the perimeters do not overfill, as in 
-                        // prusa3d/Slic3r GH #32, but with the cost of rounding the perimeters
-                        // excessively, creating gaps, which then need to be filled in by the not very 
-                        // reliable gap fill algorithm.
-                        // Also the offset2(perimeter, -x, x) may sometimes lead to a perimeter, which is larger than
-                        // the original.
-                        offsets = offset2(
-                            last,
-                            -(distance + min_spacing/2 - 1),
-                            +(min_spacing/2 - 1)
-                        );
-                    } else {
-                        // If "detect thin walls" is not enabled, this paths will be entered, which 
-                        // leads to overflows, as in prusa3d/Slic3r GH #32
-                        offsets = offset(
-                            last,
-                            -distance
+                    /*
+                    if (false) {
+                        require "Slic3r/SVG.pm";
+                        Slic3r::SVG::output(
+                            "medial_axis.svg",
+                            no_arrows       => 1,
+                            #expolygons      => \@expp,
+                            polylines       => \@thin_walls,
                         );
                     }
-                    
-                    // look for gaps
-                    if (this->config->fill_gaps && this->config->fill_density.value > 0) {
-                        // not using safety offset here would "detect" very narrow gaps
-                        // (but still long enough to escape the area threshold) that gap fill
-                        // won't be able to fill but we'd still remove from infill area
-                        Polygons diff_pp = diff(
-                            offset(last, -0.5*distance),
-                            offset(offsets, +0.5*distance + 10)  // safety offset
-                        );
-                        gaps.insert(gaps.end(), diff_pp.begin(), diff_pp.end());
-                    }
+                    */
                 }
+            } else {
+                //FIXME Is this offset correct if the line width of the inner perimeters differs
+                // from the line width of the infill?
+                coord_t distance = (i == 1) ? ext_pspacing2 : pspacing;
                 
-                if (offsets.empty()) break;
-                if (i > loop_number) break; // we were only looking for gaps this time
+                if (this->config->thin_walls) {
+                    // This path will ensure, that the perimeters do not overfill, as in 
+                    // prusa3d/Slic3r GH #32, but with the cost of rounding the perimeters
+                    // excessively, creating gaps, which then need to be filled in by the not very 
+                    // reliable gap fill algorithm.
+                    // Also the offset2(perimeter, -x, x) may sometimes lead to a perimeter, which is larger than
+                    // the original.
+                    offsets = clipper.offset2(
+                        last,
+                        -(distance + min_spacing/2 - 1),
+                        +(min_spacing/2 - 1)
+                    );
+                } else {
+                    // If "detect thin walls" is not enabled, this paths will be entered, which 
+                    // leads to overflows, as in prusa3d/Slic3r GH #32
+                    offsets = clipper.offset(
+                        last,
+                        -distance
+                    );
+                }
                 
-                last = offsets;
-                for (Polygons::const_iterator polygon = offsets.begin(); polygon != offsets.end(); ++polygon) {
-                    PerimeterGeneratorLoop loop(*polygon, i);
-                    loop.is_contour = polygon->is_counter_clockwise();
-                    if (loop.is_contour) {
-                        contours[i].push_back(loop);
-                    } else {
-                        holes[i].push_back(loop);
-                    }
+                // look for gaps
+                if (this->config->fill_gaps && this->config->fill_density.value > 0) {
+                    // not using safety offset here would "detect" very narrow gaps
+                    // (but still long enough to escape the area threshold) that gap fill
+                    // won't be able to fill but we'd still remove from infill area
+                    const ClipperLib::Paths diff_pp = clipper.diff(
+                        clipper.offset(last, -0.5*distance),
+                        clipper.offset(offsets, +0.5*distance + 10)  // safety offset
+                    );
+                    gaps.insert(gaps.end(), diff_pp.begin(), diff_pp.end());
                 }
             }
             
-            // nest loops: holes first
-            for (int d = 0; d <= loop_number; ++d) {
-                PerimeterGeneratorLoops &holes_d = holes[d];
-                
-                // loop through all holes having depth == d
-                for (int i = 0; i < (int)holes_d.size(); ++i) {
-                    const PerimeterGeneratorLoop &loop = holes_d[i];
-                    
-                    // find the hole loop that contains this one, if any
-                    for (int t = d+1; t <= loop_number; ++t) {
-                        for (int j = 0; j < (int)holes[t].size(); ++j) {
-                            PerimeterGeneratorLoop &candidate_parent = holes[t][j];
-                            if (candidate_parent.polygon.contains(loop.polygon.first_point())) {
-                                candidate_parent.children.push_back(loop);
-                                holes_d.erase(holes_d.begin() + i);
-                                --i;
-                                goto NEXT_LOOP;
-                            }
-                        }
-                    }
-                    
-                    // if no hole contains this hole, find the contour loop that contains it
-                    for (int t = loop_number; t >= 0; --t) {
-                        for (int j = 0; j < (int)contours[t].size(); ++j) {
-                            PerimeterGeneratorLoop &candidate_parent = contours[t][j];
-                            if (candidate_parent.polygon.contains(loop.polygon.first_point())) {
-                                candidate_parent.children.push_back(loop);
-                                holes_d.erase(holes_d.begin() + i);
-                                --i;
-                                goto NEXT_LOOP;
-                            }
-                        }
-                    }
-                    NEXT_LOOP: ;
+            if (offsets.empty()) break;
+            if (i > loop_number) break; // we were only looking for gaps this time
+            
+            const Polygons polygons = ClipperContext::polygons(offsets);
+            last = std::move(offsets);
+            for (Polygons::const_iterator polygon = polygons.begin(); polygon != polygons.end(); ++polygon) {
+                PerimeterGeneratorLoop loop(*polygon, i);
+                loop.is_contour = polygon->is_counter_clockwise();
+                if (loop.is_contour) {
+                    contours[i].push_back(loop);
+                } else {
+                    holes[i].push_back(loop);
                 }
             }
+        }
         
-            // nest contour loops
-            for (int d = loop_number; d >= 1; --d) {
-                PerimeterGeneratorLoops &contours_d = contours[d];
+        // nest loops: holes first
+        for (int d = 0; d <= loop_number; ++d) {
+            PerimeterGeneratorLoops &holes_d = holes[d];
+            
+            // loop through all holes having depth == d
+            for (int i = 0; i < (int)holes_d.size(); ++i) {
+                const PerimeterGeneratorLoop &loop = holes_d[i];
                 
-                // loop through all contours having depth == d
-                for (int i = 0; i < (int)contours_d.size(); ++i) {
-                    const PerimeterGeneratorLoop &loop = contours_d[i];
+                // find the hole loop that contains this one, if any
+                for (int t = d+1; t <= loop_number; ++t) {
+                    for (int j = 0; j < (int)holes[t].size(); ++j) {
+                        PerimeterGeneratorLoop &candidate_parent = holes[t][j];
+                        if (candidate_parent.polygon.contains(loop.polygon.first_point())) {
+                            candidate_parent.children.push_back(loop);
+                            holes_d.erase(holes_d.begin() + i);
+                            --i;
+                            goto NEXT_LOOP;
+                        }
+                    }
+                }
                 
-                    // find the contour loop that contains it
-                    for (int t = d-1; t >= 0; --t) {
-                        for (size_t j = 0; j < contours[t].size(); ++j) {
-                            PerimeterGeneratorLoop &candidate_parent = contours[t][j];
-                            if (candidate_parent.polygon.contains(loop.polygon.first_point())) {
-                                candidate_parent.children.push_back(loop);
-                                contours_d.erase(contours_d.begin() + i);
-                                --i;
-                                goto NEXT_CONTOUR;
-                            }
+                // if no hole contains this hole, find the contour loop that contains it
+                for (int t = loop_number; t >= 0; --t) {
+                    for (int j = 0; j < (int)contours[t].size(); ++j) {
+                        PerimeterGeneratorLoop &candidate_parent = contours[t][j];
+                        if (candidate_parent.polygon.contains(loop.polygon.first_point())) {
+                            candidate_parent.children.push_back(loop);
+                            holes_d.erase(holes_d.begin() + i);
+                            --i;
+                            goto NEXT_LOOP;
                         }
                     }
-                    
-                    NEXT_CONTOUR: ;
                 }
+                NEXT_LOOP: ;
             }
-        
-            // at this point, all loops should be in contours[0]
-            
-            ExtrusionEntityCollection entities = this->_traverse_loops(contours.front(), thin_walls);
-            
-            // if brim will be printed, reverse the order of perimeters so that
-            // we continue inwards after having finished the brim
-            // TODO: add test for perimeter order
-            if (this->config->external_perimeters_first
-                || (this->layer_id == 0 && this->print_config->brim_width.value > 0))
-                    entities.reverse();
-            
-            // append perimeters for this slice as a collection
-            if (!entities.empty())
-                this->loops->append(entities);
         }
-        
-        // fill gaps
-        if (!gaps.empty()) {
-            /*
-            SVG svg("gaps.svg");
-            svg.draw(union_ex(gaps));
-            svg.Close();
-            */
-            
-            // collapse 
-            double min = 0.2*pwidth * (1 - INSET_OVERLAP_TOLERANCE);
-            double max = 2*pspacing;
-            ExPolygons gaps_ex = diff_ex(
-                offset2(gaps, -min/2, +min/2),
-                offset2(gaps, -max/2, +max/2),
-                true
-            );
+    
+        // nest contour loops
+        for (int d = loop_number; d >= 1; --d) {
+            PerimeterGeneratorLoops &contours_d = contours[d];
             
-            ThickPolylines polylines;
-            for (ExPolygons::const_iterator ex = gaps_ex.begin(); ex != gaps_ex.end(); ++ex)
-                ex->medial_axis(*ex, max, min, &polylines);
+            // loop through all contours having depth == d
+            for (int i = 0; i < (int)contours_d.size(); ++i) {
+                const PerimeterGeneratorLoop &loop = contours_d[i];
             
-            if (!polylines.empty()) {
-                ExtrusionEntityCollection gap_fill = this->_variable_width(polylines, 
-                    erGapFill, this->solid_infill_flow);
+                // find the contour loop that contains it
+                for (int t = d-1; t >= 0; --t) {
+                    for (size_t j = 0; j < contours[t].size(); ++j) {
+                        PerimeterGeneratorLoop &candidate_parent = contours[t][j];
+                        if (candidate_parent.polygon.contains(loop.polygon.first_point())) {
+                            candidate_parent.children.push_back(loop);
+                            contours_d.erase(contours_d.begin() + i);
+                            --i;
+                            goto NEXT_CONTOUR;
+                        }
+                    }
+                }
                 
-                this->gap_fill->append(gap_fill.entities);
-            
-                /*  Make sure we don't infill narrow parts that are already gap-filled
-                    (we only consider this surface's gaps to reduce the diff() complexity).
-                    Growing actual extrusions ensures that gaps not filled by medial axis
-                    are not subtracted from fill surfaces (they might be too short gaps
-                    that medial axis skips but infill might join with other infill regions
-                    and use zigzag).  */
-                //FIXME Vojtech: This grows by a rounded extrusion width, not by line spacing,
-                // therefore it may cover the area, but no the volume.
-                last = diff(last, gap_fill.grow());
+                NEXT_CONTOUR: ;
             }
         }
+    
+        // at this point, all loops should be in contours[0]
         
-        // create one more offset to be used as boundary for fill
-        // we offset by half the perimeter spacing (to get to the actual infill boundary)
-        // and then we offset back and forth by half the infill spacing to only consider the
-        // non-collapsing regions
-        coord_t inset = 0;
-        if (loop_number == 0) {
-            // one loop
-            inset += ext_pspacing2/2;
-        } else if (loop_number > 0) {
-            // two or more loops
-            inset += pspacing/2;
-        }
+        ExtrusionEntityCollection entities = this->_traverse_loops(contours.front(), thin_walls);
         
-        {
-            ExPolygons expp = union_ex(last);
-            
-            // simplify infill contours according to resolution
-            Polygons pp;
-            for (ExPolygons::const_iterator ex = expp.begin(); ex != expp.end(); ++ex)
-                ex->simplify_p(SCALED_RESOLUTION, &pp);
-            
-            // collapse too narrow infill areas
-            coord_t min_perimeter_infill_spacing = ispacing * (1 - INSET_OVERLAP_TOLERANCE);
-            expp = offset2_ex(
-                pp,
-                -inset -min_perimeter_infill_spacing/2,
-                +min_perimeter_infill_spacing/2
-            );
+        // if brim will be printed, reverse the order of perimeters so that
+        // we continue inwards after having finished the brim
+        // TODO: add test for perimeter order
+        if (this->config->external_perimeters_first
+            || (this->layer_id == 0 && this->print_config->brim_width.value > 0))
+                entities.reverse();
+        
+        island_loops->swap(entities);
+    }
+    
+    // fill gaps
+    if (!gaps.empty()) {
+        /*
+        SVG svg("gaps.svg");
+        svg.draw(union_ex(gaps));
+        svg.Close();
+        */
+        
+        // collapse 
+        double min = 0.2*pwidth * (1 - INSET_OVERLAP_TOLERANCE);
+        double max = 2*pspacing;
+        ExPolygons gaps_ex = clipper.diff_ex(
+            clipper.offset2(gaps, -min/2, +min/2),
+            clipper.offset2(gaps, -max/2, +max/2),
+            true
+        );
+        
+        ThickPolylines polylines;
+        for (ExPolygons::const_iterator ex = gaps_ex.begin(); ex != gaps_ex.end(); ++ex)
+            ex->medial_axis(*ex, max, min, &polylines);
+        
+        if (!polylines.empty()) {
+            ExtrusionEntityCollection gap_fill = this->_variable_width(polylines, 
+                erGapFill, this->solid_infill_flow);
             
-            // append infill areas to fill_surfaces
-            this->fill_surfaces->append(expp, stInternal);  // use a bogus surface type
+            /*  Make sure we don't infill narrow parts that are already gap-filled
+                (we only consider this surface's gaps to reduce the diff() complexity).
+                Growing actual extrusions ensures that gaps not filled by medial axis
+                are not subtracted from fill surfaces (they might be too short gaps
+                that medial axis skips but infill might join with other infill regions
+                and use zigzag).  */
+            //FIXME Vojtech: This grows by a rounded extrusion width, not by line spacing,
+            // therefore it may cover the area, but no the volume.
+            last = clipper.diff(last, ClipperContext::paths(gap_fill.grow()));
+            island_gap_fill->swap(gap_fill);
         }
     }
+    
+    // create one more offset to be used as boundary for fill
+    // we offset by half the perimeter spacing (to get to the actual infill boundary)
+    // and then we offset back and forth by half the infill spacing to only consider the
+    // non-collapsing regions
+    coord_t inset = 0;
+    if (loop_number == 0) {
+        // one loop
+        inset += ext_pspacing2/2;
+    } else if (loop_number > 0) {
+        // two or more loops
+        inset += pspacing/2;
+    }
+    
+    {
+        ExPolygons expp = clipper.union_ex(last);
+        
+        // simplify infill contours according to resolution
+        Polygons pp;
+        for (ExPolygons::const_iterator ex = expp.begin(); ex != expp.end(); ++ex)
+            ex->simplify_p(SCALED_RESOLUTION, &pp);
+        
+        // collapse too narrow infill areas
+        coord_t min_perimeter_infill_spacing = ispacing * (1 - INSET_OVERLAP_TOLERANCE);
+        expp = clipper.expolygons(clipper.offset2(
+            ClipperContext::paths(pp),
+            -inset -min_perimeter_infill_spacing/2,
+            +min_perimeter_infill_spacing/2
+        ));
+        
+        // append infill areas to fill_surfaces
+        island_fill_surfaces->append(expp, stInternal);  // use a bogus surface type
+    }
 }
 
 ExtrusionEntityCollection
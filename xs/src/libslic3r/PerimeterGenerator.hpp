@@ -84,6 +84,10 @@ public:
     double _mm3_per_mm_overhang;
     Polygons _lower_slices_p;
     
+    /// Generates the perimeters, gap fill and infill area of one island.
+    /// It only reads the generator, so islands can be processed in parallel.
+    void _process_island(const Surface &surface, ExtrusionEntityCollection* island_loops,
+        ExtrusionEntityCollection* island_gap_fill, SurfaceCollection* island_fill_surfaces) const;
     ExtrusionEntityCollection _traverse_loops(const PerimeterGeneratorLoops &loops,
         ThickPolylines &thin_walls) const;
     ExtrusionEntityCollection _variable_width
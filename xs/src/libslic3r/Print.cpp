@@ -410,6 +410,7 @@ Print::invalidate_state_by_config(const PrintConfigBase &config)
             || opt_key == "first_layer_speed"
             || opt_key == "first_layer_temperature"
             || opt_key == "gcode_arcs"
+            || opt_key == "gcode_arcs_tolerance"
             || opt_key == "gcode_comments"
             || opt_key == "gcode_flavor"
             || opt_key == "infill_acceleration"
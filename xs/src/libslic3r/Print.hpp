@@ -18,6 +18,7 @@
 #include "SlicingAdaptive.hpp"
 #include "LayerHeightSpline.hpp"
 #include "SupportMaterial.hpp"
+#include "SliceCache.hpp"
 
 #include <exception>
 
@@ -31,6 +32,7 @@ class Print;
 class PrintObject;
 class ModelObject;
 class SupportMaterial;
+class LayerGCodeCache;
 
 // Print step IDs for keeping track of the print state.
 enum PrintStep {
@@ -163,6 +165,10 @@ class PrintObject
     std::vector<coordf_t> generate_object_layers(coordf_t first_layer_height);
     void _slice();
     std::vector<ExPolygons> _slice_region(size_t region_id, std::vector<float> z, bool modifier);
+    /// Slice the volumes of a region a window of layers at a time, passing the
+    /// slices of each layer to cb as soon as they are ready.
+    void _slice_region(size_t region_id, const std::vector<float> &z, bool modifier,
+        const TriangleMeshSlicer<Z>::layer_slices_cb_t &cb);
 
     void _make_perimeters();
     void _infill();
@@ -245,6 +251,13 @@ class Print
     std::map<size_t,float> filament_stats;
     PrintState<PrintStep> state;
 
+    /// Where the slices of the objects are kept between runs, if anywhere.
+    std::shared_ptr<SliceCache> slice_cache {nullptr};
+    #ifndef SLIC3RXS
+    /// Where the G-code of the layers is kept between exports, if anywhere.
+    std::shared_ptr<LayerGCodeCache> gcode_cache {nullptr};
+    #endif // SLIC3RXS
+
     // ordered collections of extrusion paths to build skirt loops and brim
     ExtrusionEntityCollection skirt, brim;
 
@@ -623,6 +623,14 @@ PrintConfigDef::PrintConfigDef()
     def->cli = "gcode-arcs!";
     def->default_value = new ConfigOptionBool(0);
 
+    def = this->add("gcode_arcs_tolerance", coFloat);
+    def->label = __TRANS("Arc tolerance");
+    def->tooltip = __TRANS("Maximum distance between the arcs written when G-code arcs are enabled and the segments they replace.");
+    def->sidetext = "mm";
+    def->cli = "gcode-arcs-tolerance=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(0.01);
+
     def = this->add("gcode_comments", coBool);
     def->label = __TRANS("Verbose G-code");
     def->tooltip = __TRANS("Enable this to get a commented G-code file, with each line explained by a descriptive text. If you print from SD card, the additional weight of the file could make your firmware slow down.");
@@ -781,6 +789,141 @@ PrintConfigDef::PrintConfigDef()
     def->min = 0;
     def->default_value = new ConfigOptionFloat(0.3);
 
+    def = this->add("machine_max_acceleration_e", coFloat);
+    def->label = __TRANS("E");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum acceleration of the E axis (M201 E). Only used to estimate the print time.");
+    def->sidetext = "mm/s²";
+    def->cli = "machine-max-acceleration-e=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(10000);
+
+    def = this->add("machine_max_acceleration_extruding", coFloat);
+    def->label = __TRANS("Extruding");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum acceleration of the moves that extrude (M204 P, or S). Only used to estimate the print time.");
+    def->sidetext = "mm/s²";
+    def->cli = "machine-max-acceleration-extruding=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(1500);
+
+    def = this->add("machine_max_acceleration_retracting", coFloat);
+    def->label = __TRANS("Retracting");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum acceleration of the retractions (M204 R). Only used to estimate the print time.");
+    def->sidetext = "mm/s²";
+    def->cli = "machine-max-acceleration-retracting=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(1500);
+
+    def = this->add("machine_max_acceleration_travel", coFloat);
+    def->label = __TRANS("Travel");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum acceleration of the travel moves (M204 T). Only used to estimate the print time.");
+    def->sidetext = "mm/s²";
+    def->cli = "machine-max-acceleration-travel=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(1500);
+
+    def = this->add("machine_max_acceleration_x", coFloat);
+    def->label = __TRANS("X");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum acceleration of the X axis (M201 X). Only used to estimate the print time.");
+    def->sidetext = "mm/s²";
+    def->cli = "machine-max-acceleration-x=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(9000);
+
+    def = this->add("machine_max_acceleration_y", coFloat);
+    def->label = __TRANS("Y");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum acceleration of the Y axis (M201 Y). Only used to estimate the print time.");
+    def->sidetext = "mm/s²";
+    def->cli = "machine-max-acceleration-y=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(9000);
+
+    def = this->add("machine_max_acceleration_z", coFloat);
+    def->label = __TRANS("Z");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum acceleration of the Z axis (M201 Z). Only used to estimate the print time.");
+    def->sidetext = "mm/s²";
+    def->cli = "machine-max-acceleration-z=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(500);
+
+    def = this->add("machine_max_feedrate_e", coFloat);
+    def->label = __TRANS("E");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum feedrate of the E axis (M203 E). Only used to estimate the print time.");
+    def->sidetext = "mm/s";
+    def->cli = "machine-max-feedrate-e=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(120);
+
+    def = this->add("machine_max_feedrate_x", coFloat);
+    def->label = __TRANS("X");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum feedrate of the X axis (M203 X). Only used to estimate the print time.");
+    def->sidetext = "mm/s";
+    def->cli = "machine-max-feedrate-x=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(500);
+
+    def = this->add("machine_max_feedrate_y", coFloat);
+    def->label = __TRANS("Y");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum feedrate of the Y axis (M203 Y). Only used to estimate the print time.");
+    def->sidetext = "mm/s";
+    def->cli = "machine-max-feedrate-y=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(500);
+
+    def = this->add("machine_max_feedrate_z", coFloat);
+    def->label = __TRANS("Z");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum feedrate of the Z axis (M203 Z). Only used to estimate the print time.");
+    def->sidetext = "mm/s";
+    def->cli = "machine-max-feedrate-z=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(12);
+
+    def = this->add("machine_max_jerk_e", coFloat);
+    def->label = __TRANS("E");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum speed change of the E axis the firmware makes without accelerating (M205 E). Only used to estimate the print time.");
+    def->sidetext = "mm/s";
+    def->cli = "machine-max-jerk-e=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(2.5);
+
+    def = this->add("machine_max_jerk_x", coFloat);
+    def->label = __TRANS("X");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum speed change of the X axis the firmware makes without accelerating (M205 X). Only used to estimate the print time.");
+    def->sidetext = "mm/s";
+    def->cli = "machine-max-jerk-x=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(10);
+
+    def = this->add("machine_max_jerk_y", coFloat);
+    def->label = __TRANS("Y");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum speed change of the Y axis the firmware makes without accelerating (M205 Y). Only used to estimate the print time.");
+    def->sidetext = "mm/s";
+    def->cli = "machine-max-jerk-y=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(10);
+
+    def = this->add("machine_max_jerk_z", coFloat);
+    def->label = __TRANS("Z");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum speed change of the Z axis the firmware makes without accelerating (M205 Z). Only used to estimate the print time.");
+    def->sidetext = "mm/s";
+    def->cli = "machine-max-jerk-z=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(0.2);
+
     def = this->add("match_horizontal_surfaces", coBool);
     def->label = "Match horizontal surfaces";
     def->tooltip = "Try to match horizontal surfaces during the slicing process. Matching is not guaranteed, very small surfaces and multiple surfaces with low vertical distance might cause bad results.";
@@ -1950,6 +2093,20 @@ CLIConfigDef::CLIConfigDef()
     def->cli = "slice";
     def->default_value = new ConfigOptionBool(false);
 
+    def = this->add("slice_cache", coString);
+    def->label = __TRANS("Slice cache directory");
+    def->tooltip = __TRANS("Keep the slices of the objects in the given directory and reuse them when the same objects are sliced again at the same layer heights.");
+    def->cli = "slice-cache";
+    def->default_value = new ConfigOptionString("");
+
+    def = this->add("slice_cache_size", coInt);
+    def->label = __TRANS("Slice cache size");
+    def->tooltip = __TRANS("Size limit of the slice cache directory. The least recently used slices are removed when it is exceeded.");
+    def->sidetext = __TRANS("MB");
+    def->cli = "slice-cache-size=i";
+    def->min = 1;
+    def->default_value = new ConfigOptionInt(1024);
+
     def = this->add("help", coBool);
     def->label = __TRANS("Help");
     def->tooltip = __TRANS("Show this help.");
@@ -340,6 +340,21 @@ class GCodeConfig : public virtual StaticPrintConfig
     ConfigOptionEnum<GCodeFlavor>   gcode_flavor;
     ConfigOptionBool                label_printed_objects;
     ConfigOptionString              layer_gcode;
+    ConfigOptionFloat               machine_max_acceleration_e;
+    ConfigOptionFloat               machine_max_acceleration_extruding;
+    ConfigOptionFloat               machine_max_acceleration_retracting;
+    ConfigOptionFloat               machine_max_acceleration_travel;
+    ConfigOptionFloat               machine_max_acceleration_x;
+    ConfigOptionFloat               machine_max_acceleration_y;
+    ConfigOptionFloat               machine_max_acceleration_z;
+    ConfigOptionFloat               machine_max_feedrate_e;
+    ConfigOptionFloat               machine_max_feedrate_x;
+    ConfigOptionFloat               machine_max_feedrate_y;
+    ConfigOptionFloat               machine_max_feedrate_z;
+    ConfigOptionFloat               machine_max_jerk_e;
+    ConfigOptionFloat               machine_max_jerk_x;
+    ConfigOptionFloat               machine_max_jerk_y;
+    ConfigOptionFloat               machine_max_jerk_z;
     ConfigOptionFloat               max_print_speed;
     ConfigOptionFloat               max_volumetric_speed;
     ConfigOptionString              notes;
@@ -384,6 +399,21 @@ class GCodeConfig : public virtual StaticPrintConfig
         OPT_PTR(gcode_flavor);
         OPT_PTR(label_printed_objects);
         OPT_PTR(layer_gcode);
+        OPT_PTR(machine_max_acceleration_e);
+        OPT_PTR(machine_max_acceleration_extruding);
+        OPT_PTR(machine_max_acceleration_retracting);
+        OPT_PTR(machine_max_acceleration_travel);
+        OPT_PTR(machine_max_acceleration_x);
+        OPT_PTR(machine_max_acceleration_y);
+        OPT_PTR(machine_max_acceleration_z);
+        OPT_PTR(machine_max_feedrate_e);
+        OPT_PTR(machine_max_feedrate_x);
+        OPT_PTR(machine_max_feedrate_y);
+        OPT_PTR(machine_max_feedrate_z);
+        OPT_PTR(machine_max_jerk_e);
+        OPT_PTR(machine_max_jerk_x);
+        OPT_PTR(machine_max_jerk_y);
+        OPT_PTR(machine_max_jerk_z);
         OPT_PTR(max_print_speed);
         OPT_PTR(max_volumetric_speed);
         OPT_PTR(notes);
@@ -451,6 +481,7 @@ class PrintConfig : public GCodeConfig
     ConfigOptionFloatOrPercent      first_layer_speed;
     ConfigOptionInts                first_layer_temperature;
     ConfigOptionBool                gcode_arcs;
+    ConfigOptionFloat               gcode_arcs_tolerance;
     ConfigOptionFloat               infill_acceleration;
     ConfigOptionBool                infill_first;
     ConfigOptionFloat               interior_brim_width;
@@ -513,6 +544,7 @@ class PrintConfig : public GCodeConfig
         OPT_PTR(first_layer_speed);
         OPT_PTR(first_layer_temperature);
         OPT_PTR(gcode_arcs);
+        OPT_PTR(gcode_arcs_tolerance);
         OPT_PTR(infill_acceleration);
         OPT_PTR(infill_first);
         OPT_PTR(interior_brim_width);
@@ -672,6 +704,8 @@ class CLIConfig
     ConfigOptionPoint3              scale_to_fit;
     ConfigOptionPoint               center;
     ConfigOptionBool                slice;
+    ConfigOptionString              slice_cache;
+    ConfigOptionInt                 slice_cache_size;
     ConfigOptionBool                threads;
     
     CLIConfig() : ConfigBase(), StaticConfig() {
@@ -700,6 +734,8 @@ class CLIConfig
         OPT_PTR(scale);
         OPT_PTR(scale_to_fit);
         OPT_PTR(slice);
+        OPT_PTR(slice_cache);
+        OPT_PTR(slice_cache_size);
         OPT_PTR(threads);
         
         return NULL;
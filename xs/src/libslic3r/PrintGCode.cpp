@@ -1,8 +1,12 @@
 #ifndef SLIC3RXS
 #include "PrintGCode.hpp"
+#include "Log.hpp"
 #include "PrintConfig.hpp"
+#include "ThreadPool.hpp"
 
 #include <ctime>
+#include <future>
+#include <sstream>
 #include <iostream>
 
 namespace Slic3r {
@@ -101,6 +105,12 @@ PrintGCode::output()
     // Prepare the helper object for replacing placeholders in custom G-Code and output filename
     print.placeholder_parser.update_timestamp();
 
+    // the placeholders of the custom G-code other than their variables
+    // don't change during the export
+    this->_compile_templates(print.placeholder_parser);
+
+    if (this->_cache != nullptr) this->_cache->begin_export();
+
     // GCode sets this automatically when change_layer() is called, but needed for skirt/brim as well
     gcodegen.first_layer = true;
 
@@ -142,6 +152,7 @@ PrintGCode::output()
     fh << gcodegen.preamble();
 
     // initialize motion planner for object-to-object travel moves
+    ExPolygons& external_islands {this->_external_islands};
     if (config.avoid_crossing_perimeters.getBool()) {
 
         // compute the offsetted convex hull for each object and repeat it for each copy
@@ -163,7 +174,8 @@ PrintGCode::output()
             }
         }
         
-        gcodegen.avoid_crossing_perimeters.init_external_mp(union_ex(islands_p));
+        external_islands = union_ex(islands_p);
+        gcodegen.avoid_crossing_perimeters.init_external_mp(external_islands);
     }
 
     // Calculate wiping points if needed.
@@ -173,6 +185,24 @@ PrintGCode::output()
     // Set initial extruder only after custom start gcode
     fh << gcodegen.set_extruder(*(extruders.begin()));
 
+    // what the G-code of every layer depends on, for the keys of the cache
+    if (this->_cache != nullptr) {
+        LayerGCodeCache::Key key;
+        key.add_config(print.config);
+        key.add(gcodegen.layer_count);
+        key.add_entity(print.skirt);
+        key.add_entity(print.brim);
+        const Flow skirt_flow {print.skirt_flow()};
+        key.add(skirt_flow.width);
+        key.add(skirt_flow.nozzle_diameter);
+        key.add(skirt_flow.bridge);
+        key.add_expolygons(external_islands);
+        key.add_string(gcodegen.placeholder_parser->process(config.before_layer_gcode.value));
+        key.add_string(gcodegen.placeholder_parser->process(config.layer_gcode.value));
+        key.add_string(gcodegen.placeholder_parser->process(config.toolchange_gcode.value));
+        this->_export_key = key.value;
+    }
+
     // Do all objects for each layer.
 
     if (config.complete_objects) {
@@ -206,11 +236,15 @@ PrintGCode::output()
                     layers.emplace_back(static_cast<Layer*>(l));
                 }
                 std::sort(layers.begin(), layers.end(), [] (const Layer* a, const Layer* b) { return a->print_z < b->print_z; });
-                for (Layer* layer : layers) {
+                std::vector<LayerJob> jobs;
+                jobs.reserve(layers.size());
+                for (const Layer* layer : layers)
+                    jobs.emplace_back(LayerJob { obj_idx, layer, Points({copy}) });
+                this->_process_layers(jobs, [&] (const LayerJob& job) {
                     // if we are printing the bottom layer of an object, and we have already finished
                     // another one, set first layer temperatures. this happens before the Z move
                     // is triggered, so machine has more time to reach such temperatures
-                    if (layer->id() == 0 && finished_objects > 0) {
+                    if (job.layer->id() == 0 && finished_objects > 0) {
                         if (config.first_layer_bed_temperature > 0 &&
                                 config.has_heatbed &&
                                 std::regex_search(config.between_objects_gcode.getString(), bed_temp_regex)) 
@@ -221,8 +255,7 @@ PrintGCode::output()
                             _print_first_layer_temperature(false);
                         }
                     }
-                    this->process_layer(obj_idx, layer, Points({copy}));
-                }
+                });
                 this->flush_filters();
                 finished_objects++;
                 this->_second_layer_things_done = false;
@@ -263,13 +296,15 @@ PrintGCode::output()
         // pass the comparator to leave no doubt.
         std::sort(z.begin(), z.end(),  std::less<size_t>());
         //  call process_layers in the order given by obj_idx
+        std::vector<LayerJob> jobs;
         for (const auto& print_z : z) {
             for (const auto& idx : obj_idx) {
                 for (const auto* layer : layers[print_z][idx] ) {
-                    this->process_layer(idx, layer, layer->object()->_shifted_copies);
+                    jobs.emplace_back(LayerJob { idx, layer, layer->object()->_shifted_copies });
                 }
             }
         }
+        this->_process_layers(jobs);
         
         this->flush_filters();
     }
@@ -328,6 +363,17 @@ PrintGCode::output()
     _print_config(print.config);
     _print_config(print.default_object_config);
     _print_config(print.default_region_config);
+
+    if (this->_speculated_layers > 0) {
+        Slic3r::Log::info("PrintGCode") << this->_speculated_layers << " of " << this->_layers_count
+            << " layers written from the ones generated ahead\n";
+    }
+    if (gcodegen.arcs > 0) {
+        Slic3r::Log::info("PrintGCode") << gcodegen.arcs << " arcs written instead of "
+            << gcodegen.arc_segments << " G1 moves in the layers generated, " << gcodegen.arc_segments - gcodegen.arcs << " lines fewer\n";
+    }
+
+    if (this->_cache != nullptr) this->_cache->end_export();
 }
 
 std::string 
@@ -337,31 +383,151 @@ PrintGCode::filter(const std::string& in, bool wait)
 }
 
 void
-PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
+PrintGCode::_compile_templates(const PlaceholderParser& parser)
 {
-    std::string gcode {""};
-    auto& gcodegen {this->_gcodegen};
+    const std::vector<std::string> layer_variables {"layer_num", "layer_z", "current_retraction", "current_extruder"};
+    this->_before_layer_template = GCodeTemplate(this->config.before_layer_gcode.value, parser, layer_variables);
+    this->_layer_template = GCodeTemplate(this->config.layer_gcode.value, parser, layer_variables);
+    this->_gcodegen.toolchange_template = GCodeTemplate(this->config.toolchange_gcode.value, parser,
+        {"previous_extruder", "next_extruder", "previous_retraction", "next_retraction", "current_extruder"});
+}
+
+/// A PrintGCode that writes nowhere, set up like main but with a placeholder
+/// parser and compiled templates of its own, as set_extruder() and the
+/// templates change them.
+struct PrintGCode::Speculator {
+    PlaceholderParser placeholder_parser;
+    std::ostringstream unused;
+    PrintGCode generator;
+
+    explicit Speculator(const PrintGCode& main)
+        : placeholder_parser(*main._gcodegen.placeholder_parser), generator(main._print, this->unused)
+    {
+        // the cache isn't shared with the threads
+        this->generator._cache = nullptr;
+        this->generator._gcodegen.placeholder_parser = &this->placeholder_parser;
+        this->generator._gcodegen.writer.relocatable_E = true;
+        this->generator._compile_templates(this->placeholder_parser);
+        if (main.config.avoid_crossing_perimeters)
+            this->generator._gcodegen.avoid_crossing_perimeters.init_external_mp(main._external_islands);
+    }
+
+    /// Generate the layer of job from the state the generator is in.
+    void speculate(const PrintGCode& main, const LayerJob& job, Speculation* speculation)
+    {
+        PrintGCode& generator {this->generator};
+        speculation->plan = main._plan_layer(job.layer);
+        generator._begin_layer(job.layer, speculation->plan);
+        // as the cooling buffer of main leaves them before each layer
+        generator._gcodegen.elapsed_time = 0;
+        generator._gcodegen.elapsed_time_bridges = 0;
+        generator._gcodegen.elapsed_time_external = 0;
+        speculation->key = generator._state_key(job.layer);
+        const Totals totals {generator._totals()};
+        std::string gcode;
+        generator._generate_layer(job.idx, job.layer, job.copies, speculation->plan, &gcode);
+        speculation->entry = generator._save_layer(std::move(gcode), job.layer, totals);
+        speculation->relocated_E = generator._gcodegen.writer.relocated_E;
+        for (const auto& extruder : generator._gcodegen.writer.extruders)
+            speculation->E_steps[extruder.first] = extruder.second.E_steps;
+    }
+};
+
+void
+PrintGCode::_process_layers(const std::vector<LayerJob>& jobs, const std::function<void(const LayerJob&)>& before_layer)
+{
+    const int threads_count {std::max(1, this->config.threads.value)};
+    // Layers a speculator generates in a row. The state the first of them
+    // starts from is guessed, as the layers before are still being written,
+    // so it is usually generated again; the next ones start from the state
+    // the one before leaves and are spliced once it is the same as the
+    // written layer leaves, which is as soon as the paths end at the same
+    // place, E being written once the layer before is.
+    const size_t chunk {16};
+    bool speculate {threads_count > 1 && jobs.size() > chunk};
+    if (speculate) {
+        // submit() runs a task inline when the pool has no workers, which
+        // would only generate the layers twice
+        ThreadPool::instance().reserve(threads_count - 1);
+        speculate = ThreadPool::instance().size() > 0;
+    }
+    if (!speculate) {
+        for (const auto& job : jobs) {
+            if (before_layer) before_layer(job);
+            this->process_layer(job.idx, job.layer, job.copies);
+        }
+        this->_layers_count += jobs.size();
+        return;
+    }
+
+    while (this->_speculators.size() + 1 < size_t(threads_count))
+        this->_speculators.emplace_back(new Speculator(*this));
+
+    // this thread writes the first chunk of each window while the
+    // speculators generate the other ones
+    const size_t window {chunk * threads_count};
+    std::vector<Speculation> speculations;
+    for (size_t begin = 0; begin < jobs.size(); begin += window) {
+        const size_t end {std::min(begin + window, jobs.size())};
+        speculations.clear();
+        speculations.resize(end - begin);
+
+        std::vector<std::future<void>> speculated;
+        for (size_t from = begin + chunk; from < end; from += chunk) {
+            Speculator& speculator {*this->_speculators.at(speculated.size())};
+            speculator.generator._guess_state(*this, jobs, begin, from);
+            const size_t to {std::min(from + chunk, end)};
+            auto task = std::make_shared<std::packaged_task<void()>>([this, &jobs, &speculator, &speculations, begin, from, to] {
+                for (size_t i = from; i < to; ++i)
+                    speculator.speculate(*this, jobs[i], &speculations[i - begin]);
+            });
+            speculated.emplace_back(task->get_future());
+            ThreadPool::instance().submit([task] { (*task)(); });
+        }
+
+        try {
+            for (size_t i = begin; i < end; ++i) {
+                const auto& job {jobs.at(i)};
+                if (before_layer) before_layer(job);
+                if (i < begin + chunk) {
+                    this->process_layer(job.idx, job.layer, job.copies);
+                } else {
+                    auto& done {speculated.at((i - begin) / chunk - 1)};
+                    // rethrows what the speculator threw
+                    if (done.valid()) done.get();
+                    Speculation& speculation {speculations.at(i - begin)};
+                    this->process_layer(job.idx, job.layer, job.copies, speculation.plan, &speculation);
+                }
+            }
+        } catch (...) {
+            // the speculators refer to the locals of this frame
+            for (auto& done : speculated)
+                if (done.valid()) done.wait();
+            throw;
+        }
+    }
+    this->_layers_count += jobs.size();
+}
+
+PrintGCode::LayerPlan
+PrintGCode::_plan_layer(const Layer* layer) const
+{
+    LayerPlan plan;
     const auto& print {this->_print};
     const auto& config {this->config};
-
     const auto& obj {*(layer->object())};
-    gcodegen.config.apply(obj.config, true);
 
     // check for usage of spiralvase logic.
-    this->_spiral_vase.enable = (
+    plan.spiral_vase = (
             layer->id() > 0 
-            && (print.config.skirts == 0 || (layer->id() >= print.config.skirt_height && !print.has_infinite_skirt()))
+            && (print.config.skirts == 0
+                || (layer->id() >= static_cast<size_t>(std::max(0, print.config.skirt_height.value)) && !print.has_infinite_skirt()))
             && std::find_if(layer->regions.cbegin(), layer->regions.cend(), [layer] (const LayerRegion* l) 
-                { return    l->region()->config.bottom_solid_layers > layer->id() 
+                { return    static_cast<size_t>(std::max(0, l->region()->config.bottom_solid_layers.value)) > layer->id() 
                          || l->perimeters.items_count() > 1 
                          || l->fills.items_count() > 0; 
                 }) == layer->regions.cend()
             );
-    this->_gcodegen.enable_loop_clipping = this->_spiral_vase.enable;
-
-
-
-    // if using spiralvase, disable loop clipping.
 
     // initialize autospeed.
     {
@@ -412,9 +578,185 @@ PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
             if (config.max_volumetric_speed > 0) {
                 volumetric_speed = std::min(volumetric_speed, config.max_volumetric_speed.getFloat());
             }
-            gcodegen.volumetric_speed = volumetric_speed;
+            plan.has_volumetric_speed = true;
+            plan.volumetric_speed = volumetric_speed;
         }
     }
+
+    // We now define a strategy for building perimeters and fills. The separation 
+    // between regions doesn't matter in terms of printing order, as we follow 
+    // another logic instead:
+    // - we group all extrusions by extruder so that we minimize toolchanges
+    // - we start from the last used extruder
+    // - for each extruder, we group extrusions by island
+    // - for each island, we extrude perimeters first, unless user set the infill_first
+    //   option
+    // (Still, we have to keep track of regions because we need to apply their config)
+
+    // group extrusions by extruder and then by island
+    auto& by_extruder {plan.by_extruder};
+
+    // cache bounding boxes of layer slices
+    std::vector<BoundingBox> layer_slices_bb;
+    std::transform(layer->slices.cbegin(), layer->slices.cend(), std::back_inserter(layer_slices_bb), [] (const ExPolygon& s)-> BoundingBox { return s.bounding_box(); });
+    auto point_inside_surface { [&layer_slices_bb, &layer] (size_t i, Point point) -> bool {
+        const auto& bbox {layer_slices_bb.at(i)};
+        return bbox.contains(point) && layer->slices.at(i).contour.contains(point);
+    }};
+    const auto n_slices {layer->slices.size()};
+
+    for (auto region_id = 0U; region_id < print.regions.size(); ++region_id) {
+        const LayerRegion* layerm;
+        try {
+            layerm = layer->get_region(region_id); // we promise to be good and not give this to anyone who will modify it
+        } catch (std::out_of_range &e) {
+            continue; // if no regions, bail;
+        }
+        auto* region {print.get_region(region_id)};
+        // process perimeters
+        {
+            auto extruder_id = region->config.perimeter_extruder-1;
+            // Casting away const just to avoid double dereferences
+            for(auto* perimeter_coll : layerm->perimeters.flatten().entities) {
+
+                if(perimeter_coll->length() == 0) continue;  // this shouldn't happen but first_point() would fail
+                
+                // perimeter_coll is an ExtrusionPath::Collection object representing a single slice
+                for(auto i = 0U; i < n_slices; i++){
+                    if (// perimeter_coll->first_point does not fit inside any slice
+                        i == n_slices - 1
+                        // perimeter_coll->first_point fits inside ith slice
+                        || point_inside_surface(i, perimeter_coll->first_point())) {
+                        std::get<0>(by_extruder[extruder_id][i])[region_id].append(*perimeter_coll);
+                        break;
+                    }
+                }
+            }
+        }
+        
+        // process infill
+        // $layerm->fills is a collection of ExtrusionPath::Collection objects, each one containing
+        // the ExtrusionPath objects of a certain infill "group" (also called "surface"
+        // throughout the code). We can redefine the order of such Collections but we have to 
+        // do each one completely at once.
+        for(auto* fill : layerm->fills.flatten().entities) {
+            if(fill->length() == 0) continue;  // this shouldn't happen but first_point() would fail
+            
+            auto extruder_id = fill->is_solid_infill()
+                ? region->config.solid_infill_extruder-1
+                : region->config.infill_extruder-1;
+            
+            // $fill is an ExtrusionPath::Collection object
+            for(auto i = 0U; i < n_slices; i++){
+                if (i == n_slices - 1
+                    || point_inside_surface(i, fill->first_point())) {
+                    std::get<1>(by_extruder[extruder_id][i])[region_id].append(*fill);
+                    break;
+                }
+            }
+        }
+    }
+
+    if (this->_cache != nullptr) {
+        LayerGCodeCache::Key key;
+        key.add(layer->id());
+        key.add(layer->print_z);
+        key.add(layer->height);
+        key.add(layer->is_support());
+        key.add(this->_object_keys.at(&obj));
+        key.add_expolygons(layer->slices.expolygons);
+        for (size_t region_id = 0; region_id < layer->regions.size(); ++region_id) {
+            const LayerRegion* layerm {layer->regions.at(region_id)};
+            // the layers have a region for each region of the print, the ones
+            // of the other objects are empty and their config doesn't matter
+            if (layerm->perimeters.entities.empty() && layerm->fills.entities.empty()) continue;
+            key.add(region_id);
+            key.add(this->_region_keys.at(region_id));
+            key.add_entity(layerm->perimeters);
+            key.add_entity(layerm->fills);
+        }
+        if (layer->is_support()) {
+            const SupportLayer* slayer = dynamic_cast<const SupportLayer*>(layer);
+            key.add_entity(slayer->support_fills);
+            key.add_entity(slayer->support_interface_fills);
+        }
+        plan.key = key.value;
+    }
+
+    return plan;
+}
+
+void
+PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
+{
+    this->process_layer(idx, layer, copies, this->_plan_layer(layer));
+}
+
+void
+PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies, const LayerPlan& plan, Speculation* speculation)
+{
+    this->_begin_layer(layer, plan);
+    const LayerGCodeCache::key_t state {this->_state_key(layer)};
+
+    // splice the layer if it was generated from the same state before
+    LayerGCodeCache::key_t key {0};
+    if (this->_cache != nullptr) {
+        key = this->_layer_key(idx, layer, copies, plan, state);
+        if (const LayerGCodeCache::Entry* entry = this->_cache->find(key)) {
+            this->_restore_layer(*entry, layer);
+            this->_write_layer(layer, entry->gcode);
+            return;
+        }
+    }
+
+    // or if it was generated ahead from it
+    if (speculation != nullptr && speculation->key == state && this->_relocate_E(speculation)) {
+        this->_restore_layer(speculation->entry, layer);
+        this->_write_layer(layer, speculation->entry.gcode);
+        if (this->_cache != nullptr)
+            this->_cache->store(key, std::move(speculation->entry));
+        ++this->_speculated_layers;
+        return;
+    }
+
+    // reuse the buffer of the previous layer, already grown to fit
+    std::string& gcode {this->_layer_gcode};
+    gcode.clear();
+    const Totals totals {this->_totals()};
+    this->_generate_layer(idx, layer, copies, plan, &gcode);
+    if (this->_cache != nullptr)
+        this->_cache->store(key, this->_save_layer(gcode, layer, totals));
+    this->_write_layer(layer, gcode);
+}
+
+void
+PrintGCode::_begin_layer(const Layer* layer, const LayerPlan& plan)
+{
+    auto& gcodegen {this->_gcodegen};
+    gcodegen.config.apply(layer->object()->config, true);
+    for (auto& extruder : gcodegen.writer.extruders) {
+        extruder.second.absolute_E_steps.clear();
+        extruder.second.E_steps.clear();
+    }
+    gcodegen.writer.relocated_E.clear();
+
+    // if using spiralvase, disable loop clipping.
+    this->_spiral_vase.enable = plan.spiral_vase;
+    gcodegen.enable_loop_clipping = this->_spiral_vase.enable;
+
+    if (plan.has_volumetric_speed)
+        gcodegen.volumetric_speed = plan.volumetric_speed;
+}
+
+void
+PrintGCode::_generate_layer(size_t idx, const Layer* layer, const Points& copies, const LayerPlan& plan, std::string* gcode_out)
+{
+    std::string& gcode {*gcode_out};
+    auto& gcodegen {this->_gcodegen};
+    const auto& print {this->_print};
+    const auto& config {this->config};
+    const auto& obj {*(layer->object())};
+
     // set the second layer + temp
     if (!this->_second_layer_things_done && layer->id() == 1) {
         for (const auto& extruder_ref : gcodegen.writer.extruders) {
@@ -432,34 +774,27 @@ PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
     }
 
     // set new layer - this will change Z and force a retraction if retract_layer_change is enabled
+    // the values of the variables of the templates, as PlaceholderParser::set() takes them
+    const auto layer_values = [&gcodegen, layer] () -> std::vector<int> {
+        return {
+            gcodegen.layer_index,
+            static_cast<int>(layer->print_z),
+            static_cast<int>(gcodegen.writer.extruder()->retracted),
+            static_cast<int>(gcodegen.writer.extruder()->id),
+        };
+    };
     if (print.config.before_layer_gcode.getString().size() > 0) {
-        auto pp {*(gcodegen.placeholder_parser)};
-        pp.set("layer_num", gcodegen.layer_index);
-        pp.set("layer_z", layer->print_z);
-        pp.set("current_retraction", gcodegen.writer.extruder()->retracted);
-
-        gcode += apply_math(pp.process(print.config.before_layer_gcode.getString()));
+        gcode += this->_before_layer_template.process(layer_values());
         gcode += "\n";
     }
     gcode += gcodegen.change_layer(*layer);
     if (print.config.layer_gcode.getString().size() > 0) {
-        auto pp {*(gcodegen.placeholder_parser)};
-        pp.set("layer_num", gcodegen.layer_index);
-        pp.set("layer_z", layer->print_z);
-        pp.set("current_retraction", gcodegen.writer.extruder()->retracted);
-
-        gcode += apply_math(pp.process(print.config.layer_gcode.getString()));
+        gcode += this->_layer_template.process(layer_values());
         gcode += "\n";
     }
 
     
-    // extrude skirt along raft layers and normal obj layers
-    // (not along interlaced support material layers)
-    if (layer->id() < static_cast<size_t>(obj.config.raft_layers)
-        || ((print.has_infinite_skirt() || _skirt_done.size() == 0 || (_skirt_done.rbegin())->first < print.config.skirt_height)
-        && _skirt_done.count(scale_(layer->print_z)) == 0
-        && typeid(layer) != typeid(SupportLayer*)) ) {
-
+    if (this->_extrudes_skirt(layer)) {
 
         gcodegen.set_origin(Pointf(0,0));
         gcodegen.avoid_crossing_perimeters.use_external_mp = true;
@@ -499,7 +834,7 @@ PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
                         path.mm3_per_mm = mm3_per_mm;
                     }
                 }
-                gcode += gcodegen.extrude(loop, "skirt", obj.config.support_material_speed);
+                gcodegen.extrude(&gcode, loop, "skirt", obj.config.support_material_speed);
             }
 
         }
@@ -516,7 +851,7 @@ PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
         gcodegen.set_origin(Pointf(0,0));
         gcodegen.avoid_crossing_perimeters.use_external_mp = true;
         for (const auto& b : print.brim.entities) {
-            gcode += gcodegen.extrude(*b, "brim", obj.config.get_abs_value("support_material_speed"));
+            gcodegen.extrude(&gcode, *b, "brim", obj.config.get_abs_value("support_material_speed"));
         }
         this->_brim_done = true;
         gcodegen.avoid_crossing_perimeters.use_external_mp = false;
@@ -547,120 +882,42 @@ PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
                 gcode += gcodegen.set_extruder(obj.config.support_material_interface_extruder - 1);
                 slayer->support_interface_fills.chained_path_from(gcodegen.last_pos(), &paths, false);
                 for (const auto& path : paths) {
-                    gcode += gcodegen.extrude(*path, "support material interface", obj.config.get_abs_value("support_material_interface_speed"));
+                    gcodegen.extrude(&gcode, *path, "support material interface", obj.config.get_abs_value("support_material_interface_speed"));
                 }
             }
             if (slayer->support_fills.size() > 0) {
                 gcode += gcodegen.set_extruder(obj.config.support_material_extruder - 1);
                 slayer->support_fills.chained_path_from(gcodegen.last_pos(), &paths, false);
                 for (const auto& path : paths) {
-                    gcode += gcodegen.extrude(*path, "support material", obj.config.get_abs_value("support_material_speed"));
+                    gcodegen.extrude(&gcode, *path, "support material", obj.config.get_abs_value("support_material_speed"));
                 }
             }
         }
-        // We now define a strategy for building perimeters and fills. The separation 
-        // between regions doesn't matter in terms of printing order, as we follow 
-        // another logic instead:
-        // - we group all extrusions by extruder so that we minimize toolchanges
-        // - we start from the last used extruder
-        // - for each extruder, we group extrusions by island
-        // - for each island, we extrude perimeters first, unless user set the infill_first
-        //   option
-        // (Still, we have to keep track of regions because we need to apply their config)
-
-        // group extrusions by extruder and then by island
-        //       extruder        island
-        std::map<size_t,std::map<size_t,
-            //                  region
-            std::tuple<std::map<size_t,ExtrusionEntityCollection>, // perimeters
-                       std::map<size_t,ExtrusionEntityCollection>>  // infill
-        >> by_extruder;
-
-        // cache bounding boxes of layer slices
-        std::vector<BoundingBox> layer_slices_bb;
-        std::transform(layer->slices.cbegin(), layer->slices.cend(), std::back_inserter(layer_slices_bb), [] (const ExPolygon& s)-> BoundingBox { return s.bounding_box(); });
-        auto point_inside_surface { [&layer_slices_bb, &layer] (size_t i, Point point) -> bool {
-            const auto& bbox {layer_slices_bb.at(i)};
-            return bbox.contains(point) && layer->slices.at(i).contour.contains(point);
-        }};
-        const auto n_slices {layer->slices.size()};
-
-        for (auto region_id = 0U; region_id < print.regions.size(); ++region_id) {
-            const LayerRegion* layerm;
-            try {
-                layerm = layer->get_region(region_id); // we promise to be good and not give this to anyone who will modify it
-            } catch (std::out_of_range &e) {
-                continue; // if no regions, bail;
-            }
-            auto* region {print.get_region(region_id)};
-            // process perimeters
-            {
-                auto extruder_id = region->config.perimeter_extruder-1;
-                // Casting away const just to avoid double dereferences
-                for(auto* perimeter_coll : layerm->perimeters.flatten().entities) {
-
-                    if(perimeter_coll->length() == 0) continue;  // this shouldn't happen but first_point() would fail
-                    
-                    // perimeter_coll is an ExtrusionPath::Collection object representing a single slice
-                    for(auto i = 0U; i < n_slices; i++){
-                        if (// perimeter_coll->first_point does not fit inside any slice
-                            i == n_slices - 1
-                            // perimeter_coll->first_point fits inside ith slice
-                            || point_inside_surface(i, perimeter_coll->first_point())) {
-                            std::get<0>(by_extruder[extruder_id][i])[region_id].append(*perimeter_coll);
-                            break;
-                        }
-                    }
-                }
-            }
-            
-            // process infill
-            // $layerm->fills is a collection of ExtrusionPath::Collection objects, each one containing
-            // the ExtrusionPath objects of a certain infill "group" (also called "surface"
-            // throughout the code). We can redefine the order of such Collections but we have to 
-            // do each one completely at once.
-            for(auto* fill : layerm->fills.flatten().entities) {
-                if(fill->length() == 0) continue;  // this shouldn't happen but first_point() would fail
-                
-                auto extruder_id = fill->is_solid_infill()
-                    ? region->config.solid_infill_extruder-1
-                    : region->config.infill_extruder-1;
-                
-                // $fill is an ExtrusionPath::Collection object
-                for(auto i = 0U; i < n_slices; i++){
-                    if (i == n_slices - 1
-                        || point_inside_surface(i, fill->first_point())) {
-                        std::get<1>(by_extruder[extruder_id][i])[region_id].append(*fill);
-                        break;
-                    }
-                }
-            }
-        }
-        
         // tweak extruder ordering to save toolchanges
         
+        const auto& by_extruder {plan.by_extruder};
         auto last_extruder = gcodegen.writer.extruder()->id;
         if (by_extruder.count(last_extruder)) {
-            for(auto &island : by_extruder[last_extruder]) {
+            for(const auto &island : by_extruder.at(last_extruder)) {
                if (print.config.infill_first()) {
-                    gcode += this->_extrude_infill(std::get<1>(island.second));
-                    gcode += this->_extrude_perimeters(std::get<0>(island.second));
+                    this->_extrude_infill(&gcode, std::get<1>(island.second));
+                    this->_extrude_perimeters(&gcode, std::get<0>(island.second));
                 } else {
-                    gcode += this->_extrude_perimeters(std::get<0>(island.second));
-                    gcode += this->_extrude_infill(std::get<1>(island.second));
+                    this->_extrude_perimeters(&gcode, std::get<0>(island.second));
+                    this->_extrude_infill(&gcode, std::get<1>(island.second));
                 }
             }
         }
-        for(auto &pair : by_extruder) {
+        for(const auto &pair : by_extruder) {
             if(pair.first == last_extruder)continue;
             gcode += gcodegen.set_extruder(pair.first);
-            for(auto &island : pair.second) {
+            for(const auto &island : pair.second) {
                if (print.config.infill_first()) {
-                    gcode += this->_extrude_infill(std::get<1>(island.second));
-                    gcode += this->_extrude_perimeters(std::get<0>(island.second));
+                    this->_extrude_infill(&gcode, std::get<1>(island.second));
+                    this->_extrude_perimeters(&gcode, std::get<0>(island.second));
                 } else {
-                    gcode += this->_extrude_perimeters(std::get<0>(island.second));
-                    gcode += this->_extrude_infill(std::get<1>(island.second));
+                    this->_extrude_perimeters(&gcode, std::get<0>(island.second));
+                    this->_extrude_infill(&gcode, std::get<1>(island.second));
                 }
             }
         }
@@ -669,49 +926,275 @@ PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
         }
         copy_idx++;
     }
+}
+
+LayerGCodeCache::key_t
+PrintGCode::_layer_key(size_t idx, const Layer* layer, const Points& copies, const LayerPlan& plan,
+    LayerGCodeCache::key_t state) const
+{
+    LayerGCodeCache::Key key;
+    key.add(this->_export_key);
+    key.add(plan.key);
+    key.add(plan.spiral_vase);
+    key.add(idx);
+    key.add_points(copies);
+    key.add(state);
+    for (const auto& extruder : this->_gcodegen.writer.extruders)
+        key.add(extruder.second.E);
+    if (this->_last_region_id != SIZE_MAX)
+        key.add(this->_region_keys.at(this->_last_region_id));
+    return key.value;
+}
 
+LayerGCodeCache::key_t
+PrintGCode::_state_key(const Layer* layer) const
+{
+    const auto& gcodegen {this->_gcodegen};
+    LayerGCodeCache::Key key;
+    const GCodeWriter::State writer {gcodegen.writer.state()};
+    key.add(writer.extruder_id);
+    key.add(writer.last_acceleration);
+    key.add(writer.lifted);
+    key.add(writer.pos.x);
+    key.add(writer.pos.y);
+    key.add(writer.pos.z);
+    for (const auto& extruder : writer.extruders) {
+        key.add(extruder.id);
+        key.add(extruder.retracted);
+        key.add(extruder.restart_extra);
+    }
+    key.add(gcodegen.origin.x);
+    key.add(gcodegen.origin.y);
+    key.add(gcodegen.last_pos_defined());
+    key.add(gcodegen.last_pos().x);
+    key.add(gcodegen.last_pos().y);
+    key.add_points(gcodegen.wipe.path.points);
+    key.add(gcodegen.avoid_crossing_perimeters.use_external_mp);
+    key.add(gcodegen.avoid_crossing_perimeters.use_external_mp_once);
+    key.add(gcodegen.avoid_crossing_perimeters.disable_once);
+    key.add(gcodegen.enable_cooling_markers);
+    key.add(gcodegen.layer_index);
+    key.add(gcodegen.volumetric_speed);
+    const auto seam {gcodegen._seam_position.find(layer->object())};
+    key.add(seam != gcodegen._seam_position.end());
+    if (seam != gcodegen._seam_position.end()) {
+        key.add(seam->second.x);
+        key.add(seam->second.y);
+    }
+    key.add(this->_last_region_id);
+
+    // and of this
+    key.add(this->_skirt_done.empty());
+    if (!this->_skirt_done.empty())
+        key.add(this->_skirt_done.rbegin()->first);
+    key.add(this->_skirt_done.count(scale_(layer->print_z)) > 0);
+    key.add(this->_brim_done);
+    key.add(this->_second_layer_things_done);
+    key.add(this->_last_obj_copy.first.x);
+    key.add(this->_last_obj_copy.first.y);
+    key.add(this->_last_obj_copy.second);
+    return key.value;
+}
+
+bool
+PrintGCode::_relocate_E(Speculation* speculation) const
+{
+    std::map<unsigned int, double> E;
+    for (const auto& extruder : this->_gcodegen.writer.extruders)
+        E[extruder.first] = extruder.second.E;
+    std::string gcode;
+    if (!GCodeWriter::relocate_E(speculation->entry.gcode, speculation->relocated_E, speculation->E_steps, &E, &gcode))
+        return false;
+    speculation->entry.gcode = std::move(gcode);
+    for (auto& extruder : speculation->entry.writer.extruders)
+        extruder.E = E.at(extruder.id);
+    return true;
+}
+
+PrintGCode::Totals
+PrintGCode::_totals() const
+{
+    const auto& gcodegen {this->_gcodegen};
+    return Totals {
+        { gcodegen.elapsed_time, gcodegen.elapsed_time_bridges, gcodegen.elapsed_time_external },
+        gcodegen.arcs, gcodegen.arc_segments };
+}
+
+LayerGCodeCache::Entry
+PrintGCode::_save_layer(std::string gcode, const Layer* layer, const Totals& totals) const
+{
+    const auto& gcodegen {this->_gcodegen};
+    LayerGCodeCache::Entry entry;
+    entry.gcode = std::move(gcode);
+    entry.writer = gcodegen.writer.state();
+    for (const auto& extruder : gcodegen.writer.extruders)
+        entry.absolute_E_steps[extruder.first] = extruder.second.absolute_E_steps;
+    entry.origin = gcodegen.origin;
+    entry.last_pos_defined = gcodegen.last_pos_defined();
+    entry.last_pos = gcodegen.last_pos();
+    entry.wipe_path = gcodegen.wipe.path;
+    entry.use_external_mp = gcodegen.avoid_crossing_perimeters.use_external_mp;
+    entry.use_external_mp_once = gcodegen.avoid_crossing_perimeters.use_external_mp_once;
+    entry.disable_once = gcodegen.avoid_crossing_perimeters.disable_once;
+    entry.enable_cooling_markers = gcodegen.enable_cooling_markers;
+    entry.first_layer = gcodegen.first_layer;
+    entry.layer_index = gcodegen.layer_index;
+    entry.volumetric_speed = gcodegen.volumetric_speed;
+    entry.elapsed_time = gcodegen.elapsed_time - totals.elapsed_time[0];
+    entry.elapsed_time_bridges = gcodegen.elapsed_time_bridges - totals.elapsed_time[1];
+    entry.elapsed_time_external = gcodegen.elapsed_time_external - totals.elapsed_time[2];
+    entry.arcs = gcodegen.arcs - totals.arcs;
+    entry.arc_segments = gcodegen.arc_segments - totals.arc_segments;
+    const auto seam {gcodegen._seam_position.find(layer->object())};
+    entry.has_seam_position = seam != gcodegen._seam_position.end();
+    if (entry.has_seam_position) entry.seam_position = seam->second;
+    entry.last_region_id = this->_last_region_id;
+    entry.skirt_done = this->_skirt_done.count(scale_(layer->print_z)) > 0;
+    entry.brim_done = this->_brim_done;
+    entry.second_layer_things_done = this->_second_layer_things_done;
+    entry.last_obj_copy = this->_last_obj_copy;
+    return entry;
+}
+
+void
+PrintGCode::_restore_layer(const LayerGCodeCache::Entry& entry, const Layer* layer)
+{
+    auto& gcodegen {this->_gcodegen};
+    // the fan is set by the cooling buffer, as the layers are written
+    GCodeWriter::State writer {entry.writer};
+    writer.last_fan_speed = gcodegen.writer.state().last_fan_speed;
+    // and the filament used adds up in the order the layer used it
+    for (auto& extruder : writer.extruders) {
+        extruder.absolute_E = gcodegen.writer.extruders.at(extruder.id).absolute_E;
+        for (double step : entry.absolute_E_steps.at(extruder.id))
+            extruder.absolute_E += step;
+    }
+    gcodegen.writer.restore(writer);
+    if (entry.writer.extruder_id >= 0)
+        gcodegen.placeholder_parser->set("current_extruder", entry.writer.extruder_id);
+    // not set_origin(), which would move the last position
+    gcodegen.origin = entry.origin;
+    if (entry.last_pos_defined) gcodegen.set_last_pos(entry.last_pos);
+    gcodegen.wipe.path = entry.wipe_path;
+    gcodegen.avoid_crossing_perimeters.use_external_mp = entry.use_external_mp;
+    gcodegen.avoid_crossing_perimeters.use_external_mp_once = entry.use_external_mp_once;
+    gcodegen.avoid_crossing_perimeters.disable_once = entry.disable_once;
+    gcodegen.enable_cooling_markers = entry.enable_cooling_markers;
+    gcodegen.layer = layer;
+    gcodegen.first_layer = entry.first_layer;
+    gcodegen.layer_index = entry.layer_index;
+    gcodegen.volumetric_speed = entry.volumetric_speed;
+    gcodegen.elapsed_time += entry.elapsed_time;
+    gcodegen.elapsed_time_bridges += entry.elapsed_time_bridges;
+    gcodegen.elapsed_time_external += entry.elapsed_time_external;
+    gcodegen.arcs += entry.arcs;
+    gcodegen.arc_segments += entry.arc_segments;
+    if (entry.has_seam_position) gcodegen._seam_position[layer->object()] = entry.seam_position;
+    this->_last_region_id = entry.last_region_id;
+    if (this->_last_region_id != SIZE_MAX)
+        gcodegen.config.apply(this->_print.get_region(this->_last_region_id)->config);
+    if (entry.skirt_done) this->_skirt_done[scale_(layer->print_z)] = true;
+    this->_brim_done = entry.brim_done;
+    this->_second_layer_things_done = entry.second_layer_things_done;
+    this->_last_obj_copy = entry.last_obj_copy;
+}
+
+bool
+PrintGCode::_extrudes_skirt(const Layer* layer) const
+{
+    const auto& print {this->_print};
+    // extrude skirt along raft layers and normal obj layers
+    // (not along interlaced support material layers)
+    return layer->id() < static_cast<size_t>(layer->object()->config.raft_layers)
+        || ((print.has_infinite_skirt() || _skirt_done.size() == 0 || (_skirt_done.rbegin())->first < print.config.skirt_height)
+        && _skirt_done.count(scale_(layer->print_z)) == 0
+        && typeid(layer) != typeid(SupportLayer*));
+}
+
+void
+PrintGCode::_guess_state(const PrintGCode& main, const std::vector<LayerJob>& jobs, size_t from, size_t to)
+{
+    auto& gcodegen {this->_gcodegen};
+    const auto& main_gcodegen {main._gcodegen};
+    gcodegen.config.apply(main_gcodegen.config);
+    gcodegen.writer.restore(main_gcodegen.writer.state());
+    if (main_gcodegen.writer.extruder() != nullptr)
+        gcodegen.placeholder_parser->set("current_extruder", main_gcodegen.writer.extruder()->id);
+    gcodegen.origin = main_gcodegen.origin;
+    if (main_gcodegen.last_pos_defined()) gcodegen.set_last_pos(main_gcodegen.last_pos());
+    gcodegen.wipe.path = main_gcodegen.wipe.path;
+    gcodegen.avoid_crossing_perimeters.use_external_mp = main_gcodegen.avoid_crossing_perimeters.use_external_mp;
+    gcodegen.avoid_crossing_perimeters.use_external_mp_once = main_gcodegen.avoid_crossing_perimeters.use_external_mp_once;
+    gcodegen.avoid_crossing_perimeters.disable_once = main_gcodegen.avoid_crossing_perimeters.disable_once;
+    gcodegen.enable_cooling_markers = main_gcodegen.enable_cooling_markers;
+    gcodegen.layer = main_gcodegen.layer;
+    gcodegen.first_layer = main_gcodegen.first_layer;
+    // every layer moves to the next one
+    gcodegen.layer_index = main_gcodegen.layer_index + int(to - from);
+    gcodegen.volumetric_speed = main_gcodegen.volumetric_speed;
+    gcodegen._seam_position = main_gcodegen._seam_position;
+    this->_last_region_id = main._last_region_id;
+    this->_skirt_done = main._skirt_done;
+    this->_brim_done = main._brim_done;
+    this->_second_layer_things_done = main._second_layer_things_done;
+    this->_last_obj_copy = main._last_obj_copy;
+
+    // what the layers in between set regardless of where their paths go
+    for (size_t i = from; i < to; ++i) {
+        const LayerJob& job {jobs.at(i)};
+        if (this->_extrudes_skirt(job.layer))
+            this->_skirt_done[scale_(job.layer->print_z)] = true;
+        if (job.layer->id() == 1)
+            this->_second_layer_things_done = true;
+        if (!job.copies.empty())
+            this->_last_obj_copy = std::make_pair(job.copies.back(), true);
+    }
+}
+
+void
+PrintGCode::_write_layer(const Layer* layer, const std::string& gcode)
+{
     // Apply spiral vase post-processing if this layer contains suitable geometry
     // (we must feed all the G-code into the post-processor, including the first 
     // bottom non-spiral layers otherwise it will mess with positions)
     // we apply spiral vase at this stage because it requires a full layer
-    gcode = this->_spiral_vase.process_layer(gcode);
+    std::string output {this->_spiral_vase.process_layer(gcode)};
     // Apply the cooling logic.
-    gcode = this->_cooling_buffer.append(gcode, std::to_string(reinterpret_cast<long long unsigned int>(layer->object())) + std::string(typeid(layer).name()), 
+    output = this->_cooling_buffer.append(output, std::to_string(reinterpret_cast<long long unsigned int>(layer->object())) + std::string(typeid(layer).name()), 
                                          layer->id(), layer->print_z);
     
     // write the resulting gcode
-    fh << this->filter(gcode);
+    fh << this->filter(output);
 }
 
 
 // Extrude perimeters: Decide where to put seams (hide or align seams).
-std::string
-PrintGCode::_extrude_perimeters(std::map<size_t,ExtrusionEntityCollection> &by_region)
+void
+PrintGCode::_extrude_perimeters(std::string* gcode, const std::map<size_t,ExtrusionEntityCollection> &by_region)
 {
-    std::string gcode = "";
-    for(auto& pair : by_region) {
+    for(const auto& pair : by_region) {
         this->_gcodegen.config.apply(this->_print.get_region(pair.first)->config);
-        for(auto& ee : pair.second){
-            gcode += this->_gcodegen.extrude(*ee, "perimeter");
+        this->_last_region_id = pair.first;
+        for(auto it = pair.second.cbegin(); it != pair.second.cend(); ++it){
+            const auto& ee {*it};
+            this->_gcodegen.extrude(gcode, *ee, "perimeter");
         }
     }
-    return gcode;
 }
 
 // Chain the paths hierarchically by a greedy algorithm to minimize a travel distance.
-std::string
-PrintGCode::_extrude_infill(std::map<size_t,ExtrusionEntityCollection> &by_region)
+void
+PrintGCode::_extrude_infill(std::string* gcode, const std::map<size_t,ExtrusionEntityCollection> &by_region)
 {
-    std::string gcode = "";
-    for(auto& pair : by_region) {
+    for(const auto& pair : by_region) {
         this->_gcodegen.config.apply(this->_print.get_region(pair.first)->config);
+        this->_last_region_id = pair.first;
         ExtrusionEntityCollection tmp;
         pair.second.chained_path_from(this->_gcodegen.last_pos(),&tmp);
         for(auto& ee : tmp){
-            gcode += this->_gcodegen.extrude(*ee, "infill");
+            this->_gcodegen.extrude(gcode, *ee, "infill");
         }
     }
-    return gcode;
 }
 
 
@@ -741,6 +1224,8 @@ PrintGCode::_print_config(const ConfigBase& config)
     }
 }
 
+PrintGCode::~PrintGCode() = default;
+
 PrintGCode::PrintGCode(Slic3r::Print& print, std::ostream& _fh) : 
         _print(print), 
         config(print.config), 
@@ -765,6 +1250,38 @@ PrintGCode::PrintGCode(Slic3r::Print& print, std::ostream& _fh) :
 
     auto extruders {print.extruders()}; 
     _gcodegen.set_extruders(extruders.cbegin(), extruders.cend());
+    // for the layers spliced from the cache or from speculation
+    for (auto& extruder : _gcodegen.writer.extruders)
+        extruder.second.record_steps = true;
+
+    _cache = print.gcode_cache.get();
+    if (_cache != nullptr) {
+        for (const PrintObject* object : objects) {
+            LayerGCodeCache::Key key;
+            key.add_config(object->config);
+            key.add_string(object->model_object().name);
+            const BoundingBox bb {object->bounding_box()};
+            key.add(bb.min.x);
+            key.add(bb.min.y);
+            key.add(bb.max.x);
+            key.add(bb.max.y);
+            _object_keys[object] = key.value;
+        }
+        // the options of the regions GCode reads, the others only shape the
+        // extrusions of the layers, which are in the keys already
+        const t_config_option_keys region_options {
+            "perimeters", "fill_density",
+            "perimeter_extruder", "infill_extruder", "solid_infill_extruder",
+            "perimeter_speed", "small_perimeter_speed", "external_perimeter_speed",
+            "infill_speed", "solid_infill_speed", "top_solid_infill_speed",
+            "gap_fill_speed", "bridge_speed",
+        };
+        for (const PrintRegion* region : print.regions) {
+            LayerGCodeCache::Key key;
+            key.add_config(region->config, region_options);
+            _region_keys.push_back(key.value);
+        }
+    }
 }
 
 } // namespace Slic3r
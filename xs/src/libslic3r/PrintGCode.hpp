@@ -4,12 +4,16 @@
 
 #include "GCode.hpp"
 #include "GCode/CoolingBuffer.hpp"
+#include "GCode/LayerGCodeCache.hpp"
 #include "GCode/SpiralVase.hpp"
+#include "GCodeTemplate.hpp"
 #include "Geometry.hpp"
 #include "Flow.hpp"
 #include "ExtrusionEntity.hpp"
 #include "libslic3r.h"
 
+#include <functional>
+#include <memory>
 #include <string>
 #include <iostream>
 #include <regex>
@@ -20,6 +24,7 @@ class PrintGCode {
 public:
     /// Constructor.
     PrintGCode(Slic3r::Print& print, std::ostream& _fh);
+    ~PrintGCode();
 
     /// Perform the export. export is a reserved name in C++, so changed to output
     void output();
@@ -32,8 +37,64 @@ public:
     /// Applies various filters, if enabled.
     std::string filter(const std::string& in, bool wait = false);
 
+    /// Layers written from the ones generated ahead on other threads.
+    size_t speculated_layers() const { return this->_speculated_layers; };
+
 private:
-    
+
+    /// Extrusions of a layer grouped by island and region.
+    typedef std::map<size_t,
+        //                  region
+        std::tuple<std::map<size_t,ExtrusionEntityCollection>, // perimeters
+                   std::map<size_t,ExtrusionEntityCollection>>  // infill
+    > islands_t;
+
+    /// The part of the work on a layer that doesn't depend on the state of
+    /// the G-code generator, so that it can be done for the layers ahead of
+    /// the one being written while output() emits them in order.
+    struct LayerPlan {
+        /// Whether the spiral vase logic applies to the layer.
+        bool spiral_vase {false};
+        /// Volumetric speed that honors max_print_speed, if the layer sets one.
+        bool has_volumetric_speed {false};
+        double volumetric_speed {0};
+        /// Extrusions grouped by extruder and then by island, shared by the copies.
+        std::map<size_t, islands_t> by_extruder;
+        /// Hash of the extrusions, slices and configs of the layer, if the print has a G-code cache.
+        LayerGCodeCache::key_t key {0};
+    };
+
+    /// A layer output() has to print, in printing order.
+    struct LayerJob {
+        size_t idx;
+        const Layer* layer;
+        Points copies;
+    };
+
+    /// A layer generated ahead of the one being written, from a guess of the
+    /// state the generator will start it in.
+    struct Speculation {
+        LayerPlan plan;
+        /// _state_key() of the guess: the layer is only spliced if the
+        /// generator starts it in the same state.
+        LayerGCodeCache::key_t key {0};
+        /// The G-code leaves E out, see _relocate_E().
+        LayerGCodeCache::Entry entry;
+        std::vector<GCodeWriter::RelocatedE> relocated_E;
+        std::map<unsigned int, std::vector<double>> E_steps;
+    };
+
+    /// A generator of its own that speculates layers for this one, see
+    /// _process_layers().
+    struct Speculator;
+
+    /// What the generator adds up over the layers without it showing in the
+    /// G-code, so that a layer spliced from elsewhere adds to it.
+    struct Totals {
+        float elapsed_time[3];
+        size_t arcs, arc_segments;
+    };
+
     Slic3r::Print& _print;
     const Slic3r::PrintConfig& config;
 
@@ -46,7 +107,6 @@ private:
     Slic3r::CoolingBuffer _cooling_buffer;
     Slic3r::SpiralVase _spiral_vase;
 //    Slic3r::VibrationLimit _vibration_limit;
-//    Slic3r::ArcFitting _arc_fitting;
 //    Slic3r::PressureRegulator _pressure_regulator;
 
     /// presence in the array indicates that the 
@@ -55,6 +115,73 @@ private:
     bool _second_layer_things_done {false};
     std::pair<Point, bool> _last_obj_copy {std::pair<Point, bool>(Point(), false)};
     bool _autospeed {false};
+    /// G-code of the layer being processed, kept to reuse its allocation.
+    std::string _layer_gcode;
+    /// before_layer_gcode and layer_gcode, compiled once for the export.
+    GCodeTemplate _before_layer_template, _layer_template;
+    /// Region whose config was applied to _gcodegen last, SIZE_MAX if none was.
+    size_t _last_region_id {SIZE_MAX};
+    /// The islands of all the objects the travels between them avoid, if
+    /// avoid_crossing_perimeters is set.
+    ExPolygons _external_islands;
+
+    /// Created by the first _process_layers() that uses several threads.
+    std::vector<std::unique_ptr<Speculator>> _speculators;
+    /// Layers written from a speculation, out of all of them.
+    size_t _speculated_layers {0}, _layers_count {0};
+
+    /// The cache of the print, if any, and the hashes its keys are made of:
+    /// what every layer depends on, and the configs of the objects and regions.
+    LayerGCodeCache* _cache {nullptr};
+    LayerGCodeCache::key_t _export_key {0};
+    std::map<const PrintObject*, LayerGCodeCache::key_t> _object_keys;
+    std::vector<LayerGCodeCache::key_t> _region_keys;
+
+    /// Plan a layer. Only reads the print, so it can run on several layers at once.
+    LayerPlan _plan_layer(const Layer* layer) const;
+
+    /// Compile the custom G-code run for every layer or toolchange.
+    void _compile_templates(const PlaceholderParser& parser);
+
+    /// Write the layers of jobs in order, generating them on several threads
+    /// when the config allows it. before_layer is called ahead of writing
+    /// each layer.
+    void _process_layers(const std::vector<LayerJob>& jobs, const std::function<void(const LayerJob&)>& before_layer = nullptr);
+
+    /// Write a layer planned by _plan_layer(), splicing speculation if
+    /// there is one and the generator is in the state it was guessed from.
+    void process_layer(size_t idx, const Layer* layer, const Points& copies, const LayerPlan& plan, Speculation* speculation = nullptr);
+
+    /// Set up the generator for a layer, ahead of its key.
+    void _begin_layer(const Layer* layer, const LayerPlan& plan);
+    /// Append the G-code of a layer to gcode.
+    void _generate_layer(size_t idx, const Layer* layer, const Points& copies, const LayerPlan& plan, std::string* gcode);
+
+    /// Hash of the state the generator starts layer in, the part of it that
+    /// shows in the G-code of the layer but E, which a speculated layer is
+    /// relocated for.
+    LayerGCodeCache::key_t _state_key(const Layer* layer) const;
+    /// Key of a layer in the cache: its plan and the state the generator
+    /// starts it in, whose _state_key() is state.
+    LayerGCodeCache::key_t _layer_key(size_t idx, const Layer* layer, const Points& copies, const LayerPlan& plan,
+        LayerGCodeCache::key_t state) const;
+    Totals _totals() const;
+    /// Cache entry holding gcode and the state the generator is left in.
+    /// totals are the ones of the generator before the layer.
+    LayerGCodeCache::Entry _save_layer(std::string gcode, const Layer* layer, const Totals& totals) const;
+    /// Put the generator in the state a cached layer left it in.
+    void _restore_layer(const LayerGCodeCache::Entry& entry, const Layer* layer);
+    /// Write the E values of a speculated layer from the ones the generator
+    /// has, which the speculator could only guess. Returns false if the
+    /// layer doesn't fit them, see GCodeWriter::relocate_E().
+    bool _relocate_E(Speculation* speculation) const;
+    /// Whether layer gets a skirt.
+    bool _extrudes_skirt(const Layer* layer) const;
+    /// Put the generator in the state main is in now, as a guess of the one
+    /// it will be in once it has written jobs[from, to).
+    void _guess_state(const PrintGCode& main, const std::vector<LayerJob>& jobs, size_t from, size_t to);
+    /// Pass the G-code of a layer through the filters to the output.
+    void _write_layer(const Layer* layer, const std::string& gcode);
 
     void _print_first_layer_temperature(bool wait);
     void _print_off_temperature(bool wait);
@@ -63,10 +190,10 @@ private:
     void _print_config(const ConfigBase& config);
 
     // Extrude perimeters: Decide where to put seams (hide or align seams).
-    std::string _extrude_perimeters(std::map<size_t,ExtrusionEntityCollection> &by_region);
+    void _extrude_perimeters(std::string* gcode, const std::map<size_t,ExtrusionEntityCollection> &by_region);
 
     // Chain the paths hierarchically by a greedy algorithm to minimize a travel distance.
-    std::string _extrude_infill(std::map<size_t,ExtrusionEntityCollection> &by_region);
+    void _extrude_infill(std::string* gcode, const std::map<size_t,ExtrusionEntityCollection> &by_region);
 
     /// regular expression to match heater gcodes
     std::regex bed_temp_regex { std::regex("M(?:190|140)", std::regex_constants::icase)};
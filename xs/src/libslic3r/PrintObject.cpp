@@ -807,33 +807,35 @@ void PrintObject::_slice()
         }
     }
 
+    // The regions are sliced a window of layers at a time, straight into the
+    // layer regions, so that no per-layer intermediate results are kept for
+    // the whole height of the object.
     if (this->print()->regions.size() == 1) {
         // Optimized for a single region. Slice the single non-modifier mesh.
-        std::vector<ExPolygons> expolygons_by_layer = this->_slice_region(0, slice_zs, false);
-        for (size_t layer_id = 0; layer_id < expolygons_by_layer.size(); ++ layer_id)
-            this->layers[layer_id]->regions.front()->slices.append(std::move(expolygons_by_layer[layer_id]), stInternal);
+        this->_slice_region(0, slice_zs, false, [this](size_t layer_id, ExPolygons &&slices) {
+            this->layers[layer_id]->regions.front()->slices.append(std::move(slices), stInternal);
+        });
     } else {
         // Slice all non-modifier volumes.
         for (size_t region_id = 0; region_id < this->print()->regions.size(); ++ region_id) {
-            std::vector<ExPolygons> expolygons_by_layer = this->_slice_region(region_id, slice_zs, false);
-            for (size_t layer_id = 0; layer_id < expolygons_by_layer.size(); ++ layer_id)
-                this->layers[layer_id]->regions[region_id]->slices.append(std::move(expolygons_by_layer[layer_id]), stInternal);
+            this->_slice_region(region_id, slice_zs, false, [this, region_id](size_t layer_id, ExPolygons &&slices) {
+                this->layers[layer_id]->regions[region_id]->slices.append(std::move(slices), stInternal);
+            });
         }
         // Slice all modifier volumes.
         for (size_t region_id = 0; region_id < this->print()->regions.size(); ++ region_id) {
-            std::vector<ExPolygons> expolygons_by_layer = this->_slice_region(region_id, slice_zs, true);
-            // loop through the other regions and 'steal' the slices belonging to this one
-            for (size_t other_region_id = 0; other_region_id < this->print()->regions.size(); ++ other_region_id) {
-                if (region_id == other_region_id)
-                    continue;
-                for (size_t layer_id = 0; layer_id < expolygons_by_layer.size(); ++ layer_id) {
+            this->_slice_region(region_id, slice_zs, true, [this, region_id](size_t layer_id, ExPolygons &&slices) {
+                // loop through the other regions and 'steal' the slices belonging to this one
+                for (size_t other_region_id = 0; other_region_id < this->print()->regions.size(); ++ other_region_id) {
+                    if (region_id == other_region_id)
+                        continue;
                     Layer       *layer = layers[layer_id];
                     LayerRegion *layerm = layer->regions[region_id];
                     LayerRegion *other_layerm = layer->regions[other_region_id];
                     if (layerm == nullptr || other_layerm == nullptr)
                         continue;
                     Polygons other_slices = to_polygons(other_layerm->slices);
-                    ExPolygons my_parts = intersection_ex(other_slices, to_polygons(expolygons_by_layer[layer_id]));
+                    ExPolygons my_parts = intersection_ex(other_slices, to_polygons(slices));
                     if (my_parts.empty())
                         continue;
                     // Remove such parts from original region.
@@ -841,7 +843,7 @@ void PrintObject::_slice()
                     // Append new parts to our region.
                     layerm->slices.append(std::move(my_parts), stInternal);
                 }
-            }
+            });
         }
     }
 
@@ -918,8 +920,19 @@ std::vector<ExPolygons>
 PrintObject::_slice_region(size_t region_id, std::vector<float> z, bool modifier)
 {
     std::vector<ExPolygons> layers;
+    this->_slice_region(region_id, z, modifier, [&layers, &z](size_t layer_id, ExPolygons &&slices) {
+        if (layers.empty()) layers.resize(z.size());
+        layers[layer_id] = std::move(slices);
+    });
+    return layers;
+}
+
+void
+PrintObject::_slice_region(size_t region_id, const std::vector<float> &z, bool modifier,
+    const TriangleMeshSlicer<Z>::layer_slices_cb_t &cb)
+{
     std::vector<int> &region_volumes = this->region_volumes[region_id];
-    if (region_volumes.empty()) return layers;
+    if (region_volumes.empty()) return;
     
     ModelObject &object = *this->model_object();
     
@@ -933,7 +946,7 @@ PrintObject::_slice_region(size_t region_id, std::vector<float> z, bool modifier
         
         mesh.merge(volume.mesh);
     }
-    if (mesh.facets_count() == 0) return layers;
+    if (mesh.facets_count() == 0) return;
 
     // transform mesh
     // we ignore the per-instance transformations currently and only 
@@ -947,9 +960,36 @@ PrintObject::_slice_region(size_t region_id, std::vector<float> z, bool modifier
         -object.bounding_box().min.z
     );
     
+    // the slicer only needs the indexed mesh, drop the facet soup
+    mesh.compact();
+    
+    // reuse the slices of an identical mesh cut at the same Zs
+    SliceCache* cache = this->_print->slice_cache.get();
+    SliceCache::key_t key;
+    if (cache != nullptr) {
+        key = SliceCache::key(mesh, z);
+        std::vector<ExPolygons> layers;
+        if (cache->load(key, z.size(), &layers)) {
+            for (size_t layer_id = 0; layer_id < layers.size(); ++layer_id)
+                cb(layer_id, std::move(layers[layer_id]));
+            return;
+        }
+    }
+    
     // perform actual slicing
-    TriangleMeshSlicer<Z>(&mesh).slice(z, &layers);
-    return layers;
+    TriangleMeshSlicer<Z> slicer(&mesh);
+    slicer.threads = this->_print->config.threads.value;
+    const size_t window = std::max(32, 8 * slicer.threads);
+    if (cache == nullptr) {
+        slicer.slice(z, window, cb);
+        return;
+    }
+    SliceCache::Writer writer;
+    slicer.slice(z, window, [&writer, &cb](size_t layer_id, ExPolygons &&slices) {
+        writer.add_layer(slices);
+        cb(layer_id, std::move(slices));
+    });
+    cache->store(key, writer);
 }
 
 #ifndef SLIC3RXS
@@ -1456,6 +1496,9 @@ void
 PrintObject::_discover_neighbor_horizontal_shells(LayerRegion* layerm, const size_t& i, const size_t& region_id, const SurfaceType& type, Polygons& solid, const size_t& solid_layers)
 {
     const auto& region_config {layerm->region()->config};
+    // the shells are chained in Clipper form, solid is kept in sync with them
+    ClipperContext clipper;
+    ClipperLib::Paths solid_paths { ClipperContext::paths(solid) };
 
     for (int n = (type == stTop ? i-1 : i+1); std::abs(n-int(i)) < solid_layers; (type == stTop ? n-- : n++)) {
         if (n < 0 || static_cast<size_t>(n) >= this->layer_count()) continue;
@@ -1467,7 +1510,7 @@ PrintObject::_discover_neighbor_horizontal_shells(LayerRegion* layerm, const siz
         // intersections have contours and holes
         Polygons filtered_poly;
         polygons_append(filtered_poly, neighbor_fill_surfaces.filter_by_type({stInternal, stInternalSolid}));
-        auto new_internal_solid { intersection(solid, filtered_poly , 1 ) };
+        auto new_internal_solid { clipper.intersection(solid_paths, ClipperContext::paths(filtered_poly), 1) };
         if (new_internal_solid.size() == 0) {
             // No internal solid needed on this layer. In order to decide whether to continue
             // searching on the next neighbor (thus enforcing the configured number of solid
@@ -1491,9 +1534,11 @@ PrintObject::_discover_neighbor_horizontal_shells(LayerRegion* layerm, const siz
             // and it's not wanted in a hollow print even if it would make sense when
             // obeying the solid shell count option strictly (DWIM!)
             auto margin { neighbor_layerm->flow(frExternalPerimeter).scaled_width()};
-            auto too_narrow { diff(new_internal_solid, offset2(new_internal_solid, -margin, +margin, CLIPPER_OFFSET_SCALE, ClipperLib::jtMiter, 5), 1)}; 
-            if (too_narrow.size() > 0) 
-                new_internal_solid = solid = diff(new_internal_solid, too_narrow);
+            auto too_narrow { clipper.diff(new_internal_solid, clipper.offset2(new_internal_solid, -margin, +margin, CLIPPER_OFFSET_SCALE, ClipperLib::jtMiter, 5), 1)}; 
+            if (too_narrow.size() > 0) {
+                new_internal_solid = solid_paths = clipper.diff(new_internal_solid, too_narrow);
+                solid = ClipperContext::polygons(solid_paths);
+            }
         }
 
         // make sure the new internal solid is wide enough, as it might get collapsed
@@ -1506,7 +1551,7 @@ PrintObject::_discover_neighbor_horizontal_shells(LayerRegion* layerm, const siz
             // get a triangle in $too_narrow; if we grow it below then the shell
             // would have a different shape from the external surface and we'd still
             // have the same angle, so the next shell would be grown even more and so on.
-            auto too_narrow { diff(new_internal_solid, offset2(new_internal_solid, -margin, +margin, CLIPPER_OFFSET_SCALE, ClipperLib::jtMiter, 5), 1) };
+            auto too_narrow { clipper.diff(new_internal_solid, clipper.offset2(new_internal_solid, -margin, +margin, CLIPPER_OFFSET_SCALE, ClipperLib::jtMiter, 5), 1) };
 
             if (too_narrow.size() > 0) {
                 // grow the collapsing parts and add the extra area to  the neighbor layer 
@@ -1518,16 +1563,17 @@ PrintObject::_discover_neighbor_horizontal_shells(LayerRegion* layerm, const siz
                 for (auto& s : neighbor_fill_surfaces) {
                     if (s.is_internal() && !s.is_bridge()) tmp_internal.emplace_back(Polygon(s.expolygon)); 
                 }
-                auto grown {intersection(
-                offset(too_narrow, +margin),
+                auto grown {clipper.intersection(
+                clipper.offset(too_narrow, +margin),
                 // Discard bridges as they are grown for anchoring and we cant
                 // remove such anchors. (This may happen when a bridge is being 
                 // anchored onto a wall where little space remains after the bridge
                 // is grown, and that little space is an internal solid shell so 
                 // it triggers this too_narrow logic.)
-                tmp_internal)
+                ClipperContext::paths(tmp_internal))
                 };
-                new_internal_solid = solid = diff(new_internal_solid, too_narrow);
+                new_internal_solid = solid_paths = clipper.diff(new_internal_solid, too_narrow);
+                solid = ClipperContext::polygons(solid_paths);
             }
         }
         // internal-solid are the union of the existing internal-solid surfaces
@@ -0,0 +1,282 @@
+#include "SliceCache.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <tuple>
+#include <boost/filesystem.hpp>
+#include <boost/nowide/fstream.hpp>
+
+namespace Slic3r {
+
+namespace {
+
+/// Bump when the layout of the entries or the meaning of the key changes.
+const uint8_t format_version = 2;
+/// Bump when the slicer cuts different slices out of the same mesh at the
+/// same Zs, so that the entries it stored before are not reused.
+const uint8_t slicer_version = 1;
+const char magic[4] = { 'S', 'L', 'C', 'C' };
+const char extension[] = ".slices";
+
+/// 64 bit FNV-1a, stable across runs and platforms unlike std::hash.
+class Hasher
+{
+public:
+    void add(const void* data, size_t size)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            this->value ^= p[i];
+            this->value *= 0x100000001b3ull;
+        }
+    }
+    template <class T> void add(const T &value) { this->add(&value, sizeof(T)); }
+
+    uint64_t value {0xcbf29ce484222325ull};
+};
+
+void
+put_varint(std::string* out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out->push_back(char(value | 0x80));
+        value >>= 7;
+    }
+    out->push_back(char(value));
+}
+
+/// Read a varint at *p, advancing it. Returns false past end or on overlong values.
+bool
+get_varint(const char** p, const char* end, uint64_t* value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+        const uint8_t byte = uint8_t(*(*p)++);
+        *value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+inline uint64_t zigzag(int64_t v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+inline int64_t unzigzag(uint64_t v) { return int64_t(v >> 1) ^ -int64_t(v & 1); }
+
+/// Points are stored as differences from the previous point of the layer.
+void
+put_polygon(std::string* out, const Polygon &polygon, Point* last)
+{
+    put_varint(out, polygon.points.size());
+    for (const Point &point : polygon.points) {
+        put_varint(out, zigzag(int64_t(point.x) - int64_t(last->x)));
+        put_varint(out, zigzag(int64_t(point.y) - int64_t(last->y)));
+        *last = point;
+    }
+}
+
+bool
+get_polygon(const char** p, const char* end, Polygon* polygon, Point* last)
+{
+    uint64_t count;
+    // every point takes two bytes at least
+    if (!get_varint(p, end, &count) || count > uint64_t(end - *p) / 2) return false;
+    polygon->points.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t dx, dy;
+        if (!get_varint(p, end, &dx) || !get_varint(p, end, &dy)) return false;
+        last->x = coord_t(int64_t(last->x) + unzigzag(dx));
+        last->y = coord_t(int64_t(last->y) + unzigzag(dy));
+        polygon->points.push_back(*last);
+    }
+    return true;
+}
+
+}
+
+void
+SliceCache::Writer::add_layer(const ExPolygons &slices)
+{
+    Point last(0, 0);
+    put_varint(&this->data, slices.size());
+    for (const ExPolygon &expolygon : slices) {
+        put_varint(&this->data, expolygon.holes.size());
+        put_polygon(&this->data, expolygon.contour, &last);
+        for (const Polygon &hole : expolygon.holes)
+            put_polygon(&this->data, hole, &last);
+    }
+    ++this->layers_count;
+}
+
+SliceCache::SliceCache(const std::string &directory, uint64_t max_size)
+    : directory(directory), max_size(max_size)
+{
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(this->directory, ec);
+}
+
+SliceCache::key_t
+SliceCache::key(const TriangleMesh &mesh, const std::vector<float> &z)
+{
+    Hasher hasher;
+    hasher.add(format_version);
+    hasher.add(slicer_version);
+    const IndexedMesh &indexed = mesh.indexed;
+    hasher.add(uint64_t(indexed.vertices.size()));
+    hasher.add(indexed.vertices.data(), indexed.vertices.size() * sizeof(stl_vertex));
+    hasher.add(uint64_t(indexed.indices.size()));
+    hasher.add(indexed.indices.data(), indexed.indices.size() * sizeof(int));
+    hasher.add(uint64_t(z.size()));
+    hasher.add(z.data(), z.size() * sizeof(float));
+    
+    key_t key;
+    key.hash = hasher.value;
+    key.facets_count = indexed.facets_count();
+    const stl_stats &stats = mesh.stl.stats;
+    const float bounding_box[6] = { stats.min.x, stats.min.y, stats.min.z, stats.max.x, stats.max.y, stats.max.z };
+    std::copy(bounding_box, bounding_box + 6, key.bounding_box);
+    return key;
+}
+
+std::string
+SliceCache::path(const key_t &key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx%s", (unsigned long long)key.hash, extension);
+    return (boost::filesystem::path(this->directory) / name).string();
+}
+
+bool
+SliceCache::load(const key_t &key, size_t layers_count, std::vector<ExPolygons>* layers)
+{
+    const std::string file = this->path(key);
+    std::string data;
+    {
+        boost::nowide::ifstream in(file.c_str(), std::ios::in | std::ios::binary);
+        if (in.is_open())
+            data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    // check the header: magic, versions, key and number of layers
+    const char* p = data.data();
+    const char* end = p + data.size();
+    bool valid = data.size() >= sizeof(magic) + 2 + sizeof(key.hash) + sizeof(key.bounding_box)
+        && memcmp(p, magic, sizeof(magic)) == 0
+        && uint8_t(p[sizeof(magic)]) == format_version
+        && uint8_t(p[sizeof(magic) + 1]) == slicer_version;
+    if (valid) {
+        p += sizeof(magic) + 2;
+        key_t stored_key;
+        memcpy(&stored_key.hash, p, sizeof(stored_key.hash));
+        p += sizeof(stored_key.hash);
+        memcpy(stored_key.bounding_box, p, sizeof(stored_key.bounding_box));
+        p += sizeof(stored_key.bounding_box);
+        uint64_t count;
+        valid = stored_key.hash == key.hash
+            && memcmp(stored_key.bounding_box, key.bounding_box, sizeof(key.bounding_box)) == 0
+            && get_varint(&p, end, &stored_key.facets_count) && stored_key.facets_count == key.facets_count
+            && get_varint(&p, end, &count) && count == layers_count;
+    }
+
+    std::vector<ExPolygons> result;
+    if (valid) {
+        result.resize(layers_count);
+        for (ExPolygons &slices : result) {
+            Point last(0, 0);
+            uint64_t expolygons_count;
+            // every expolygon takes two bytes at least
+            valid = get_varint(&p, end, &expolygons_count) && expolygons_count <= uint64_t(end - p) / 2;
+            if (!valid) break;
+            slices.assign(expolygons_count, ExPolygon());
+            for (ExPolygon &expolygon : slices) {
+                uint64_t holes_count;
+                valid = get_varint(&p, end, &holes_count) && holes_count <= uint64_t(end - p)
+                    && get_polygon(&p, end, &expolygon.contour, &last);
+                if (!valid) break;
+                expolygon.holes.assign(holes_count, Polygon());
+                for (Polygon &hole : expolygon.holes)
+                    if (!(valid = get_polygon(&p, end, &hole, &last))) break;
+                if (!valid) break;
+            }
+            if (!valid) break;
+        }
+        valid = valid && p == end;
+    }
+
+    if (!valid) {
+        ++this->_misses;
+        return false;
+    }
+    ++this->_hits;
+    *layers = std::move(result);
+    
+    // the modification time tells the least recently used entries apart
+    boost::system::error_code ec;
+    boost::filesystem::last_write_time(file, std::time(nullptr), ec);
+    return true;
+}
+
+bool
+SliceCache::store(const key_t &key, const Writer &writer)
+{
+    std::string header(magic, sizeof(magic));
+    header.push_back(char(format_version));
+    header.push_back(char(slicer_version));
+    header.append(reinterpret_cast<const char*>(&key.hash), sizeof(key.hash));
+    header.append(reinterpret_cast<const char*>(key.bounding_box), sizeof(key.bounding_box));
+    put_varint(&header, key.facets_count);
+    put_varint(&header, writer.layers_count);
+
+    const std::string file = this->path(key);
+    const std::string temp_file = file + "." + boost::filesystem::unique_path().string();
+    bool written = false;
+    {
+        boost::nowide::ofstream out(temp_file.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) return false;
+        out.write(header.data(), header.size());
+        out.write(writer.data.data(), writer.data.size());
+        written = bool(out.flush());
+    }
+    boost::system::error_code ec;
+    if (written) {
+        boost::filesystem::rename(temp_file, file, ec);
+        if (!ec) {
+            this->trim();
+            return true;
+        }
+    }
+    boost::filesystem::remove(temp_file, ec);
+    return false;
+}
+
+void
+SliceCache::trim() const
+{
+    // (modification time, size, path) of every entry
+    typedef std::tuple<std::time_t, uint64_t, boost::filesystem::path> t_entry;
+    std::vector<t_entry> entries;
+    uint64_t total_size = 0;
+    boost::system::error_code ec;
+    for (boost::filesystem::directory_iterator it(this->directory, ec), end; !ec && it != end; it.increment(ec)) {
+        const boost::filesystem::path &path = it->path();
+        if (path.extension() != extension) continue;
+        boost::system::error_code entry_ec;
+        const uint64_t size = boost::filesystem::file_size(path, entry_ec);
+        const std::time_t time = boost::filesystem::last_write_time(path, entry_ec);
+        if (entry_ec) continue;
+        entries.emplace_back(time, size, path);
+        total_size += size;
+    }
+    if (total_size <= this->max_size) return;
+    
+    // evict the least recently used entries first; another process may
+    // be trimming as well, so the files it already removed are skipped
+    std::sort(entries.begin(), entries.end());
+    for (const t_entry &entry : entries) {
+        if (total_size <= this->max_size) break;
+        boost::filesystem::remove(std::get<2>(entry), ec);
+        total_size -= std::get<1>(entry);
+    }
+}
+
+}
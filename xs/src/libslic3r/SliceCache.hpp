@@ -0,0 +1,88 @@
+#ifndef slic3r_SliceCache_hpp_
+#define slic3r_SliceCache_hpp_
+
+#include "libslic3r.h"
+#include "ExPolygon.hpp"
+#include "TriangleMesh.hpp"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Slic3r {
+
+/// On-disk cache of the slices of the meshes PrintObject::_slice_region()
+/// cuts, so that slicing an unchanged object again, in this process or in a
+/// later one, reads its slices back instead of cutting the mesh.
+///
+/// An entry is keyed by a hash of the transformed mesh and of the Z list it is
+/// sliced at. The transformation of the object and the config options that
+/// decide the layer heights are thus part of the key, the other options don't
+/// change the slices and can be edited freely.
+/// Each entry is a file holding the expolygons of every layer with their
+/// points delta-encoded as zigzag varints.
+/// The cache directory is kept under a size limit by evicting the least
+/// recently used entries.
+class SliceCache
+{
+public:
+    /// Identifies an entry. The hash names its file, the facet count and the
+    /// bounding box of the mesh are stored in its header and checked on load,
+    /// so that a hash collision can't hand out the slices of another mesh.
+    struct key_t {
+        uint64_t hash {0};
+        uint64_t facets_count {0};
+        /// min x, y, z then max x, y, z
+        float bounding_box[6] {0, 0, 0, 0, 0, 0};
+    };
+
+    /// Default limit of the size of the cache directory: 1 GB.
+    static const uint64_t default_max_size = 1024 * 1024 * 1024;
+
+    /// Layers encoded one at a time as the slicer hands them out, for store().
+    class Writer
+    {
+    public:
+        void add_layer(const ExPolygons &slices);
+
+    private:
+        std::string data;
+        size_t layers_count {0};
+        friend class SliceCache;
+    };
+
+    /// Keep the cache files in directory, created if needed, evicting the
+    /// least recently used ones once they take more than max_size bytes.
+    explicit SliceCache(const std::string &directory, uint64_t max_size = default_max_size);
+
+    /// Key of the slices of mesh at the given Zs, hashed from its indexed
+    /// form (see TriangleMesh::require_shared_vertices()).
+    static key_t key(const TriangleMesh &mesh, const std::vector<float> &z);
+
+    /// Read the slices stored for key. Counts a hit if there is a valid
+    /// entry of layers_count layers, a miss otherwise. A hit marks the entry
+    /// as recently used.
+    bool load(const key_t &key, size_t layers_count, std::vector<ExPolygons>* layers);
+
+    /// Store the layers encoded by writer for key, then evict the least
+    /// recently used entries if the directory went over its size limit.
+    /// The file is written aside and renamed, so that concurrent readers
+    /// never see a partial entry.
+    bool store(const key_t &key, const Writer &writer);
+
+    size_t hits() const { return this->_hits.load(); };
+    size_t misses() const { return this->_misses.load(); };
+
+private:
+    std::string directory;
+    uint64_t max_size;
+    std::atomic<size_t> _hits {0};
+    std::atomic<size_t> _misses {0};
+
+    std::string path(const key_t &key) const;
+    void trim() const;
+};
+
+}
+
+#endif
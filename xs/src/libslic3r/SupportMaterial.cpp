@@ -10,12 +10,43 @@ PolylineCollection _fill_surface(Fill *fill, Surface *surface)
     return ps;
 }
 
+void
+ZPolygons::set(coordf_t layer_z, Polygons &&layer_polygons)
+{
+    if (this->z.empty() || layer_z > this->z.back()) {
+        this->z.push_back(layer_z);
+        this->polygons.push_back(std::move(layer_polygons));
+        return;
+    }
+    const auto it = lower_bound(this->z.begin(), this->z.end(), layer_z);
+    const auto i = it - this->z.begin();
+    if (*it == layer_z) {
+        this->polygons[i] = std::move(layer_polygons);
+    } else {
+        this->z.insert(it, layer_z);
+        this->polygons.insert(this->polygons.begin() + i, std::move(layer_polygons));
+    }
+}
+
+const Polygons*
+ZPolygons::find(coordf_t layer_z) const
+{
+    const auto it = lower_bound(this->z.begin(), this->z.end(), layer_z);
+    return (it != this->z.end() && *it == layer_z) ? &this->polygons[it - this->z.begin()] : nullptr;
+}
+
+size_t
+ZPolygons::upper_bound(coordf_t layer_z) const
+{
+    return std::upper_bound(this->z.begin(), this->z.end(), layer_z) - this->z.begin();
+}
+
 void
 SupportMaterial::generate_toolpaths(PrintObject *object,
-                                    map<coordf_t, Polygons> overhang,
-                                    map<coordf_t, Polygons> contact,
-                                    map<int, Polygons> _interface,
-                                    map<int, Polygons> base)
+                                    const ZPolygons &overhang,
+                                    const ZPolygons &contact,
+                                    const vector<Polygons> &_interface,
+                                    const vector<Polygons> &base)
 {
     // Assign the object to the supports class.
     this->object = object;
@@ -65,33 +96,33 @@ SupportMaterial::generate(PrintObject *object)
     // This method is responsible for identifying what contact surfaces
     // should the support material expose to the object in order to guarantee
     // that it will be effective, regardless of how it's built below.
-    pair<map<coordf_t, Polygons>, map<coordf_t, Polygons>> contact_overhang = contact_area(object);
-    map<coordf_t, Polygons> &contact = contact_overhang.first;
-    map<coordf_t, Polygons> &overhang = contact_overhang.second;
+    pair<ZPolygons, ZPolygons> contact_overhang = contact_area(object);
+    const ZPolygons &contact = contact_overhang.first;
+    const ZPolygons &overhang = contact_overhang.second;
 
     // Determine the top surfaces of the object. We need these to determine
     // the layer heights of support material and to clip support to the object
     // silhouette.
-    map<coordf_t, Polygons> top = object_top(object, &contact);
+    ZPolygons top = object_top(object, contact);
     // We now know the upper and lower boundaries for our support material object
     // (@$contact_z and @$top_z), so we can generate intermediate layers.
-    vector<coordf_t> support_z = support_layers_z(get_keys_sorted(contact),
-                                                  get_keys_sorted(top),
+    vector<coordf_t> support_z = support_layers_z(contact.z,
+                                                  top.z,
                                                   get_max_layer_height(object));
     // If we wanted to apply some special logic to the first support layers lying on
     // object's top surfaces this is the place to detect them.
-    map<int, Polygons> shape;
+    vector<Polygons> shape;
     if (object_config->support_material_pattern.value == smpPillars)
         this->generate_pillars_shape(contact, support_z, shape);
 
     // Propagate contact layers downwards to generate interface layers.
-    map<int, Polygons> _interface = generate_interface_layers(support_z, contact, top);
+    vector<Polygons> _interface = generate_interface_layers(support_z, contact, top);
     clip_with_object(_interface, support_z, *object);
     if (!shape.empty())
         clip_with_shape(_interface, shape);
     // Propagate contact layers and interface layers downwards to generate
     // the main support layers.
-    map<int, Polygons> base = generate_base_layers(support_z, contact, _interface, top);
+    vector<Polygons> base = generate_base_layers(support_z, contact, _interface, top);
     clip_with_object(base, support_z, *object);
     if (!shape.empty())
         clip_with_shape(base, shape);
@@ -190,7 +221,7 @@ SupportMaterial::support_layers_z(vector<coordf_t> contact_z,
     return z;
 }
 
-pair<map<coordf_t, Polygons>, map<coordf_t, Polygons>>
+pair<ZPolygons, ZPolygons>
 SupportMaterial::contact_area(PrintObject *object)
 {
     PrintObjectConfig &conf = *this->object_config;
@@ -213,12 +244,10 @@ SupportMaterial::contact_area(PrintObject *object)
     bool buildplate_only =
         (conf.support_material || conf.support_material_enforce_layers)
             && conf.support_material_buildplate_only;
-    Polygons buildplate_only_top_surfaces;
 
-    // Determine contact areas.
-    map<coordf_t, Polygons> contact; // contact_z => [ polygons ].
-    map<coordf_t, Polygons> overhang; // This stores the actual overhang supported by each contact layer
-    for (int layer_id = 0; layer_id < object->layers.size(); layer_id++) {
+    // Find the layers to detect overhangs on.
+    vector<int> layer_ids;
+    for (int layer_id = 0; layer_id < static_cast<int>(object->layers.size()); layer_id++) {
         // Note $layer_id might != $layer->id when raft_layers > 0
         // so $layer_id == 0 means first object layer
         // and $layer->id == 0 means first print layer (including raft).
@@ -237,289 +266,336 @@ SupportMaterial::contact_area(PrintObject *object)
             // the 'overhangs' of the first object layer.
             break;
 
-        Layer *layer = object->get_layer(layer_id);
-
         if (conf.support_material_max_layers
             && layer_id > conf.support_material_max_layers)
             break;
 
-        if (buildplate_only) {
-            // Collect the top surfaces up to this layer and merge them. TODO @Ask about this line.
+        layer_ids.push_back(layer_id);
+    }
+    if (layer_ids.empty())
+        return make_pair(ZPolygons(), ZPolygons());
+
+    // The top surfaces up to each of these layers, merged. A snapshot is only
+    // made by the layers that add top surfaces: the layers above them share it.
+    vector<std::shared_ptr<const Polygons>> buildplate_only_top_surfaces;
+    if (buildplate_only) {
+        vector<Polygons> new_top_surfaces(layer_ids.size());
+        parallelize<size_t>(0, layer_ids.size() - 1, [&] (size_t i) {
             Polygons projection_new;
-            for (auto const &region : layer->regions) {
+            for (auto const &region : object->get_layer(layer_ids[i])->regions) {
                 SurfacesPtr top_surfaces = region->slices.filter_by_type(stTop);
                 for (const auto &polygon : p(top_surfaces)) {
                     projection_new.push_back(polygon);
                 }
             }
-            if (!projection_new.empty()) {
-                // Merge the new top surfaces with the preceding top surfaces. TODO @Ask about this line.
-                // Apply the safety offset to the newly added polygons, so they will connect
-                // with the polygons collected before,
-                // but don't apply the safety offset during the union operation as it would
-                // inflate the polygons over and over.
-                append_to(buildplate_only_top_surfaces, offset(projection_new, scale_(0.01)));
-
-                buildplate_only_top_surfaces = union_(buildplate_only_top_surfaces, 0);
+            // Apply the safety offset to the newly added polygons, so they will connect
+            // with the polygons collected before,
+            // but don't apply the safety offset during the union operation as it would
+            // inflate the polygons over and over.
+            if (!projection_new.empty())
+                new_top_surfaces[i] = offset(projection_new, scale_(0.01));
+        }, this->config->threads.value);
+
+        auto merged = std::make_shared<const Polygons>();
+        buildplate_only_top_surfaces.reserve(layer_ids.size());
+        for (const Polygons &top_surfaces : new_top_surfaces) {
+            if (!top_surfaces.empty()) {
+                // Merge the new top surfaces with the preceding top surfaces.
+                Polygons polygons {*merged};
+                append_to(polygons, top_surfaces);
+                merged = std::make_shared<const Polygons>(union_(polygons, 0));
             }
+            buildplate_only_top_surfaces.push_back(merged);
         }
+    }
 
-        // Detect overhangs and contact areas needed to support them.
-        Polygons tmp_overhang, tmp_contact;
-        if (layer_id == 0) {
-            // this is the first object layer, so we're here just to get the object
-            // footprint for the raft.
-            // we only consider contours and discard holes to get a more continuous raft.
-            for (auto const &contour : layer->slices.contours())
-                tmp_overhang.push_back(contour);
-
-            Polygons polygons = offset(tmp_overhang, scale_(+SUPPORT_MATERIAL_MARGIN));
-            append_to(tmp_contact, polygons);
-        }
-        else {
-            Layer *lower_layer = object->get_layer(layer_id - 1);
-            for (auto layer_m : layer->regions) {
-                auto fw = layer_m->flow(frExternalPerimeter).scaled_width();
-                Polygons difference;
-
-                // If a threshold angle was specified, use a different logic for detecting overhangs.
-                if ((conf.support_material && threshold_rad != 0.0)
-                    || layer_id <= conf.support_material_enforce_layers
-                    || (conf.raft_layers > 0 && layer_id
-                        == 0)) { // TODO ASK @Samir why layer_id ==0 check , layer_id will never equal to zero
-                    float d = 0;
-                    float layer_threshold_rad = threshold_rad;
-                    if (layer_id <= conf.support_material_enforce_layers) {
-                        // Use ~45 deg number for enforced supports if we are in auto.
-                        layer_threshold_rad = static_cast<float>(Geometry::deg2rad(89));
-                    }
-                    if (layer_threshold_rad > 0) {
-                        d = scale_(lower_layer->height
-                                       * (cos(layer_threshold_rad) / sin(layer_threshold_rad)));
-                    }
+    // Detect overhangs and contact areas needed to support them. Each layer
+    // only reads its own and the lower layer, so they run in parallel.
+    vector<Polygons> layer_contact(layer_ids.size()), layer_overhang(layer_ids.size());
+    parallelize<size_t>(0, layer_ids.size() - 1, [&] (size_t i) {
+        this->layer_contact_area(
+            object,
+            layer_ids[i],
+            threshold_rad,
+            buildplate_only ? buildplate_only_top_surfaces[i].get() : nullptr,
+            &layer_contact[i],
+            &layer_overhang[i]
+        );
+    }, this->config->threads.value);
 
-                    difference = diff(
-                        Polygons(layer_m->slices),
-                        offset(lower_layer->slices, +d)
-                    );
+    // Determine contact areas, in layer order whatever the threads.
+    ZPolygons contact; // contact_z => [ polygons ].
+    ZPolygons overhang; // This stores the actual overhang supported by each contact layer
+    for (size_t i = 0; i < layer_ids.size(); i++) {
+        if (layer_contact[i].empty())
+            continue;
 
-                    // only enforce spacing from the object ($fw/2) if the threshold angle
-                    // is not too high: in that case, $d will be very small (as we need to catch
-                    // very short overhangs), and such contact area would be eaten by the
-                    // enforced spacing, resulting in high threshold angles to be almost ignored
-                    if (d > fw / 2)
-                        difference = diff(
-                            offset(difference, d - fw / 2),
-                            lower_layer->slices);
+        Layer *layer = object->get_layer(layer_ids[i]);
 
-                }
-                else {
-                    difference = diff(
-                        Polygons(layer_m->slices),
-                        offset(lower_layer->slices,
-                               static_cast<const float>(+conf.get_abs_value("support_material_threshold", fw)))
-                    );
+        // Now apply the contact areas to the layer were they need to be made.
+        {
+            // Get the average nozzle diameter used on this layer.
+            vector<double> nozzle_diameters;
+            for (auto region : layer->regions) {
+                nozzle_diameters.push_back(config->nozzle_diameter.get_at(static_cast<size_t>(
+                                                                              region->region()->config
+                                                                                  .perimeter_extruder - 1)));
+                nozzle_diameters.push_back(config->nozzle_diameter.get_at(static_cast<size_t>(
+                                                                              region->region()->config
+                                                                                  .infill_extruder - 1)));
+                nozzle_diameters.push_back(config->nozzle_diameter.get_at(static_cast<size_t>(
+                                                                              region->region()->config
+                                                                                  .solid_infill_extruder - 1)));
+            }
 
-                    // Collapse very tiny spots.
-                    difference = offset2(difference, -fw / 10, +fw / 10);
-                    // $diff now contains the ring or stripe comprised between the boundary of
-                    // lower slices and the centerline of the last perimeter in this overhanging layer.
-                    // Void $diff means that there's no upper perimeter whose centerline is
-                    // outside the lower slice boundary, thus no overhang
-                }
+            int nozzle_diameters_count = static_cast<int>(!nozzle_diameters.empty() ? nozzle_diameters.size() : 1);
+            auto nozzle_diameter =
+                accumulate(nozzle_diameters.begin(), nozzle_diameters.end(), 0.0) / nozzle_diameters_count;
 
-                if (conf.dont_support_bridges) {
-                    // Compute the area of bridging perimeters.
-                    Polygons bridged_perimeters;
-                    {
-                        auto bridge_flow = layer_m->flow(FlowRole::frPerimeter, 1);
-
-                        // Get the lower layer's slices and grow them by half the nozzle diameter
-                        // because we will consider the upper perimeters supported even if half nozzle
-                        // falls outside the lower slices.
-                        Polygons lower_grown_slices;
-                        {
-                            coordf_t nozzle_diameter = this->config->nozzle_diameter
-                                .get_at(static_cast<size_t>(layer_m->region()->config.perimeter_extruder - 1));
-
-                            lower_grown_slices = offset(
-                                lower_layer->slices,
-                                scale_(nozzle_diameter / 2)
-                            );
-                        }
+            coordf_t contact_z = layer->print_z - contact_distance(layer->height, nozzle_diameter);
 
-                        // TODO Revise Here.
-                        // Get all perimeters as polylines.
-                        // TODO: split_at_first_point() (called by as_polyline() for ExtrusionLoops)
-                        // could split a bridge mid-way.
-                        Polylines overhang_perimeters;
-                        for (auto extr_path : ExtrusionPaths(layer_m->perimeters.flatten())) {
-                            overhang_perimeters.push_back(extr_path.as_polyline());
-                        }
+            // Ignore this contact area if it's too low.
+            if (contact_z < conf.first_layer_height - EPSILON)
+                continue;
 
-                        // Only consider the overhang parts of such perimeters,
-                        // overhangs being those parts not supported by
-                        // workaround for Clipper bug, see Slic3r::Polygon::clip_as_polyline()
-                        for (auto &overhang_perimeter : overhang_perimeters)
-                            overhang_perimeter.translate(1, 0);
-                        overhang_perimeters = diff_pl(overhang_perimeters, lower_grown_slices);
-
-                        // Only consider straight overhangs.
-                        Polylines new_overhangs_perimeters_polylines;
-                        for (const auto &p : overhang_perimeters)
-                            if (p.is_straight())
-                                new_overhangs_perimeters_polylines.push_back(p);
-
-                        overhang_perimeters = new_overhangs_perimeters_polylines;
-
-                        // Only consider overhangs having endpoints inside layer's slices
-                        for (auto &p : overhang_perimeters) {
-                            p.extend_start(fw);
-                            p.extend_end(fw);
-                        }
+            contact.set(contact_z, std::move(layer_contact[i]));
+            overhang.set(contact_z, std::move(layer_overhang[i]));
+        }
+    }
 
-                        new_overhangs_perimeters_polylines = Polylines();
-                        for (const auto &p : overhang_perimeters) {
-                            if (layer->slices.contains_b(p.first_point())
-                                && layer->slices.contains_b(p.last_point())) {
-                                new_overhangs_perimeters_polylines.push_back(p);
-                            }
-                        }
+    return make_pair(contact, overhang);
+}
 
-                        overhang_perimeters = new_overhangs_perimeters_polylines;
-                        new_overhangs_perimeters_polylines = Polylines();
+void
+SupportMaterial::layer_contact_area(PrintObject *object,
+                                    int layer_id,
+                                    float threshold_rad,
+                                    const Polygons *buildplate_only_top_surfaces,
+                                    Polygons *contact,
+                                    Polygons *overhang)
+{
+    PrintObjectConfig &conf = *this->object_config;
 
-                        // Convert bridging polylines into polygons by inflating them with their thickness.
-                        {
-                            // For bridges we can't assume width is larger than spacing because they
-                            // are positioned according to non-bridging perimeters spacing.
-                            coord_t widths[] = {bridge_flow.scaled_width(),
-                                                bridge_flow.scaled_spacing(),
-                                                fw,
-                                                layer_m->flow(FlowRole::frPerimeter).scaled_width()};
+    Layer *layer = object->get_layer(layer_id);
+    if (layer_id == 0) {
+        // this is the first object layer, so we're here just to get the object
+        // footprint for the raft.
+        // we only consider contours and discard holes to get a more continuous raft.
+        for (auto const &contour : layer->slices.contours())
+            overhang->push_back(contour);
 
-                            auto w = *max_element(widths, widths + 4);
+        Polygons polygons = offset(*overhang, scale_(+SUPPORT_MATERIAL_MARGIN));
+        append_to(*contact, polygons);
+    }
+    else {
+        Layer *lower_layer = object->get_layer(layer_id - 1);
+        for (auto layer_m : layer->regions) {
+            auto fw = layer_m->flow(frExternalPerimeter).scaled_width();
+            Polygons difference;
+
+            // If a threshold angle was specified, use a different logic for detecting overhangs.
+            if ((conf.support_material && threshold_rad != 0.0)
+                || layer_id <= conf.support_material_enforce_layers
+                || (conf.raft_layers > 0 && layer_id
+                    == 0)) { // TODO ASK @Samir why layer_id ==0 check , layer_id will never equal to zero
+                float d = 0;
+                float layer_threshold_rad = threshold_rad;
+                if (layer_id <= conf.support_material_enforce_layers) {
+                    // Use ~45 deg number for enforced supports if we are in auto.
+                    layer_threshold_rad = static_cast<float>(Geometry::deg2rad(89));
+                }
+                if (layer_threshold_rad > 0) {
+                    d = scale_(lower_layer->height
+                                   * (cos(layer_threshold_rad) / sin(layer_threshold_rad)));
+                }
 
-                            // Also apply safety offset to ensure no gaps are left in between.
-                            Polygons ps = offset(overhang_perimeters, w / 2 + 10);
-                            bridged_perimeters = union_(ps);
-                        }
-                    }
+                difference = diff(
+                    Polygons(layer_m->slices),
+                    offset(lower_layer->slices, +d)
+                );
 
-                    if (1) {
-                        // Remove the entire bridges and only support the unsupported edges.
-                        ExPolygons bridges;
-                        for (auto surface : layer_m->fill_surfaces.filter_by_type(stBottomBridge)) {
-                            if (surface->bridge_angle != -1) {
-                                bridges.push_back(surface->expolygon);
-                            }
-                        }
+                // only enforce spacing from the object ($fw/2) if the threshold angle
+                // is not too high: in that case, $d will be very small (as we need to catch
+                // very short overhangs), and such contact area would be eaten by the
+                // enforced spacing, resulting in high threshold angles to be almost ignored
+                if (d > fw / 2)
+                    difference = diff(
+                        offset(difference, d - fw / 2),
+                        lower_layer->slices);
+
+            }
+            else {
+                difference = diff(
+                    Polygons(layer_m->slices),
+                    offset(lower_layer->slices,
+                           static_cast<const float>(+conf.get_abs_value("support_material_threshold", fw)))
+                );
 
-                        Polygons ps = to_polygons(bridges);
-                        append_to(ps, bridged_perimeters);
+                // Collapse very tiny spots.
+                difference = offset2(difference, -fw / 10, +fw / 10);
+                // $diff now contains the ring or stripe comprised between the boundary of
+                // lower slices and the centerline of the last perimeter in this overhanging layer.
+                // Void $diff means that there's no upper perimeter whose centerline is
+                // outside the lower slice boundary, thus no overhang
+            }
 
-                        difference = diff( // TODO ASK about expolygons and polygons miss match.
-                            difference,
-                            ps,
-                            true
-                        );
+            if (conf.dont_support_bridges) {
+                // Compute the area of bridging perimeters.
+                Polygons bridged_perimeters;
+                {
+                    auto bridge_flow = layer_m->flow(FlowRole::frPerimeter, 1);
 
-                        append_to(difference,
-                                  intersection(
-                                      offset(layer_m->unsupported_bridge_edges.polylines,
-                                             +scale_(SUPPORT_MATERIAL_MARGIN)), to_polygons(bridges)));
-                    }
-                    else {
-                        // just remove bridged areas.
-                        difference = diff(
-                            difference,
-                            layer_m->bridged,
-                            true
+                    // Get the lower layer's slices and grow them by half the nozzle diameter
+                    // because we will consider the upper perimeters supported even if half nozzle
+                    // falls outside the lower slices.
+                    Polygons lower_grown_slices;
+                    {
+                        coordf_t nozzle_diameter = this->config->nozzle_diameter
+                            .get_at(static_cast<size_t>(layer_m->region()->config.perimeter_extruder - 1));
+
+                        lower_grown_slices = offset(
+                            lower_layer->slices,
+                            scale_(nozzle_diameter / 2)
                         );
                     }
-                } // if ($conf->dont_support_bridges)
 
-                if (buildplate_only) {
-                    // Don't support overhangs above the top surfaces.
-                    // This step is done before the contact surface is calcuated by growing the overhang region.
-                    difference = diff(difference, buildplate_only_top_surfaces);
-                }
+                    // TODO Revise Here.
+                    // Get all perimeters as polylines.
+                    // TODO: split_at_first_point() (called by as_polyline() for ExtrusionLoops)
+                    // could split a bridge mid-way.
+                    Polylines overhang_perimeters;
+                    for (auto extr_path : ExtrusionPaths(layer_m->perimeters.flatten())) {
+                        overhang_perimeters.push_back(extr_path.as_polyline());
+                    }
 
-                if (difference.empty()) continue;
+                    // Only consider the overhang parts of such perimeters,
+                    // overhangs being those parts not supported by
+                    // workaround for Clipper bug, see Slic3r::Polygon::clip_as_polyline()
+                    for (auto &overhang_perimeter : overhang_perimeters)
+                        overhang_perimeter.translate(1, 0);
+                    overhang_perimeters = diff_pl(overhang_perimeters, lower_grown_slices);
+
+                    // Only consider straight overhangs.
+                    Polylines new_overhangs_perimeters_polylines;
+                    for (const auto &p : overhang_perimeters)
+                        if (p.is_straight())
+                            new_overhangs_perimeters_polylines.push_back(p);
+
+                    overhang_perimeters = new_overhangs_perimeters_polylines;
+
+                    // Only consider overhangs having endpoints inside layer's slices
+                    for (auto &p : overhang_perimeters) {
+                        p.extend_start(fw);
+                        p.extend_end(fw);
+                    }
 
-                // NOTE: this is not the full overhang as it misses the outermost half of the perimeter width!
-                append_to(tmp_overhang, difference);
+                    new_overhangs_perimeters_polylines = Polylines();
+                    for (const auto &p : overhang_perimeters) {
+                        if (layer->slices.contains_b(p.first_point())
+                            && layer->slices.contains_b(p.last_point())) {
+                            new_overhangs_perimeters_polylines.push_back(p);
+                        }
+                    }
 
-                // Let's define the required contact area by using a max gap of half the upper
-                // extrusion width and extending the area according to the configured margin.
-                //    We increment the area in steps because we don't want our support to overflow
-                // on the other side of the object (if it's very thin).
-                {
-                    Polygons slices_margin = offset(lower_layer->slices, +fw / 2);
+                    overhang_perimeters = new_overhangs_perimeters_polylines;
+                    new_overhangs_perimeters_polylines = Polylines();
 
-                    if (buildplate_only) {
-                        // Trim the inflated contact surfaces by the top surfaces as well.
-                        append_to(slices_margin, buildplate_only_top_surfaces);
-                        slices_margin = union_(slices_margin);
+                    // Convert bridging polylines into polygons by inflating them with their thickness.
+                    {
+                        // For bridges we can't assume width is larger than spacing because they
+                        // are positioned according to non-bridging perimeters spacing.
+                        coord_t widths[] = {bridge_flow.scaled_width(),
+                                            bridge_flow.scaled_spacing(),
+                                            fw,
+                                            layer_m->flow(FlowRole::frPerimeter).scaled_width()};
+
+                        auto w = *max_element(widths, widths + 4);
+
+                        // Also apply safety offset to ensure no gaps are left in between.
+                        Polygons ps = offset(overhang_perimeters, w / 2 + 10);
+                        bridged_perimeters = union_(ps);
                     }
+                }
 
-                    vector<coord_t> scale_vector
-                        (static_cast<unsigned long>(SUPPORT_MATERIAL_MARGIN / MARGIN_STEP), scale_(MARGIN_STEP));
-                    scale_vector.push_back(fw / 2);
-                    for (int i = static_cast<int>(scale_vector.size()) - 1; i >= 0; i--) {
-                        difference = diff(
-                            offset(difference, i),
-                            slices_margin
-                        );
+                if (1) {
+                    // Remove the entire bridges and only support the unsupported edges.
+                    ExPolygons bridges;
+                    for (auto surface : layer_m->fill_surfaces.filter_by_type(stBottomBridge)) {
+                        if (surface->bridge_angle != -1) {
+                            bridges.push_back(surface->expolygon);
+                        }
                     }
+
+                    Polygons ps = to_polygons(bridges);
+                    append_to(ps, bridged_perimeters);
+
+                    difference = diff( // TODO ASK about expolygons and polygons miss match.
+                        difference,
+                        ps,
+                        true
+                    );
+
+                    append_to(difference,
+                              intersection(
+                                  offset(layer_m->unsupported_bridge_edges.polylines,
+                                         +scale_(SUPPORT_MATERIAL_MARGIN)), to_polygons(bridges)));
                 }
-                append_to(tmp_contact, difference);
-            }
-        }
-        if (tmp_contact.empty())
-            continue;
+                else {
+                    // just remove bridged areas.
+                    difference = diff(
+                        difference,
+                        layer_m->bridged,
+                        true
+                    );
+                }
+            } // if ($conf->dont_support_bridges)
 
-        // Now apply the contact areas to the layer were they need to be made.
-        {
-            // Get the average nozzle diameter used on this layer.
-            vector<double> nozzle_diameters;
-            for (auto region : layer->regions) {
-                nozzle_diameters.push_back(config->nozzle_diameter.get_at(static_cast<size_t>(
-                                                                              region->region()->config
-                                                                                  .perimeter_extruder - 1)));
-                nozzle_diameters.push_back(config->nozzle_diameter.get_at(static_cast<size_t>(
-                                                                              region->region()->config
-                                                                                  .infill_extruder - 1)));
-                nozzle_diameters.push_back(config->nozzle_diameter.get_at(static_cast<size_t>(
-                                                                              region->region()->config
-                                                                                  .solid_infill_extruder - 1)));
+            if (buildplate_only_top_surfaces != nullptr) {
+                // Don't support overhangs above the top surfaces.
+                // This step is done before the contact surface is calcuated by growing the overhang region.
+                difference = diff(difference, *buildplate_only_top_surfaces);
             }
 
-            int nozzle_diameters_count = static_cast<int>(!nozzle_diameters.empty() ? nozzle_diameters.size() : 1);
-            auto nozzle_diameter =
-                accumulate(nozzle_diameters.begin(), nozzle_diameters.end(), 0.0) / nozzle_diameters_count;
+            if (difference.empty()) continue;
 
-            coordf_t contact_z = layer->print_z - contact_distance(layer->height, nozzle_diameter);
+            // NOTE: this is not the full overhang as it misses the outermost half of the perimeter width!
+            append_to(*overhang, difference);
 
-            // Ignore this contact area if it's too low.
-            if (contact_z < conf.first_layer_height - EPSILON)
-                continue;
+            // Let's define the required contact area by using a max gap of half the upper
+            // extrusion width and extending the area according to the configured margin.
+            //    We increment the area in steps because we don't want our support to overflow
+            // on the other side of the object (if it's very thin).
+            {
+                Polygons slices_margin = offset(lower_layer->slices, +fw / 2);
 
-            contact[contact_z] = tmp_contact;
-            overhang[contact_z] = tmp_overhang;
+                if (buildplate_only_top_surfaces != nullptr) {
+                    // Trim the inflated contact surfaces by the top surfaces as well.
+                    append_to(slices_margin, *buildplate_only_top_surfaces);
+                    slices_margin = union_(slices_margin);
+                }
+
+                vector<coord_t> scale_vector
+                    (static_cast<unsigned long>(SUPPORT_MATERIAL_MARGIN / MARGIN_STEP), scale_(MARGIN_STEP));
+                scale_vector.push_back(fw / 2);
+                for (int i = static_cast<int>(scale_vector.size()) - 1; i >= 0; i--) {
+                    difference = diff(
+                        offset(difference, i),
+                        slices_margin
+                    );
+                }
+            }
+            append_to(*contact, difference);
         }
     }
-
-    return make_pair(contact, overhang);
 }
 
-map<coordf_t, Polygons>
-SupportMaterial::object_top(PrintObject *object, map<coordf_t, Polygons> *contact)
+ZPolygons
+SupportMaterial::object_top(PrintObject *object, const ZPolygons &contact)
 {
     // find object top surfaces
     // we'll use them to clip our support and detect where does it stick.
-    map<coordf_t, Polygons> top;
-    if (object_config->support_material_buildplate_only.value)
+    ZPolygons top;
+    if (object_config->support_material_buildplate_only.value || contact.empty())
         return top;
 
     Polygons projection;
@@ -537,14 +613,12 @@ SupportMaterial::object_top(PrintObject *object, map<coordf_t, Polygons> *contac
         // first add all the 'new' contact areas to the current projection
         // ('new' means all the areas that are lower than the last top layer
         // we considered).
-        double min_top = (!top.empty() ? top.begin()->first : contact->rbegin()->first);
+        double min_top = (!top.empty() ? top.z.front() : contact.z.back());
 
         // Use <= instead of just < because otherwise we'd ignore any contact regions
         // having the same Z of top layers.
-        for (auto el : *contact)
-            if (el.first > layer->print_z && el.first <= min_top)
-                for (const auto &p : el.second)
-                    projection.push_back(p);
+        for (size_t j = contact.upper_bound(layer->print_z); j < contact.size() && contact.z[j] <= min_top; j++)
+            append_to(projection, contact.polygons[j]);
 
         // Now find whether any projection falls onto this top surface.
         Polygons touching = intersection(projection, p(m_top));
@@ -552,7 +626,7 @@ SupportMaterial::object_top(PrintObject *object, map<coordf_t, Polygons> *contac
             // Grow top surfaces so that interface and support generation are generated
             // with some spacing from object - it looks we don't need the actual
             // top shapes so this can be done here.
-            top[layer->print_z] = offset(touching, flow.scaled_width());
+            top.set(layer->print_z, offset(touching, flow.scaled_width()));
         }
 
         // Remove the areas that touched from the projection that will continue on
@@ -564,9 +638,9 @@ SupportMaterial::object_top(PrintObject *object, map<coordf_t, Polygons> *contac
 }
 
 void
-SupportMaterial::generate_pillars_shape(const map<coordf_t, Polygons> &contact,
+SupportMaterial::generate_pillars_shape(const ZPolygons &contact,
                                         const vector<coordf_t> &support_z,
-                                        map<int, Polygons> &shape)
+                                        vector<Polygons> &shape)
 {
     // This prevents supplying an empty point set to BoundingBox constructor.
     if (contact.empty()) return;
@@ -587,8 +661,8 @@ SupportMaterial::generate_pillars_shape(const map<coordf_t, Polygons> &contact,
         BoundingBox bb;
         {
             Points bb_points;
-            for (auto contact_el : contact) {
-                append_to(bb_points, to_points(contact_el.second));
+            for (const auto &contact_polygons : contact.polygons) {
+                append_to(bb_points, to_points(contact_polygons));
             }
             bb = BoundingBox(bb_points);
         }
@@ -603,16 +677,14 @@ SupportMaterial::generate_pillars_shape(const map<coordf_t, Polygons> &contact,
         grid = union_(pillars);
     }
     // Add pillars to every layer.
-    for (auto i = 0; i < support_z.size(); i++) {
-        shape[i] = grid;
-    }
+    shape.assign(support_z.size(), grid);
     // Build capitals.
-    for (auto i = 0; i < support_z.size(); i++) {
-        coordf_t z = support_z[i];
+    for (size_t i = 0; i < support_z.size(); i++) {
+        const Polygons *contact_z = contact.find(support_z[i]);
 
         auto capitals = intersection(
             grid,
-            contact.count(z) > 0 ? contact.at(z) : Polygons()
+            contact_z != nullptr ? *contact_z : Polygons()
         );
         // Work on one pillar at time (if any) to prevent the capitals from being merged
         // but store the contact area supported by the capital because we need to make
@@ -623,7 +695,7 @@ SupportMaterial::generate_pillars_shape(const map<coordf_t, Polygons> &contact,
             auto capital_polygons = offset(Polygons({capital}), +(pillar_spacing - pillar_size) / 2);
             append_to(contact_supported_by_capitals, capital_polygons);
 
-            for (int j = i - 1; j >= 0; j--) {
+            for (size_t j = i; j-- > 0; ) {
                 auto jz = support_z[j];
                 capital_polygons = offset(Polygons{capital}, -interface_flow.scaled_width() / 2);
                 if (capitals.empty()) break;
@@ -634,54 +706,54 @@ SupportMaterial::generate_pillars_shape(const map<coordf_t, Polygons> &contact,
         // but store the contact area supported by the capital because we need to make
         // sure nothing is left.
         auto contact_not_supported_by_capitals = diff(
-            contact.count(z) > 0 ? contact.at(z) : Polygons(),
+            contact_z != nullptr ? *contact_z : Polygons(),
             contact_supported_by_capitals
         );
 
         if (!contact_not_supported_by_capitals.empty()) {
-            for (int j = i - 1; j >= 0; j--) {
+            for (size_t j = i; j-- > 0; ) {
                 append_to(shape[j], contact_not_supported_by_capitals);
             }
         }
     }
 }
 
-map<int, Polygons>
-SupportMaterial::generate_base_layers(vector<coordf_t> support_z,
-                                      map<coordf_t, Polygons> contact,
-                                      map<int, Polygons> _interface,
-                                      map<coordf_t, Polygons> top)
+vector<Polygons>
+SupportMaterial::generate_base_layers(const vector<coordf_t> &support_z,
+                                      const ZPolygons &contact,
+                                      const vector<Polygons> &_interface,
+                                      const ZPolygons &top)
 {
     // Let's now generate support layers under interface layers.
-    map<int, Polygons> base;
+    vector<Polygons> base(support_z.size());
     {
-        for (auto i = static_cast<int>(support_z.size()) - 1; i >= 0; i--) {
-            auto z = support_z[i];
-            auto overlapping_layers = this->overlapping_layers(i, support_z);
-            vector<coordf_t> overlapping_z;
-            for (auto el : overlapping_layers)
-                overlapping_z.push_back(support_z[el]);
-
+        vector<pair<size_t, size_t>> overlapping_layers = this->overlapping_layers(support_z);
+        for (size_t i = support_z.size(); i-- > 0; ) {
             // In case we have no interface layers, look at upper contact
             // (1 interface layer means we only have contact layer, so $interface->{$i+1} is empty).
-            Polygons upper_contact;
-            if (object_config->support_material_interface_layers.value <= 1) {
-                append_to(upper_contact, (i + 1 < support_z.size() ? contact[support_z[i + 1]] : contact[-1]));
-            }
-
             Polygons ps_1;
-            append_to(ps_1, base[i + 1]); // support regions on upper layer.
-            append_to(ps_1, _interface[i + 1]); // _interface regions on upper layer
-            append_to(ps_1, upper_contact); // contact regions on upper layer
+            if (i + 1 < support_z.size()) {
+                append_to(ps_1, base[i + 1]); // support regions on upper layer.
+                append_to(ps_1, _interface[i + 1]); // _interface regions on upper layer
+                if (object_config->support_material_interface_layers.value <= 1) {
+                    const Polygons *upper_contact = contact.find(support_z[i + 1]);
+                    if (upper_contact != nullptr)
+                        append_to(ps_1, *upper_contact); // contact regions on upper layer
+                }
+            }
 
             Polygons ps_2;
-            for (auto el : overlapping_z) {
-                if (top.count(el) > 0)
-                    append_to(ps_2, top[el]); // top slices on this layer.
-                if (_interface.count(el) > 0)
-                    append_to(ps_2, _interface[el]); // _interface regions on this layer.
-                if (contact.count(el) > 0)
-                    append_to(ps_2, contact[el]); // contact regions on this layer.
+            for (size_t j = overlapping_layers[i].first; j < overlapping_layers[i].second; j++) {
+                if (j == i) continue;
+                if (const Polygons *top_j = top.find(support_z[j]))
+                    append_to(ps_2, *top_j); // top slices on this layer.
+                // Looked up by layer index, like $interface->{$_} in Perl. The map keyed by
+                // int this used to be was looked up with the Z truncated to an int, which
+                // found the interface of another layer, or none. As support_z is sorted, no
+                // other layer overlaps this one, so the base support doesn't change.
+                append_to(ps_2, _interface[j]); // _interface regions on this layer.
+                if (const Polygons *contact_j = contact.find(support_z[j]))
+                    append_to(ps_2, *contact_j); // contact regions on this layer.
             }
 
             base[i] = diff(
@@ -694,30 +766,25 @@ SupportMaterial::generate_base_layers(vector<coordf_t> support_z,
     return base;
 }
 
-map<int, Polygons>
-SupportMaterial::generate_interface_layers(vector<coordf_t> support_z,
-                                           map<coordf_t, Polygons> contact,
-                                           map<coordf_t, Polygons> top)
+vector<Polygons>
+SupportMaterial::generate_interface_layers(const vector<coordf_t> &support_z,
+                                           const ZPolygons &contact,
+                                           const ZPolygons &top)
 {
     // let's now generate interface layers below contact areas.
-    map<int, Polygons> _interface;
-    auto interface_layers_num = object_config->support_material_interface_layers.value;
-
-    for (int layer_id = 0; layer_id < support_z.size(); layer_id++) {
-        auto z = support_z[layer_id];
-
-        if (contact.count(z) <= 0)
+    vector<Polygons> _interface(support_z.size());
+    const auto interface_layers_num =
+        static_cast<size_t>(max(0, object_config->support_material_interface_layers.value));
+    vector<pair<size_t, size_t>> overlapping_layers = this->overlapping_layers(support_z);
+
+    for (size_t layer_id = 0; layer_id < support_z.size(); layer_id++) {
+        const Polygons *contact_z = contact.find(support_z[layer_id]);
+        if (contact_z == nullptr)
             continue;
-        Polygons &_contact = contact[z];
+        Polygons _contact = *contact_z;
 
         // Count contact layer as interface layer.
-        for (int i = layer_id - 1; i >= 0 && i > layer_id - interface_layers_num; i--) {
-            auto _z = support_z[i];
-            auto overlapping_layers = this->overlapping_layers(i, support_z);
-            vector<coordf_t> overlapping_z;
-            for (auto z_el : overlapping_layers)
-                overlapping_z.push_back(support_z[z_el]);
-
+        for (size_t i = layer_id; i-- > 0 && i + interface_layers_num > layer_id; ) {
             // Compute interface area on this layer as diff of upper contact area
             // (or upper interface area) and layer slices.
             // This diff is responsible of the contact between support material and
@@ -729,11 +796,12 @@ SupportMaterial::generate_interface_layers(vector<coordf_t> support_z,
             append_to(ps_1, _interface[i]); // _interface regions already applied to this layer.
 
             Polygons ps_2;
-            for (auto el : overlapping_z) {
-                if (top.count(el) > 0)
-                    append_to(ps_2, top[el]); // top slices on this layer.
-                if (contact.count(el) > 0)
-                    append_to(ps_2, contact[el]); // contact regions on this layer.
+            for (size_t j = overlapping_layers[i].first; j < overlapping_layers[i].second; j++) {
+                if (j == i) continue;
+                if (const Polygons *top_j = top.find(support_z[j]))
+                    append_to(ps_2, *top_j); // top slices on this layer.
+                if (const Polygons *contact_j = contact.find(support_z[j]))
+                    append_to(ps_2, *contact_j); // contact regions on this layer.
             }
 
             _contact = _interface[i] = diff(
@@ -748,9 +816,9 @@ SupportMaterial::generate_interface_layers(vector<coordf_t> support_z,
 
 void
 SupportMaterial::generate_bottom_interface_layers(const vector<coordf_t> &support_z,
-                                                  map<int, Polygons> &base,
-                                                  map<coordf_t, Polygons> &top,
-                                                  map<int, Polygons> &_interface)
+                                                  vector<Polygons> &base,
+                                                  const ZPolygons &top,
+                                                  vector<Polygons> &_interface)
 {
     // If no interface layers are allowed, don't generate bottom interface layers.
     if (object_config->support_material_interface_layers.value == 0)
@@ -758,46 +826,44 @@ SupportMaterial::generate_bottom_interface_layers(const vector<coordf_t> &suppor
 
     auto area_threshold = interface_flow.scaled_spacing() * interface_flow.scaled_spacing();
 
-    // Loop through object's top surfaces. TODO CHeck if the keys are sorted.
-    for (auto &top_el : top) {
+    // Loop through object's top surfaces, sorted by Z.
+    for (size_t top_id = 0; top_id < top.size(); top_id++) {
         // Keep a count of the interface layers we generated for this top surface.
-        int interface_layers = 0;
+        size_t interface_layers = 0;
 
         // Loop through support layers until we find the one(s) right above the top
         // surface.
-        for (int layer_id = 0; layer_id < support_z.size(); layer_id++) {
+        for (size_t layer_id = 0; layer_id < support_z.size(); layer_id++) {
             auto z = support_z[layer_id];
-            if (!z > top_el.first) // next unless $z > $top_z;
+            if (!z > top.z[top_id]) // next unless $z > $top_z;
                 continue;
 
-            if (base.count(layer_id) > 0) {
-                // Get the support material area that should be considered interface.
-                auto interface_area = intersection(
-                    base[layer_id],
-                    top_el.second
-                );
+            // Get the support material area that should be considered interface.
+            auto interface_area = intersection(
+                base[layer_id],
+                top.polygons[top_id]
+            );
 
-                // Discard too small areas.
-                Polygons new_interface_area;
-                for (auto p : interface_area) {
-                    if (abs(p.area()) >= area_threshold)
-                        new_interface_area.push_back(p);
-                }
-                interface_area = new_interface_area;
+            // Discard too small areas.
+            Polygons new_interface_area;
+            for (auto p : interface_area) {
+                if (abs(p.area()) >= area_threshold)
+                    new_interface_area.push_back(p);
+            }
+            interface_area = new_interface_area;
 
-                // Subtract new interface area from base.
-                base[layer_id] = diff(
-                    base[layer_id],
-                    interface_area
-                );
+            // Subtract new interface area from base.
+            base[layer_id] = diff(
+                base[layer_id],
+                interface_area
+            );
 
-                // Add the new interface area to interface.
-                append_to(_interface[layer_id], interface_area);
-            }
+            // Add the new interface area to interface.
+            append_to(_interface[layer_id], interface_area);
 
             interface_layers++;
-            if (interface_layers == object_config->support_material_interface_layers.value)
-                layer_id = static_cast<int>(support_z.size());
+            if (interface_layers == static_cast<size_t>(object_config->support_material_interface_layers.value))
+                break;
         }
     }
 }
@@ -814,50 +880,47 @@ SupportMaterial::contact_distance(coordf_t layer_height, coordf_t nozzle_diamete
     }
 }
 
-vector<int>
-SupportMaterial::overlapping_layers(int layer_idx, const vector<coordf_t> &support_z)
+vector<pair<size_t, size_t>>
+SupportMaterial::overlapping_layers(const vector<coordf_t> &support_z)
 {
-    vector<int> ret;
-
-    coordf_t z_max = support_z[layer_idx];
-    coordf_t z_min = layer_idx == 0 ? 0 : support_z[layer_idx - 1];
-
-    for (int i = 0; i < support_z.size(); i++) {
-        if (i == layer_idx) continue;
-
-        coordf_t z_max2 = support_z[i];
-        coordf_t z_min2 = i == 0 ? 0 : support_z[i - 1];
-
-        if (z_max > z_min2 && z_min < z_max2)
-            ret.push_back(i);
+    // support_z is sorted, so the layers whose [z_min2, z_max2] range overlaps
+    // the one of a layer are contiguous.
+    vector<pair<size_t, size_t>> ret;
+    ret.reserve(support_z.size());
+    for (size_t layer_idx = 0; layer_idx < support_z.size(); layer_idx++) {
+        coordf_t z_max = support_z[layer_idx];
+        coordf_t z_min = layer_idx == 0 ? 0 : support_z[layer_idx - 1];
+
+        // first layer with z_max2 > z_min, and after the last one with z_min2 < z_max
+        size_t first = upper_bound(support_z.begin(), support_z.end(), z_min) - support_z.begin();
+        size_t last = lower_bound(support_z.begin(), support_z.end(), z_max) - support_z.begin() + 1;
+        ret.emplace_back(first, max(first, min(last, support_z.size())));
     }
 
     return ret;
 }
 
 void
-SupportMaterial::clip_with_shape(map<int, Polygons> &support, map<int, Polygons> &shape)
+SupportMaterial::clip_with_shape(vector<Polygons> &support, const vector<Polygons> &shape)
 {
-    for (auto layer : support) {
+    const auto raft_layers = static_cast<size_t>(max(0, object_config->raft_layers.value));
+    for (size_t i = 0; i < support.size(); i++) {
         // Don't clip bottom layer with shape so that we
         // can generate a continuous base flange
         // also don't clip raft layers
-        if (layer.first == 0) continue;
-        else if (layer.first < object_config->raft_layers) continue;
+        if (i == 0) continue;
+        else if (i < raft_layers) continue;
 
-        layer.second = intersection(layer.second, shape[layer.first]);
+        support[i] = intersection(support[i], shape[i]);
     }
 }
 
 void
-SupportMaterial::clip_with_object(map<int, Polygons> &support, vector<coordf_t> support_z, PrintObject &object)
+SupportMaterial::clip_with_object(vector<Polygons> &support, const vector<coordf_t> &support_z, PrintObject &object)
 {
-    int i = 0;
-    for (auto support_layer: support) {
-        if (support_layer.second.empty()) {
-            i++;
+    for (size_t i = 0; i < support.size(); i++) {
+        if (support[i].empty())
             continue;
-        }
         coordf_t z_max = support_z[i];
         coordf_t z_min = (i == 0) ? 0 : support_z[i - 1];
 
@@ -878,7 +941,7 @@ SupportMaterial::clip_with_object(map<int, Polygons> &support, vector<coordf_t>
                 slices.push_back(s);
             }
         }
-        support_layer.second = diff(support_layer.second, offset(slices, flow.scaled_width()));
+        support[i] = diff(support[i], offset(slices, flow.scaled_width()));
     }
     /*
         $support->{$i} = diff(
@@ -889,7 +952,7 @@ SupportMaterial::clip_with_object(map<int, Polygons> &support, vector<coordf_t>
 }
 
 void
-SupportMaterial::process_layer(int layer_id, toolpaths_params params)
+SupportMaterial::process_layer(size_t layer_id, toolpaths_params params)
 {
     SupportLayer *layer = this->object->support_layers[layer_id];
     coordf_t z = layer->print_z;
@@ -900,10 +963,12 @@ SupportMaterial::process_layer(int layer_id, toolpaths_params params)
     _flow.height = static_cast<float>(layer->height);
     _interface_flow.height = static_cast<float>(layer->height);
 
-    Polygons overhang = this->overhang.count(z) > 0 ? this->overhang[z] : Polygons();
-    Polygons contact = this->contact.count(z) > 0 ? this->contact[z] : Polygons();
-    Polygons _interface = this->_interface.count(layer_id) > 0 ? this->_interface[layer_id] : Polygons();
-    Polygons base = this->base.count(layer_id) > 0 ? this->base[layer_id] : Polygons();
+    const Polygons *overhang_z = this->overhang.find(z);
+    const Polygons *contact_z = this->contact.find(z);
+    Polygons overhang = overhang_z != nullptr ? *overhang_z : Polygons();
+    Polygons contact = contact_z != nullptr ? *contact_z : Polygons();
+    Polygons _interface = layer_id < this->_interface.size() ? this->_interface[layer_id] : Polygons();
+    Polygons base = layer_id < this->base.size() ? this->base[layer_id] : Polygons();
 
     // Islands.
     {
@@ -1186,16 +1251,6 @@ SupportMaterial::append_polygons(Polygons &dst, Polygons &src)
     }
 }
 
-vector<coordf_t>
-SupportMaterial::get_keys_sorted(map<coordf_t, Polygons> _map)
-{
-    vector<coordf_t> ret;
-    for (auto el : _map)
-        ret.push_back(el.first);
-    sort(ret.begin(), ret.end());
-    return ret;
-}
-
 coordf_t
 SupportMaterial::get_max_layer_height(PrintObject *object)
 {
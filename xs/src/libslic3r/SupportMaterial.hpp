@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <numeric>
 #include <vector>
 
@@ -64,6 +65,26 @@ struct toolpaths_params
     {}
 };
 
+/// Polygons of layers sorted by their Z, in two flat vectors instead of a map<coordf_t, Polygons>.
+struct ZPolygons
+{
+    vector<coordf_t> z;
+    vector<Polygons> polygons;
+
+    size_t size() const { return z.size(); }
+    bool empty() const { return z.empty(); }
+
+    /// Add the polygons of a layer, or replace them if there is already a layer at layer_z.
+    /// Cheapest above all the other layers.
+    void set(coordf_t layer_z, Polygons &&layer_polygons);
+
+    /// The polygons of the layer at exactly layer_z, or nullptr.
+    const Polygons* find(coordf_t layer_z) const;
+
+    /// Index of the first layer above layer_z.
+    size_t upper_bound(coordf_t layer_z) const;
+};
+
 class SupportMaterial
 {
 public:
@@ -77,10 +98,10 @@ public:
 
     /// Generate the extrusions paths for the support matterial generated for the given print object.
     void generate_toolpaths(PrintObject *object,
-                            map<coordf_t, Polygons> overhang,
-                            map<coordf_t, Polygons> contact,
-                            map<int, Polygons> _interface,
-                            map<int, Polygons> base);
+                            const ZPolygons &overhang,
+                            const ZPolygons &contact,
+                            const vector<Polygons> &_interface,
+                            const vector<Polygons> &base);
 
     /// Generate support material for the given print object.
     void generate(PrintObject *object);
@@ -90,41 +111,55 @@ public:
                                       vector<coordf_t> top_z,
                                       coordf_t max_object_layer_height);
 
-    pair<map<coordf_t, Polygons>, map<coordf_t, Polygons>> contact_area(PrintObject *object);
+    pair<ZPolygons, ZPolygons> contact_area(PrintObject *object);
 
-    map<coordf_t, Polygons> object_top(PrintObject *object, map<coordf_t, Polygons> *contact);
+    /// Detect the overhangs of an object layer over the one below it, and the contact area needed to support them.
+    /// Only reads the two layers, so that contact_area() can run it on many layers at once.
+    void layer_contact_area(PrintObject *object,
+                            int layer_id,
+                            float threshold_rad,
+                            const Polygons *buildplate_only_top_surfaces,
+                            Polygons *contact,
+                            Polygons *overhang);
 
-    void generate_pillars_shape(const map<coordf_t, Polygons> &contact,
+    ZPolygons object_top(PrintObject *object, const ZPolygons &contact);
+
+    /// The shape of the pillars on each support layer.
+    void generate_pillars_shape(const ZPolygons &contact,
                                 const vector<coordf_t> &support_z,
-                                map<int, Polygons> &shape);
+                                vector<Polygons> &shape);
 
-    map<int, Polygons> generate_base_layers(vector<coordf_t> support_z,
-                                            map<coordf_t, Polygons> contact,
-                                            map<int, Polygons> _interface,
-                                            map<coordf_t, Polygons> top);
+    /// The base support of each support layer: the base and interface of the layer
+    /// above, minus the top surfaces, interface and contact of the layers overlapping
+    /// with it. _interface and the result are indexed by support layer.
+    vector<Polygons> generate_base_layers(const vector<coordf_t> &support_z,
+                                          const ZPolygons &contact,
+                                          const vector<Polygons> &_interface,
+                                          const ZPolygons &top);
 
-    map<int, Polygons> generate_interface_layers(vector<coordf_t> support_z,
-                                                 map<coordf_t, Polygons> contact,
-                                                 map<coordf_t, Polygons> top);
+    /// The interface of each support layer.
+    vector<Polygons> generate_interface_layers(const vector<coordf_t> &support_z,
+                                               const ZPolygons &contact,
+                                               const ZPolygons &top);
 
     void generate_bottom_interface_layers(const vector<coordf_t> &support_z,
-                                          map<int, Polygons> &base,
-                                          map<coordf_t, Polygons> &top,
-                                          map<int, Polygons> &_interface);
+                                          vector<Polygons> &base,
+                                          const ZPolygons &top,
+                                          vector<Polygons> &_interface);
 
     coordf_t contact_distance(coordf_t layer_height, coordf_t nozzle_diameter);
 
-    /// This method returns the indices of the layers overlapping with the given one.
-    vector<int> overlapping_layers(int layer_idx, const vector<coordf_t> &support_z);
+    /// For each support layer, the range [first, last) of the layers overlapping with it, itself included.
+    vector<pair<size_t, size_t>> overlapping_layers(const vector<coordf_t> &support_z);
 
-    void clip_with_shape(map<int, Polygons> &support, map<int, Polygons> &shape);
+    void clip_with_shape(vector<Polygons> &support, const vector<Polygons> &shape);
 
     // This method removes object silhouette from support material
     // (it's used with interface and base only). It removes a bit more,
     // leaving a thin gap between object and support in the XY plane.
-    void clip_with_object(map<int, Polygons> &support, vector<coordf_t> support_z, PrintObject &object);
+    void clip_with_object(vector<Polygons> &support, const vector<coordf_t> &support_z, PrintObject &object);
 
-    void process_layer(int layer_id, toolpaths_params params);
+    void process_layer(size_t layer_id, toolpaths_params params);
 
 private:
     /// SupportMaterial is generated by PrintObject.
@@ -150,16 +185,14 @@ private:
     // Return polygon vector given a vector of surfaces.
     Polygons p(SurfacesPtr &surfaces);
 
-    vector<coordf_t> get_keys_sorted(map<coordf_t, Polygons> _map);
-
     Polygon create_circle(coordf_t radius);
 
     // Used during generate_toolpaths function.
     PrintObject *object;
-    map<coordf_t, Polygons> overhang;
-    map<coordf_t, Polygons> contact;
-    map<int, Polygons> _interface;
-    map<int, Polygons> base;
+    ZPolygons overhang;
+    ZPolygons contact;
+    vector<Polygons> _interface;
+    vector<Polygons> base;
 
 };
 
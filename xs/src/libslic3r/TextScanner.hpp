@@ -0,0 +1,199 @@
+#ifndef slic3r_TextScanner_hpp_
+#define slic3r_TextScanner_hpp_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace Slic3r {
+
+/// Helpers for the hand written parsers of the text file formats (ASCII STL,
+/// OBJ). They work on [p, end) ranges of a memory mapped file, never look past
+/// end and never depend on the C locale.
+
+inline bool
+is_blank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+inline bool
+is_whitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/// Skip spaces and tabs.
+inline const char*
+skip_blanks(const char* p, const char* end)
+{
+    while (p < end && is_blank(*p)) ++p;
+    return p;
+}
+
+/// Skip spaces, tabs and line breaks.
+inline const char*
+skip_whitespace(const char* p, const char* end)
+{
+    while (p < end && is_whitespace(*p)) ++p;
+    return p;
+}
+
+/// Position of the next '\r' or '\n' at or after p, or end.
+inline const char*
+find_line_end(const char* p, const char* end)
+{
+    while (p < end && *p != '\n' && *p != '\r') ++p;
+    return p;
+}
+
+/// Position of the first character after the line break following p, or end.
+inline const char*
+next_line(const char* p, const char* end)
+{
+    const void* nl = memchr(p, '\n', end - p);
+    return nl == nullptr ? end : static_cast<const char*>(nl) + 1;
+}
+
+/// Whether the word at p is keyword, followed by whitespace or by end.
+inline bool
+starts_with_word(const char* p, const char* end, const char* keyword, size_t len)
+{
+    return size_t(end - p) >= len && memcmp(p, keyword, len) == 0
+        && (p + len == end || is_whitespace(p[len]));
+}
+
+/// Split [begin, end) into about chunks pieces, moving every cut to the start
+/// of the following line. Returns the starts of the pieces followed by end;
+/// pieces can come out empty on short inputs.
+inline std::vector<const char*>
+split_at_lines(const char* begin, const char* end, size_t chunks)
+{
+    std::vector<const char*> cuts(1, begin);
+    const size_t size = end - begin;
+    for (size_t i = 1; i < chunks; ++i) {
+        const char* cut = begin + size / chunks * i;
+        cut = (cut <= cuts.back()) ? cuts.back() : next_line(cut - 1, end);
+        cuts.push_back(cut);
+    }
+    cuts.push_back(end);
+    return cuts;
+}
+
+/// Parse the decimal number at p ("-1.5", "2", ".5e-3"...) into a float.
+/// Returns the position after the number, or nullptr if p does not start
+/// with one. The result is the correctly rounded float strtof() returns in
+/// the "C" locale: the common case (at most 19 significant digits and a small
+/// exponent) is computed exactly in double precision, the rest goes through
+/// the classic locale of the standard streams.
+inline const char*
+parse_float(const char* p, const char* end, float* out)
+{
+    static const double pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    static const uint64_t pow10_int[] = {
+        1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+        100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+        10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+        100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull
+    };
+    const char* start = p;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    // value = mantissa * 10^(int_digits - digits + zeros + exponent), where
+    // zeros counts the trailing zeros not yet multiplied into the mantissa
+    uint64_t mantissa = 0;
+    int significant = 0, zeros = 0, digits = 0, int_digits = 0;
+    bool exact = true;
+    bool seen_point = false;
+    for (; p < end; ++p) {
+        if (*p == '.' && !seen_point) {
+            seen_point = true;
+            int_digits = digits;
+            continue;
+        }
+        const unsigned int d = static_cast<unsigned char>(*p) - '0';
+        if (d > 9) break;
+        ++digits;
+        if (d == 0) {
+            if (significant > 0) ++zeros;
+        } else if (significant + zeros + 1 > 19) {
+            exact = false;
+        } else {
+            mantissa = mantissa * pow10_int[zeros + 1] + d;
+            significant += zeros + 1;
+            zeros = 0;
+        }
+    }
+    if (digits == 0) return nullptr;
+    if (!seen_point) int_digits = digits;
+
+    int exponent = 0;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool exp_negative = false;
+        if (q < end && (*q == '-' || *q == '+')) {
+            exp_negative = (*q == '-');
+            ++q;
+        }
+        if (q < end && static_cast<unsigned int>(static_cast<unsigned char>(*q) - '0') <= 9) {
+            for (; q < end && static_cast<unsigned int>(static_cast<unsigned char>(*q) - '0') <= 9; ++q)
+                if (exponent < 100000) exponent = exponent * 10 + (*q - '0');
+            if (exp_negative) exponent = -exponent;
+            p = q;
+        }
+        // otherwise the 'e' is not part of the number, like strtof() decides
+    }
+
+    if (exact) {
+        if (mantissa == 0) {
+            *out = negative ? -0.f : 0.f;
+            return p;
+        }
+        const int exp10 = int_digits - digits + zeros + exponent;
+        if (mantissa <= (uint64_t(1) << 53) && exp10 >= -22 && exp10 <= 22) {
+            double v = double(mantissa);
+            v = (exp10 < 0) ? v / pow10[-exp10] : v * pow10[exp10];
+            // Rounding the correctly rounded double to float is only off when
+            // the double falls exactly halfway between two floats, and only
+            // normal floats are worth the trouble.
+            uint64_t bits;
+            memcpy(&bits, &v, sizeof(bits));
+            if ((bits & 0x1fffffffull) != 0x10000000ull
+                && v >= double(std::numeric_limits<float>::min())
+                && v <= double(std::numeric_limits<float>::max())) {
+                *out = negative ? -float(v) : float(v);
+                return p;
+            }
+        }
+    }
+
+    std::istringstream ss(std::string(start, p));
+    ss.imbue(std::locale::classic());
+    float v;
+    ss >> v;
+    if (ss.fail()) {
+        // out of range: strtof() saturates to infinity or underflows to zero
+        const int exp10 = int_digits - digits + zeros + exponent + significant;
+        v = (exp10 > 0) ? std::numeric_limits<float>::infinity() : 0.f;
+        if (negative) v = -v;
+    }
+    *out = v;
+    return p;
+}
+
+} // namespace Slic3r
+
+#endif // slic3r_TextScanner_hpp_
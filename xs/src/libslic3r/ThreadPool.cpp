@@ -0,0 +1,219 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace Slic3r {
+
+namespace {
+    const size_t no_worker = std::numeric_limits<size_t>::max();
+
+    // Index of the pool worker running on the current thread, if any.
+    thread_local ThreadPool* tls_pool   = nullptr;
+    thread_local size_t      tls_worker = no_worker;
+}
+
+/// State shared by the caller of parallel_for() and its helper tasks.
+/// Helpers that get scheduled after the range is exhausted return without
+/// touching body, which lives on the caller's stack.
+class ThreadPool::Job {
+    public:
+    Job(size_t count, size_t grain, const range_t &body)
+        : _count(count), _grain(grain), _body(body), _next(0), _in_flight(0) {};
+
+    void run()
+    {
+        while (true) {
+            ++this->_in_flight;
+            const size_t begin = this->_next.fetch_add(this->_grain);
+            if (begin >= this->_count) {
+                this->_release();
+                return;
+            }
+            try {
+                this->_body(begin, std::min(begin + this->_grain, this->_count));
+                boost::this_thread::interruption_point();
+            } catch (...) {
+                {
+                    boost::lock_guard<boost::mutex> l(this->_mutex);
+                    if (!this->_exception) this->_exception = std::current_exception();
+                }
+                // stop handing out chunks
+                this->_next.store(this->_count);
+            }
+            this->_release();
+        }
+    };
+
+    void wait()
+    {
+        // Returning early would leave helpers running body on a dead stack
+        // frame; an interruption is picked up by run() between chunks instead.
+        boost::this_thread::disable_interruption no_interruption;
+        boost::unique_lock<boost::mutex> l(this->_mutex);
+        while (this->_next.load() < this->_count || this->_in_flight.load() > 0)
+            this->_done_cv.wait(l);
+        if (this->_exception) std::rethrow_exception(this->_exception);
+    };
+
+    private:
+    void _release()
+    {
+        if (--this->_in_flight == 0) {
+            boost::lock_guard<boost::mutex> l(this->_mutex);
+            this->_done_cv.notify_all();
+        }
+    };
+
+    const size_t _count;
+    const size_t _grain;
+    const range_t &_body;
+    std::atomic<size_t> _next;
+    std::atomic<size_t> _in_flight;
+    boost::mutex _mutex;
+    boost::condition_variable _done_cv;
+    std::exception_ptr _exception;
+};
+
+const size_t ThreadPool::max_workers;
+
+ThreadPool&
+ThreadPool::instance()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+ThreadPool::ThreadPool()
+    : _workers(max_workers), _workers_count(0), _pending(0), _next_worker(0), _stopping(false)
+{}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        boost::lock_guard<boost::mutex> l(this->_sleep_mutex);
+        this->_stopping = true;
+    }
+    this->_sleep_cv.notify_all();
+    const size_t n = this->_workers_count.load();
+    for (size_t i = 0; i < n; ++i)
+        this->_workers[i]->thread.join();
+}
+
+void
+ThreadPool::reserve(size_t workers)
+{
+    workers = std::min(workers, max_workers);
+    if (this->_workers_count.load() >= workers) return;
+
+    boost::lock_guard<boost::mutex> l(this->_reserve_mutex);
+    for (size_t i = this->_workers_count.load(); i < workers; ++i) {
+        this->_workers[i].reset(new Worker());
+        // publish the slot before its thread starts scanning the others
+        this->_workers_count.store(i + 1);
+        this->_workers[i]->thread = boost::thread(&ThreadPool::_worker_loop, this, i);
+    }
+}
+
+void
+ThreadPool::submit(task_t task)
+{
+    const size_t n = this->_workers_count.load();
+    if (n == 0) {
+        task();
+        return;
+    }
+    const size_t idx = (tls_pool == this && tls_worker != no_worker)
+        ? tls_worker
+        : this->_next_worker++ % n;
+    ++this->_pending;
+    {
+        Worker &w = *this->_workers[idx];
+        boost::lock_guard<boost::mutex> l(w.mutex);
+        w.tasks.push_back(std::move(task));
+    }
+    {
+        boost::lock_guard<boost::mutex> l(this->_sleep_mutex);
+    }
+    this->_sleep_cv.notify_one();
+}
+
+bool
+ThreadPool::_pop_task(size_t idx, task_t* task)
+{
+    const size_t n = this->_workers_count.load();
+
+    // own deque first, newest task first
+    if (idx != no_worker) {
+        Worker &w = *this->_workers[idx];
+        boost::lock_guard<boost::mutex> l(w.mutex);
+        if (!w.tasks.empty()) {
+            *task = std::move(w.tasks.back());
+            w.tasks.pop_back();
+            --this->_pending;
+            return true;
+        }
+    }
+
+    // then steal the oldest task of a peer
+    const size_t start = (idx == no_worker) ? 0 : idx + 1;
+    for (size_t k = 0; k < n; ++k) {
+        const size_t victim = (start + k) % n;
+        if (victim == idx) continue;
+        Worker &w = *this->_workers[victim];
+        boost::lock_guard<boost::mutex> l(w.mutex);
+        if (!w.tasks.empty()) {
+            *task = std::move(w.tasks.front());
+            w.tasks.pop_front();
+            --this->_pending;
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+ThreadPool::_worker_loop(size_t idx)
+{
+    tls_pool   = this;
+    tls_worker = idx;
+
+    task_t task;
+    while (true) {
+        if (this->_pop_task(idx, &task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        boost::unique_lock<boost::mutex> l(this->_sleep_mutex);
+        if (this->_stopping) return;
+        if (this->_pending.load() > 0) continue;
+        this->_sleep_cv.wait(l);
+    }
+}
+
+void
+ThreadPool::parallel_for(size_t count, const range_t &body, int threads_count, size_t grain)
+{
+    if (count == 0) return;
+    if (threads_count <= 0) threads_count = 2;
+
+    // Aim for plenty of chunks per thread so that uneven items balance out,
+    // while keeping large ranges (mesh facets) from paying one atomic per item.
+    if (grain == 0)
+        grain = std::max<size_t>(1, count / (size_t(threads_count) * 64));
+    const size_t chunks  = (count + grain - 1) / grain;
+    const size_t helpers = std::min<size_t>(threads_count, chunks) - 1;
+
+    // Helpers that get scheduled after the range is exhausted still hold
+    // the job, so it must outlive this call.
+    std::shared_ptr<Job> job = std::make_shared<Job>(count, grain, body);
+    if (helpers > 0) {
+        this->reserve(helpers);
+        for (size_t i = 0; i < helpers; ++i)
+            this->submit([job]() { job->run(); });
+    }
+    job->run();
+    job->wait();
+}
+
+} // namespace Slic3r
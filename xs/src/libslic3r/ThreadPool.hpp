@@ -0,0 +1,80 @@
+#ifndef slic3r_ThreadPool_hpp_
+#define slic3r_ThreadPool_hpp_
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <boost/thread.hpp>
+
+namespace Slic3r {
+
+/// Process-wide pool of worker threads used by parallelize<T>().
+/// Each worker owns a task deque: it pops its own tasks from the back and,
+/// once it runs dry, steals from the front of the other workers' deques.
+/// Tasks submitted from inside a worker land on that worker's deque, so
+/// nested parallel sections stay local unless somebody is idle.
+class ThreadPool {
+    public:
+    typedef std::function<void()> task_t;
+    typedef std::function<void(size_t, size_t)> range_t;
+
+    /// Upper bound on the number of workers the pool will ever spawn.
+    static const size_t max_workers = 256;
+
+    /// The shared pool. Workers are spawned lazily by parallel_for().
+    static ThreadPool& instance();
+
+    ~ThreadPool();
+
+    /// Number of worker threads currently running.
+    size_t size() const { return this->_workers_count.load(); };
+
+    /// Grow the pool to at least the given number of workers. It never shrinks.
+    void reserve(size_t workers);
+
+    /// Call body(begin, end) over consecutive chunks of [0, count), using at
+    /// most threads_count threads including the calling one. A grain of 0
+    /// picks a chunk size from count and threads_count. Chunks are handed out
+    /// dynamically, so uneven items balance themselves. Blocks until every
+    /// chunk is done and rethrows the first exception raised by body.
+    /// Safe to call from inside body (nested parallelism).
+    void parallel_for(size_t count, const range_t &body, int threads_count, size_t grain = 0);
+
+    /// Queue a task for the workers.
+    void submit(task_t task);
+
+    private:
+    struct Worker {
+        boost::mutex mutex;
+        std::deque<task_t> tasks;
+        boost::thread thread;
+    };
+    class Job;
+
+    ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void _worker_loop(size_t idx);
+    bool _pop_task(size_t idx, task_t* task);
+
+    // Slots are allocated up front so that workers can scan the deques of
+    // their peers without locking while the pool grows.
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::atomic<size_t> _workers_count;
+    boost::mutex _reserve_mutex;
+
+    std::atomic<size_t> _pending;
+    std::atomic<size_t> _next_worker;
+    boost::mutex _sleep_mutex;
+    boost::condition_variable _sleep_cv;
+    bool _stopping;
+};
+
+} // namespace Slic3r
+
+#endif // slic3r_ThreadPool_hpp_
@@ -2,6 +2,7 @@
 #include "ClipperUtils.hpp"
 #include "Log.hpp"
 #include "Geometry.hpp"
+#include "TextScanner.hpp"
 #include <cmath>
 #include <deque>
 #include <queue>
@@ -13,8 +14,14 @@
 #include <math.h>
 #include <assert.h>
 #include <stdexcept>
+#include <atomic>
+#include <cstring>
+#include <limits>
 #include <boost/config.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <boost/nowide/convert.hpp>
+#include <boost/nowide/fstream.hpp>
 
 #ifdef SLIC3R_DEBUG
 #include "SVG.hpp"
@@ -22,6 +29,66 @@
 
 namespace Slic3r {
 
+stl_facet
+IndexedMesh::facet(size_t facet_idx) const
+{
+    stl_facet facet;
+    for (int i = 0; i <= 2; ++i)
+        facet.vertex[i] = this->vertex(facet_idx, i);
+    float normal[3];
+    stl_calculate_normal(normal, &facet);
+    stl_normalize_vector(normal);
+    facet.normal.x = normal[0];
+    facet.normal.y = normal[1];
+    facet.normal.z = normal[2];
+    facet.extra[0] = 0;
+    facet.extra[1] = 0;
+    return facet;
+}
+
+void
+IndexedMesh::make_edges()
+{
+    /* Sort the edges of all facets by their endpoints regardless of their
+       direction, then number the distinct ones. admesh can assign the same
+       edge to more than two facets (which is still topologically correct),
+       those simply share the number. */
+    typedef std::pair<uint64_t,int> t_edge;  // a_id,b_id packed with the lower id first => facet_idx * 3 + i
+    const size_t facets_count = this->facets_count();
+    std::vector<t_edge> edges;
+    edges.reserve(facets_count * 3);
+    for (size_t facet_idx = 0; facet_idx < facets_count; facet_idx++) {
+        for (int i = 0; i <= 2; i++) {
+            const uint32_t a_id = this->indices[facet_idx * 3 + i];
+            const uint32_t b_id = this->indices[facet_idx * 3 + (i+1) % 3];
+            edges.push_back(t_edge((uint64_t(std::min(a_id, b_id)) << 32) | std::max(a_id, b_id), facet_idx * 3 + i));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    
+    this->edges.assign(facets_count * 3, -1);
+    int edge_idx = -1;
+    for (size_t k = 0; k < edges.size(); ++k) {
+        if (k == 0 || edges[k].first != edges[k-1].first) ++edge_idx;
+        this->edges[edges[k].second] = edge_idx;
+        
+        #ifdef SLIC3R_DEBUG
+        printf("  [facet %d, edge %d] --> edge %d\n", edges[k].second / 3, edges[k].second % 3, edge_idx);
+        #endif
+    }
+    this->edges_count = edge_idx + 1;
+}
+
+void
+IndexedMesh::clear()
+{
+    // swap to release the memory
+    std::vector<stl_vertex>().swap(this->vertices);
+    std::vector<int>().swap(this->indices);
+    std::vector<int>().swap(this->edges);
+    this->edges_count = 0;
+}
+
 TriangleMesh::TriangleMesh()
     : repaired(false)
 {
@@ -71,7 +138,7 @@ TriangleMesh::TriangleMesh(const Pointf3* points, const Point3* facets, size_t n
 }
 
 TriangleMesh::TriangleMesh(const TriangleMesh &other)
-    : stl(other.stl), repaired(other.repaired)
+    : stl(other.stl), indexed(other.indexed), repaired(other.repaired)
 {
     this->clone(other);
 }
@@ -79,6 +146,7 @@ TriangleMesh::TriangleMesh(const TriangleMesh &other)
 TriangleMesh& TriangleMesh::operator= (const TriangleMesh& other)
 {
     this->stl = other.stl;
+    this->indexed = other.indexed;
     this->repaired = other.repaired;
     this->clone(other);
 
@@ -112,6 +180,7 @@ void TriangleMesh::clone(const TriangleMesh& other) {
 TriangleMesh::TriangleMesh(TriangleMesh&& other) {
     this->repaired = std::move(other.repaired);
     this->stl = std::move(other.stl);
+    this->indexed = std::move(other.indexed);
     stl_initialize(&other.stl);
 }
 
@@ -119,6 +188,7 @@ TriangleMesh& TriangleMesh::operator= (TriangleMesh&& other)
 {
     this->repaired = std::move(other.repaired);
     this->stl = std::move(other.stl);
+    this->indexed = std::move(other.indexed);
     stl_initialize(&other.stl);
 
     return *this;
@@ -129,6 +199,7 @@ void
 TriangleMesh::swap(TriangleMesh &other)
 {
     std::swap(this->stl,      other.stl);
+    std::swap(this->indexed,  other.indexed);
     std::swap(this->repaired, other.repaired);
 }
 
@@ -136,8 +207,123 @@ TriangleMesh::~TriangleMesh() {
     stl_close(&this->stl);
 }
 
+namespace {
+    /// Smallest and largest coordinates of a range of facets.
+    typedef std::pair<stl_vertex,stl_vertex> t_facet_bounds;
+    
+    inline t_facet_bounds
+    empty_bounds()
+    {
+        const float big = std::numeric_limits<float>::max();
+        const stl_vertex min = { big, big, big };
+        const stl_vertex max = { -big, -big, -big };
+        return std::make_pair(min, max);
+    }
+    
+    /// Unify +0 and -0 to +0 like stl_read() does, so that equal floats are
+    /// equal under memcmp, and grow bounds by the vertices of the facet.
+    inline void
+    finish_read_facet(stl_facet &facet, t_facet_bounds* bounds)
+    {
+        uint32_t* f = reinterpret_cast<uint32_t*>(&facet);
+        for (int j = 0; j < 12; ++j, ++f)
+            if (*f == 0x80000000) *f = 0;
+        stl_vertex &min = bounds->first, &max = bounds->second;
+        for (int j = 0; j < 3; ++j) {
+            min.x = std::min(min.x, facet.vertex[j].x);  max.x = std::max(max.x, facet.vertex[j].x);
+            min.y = std::min(min.y, facet.vertex[j].y);  max.y = std::max(max.y, facet.vertex[j].y);
+            min.z = std::min(min.z, facet.vertex[j].z);  max.z = std::max(max.z, facet.vertex[j].z);
+        }
+    }
+    
+    /// The stats stl_read() gathers through stl_facet_stats(), from the bounds
+    /// of every chunk of facets.
+    void
+    set_read_stats(stl_file &stl, const std::vector<t_facet_bounds> &bounds)
+    {
+        const stl_facet &first = stl.facet_start[0];
+        stl.stats.min = stl.stats.max = first.vertex[0];
+        for (const auto &b : bounds) {
+            stl.stats.min.x = std::min(stl.stats.min.x, b.first.x);  stl.stats.max.x = std::max(stl.stats.max.x, b.second.x);
+            stl.stats.min.y = std::min(stl.stats.min.y, b.first.y);  stl.stats.max.y = std::max(stl.stats.max.y, b.second.y);
+            stl.stats.min.z = std::min(stl.stats.min.z, b.first.z);  stl.stats.max.z = std::max(stl.stats.max.z, b.second.z);
+        }
+        stl.stats.shortest_edge = std::max(std::abs(first.vertex[0].z - first.vertex[1].z),
+            std::max(std::abs(first.vertex[0].x - first.vertex[1].x), std::abs(first.vertex[0].y - first.vertex[1].y)));
+        stl.stats.size.x = stl.stats.max.x - stl.stats.min.x;
+        stl.stats.size.y = stl.stats.max.y - stl.stats.min.y;
+        stl.stats.size.z = stl.stats.max.z - stl.stats.min.z;
+        stl.stats.bounding_diameter = sqrt(
+            stl.stats.size.x * stl.stats.size.x +
+            stl.stats.size.y * stl.stats.size.y +
+            stl.stats.size.z * stl.stats.size.z
+        );
+    }
+    
+    /// Skip whitespace and the keyword. Returns the position after it, or
+    /// nullptr if the next word is something else.
+    inline const char*
+    expect_word(const char* p, const char* end, const char* keyword, size_t len)
+    {
+        p = skip_whitespace(p, end);
+        return starts_with_word(p, end, keyword, len) ? p + len : nullptr;
+    }
+    
+    /// Skip whitespace and read count whitespace separated floats.
+    inline const char*
+    expect_floats(const char* p, const char* end, float* out, int count)
+    {
+        for (int i = 0; i < count; ++i) {
+            p = parse_float(skip_whitespace(p, end), end, out + i);
+            if (p == nullptr || (p < end && !is_whitespace(*p))) return nullptr;
+        }
+        return p;
+    }
+    
+    /// Parse the ASCII STL facets starting in [p, chunk_end) of a file ending
+    /// at end, skipping the solid and endsolid lines like stl_read() does.
+    /// Returns false on anything else.
+    bool
+    parse_ascii_facets(const char* p, const char* chunk_end, const char* end,
+        std::vector<stl_facet>* facets, t_facet_bounds* bounds)
+    {
+        while (true) {
+            if (p >= chunk_end) return p == chunk_end;
+            p = skip_whitespace(p, chunk_end);
+            if (p == chunk_end) return true;
+            if (memcmp(p, "solid", std::min<size_t>(5, end - p)) == 0
+                || memcmp(p, "endsolid", std::min<size_t>(8, end - p)) == 0) {
+                p = find_line_end(p, end);
+                continue;
+            }
+            
+            stl_facet facet;
+            if ((p = expect_word(p, end, "facet", 5)) == nullptr
+                || (p = expect_word(p, end, "normal", 6)) == nullptr
+                || (p = expect_floats(p, end, &facet.normal.x, 3)) == nullptr
+                || (p = expect_word(p, end, "outer", 5)) == nullptr
+                || (p = expect_word(p, end, "loop", 4)) == nullptr)
+                return false;
+            for (int j = 0; j < 3; ++j)
+                if ((p = expect_word(p, end, "vertex", 6)) == nullptr
+                    || (p = expect_floats(p, end, &facet.vertex[j].x, 3)) == nullptr)
+                    return false;
+            if ((p = expect_word(p, end, "endloop", 7)) == nullptr
+                || (p = expect_word(p, end, "endfacet", 8)) == nullptr)
+                return false;
+            facet.extra[0] = facet.extra[1] = 0;
+            finish_read_facet(facet, bounds);
+            facets->push_back(facet);
+        }
+    }
+}
+
 void
 TriangleMesh::ReadSTLFile(const std::string &input_file) {
+    // Files are parsed straight from memory; admesh handles the rest,
+    // including the files whose size does not match their header.
+    if (this->read_stl_mapped(input_file)) return;
+    
     #ifdef BOOST_WINDOWS
     stl_open(&stl, boost::nowide::widen(input_file).c_str());
     #else
@@ -146,9 +332,130 @@ TriangleMesh::ReadSTLFile(const std::string &input_file) {
     if (this->stl.error != 0) throw std::runtime_error("Failed to read STL file");
 }
 
+bool
+TriangleMesh::read_stl_mapped(const std::string &input_file)
+{
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+    try {
+        file = boost::interprocess::file_mapping(input_file.c_str(), boost::interprocess::read_only);
+        region = boost::interprocess::mapped_region(file, boost::interprocess::read_only);
+    } catch (const boost::interprocess::interprocess_exception &) {
+        return false;
+    }
+    const unsigned char* data = static_cast<const unsigned char*>(region.get_address());
+    const size_t file_size = region.get_size();
+    
+    // same test as stl_count_facets()
+    if (file_size < HEADER_SIZE + 128)
+        return false;
+    if (std::none_of(data + HEADER_SIZE, data + HEADER_SIZE + 128, [](unsigned char c) { return c > 127; }))
+        return this->read_ascii_stl(reinterpret_cast<const char*>(data), file_size);
+    return this->read_binary_stl(data, file_size);
+}
+
+bool
+TriangleMesh::read_binary_stl(const unsigned char* data, size_t file_size)
+{
+    // same checks as stl_count_facets()
+    if (file_size < STL_MIN_FILE_SIZE || (file_size - HEADER_SIZE) % SIZEOF_STL_FACET != 0)
+        return false;
+    const size_t facets_count = (file_size - HEADER_SIZE) / SIZEOF_STL_FACET;
+    // admesh only builds on little endian machines, so the file's byte order is ours
+    uint32_t header_num_facets;
+    memcpy(&header_num_facets, data + LABEL_SIZE, sizeof(header_num_facets));
+    if (facets_count != header_num_facets || facets_count > size_t(std::numeric_limits<int>::max()))
+        return false;
+    
+    stl_file &stl = this->stl;
+    stl_initialize(&stl);
+    stl.stats.type = binary;
+    memcpy(stl.stats.header, data, LABEL_SIZE);
+    stl.stats.header[LABEL_SIZE] = '\0';
+    stl.stats.number_of_facets = int(facets_count);
+    stl.stats.original_num_facets = stl.stats.number_of_facets;
+    stl_allocate(&stl);
+    
+    // Convert the facets like stl_read() does, keeping the bounds of every chunk.
+    const int threads_count = std::max(1u, boost::thread::hardware_concurrency());
+    const size_t grain = std::max<size_t>(16384, facets_count / (size_t(threads_count) * 4) + 1);
+    std::vector<t_facet_bounds> bounds((facets_count + grain - 1) / grain, empty_bounds());
+    ThreadPool::instance().parallel_for(facets_count, [&](size_t from, size_t to) {
+        t_facet_bounds &b = bounds[from / grain];
+        const unsigned char* src = data + HEADER_SIZE + from * SIZEOF_STL_FACET;
+        for (size_t i = from; i < to; ++i, src += SIZEOF_STL_FACET) {
+            stl_facet &facet = stl.facet_start[i];
+            memcpy(&facet, src, SIZEOF_STL_FACET);
+            finish_read_facet(facet, &b);
+        }
+    }, threads_count, grain);
+    
+    set_read_stats(stl, bounds);
+    return true;
+}
+
+bool
+TriangleMesh::read_ascii_stl(const char* data, size_t file_size)
+{
+    const char* const end = data + file_size;
+    const int threads_count = std::max(1u, boost::thread::hardware_concurrency());
+    
+    // Move every cut to the next line starting with "facet", so that each
+    // chunk holds whole facets.
+    std::vector<const char*> cuts = split_at_lines(data, end, std::max<size_t>(1, file_size / (4 << 20)) * threads_count);
+    for (size_t i = 1; i + 1 < cuts.size(); ++i) {
+        const char* p = std::max(cuts[i], cuts[i-1]);
+        while (p < end && !starts_with_word(skip_blanks(p, end), end, "facet", 5))
+            p = next_line(p, end);
+        cuts[i] = skip_blanks(p, end);
+    }
+    
+    const size_t chunks = cuts.size() - 1;
+    std::vector<std::vector<stl_facet>> facets(chunks);
+    std::vector<t_facet_bounds> bounds(chunks, empty_bounds());
+    std::atomic<bool> failed(false);
+    ThreadPool::instance().parallel_for(chunks, [&](size_t from, size_t to) {
+        for (size_t c = from; c < to; ++c)
+            if (!failed && !parse_ascii_facets(cuts[c], cuts[c+1], end, &facets[c], &bounds[c]))
+                failed = true;
+    }, threads_count, 1);
+    if (failed) return false;
+    
+    std::vector<size_t> offsets(chunks + 1, 0);
+    for (size_t c = 0; c < chunks; ++c)
+        offsets[c+1] = offsets[c] + facets[c].size();
+    // an empty solid is left to admesh, which reports it
+    if (offsets.back() == 0 || offsets.back() > size_t(std::numeric_limits<int>::max()))
+        return false;
+    
+    stl_file &stl = this->stl;
+    stl_initialize(&stl);
+    stl.stats.type = ascii;
+    // the first line, as stl_count_facets() reads it
+    size_t header_size = 0;
+    while (header_size < LABEL_SIZE && data[header_size] != '\n') ++header_size;
+    memcpy(stl.stats.header, data, header_size);
+    stl.stats.header[header_size] = '\0';
+    stl.stats.number_of_facets = int(offsets.back());
+    stl.stats.original_num_facets = stl.stats.number_of_facets;
+    stl_allocate(&stl);
+    
+    ThreadPool::instance().parallel_for(chunks, [&](size_t from, size_t to) {
+        for (size_t c = from; c < to; ++c) {
+            if (!facets[c].empty())
+                memcpy(stl.facet_start + offsets[c], facets[c].data(), facets[c].size() * sizeof(stl_facet));
+            std::vector<stl_facet>().swap(facets[c]);
+        }
+    }, threads_count, 1);
+    
+    set_read_stats(stl, bounds);
+    return true;
+}
+
 void
 TriangleMesh::write_ascii(const std::string &output_file)
 {
+    this->require_facets();
     #ifdef BOOST_WINDOWS
     stl_write_ascii(&this->stl, boost::nowide::widen(output_file).c_str(), "");
     #else
@@ -159,6 +466,7 @@ TriangleMesh::write_ascii(const std::string &output_file)
 void
 TriangleMesh::write_binary(const std::string &output_file)
 {
+    this->require_facets();
     #ifdef BOOST_WINDOWS
     stl_write_binary(&this->stl, boost::nowide::widen(output_file).c_str(), "");
     #else
@@ -204,15 +512,245 @@ TriangleMesh::repair() {
 float
 TriangleMesh::volume()
 {
-    if (this->stl.stats.volume == -1) stl_calculate_volume(&this->stl);
+    if (this->stl.stats.volume == -1) {
+        this->require_facets();
+        stl_calculate_volume(&this->stl);
+    }
     return this->stl.stats.volume;
 }
 
+namespace {
+    /// An edge of a facet to be matched by check_facets_exact().
+    struct FacetEdge {
+        /// Hash of the key of the edge.
+        uint64_t hash;
+        int facet_number;
+        /// As in stl_hash_edge: index of the edge inside the facet,
+        /// increased by 3 if the key stores it backwards.
+        int which_edge;
+    };
+    
+    // Positive and negative zeros compare equal, unlike their bits.
+    inline uint32_t
+    key_bits(float f)
+    {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        return bits == 0x80000000 ? 0 : bits;
+    }
+    
+    /// Same key as stl_load_edge_exact() builds: the two vertices of the edge
+    /// in a direction independent order.
+    inline void
+    edge_key(const stl_facet &facet, int which_edge, uint32_t key[6])
+    {
+        const stl_vertex &a = facet.vertex[which_edge % 3];
+        const stl_vertex &b = facet.vertex[(which_edge + 1) % 3];
+        const stl_vertex &first  = (which_edge < 3) ? a : b;
+        const stl_vertex &second = (which_edge < 3) ? b : a;
+        key[0] = key_bits(first.x);  key[1] = key_bits(first.y);  key[2] = key_bits(first.z);
+        key[3] = key_bits(second.x); key[4] = key_bits(second.y); key[5] = key_bits(second.z);
+    }
+    
+    inline bool
+    same_vertex(const stl_vertex &a, const stl_vertex &b)
+    {
+        return key_bits(a.x) == key_bits(b.x) && key_bits(a.y) == key_bits(b.y) && key_bits(a.z) == key_bits(b.z);
+    }
+    
+    inline bool
+    is_degenerate(const stl_facet &facet)
+    {
+        return same_vertex(facet.vertex[0], facet.vertex[1])
+            || same_vertex(facet.vertex[1], facet.vertex[2])
+            || same_vertex(facet.vertex[0], facet.vertex[2]);
+    }
+    
+    /// Load the edge like stl_load_edge_exact() and hash its key.
+    inline FacetEdge
+    load_edge(const stl_facet &facet, int facet_number, int j, float* shortest_edge)
+    {
+        const stl_vertex &a = facet.vertex[j];
+        const stl_vertex &b = facet.vertex[(j + 1) % 3];
+        const float max_diff = std::max(std::abs(a.z - b.z), std::max(std::abs(a.x - b.x), std::abs(a.y - b.y)));
+        *shortest_edge = std::min(max_diff, *shortest_edge);
+        
+        FacetEdge edge;
+        edge.facet_number = facet_number;
+        edge.which_edge = ((a.x != b.x) ? (a.x < b.x) : ((a.y != b.y) ? (a.y < b.y) : (a.z < b.z))) ? j : j + 3;
+        
+        uint32_t key[6];
+        edge_key(facet, edge.which_edge, key);
+        uint64_t h = 14695981039346656037ull;
+        for (int i = 0; i < 6; ++i) {
+            h ^= key[i];
+            h *= 1099511628211ull;
+        }
+        h ^= h >> 31;
+        h *= 0x9e3779b97f4a7c15ull;
+        edge.hash = h ^ (h >> 29);
+        return edge;
+    }
+}
+
+void
+check_facets_exact(stl_file *stl, int threads_count)
+{
+    if (stl->error) return;
+    threads_count = std::max(1, threads_count);
+    
+    stl->stats.connected_edges = 0;
+    stl->stats.connected_facets_1_edge = 0;
+    stl->stats.connected_facets_2_edge = 0;
+    stl->stats.connected_facets_3_edge = 0;
+    stl->stats.malloced = 0;
+    stl->stats.freed = 0;
+    stl->stats.collisions = 0;
+    
+    // Remove the degenerate facets. Like admesh, each is replaced by the
+    // last facet, which gets checked next.
+    for (int i = 0; i < stl->stats.number_of_facets; ) {
+        if (is_degenerate(stl->facet_start[i])) {
+            stl->stats.degenerate_facets += 1;
+            stl->stats.facets_removed += 1;
+            stl->stats.number_of_facets -= 1;
+            stl->facet_start[i] = stl->facet_start[stl->stats.number_of_facets];
+        } else {
+            ++i;
+        }
+    }
+    
+    const size_t facets_count = stl->stats.number_of_facets;
+    const size_t grain = std::max<size_t>(4096, facets_count / (size_t(threads_count) * 8) + 1);
+    const size_t chunks = (facets_count + grain - 1) / grain;
+    // Enough partitions to keep every thread busy, few enough to keep the
+    // count table small.
+    const int bucket_bits = 10;
+    const size_t buckets = size_t(1) << bucket_bits;
+    ThreadPool &pool = ThreadPool::instance();
+    
+    // Count the edges of every chunk of facets falling into each partition.
+    std::vector<size_t> offsets(chunks * buckets, 0);
+    std::vector<float> shortest_edge(chunks, stl->stats.shortest_edge);
+    pool.parallel_for(facets_count, [&](size_t from, size_t to) {
+        const size_t chunk = from / grain;
+        size_t* counts = &offsets[chunk * buckets];
+        for (size_t facet_idx = from; facet_idx < to; ++facet_idx) {
+            for (int j = 0; j < 3; ++j) {
+                stl->neighbors_start[facet_idx].neighbor[j] = -1;
+                const FacetEdge edge = load_edge(stl->facet_start[facet_idx], facet_idx, j, &shortest_edge[chunk]);
+                ++counts[edge.hash >> (64 - bucket_bits)];
+            }
+        }
+    }, threads_count, grain);
+    for (float e : shortest_edge)
+        stl->stats.shortest_edge = std::min(stl->stats.shortest_edge, e);
+    
+    // Turn the counts into the positions each chunk writes its edges of a
+    // partition to, chunk after chunk, so that every partition lists its
+    // edges in the order admesh inserts them into its hash table.
+    std::vector<size_t> bucket_start(buckets + 1, 0);
+    {
+        size_t pos = 0;
+        for (size_t b = 0; b < buckets; ++b) {
+            bucket_start[b] = pos;
+            for (size_t c = 0; c < chunks; ++c) {
+                const size_t n = offsets[c * buckets + b];
+                offsets[c * buckets + b] = pos;
+                pos += n;
+            }
+        }
+        bucket_start[buckets] = pos;
+    }
+    std::vector<FacetEdge> edges(facets_count * 3);
+    pool.parallel_for(facets_count, [&](size_t from, size_t to) {
+        size_t* next = &offsets[(from / grain) * buckets];
+        float unused = 0;
+        for (size_t facet_idx = from; facet_idx < to; ++facet_idx) {
+            for (int j = 0; j < 3; ++j) {
+                const FacetEdge edge = load_edge(stl->facet_start[facet_idx], facet_idx, j, &unused);
+                edges[next[edge.hash >> (64 - bucket_bits)]++] = edge;
+            }
+        }
+    }, threads_count, grain);
+    
+    // Sort every partition by key, keeping equal keys in insertion order, and
+    // pair up the edges of each key the way admesh's hash chains do: an edge
+    // takes the oldest unmatched edge of another facet, or waits for one.
+    std::atomic<int> connected_edges(0);
+    pool.parallel_for(buckets, [&](size_t from, size_t to) {
+        std::vector<size_t> unmatched;
+        uint32_t k1[6], k2[6];
+        const auto by_key = [stl, &k1, &k2](const FacetEdge &e1, const FacetEdge &e2) {
+            if (e1.hash != e2.hash) return e1.hash < e2.hash;
+            edge_key(stl->facet_start[e1.facet_number], e1.which_edge, k1);
+            edge_key(stl->facet_start[e2.facet_number], e2.which_edge, k2);
+            const int cmp = memcmp(k1, k2, sizeof(k1));
+            if (cmp != 0) return cmp < 0;
+            return e1.facet_number * 3 + e1.which_edge % 3 < e2.facet_number * 3 + e2.which_edge % 3;
+        };
+        int connected = 0;
+        for (size_t b = from; b < to; ++b) {
+            const auto first = edges.begin() + bucket_start[b];
+            const auto last  = edges.begin() + bucket_start[b + 1];
+            std::sort(first, last, by_key);
+            for (auto group = first; group != last; ) {
+                auto group_end = group + 1;
+                edge_key(stl->facet_start[group->facet_number], group->which_edge, k1);
+                for (; group_end != last && group_end->hash == group->hash; ++group_end) {
+                    edge_key(stl->facet_start[group_end->facet_number], group_end->which_edge, k2);
+                    if (memcmp(k1, k2, sizeof(k1)) != 0) break;
+                }
+                
+                unmatched.clear();
+                for (auto edge = group; edge != group_end; ++edge) {
+                    auto match = unmatched.begin();
+                    while (match != unmatched.end() && (first + *match)->facet_number == edge->facet_number) ++match;
+                    if (match == unmatched.end()) {
+                        unmatched.push_back(edge - first);
+                        continue;
+                    }
+                    // record the neighbors like stl_record_neighbors()
+                    const FacetEdge &edge_a = *edge;
+                    const FacetEdge &edge_b = *(first + *match);
+                    unmatched.erase(match);
+                    stl_neighbors &na = stl->neighbors_start[edge_a.facet_number];
+                    stl_neighbors &nb = stl->neighbors_start[edge_b.facet_number];
+                    na.neighbor[edge_a.which_edge % 3] = edge_b.facet_number;
+                    na.which_vertex_not[edge_a.which_edge % 3] = (edge_b.which_edge + 2) % 3;
+                    nb.neighbor[edge_b.which_edge % 3] = edge_a.facet_number;
+                    nb.which_vertex_not[edge_b.which_edge % 3] = (edge_a.which_edge + 2) % 3;
+                    if ((edge_a.which_edge < 3) == (edge_b.which_edge < 3)) {
+                        // these facets are oriented in opposite directions
+                        na.which_vertex_not[edge_a.which_edge % 3] += 3;
+                        nb.which_vertex_not[edge_b.which_edge % 3] += 3;
+                    }
+                    connected += 2;
+                }
+                group = group_end;
+            }
+        }
+        connected_edges += connected;
+    }, threads_count, 1);
+    stl->stats.connected_edges = connected_edges;
+    
+    // admesh counts a facet once it gets its first, second and third neighbor
+    for (size_t facet_idx = 0; facet_idx < facets_count; ++facet_idx) {
+        const stl_neighbors &n = stl->neighbors_start[facet_idx];
+        const int connected = (n.neighbor[0] != -1) + (n.neighbor[1] != -1) + (n.neighbor[2] != -1);
+        if (connected > 0) stl->stats.connected_facets_1_edge += 1;
+        if (connected > 1) stl->stats.connected_facets_2_edge += 1;
+        if (connected > 2) stl->stats.connected_facets_3_edge += 1;
+    }
+}
+
 void
 TriangleMesh::check_topology()
 {
+    this->require_facets();
+    
     // checking exact
-    stl_check_facets_exact(&stl);
+    check_facets_exact(&stl);
     stl.stats.facets_w_1_bad_edge = (stl.stats.connected_facets_2_edge - stl.stats.connected_facets_3_edge);
     stl.stats.facets_w_2_bad_edge = (stl.stats.connected_facets_1_edge - stl.stats.connected_facets_2_edge);
     stl.stats.facets_w_3_bad_edge = (stl.stats.number_of_facets - stl.stats.connected_facets_1_edge);
@@ -273,19 +811,31 @@ TriangleMesh::facets_count() const
 
 void
 TriangleMesh::WriteOBJFile(const std::string &output_file) {
-    stl_generate_shared_vertices(&stl);
+    this->require_shared_vertices();
     
-    #ifdef BOOST_WINDOWS
-    stl_write_obj(&stl, boost::nowide::widen(output_file).c_str());
-    #else
-    stl_write_obj(&stl, output_file.c_str());
-    #endif
+    // same output as admesh's stl_write_obj()
+    boost::nowide::ofstream fout(output_file.c_str());
+    if (!fout.is_open()) {
+        Slic3r::Log::error("TriangleMesh", "Couldn't open " + output_file + " for writing");
+        return;
+    }
+    char line[128];
+    for (const stl_vertex &v : this->indexed.vertices) {
+        snprintf(line, sizeof(line), "v %f %f %f\n", v.x, v.y, v.z);
+        fout << line;
+    }
+    for (size_t i = 0; i < this->indexed.indices.size(); i += 3) {
+        snprintf(line, sizeof(line), "f %d %d %d\n",
+            this->indexed.indices[i] + 1, this->indexed.indices[i+1] + 1, this->indexed.indices[i+2] + 1);
+        fout << line;
+    }
 }
 
 void TriangleMesh::scale(float factor)
 {
+    this->require_facets();
     stl_scale(&(this->stl), factor);
-    stl_invalidate_shared_vertices(&this->stl);
+    this->indexed.clear();
 }
 
 void TriangleMesh::scale(const Pointf3 &versor)
@@ -294,14 +844,16 @@ void TriangleMesh::scale(const Pointf3 &versor)
     fversor[0] = versor.x;
     fversor[1] = versor.y;
     fversor[2] = versor.z;
+    this->require_facets();
     stl_scale_versor(&this->stl, fversor);
-    stl_invalidate_shared_vertices(&this->stl);
+    this->indexed.clear();
 }
 
 void TriangleMesh::translate(float x, float y, float z)
 {
+    this->require_facets();
     stl_translate_relative(&(this->stl), x, y, z);
-    stl_invalidate_shared_vertices(&this->stl);
+    this->indexed.clear();
 }
 
 void TriangleMesh::translate(Pointf3 vec) {
@@ -317,6 +869,7 @@ void TriangleMesh::rotate(float angle, const Axis &axis)
     // admesh uses degrees
     angle = Slic3r::Geometry::rad2deg(angle);
     
+    this->require_facets();
     if (axis == X) {
         stl_rotate_x(&(this->stl), angle);
     } else if (axis == Y) {
@@ -324,7 +877,7 @@ void TriangleMesh::rotate(float angle, const Axis &axis)
     } else if (axis == Z) {
         stl_rotate_z(&(this->stl), angle);
     }
-    stl_invalidate_shared_vertices(&this->stl);
+    this->indexed.clear();
 }
 
 void TriangleMesh::rotate_x(float angle)
@@ -344,6 +897,7 @@ void TriangleMesh::rotate_z(float angle)
 
 void TriangleMesh::mirror(const Axis &axis)
 {
+    this->require_facets();
     if (axis == X) {
         stl_mirror_yz(&this->stl);
     } else if (axis == Y) {
@@ -351,7 +905,7 @@ void TriangleMesh::mirror(const Axis &axis)
     } else if (axis == Z) {
         stl_mirror_xy(&this->stl);
     }
-    stl_invalidate_shared_vertices(&this->stl);
+    this->indexed.clear();
 }
 
 void TriangleMesh::mirror_x()
@@ -405,12 +959,9 @@ Pointf3s TriangleMesh::vertices()
 {
     Pointf3s tmp {};
     if (this->repaired) {
-        if (this->stl.v_shared == nullptr) 
-            stl_generate_shared_vertices(&stl); // build the list of vertices
-        for (auto i = 0; i < this->stl.stats.shared_vertices; i++) {
-            const auto& v {this->stl.v_shared[i]};
+        this->require_shared_vertices(); // build the list of vertices
+        for (const auto& v : this->indexed.vertices)
             tmp.emplace_back(Pointf3(v.x, v.y, v.z));
-        }
     } else {
         Slic3r::Log::warn("TriangleMesh", "vertices() requires repair()");
     }
@@ -421,12 +972,10 @@ Point3s TriangleMesh::facets()
 {
     Point3s tmp {};
     if (this->repaired) {
-        if (this->stl.v_shared == nullptr) 
-            stl_generate_shared_vertices(&stl); // build the list of vertices
-        for (auto i = 0; i < stl.stats.number_of_facets; i++) {
-            const auto& v {stl.v_indices[i]};
-            tmp.emplace_back(Point3(v.vertex[0], v.vertex[1], v.vertex[2]));
-        }
+        this->require_shared_vertices(); // build the list of vertices
+        const auto& v {this->indexed.indices};
+        for (size_t i = 0; i < v.size(); i += 3)
+            tmp.emplace_back(Point3(v[i], v[i+1], v[i+2]));
     } else {
         Slic3r::Log::warn("TriangleMesh", "facets() requires repair()");
     }
@@ -438,7 +987,8 @@ Pointf3s TriangleMesh::normals() const
     Pointf3s tmp {};
     if (this->repaired) {
         for (auto i = 0; i < stl.stats.number_of_facets; i++) {
-            const auto& n {stl.facet_start[i].normal};
+            // a compacted mesh has no facet soup left to read the normals from
+            const auto n {stl.facet_start != nullptr ? stl.facet_start[i].normal : this->indexed.facet(i).normal};
             tmp.emplace_back(Pointf3(n.x, n.y, n.z));
         }
     } else {
@@ -517,38 +1067,66 @@ void TriangleMesh::cut(Axis axis, double z, TriangleMesh* upper, TriangleMesh* l
 
 #endif // SLIC3RXS
 
+namespace {
+// For each facet edge (facet_idx * 3 + i), the facet edge across it or -1.
+// The facet edges sharing an edge are paired in facet order, the way admesh's
+// stl_check_facets_exact() connects them.
+std::vector<int>
+facet_edges_across(const IndexedMesh &indexed)
+{
+    std::vector<int> across(indexed.edges.size(), -1);
+    std::vector<int> pending(indexed.edges_count, -1);
+    for (size_t i = 0; i < indexed.edges.size(); ++i) {
+        int &other = pending[indexed.edges[i]];
+        if (other == -1) {
+            other = i;
+        } else {
+            across[i] = other;
+            across[other] = i;
+            other = -1;
+        }
+    }
+    return across;
+}
+}
+
 TriangleMeshPtrs
-TriangleMesh::split() const
+TriangleMesh::split()
 {
     TriangleMeshPtrs meshes;
-    std::set<int> seen_facets;
     
     // we need neighbors
     if (!this->repaired) CONFESS("split() requires repair()");
+    this->require_shared_vertices();
+    IndexedMesh &indexed = this->indexed;
+    if (indexed.edges.empty()) indexed.make_edges();
+    const size_t facets_count = indexed.facets_count();
+    
+    const std::vector<int> across = facet_edges_across(indexed);
+    
+    std::vector<bool> seen_facets(facets_count, false);
+    size_t first_unseen = 0;
     
     // loop while we have remaining facets
     while (1) {
         // get the first facet
         std::queue<int> facet_queue;
         std::deque<int> facets;
-        for (int facet_idx = 0; facet_idx < this->stl.stats.number_of_facets; facet_idx++) {
-            if (seen_facets.find(facet_idx) == seen_facets.end()) {
-                // if facet was not seen put it into queue and start searching
-                facet_queue.push(facet_idx);
-                break;
-            }
-        }
-        if (facet_queue.empty()) break;
+        while (first_unseen < facets_count && seen_facets[first_unseen]) ++first_unseen;
+        if (first_unseen == facets_count) break;
+        // put the facet into queue and start searching
+        facet_queue.push(first_unseen);
         
         while (!facet_queue.empty()) {
             int facet_idx = facet_queue.front();
             facet_queue.pop();
-            if (seen_facets.find(facet_idx) != seen_facets.end()) continue;
+            if (seen_facets[facet_idx]) continue;
             facets.push_back(facet_idx);
             for (int j = 0; j <= 2; j++) {
-                facet_queue.push(this->stl.neighbors_start[facet_idx].neighbor[j]);
+                if (across[facet_idx * 3 + j] != -1)
+                    facet_queue.push(across[facet_idx * 3 + j] / 3);
             }
-            seen_facets.insert(facet_idx);
+            seen_facets[facet_idx] = true;
         }
         
         TriangleMesh* mesh = new TriangleMesh;
@@ -561,8 +1139,8 @@ TriangleMesh::split() const
         
         int first = 1;
         for (std::deque<int>::const_iterator facet = facets.begin(); facet != facets.end(); ++facet) {
-            mesh->stl.facet_start[facet - facets.begin()] = this->stl.facet_start[*facet];
-            stl_facet_stats(&mesh->stl, this->stl.facet_start[*facet], first);
+            mesh->stl.facet_start[facet - facets.begin()] = indexed.facet(*facet);
+            stl_facet_stats(&mesh->stl, mesh->stl.facet_start[facet - facets.begin()], first);
             first = 0;
         }
     }
@@ -615,8 +1193,9 @@ void
 TriangleMesh::merge(const TriangleMesh &mesh)
 {
     // reset stats and metadata
+    this->require_facets();
     int number_of_facets = this->stl.stats.number_of_facets;
-    stl_invalidate_shared_vertices(&this->stl);
+    this->indexed.clear();
     this->repaired = false;
     
     // update facet count and allocate more memory
@@ -625,8 +1204,14 @@ TriangleMesh::merge(const TriangleMesh &mesh)
     stl_reallocate(&this->stl);
     
     // copy facets
-    std::copy(mesh.stl.facet_start, mesh.stl.facet_start + mesh.stl.stats.number_of_facets, this->stl.facet_start + number_of_facets);
-    std::copy(mesh.stl.neighbors_start, mesh.stl.neighbors_start + mesh.stl.stats.number_of_facets, this->stl.neighbors_start + number_of_facets);
+    if (mesh.stl.facet_start != NULL) {
+        std::copy(mesh.stl.facet_start, mesh.stl.facet_start + mesh.stl.stats.number_of_facets, this->stl.facet_start + number_of_facets);
+        std::copy(mesh.stl.neighbors_start, mesh.stl.neighbors_start + mesh.stl.stats.number_of_facets, this->stl.neighbors_start + number_of_facets);
+    } else {
+        // compacted mesh, the neighbors get rebuilt by repair()
+        for (int i = 0; i < mesh.stl.stats.number_of_facets; ++i)
+            this->stl.facet_start[number_of_facets + i] = mesh.indexed.facet(i);
+    }
     
     // update size
     stl_get_size(&this->stl);
@@ -634,17 +1219,19 @@ TriangleMesh::merge(const TriangleMesh &mesh)
 
 /* this will return scaled ExPolygons */
 ExPolygons
-TriangleMesh::horizontal_projection() const
+TriangleMesh::horizontal_projection()
 {
+    this->require_shared_vertices();
+    const IndexedMesh &indexed = this->indexed;
     Polygons pp;
-    pp.reserve(this->stl.stats.number_of_facets);
-    for (int i = 0; i < this->stl.stats.number_of_facets; i++) {
-        stl_facet* facet = &this->stl.facet_start[i];
+    pp.reserve(indexed.facets_count());
+    for (size_t i = 0; i < indexed.facets_count(); i++) {
         Polygon p;
         p.points.resize(3);
-        p.points[0] = Point(facet->vertex[0].x / SCALING_FACTOR, facet->vertex[0].y / SCALING_FACTOR);
-        p.points[1] = Point(facet->vertex[1].x / SCALING_FACTOR, facet->vertex[1].y / SCALING_FACTOR);
-        p.points[2] = Point(facet->vertex[2].x / SCALING_FACTOR, facet->vertex[2].y / SCALING_FACTOR);
+        for (int j = 0; j <= 2; j++) {
+            const stl_vertex &v = indexed.vertex(i, j);
+            p.points[j] = Point(v.x / SCALING_FACTOR, v.y / SCALING_FACTOR);
+        }
         p.make_counter_clockwise();  // do this after scaling, as winding order might change while doing that
         pp.push_back(p);
     }
@@ -658,11 +1245,9 @@ TriangleMesh::convex_hull()
 {
     this->require_shared_vertices();
     Points pp;
-    pp.reserve(this->stl.stats.shared_vertices);
-    for (int i = 0; i < this->stl.stats.shared_vertices; i++) {
-        stl_vertex* v = &this->stl.v_shared[i];
-        pp.push_back(Point(v->x / SCALING_FACTOR, v->y / SCALING_FACTOR));
-    }
+    pp.reserve(this->indexed.vertices.size());
+    for (const stl_vertex &v : this->indexed.vertices)
+        pp.push_back(Point(v.x / SCALING_FACTOR, v.y / SCALING_FACTOR));
     return Slic3r::Geometry::convex_hull(pp);
 }
 
@@ -683,19 +1268,75 @@ void
 TriangleMesh::require_shared_vertices()
 {
     if (!this->repaired) this->repair();
-    if (this->stl.v_shared == NULL) stl_generate_shared_vertices(&(this->stl));
+    if (!this->indexed.empty() || this->stl.facet_start == NULL) return;
+    
+    // let admesh walk the neighbors to share the vertices, then move them
+    stl_generate_shared_vertices(&(this->stl));
+    if (this->stl.v_shared == NULL) return;
+    IndexedMesh &indexed = this->indexed;
+    indexed.vertices.assign(this->stl.v_shared, this->stl.v_shared + this->stl.stats.shared_vertices);
+    indexed.indices.resize(this->stl.stats.number_of_facets * 3);
+    for (int i = 0; i < this->stl.stats.number_of_facets; i++)
+        for (int j = 0; j <= 2; j++)
+            indexed.indices[i * 3 + j] = this->stl.v_indices[i].vertex[j];
+    stl_invalidate_shared_vertices(&(this->stl));
+}
+
+void
+TriangleMesh::compact()
+{
+    this->require_shared_vertices();
+    if (this->indexed.empty()) return;
+    
+    free(this->stl.facet_start);
+    this->stl.facet_start = NULL;
+    free(this->stl.neighbors_start);
+    this->stl.neighbors_start = NULL;
+    this->stl.stats.facets_malloced = 0;
+}
+
+void
+TriangleMesh::require_facets()
+{
+    if (this->stl.facet_start != NULL || this->indexed.empty()) return;
+    
+    IndexedMesh &indexed = this->indexed;
+    stl_allocate(&this->stl);
+    for (size_t i = 0; i < indexed.facets_count(); i++)
+        this->stl.facet_start[i] = indexed.facet(i);
+    
+    // connect the facets the way stl_record_neighbors() does: which_vertex_not
+    // is the vertex of the neighbor off the edge, plus 3 when both facets run
+    // the edge in the same direction
+    if (indexed.edges.empty()) indexed.make_edges();
+    const std::vector<int> across = facet_edges_across(indexed);
+    for (size_t i = 0; i < across.size(); i++) {
+        stl_neighbors &neighbors = this->stl.neighbors_start[i / 3];
+        if (across[i] == -1) {
+            neighbors.neighbor[i % 3] = -1;
+            neighbors.which_vertex_not[i % 3] = 0;
+            continue;
+        }
+        neighbors.neighbor[i % 3] = across[i] / 3;
+        neighbors.which_vertex_not[i % 3] = (across[i] % 3 + 2) % 3
+            + (indexed.indices[i] == indexed.indices[across[i]] ? 3 : 0);
+    }
 }
 
 void
 TriangleMesh::reverse_normals()
 {
+    this->require_facets();
     stl_reverse_all_facets(&this->stl);
+    this->indexed.clear();
     if (this->stl.stats.volume != -1) this->stl.stats.volume *= -1.0;
 }
 
 void
 TriangleMesh::extrude_tin(float offset)
 {
+    this->require_facets();
+    this->indexed.clear();
     calculate_normals(&this->stl);
     
     const int number_of_facets = this->stl.stats.number_of_facets;
@@ -924,57 +1565,250 @@ TriangleMeshSlicer<A>::slice(const std::vector<float> &z, std::vector<Polygons>*
         type is float.
     */
     
-    std::vector<IntersectionLines> lines(z.size());
-    {
-        boost::mutex lines_mutex;
-        parallelize<int>(
-            0,
-            this->mesh->stl.stats.number_of_facets-1,
-            boost::bind(&TriangleMeshSlicer<A>::_slice_do, this, _1, &lines, &lines_mutex, z)
-        );
+    if (this->mode == smSweep && std::is_sorted(z.begin(), z.end())) {
+        this->_slice_sweep(z, layers);
+        return;
     }
     
-    // v_scaled_shared could be freed here
+    const size_t facets_count = this->indexed.facets_count();
+    const int threads_count = std::max(1, this->threads);
+    
+    // Every chunk of facets collects its intersection lines into a buffer of
+    // its own, so the workers never contend on a shared lock. The buffers are
+    // merged per layer in _make_loops_do(), in chunk order, which keeps the
+    // line order independent of the thread timing.
+    const size_t grain = std::max<size_t>(256, facets_count / (size_t(threads_count) * 8) + 1);
+    std::vector<t_layer_lines> chunks((facets_count + grain - 1) / grain);
+    ThreadPool::instance().parallel_for(
+        facets_count,
+        [this, &z, &chunks, grain](size_t from, size_t to) {
+            this->_slice_do(from, to, &chunks[from / grain], z);
+        },
+        threads_count,
+        grain
+    );
     
     // build loops
     layers->resize(z.size());
     parallelize<size_t>(
         0,
-        lines.size()-1,
-        boost::bind(&TriangleMeshSlicer<A>::_make_loops_do, this, _1, &lines, layers)
+        z.size()-1,
+        boost::bind(&TriangleMeshSlicer<A>::_make_loops_do, this, _1, &chunks, layers),
+        threads_count
     );
 }
 
 template <Axis A>
 void
-TriangleMeshSlicer<A>::_slice_do(size_t facet_idx, std::vector<IntersectionLines>* lines, boost::mutex* lines_mutex, 
-    const std::vector<float> &z) const
+TriangleMeshSlicer<A>::_slice_do(size_t from, size_t to, t_layer_lines* lines, const std::vector<float> &z) const
 {
-    const stl_facet &facet = this->mesh->stl.facet_start[facet_idx];
+    IntersectionLines facet_lines;
+    for (size_t facet_idx = from; facet_idx < to; ++facet_idx) {
+        // find facet extents
+        float min_z, max_z;
+        this->_facet_z_range(facet_idx, &min_z, &max_z);
+        
+        #ifdef SLIC3R_DEBUG
+        const stl_vertex &v0 = this->indexed.vertex(facet_idx, 0);
+        const stl_vertex &v1 = this->indexed.vertex(facet_idx, 1);
+        const stl_vertex &v2 = this->indexed.vertex(facet_idx, 2);
+        printf("\n==> FACET %zu (%f,%f,%f - %f,%f,%f - %f,%f,%f):\n", facet_idx,
+            _x(v0), _y(v0), _z(v0), _x(v1), _y(v1), _z(v1), _x(v2), _y(v2), _z(v2));
+        printf("z: min = %.2f, max = %.2f\n", min_z, max_z);
+        #endif
+        
+        // find layer extents
+        std::vector<float>::const_iterator min_layer, max_layer;
+        min_layer = std::lower_bound(z.begin(), z.end(), min_z); // first layer whose slice_z is >= min_z
+        max_layer = std::upper_bound(z.begin() + (min_layer - z.begin()), z.end(), max_z) - 1; // last layer whose slice_z is <= max_z
+        #ifdef SLIC3R_DEBUG
+        printf("layers: min = %d, max = %d\n", (int)(min_layer - z.begin()), (int)(max_layer - z.begin()));
+        #endif
+        
+        for (std::vector<float>::const_iterator it = min_layer; it != max_layer + 1; ++it) {
+            const size_t layer_idx = it - z.begin();
+            facet_lines.clear();
+            this->slice_facet(*it / SCALING_FACTOR, facet_idx, min_z, max_z, &facet_lines);
+            for (const IntersectionLine &line : facet_lines)
+                lines->emplace_back(layer_idx, line);
+        }
+    }
     
-    // find facet extents
-    const float min_z = fminf(_z(facet.vertex[0]), fminf(_z(facet.vertex[1]), _z(facet.vertex[2])));
-    const float max_z = fmaxf(_z(facet.vertex[0]), fmaxf(_z(facet.vertex[1]), _z(facet.vertex[2])));
+    // group by layer, keeping the facet order within each layer
+    std::stable_sort(lines->begin(), lines->end(),
+        [](const t_layer_line &l1, const t_layer_line &l2) { return l1.first < l2.first; });
+}
+
+template <Axis A>
+inline stl_vertex
+TriangleMeshSlicer<A>::_scaled(int vertex_id) const
+{
+    const stl_vertex &v = this->indexed.vertices[vertex_id];
+    stl_vertex scaled;
+    scaled.x = v.x / SCALING_FACTOR;
+    scaled.y = v.y / SCALING_FACTOR;
+    scaled.z = v.z / SCALING_FACTOR;
+    return scaled;
+}
+
+template <Axis A>
+inline void
+TriangleMeshSlicer<A>::_facet_z_range(size_t facet_idx, float* min_z, float* max_z) const
+{
+    const float z0 = _z(this->indexed.vertex(facet_idx, 0));
+    const float z1 = _z(this->indexed.vertex(facet_idx, 1));
+    const float z2 = _z(this->indexed.vertex(facet_idx, 2));
+    *min_z = fminf(z0, fminf(z1, z2));
+    *max_z = fmaxf(z0, fmaxf(z1, z2));
+}
+
+template <Axis A>
+void
+TriangleMeshSlicer<A>::_sort_facets(std::vector<float>* min_z, std::vector<float>* max_z, std::vector<int>* by_min_z) const
+{
+    const size_t facets_count = this->indexed.facets_count();
     
-    #ifdef SLIC3R_DEBUG
-    printf("\n==> FACET %zu (%f,%f,%f - %f,%f,%f - %f,%f,%f):\n", facet_idx,
-        _x(facet.vertex[0]), _y(facet.vertex[0]), _z(facet.vertex[0]),
-        _x(facet.vertex[1]), _y(facet.vertex[1]), _z(facet.vertex[1]),
-        _x(facet.vertex[2]), _y(facet.vertex[2]), _z(facet.vertex[2]));
-    printf("z: min = %.2f, max = %.2f\n", min_z, max_z);
-    #endif
+    // facet extents, computed the same way as in _slice_do() since
+    // slice_facet() compares them against the vertices
+    min_z->resize(facets_count);
+    max_z->resize(facets_count);
+    for (size_t facet_idx = 0; facet_idx < facets_count; ++facet_idx)
+        this->_facet_z_range(facet_idx, &(*min_z)[facet_idx], &(*max_z)[facet_idx]);
     
-    // find layer extents
-    std::vector<float>::const_iterator min_layer, max_layer;
-    min_layer = std::lower_bound(z.begin(), z.end(), min_z); // first layer whose slice_z is >= min_z
-    max_layer = std::upper_bound(z.begin() + (min_layer - z.begin()), z.end(), max_z) - 1; // last layer whose slice_z is <= max_z
-    #ifdef SLIC3R_DEBUG
-    printf("layers: min = %d, max = %d\n", (int)(min_layer - z.begin()), (int)(max_layer - z.begin()));
-    #endif
+    by_min_z->resize(facets_count);
+    for (size_t facet_idx = 0; facet_idx < facets_count; ++facet_idx)
+        (*by_min_z)[facet_idx] = facet_idx;
+    const std::vector<float> &mz = *min_z;
+    std::stable_sort(by_min_z->begin(), by_min_z->end(),
+        [&mz](int f1, int f2) { return mz[f1] < mz[f2]; });
+}
+
+template <Axis A>
+void
+TriangleMeshSlicer<A>::_slice_sweep(const std::vector<float> &z, std::vector<Polygons>* layers) const
+{
+    const int threads_count = std::max(1, this->threads);
+    std::vector<float> min_z, max_z;
+    std::vector<int> by_min_z;
+    this->_sort_facets(&min_z, &max_z, &by_min_z);
     
-    for (std::vector<float>::const_iterator it = min_layer; it != max_layer + 1; ++it) {
-        std::vector<float>::size_type layer_idx = it - z.begin();
-        this->slice_facet(*it / SCALING_FACTOR, facet, facet_idx, min_z, max_z, &(*lines)[layer_idx], lines_mutex);
+    // Every block of consecutive layers is swept by one thread. A few blocks
+    // per thread balance out the thin and the crowded parts of the mesh.
+    layers->resize(z.size());
+    const size_t grain = std::max<size_t>(1, z.size() / (size_t(threads_count) * 4));
+    t_sweep sweep;
+    const std::vector<t_sweep> seeds = this->_sweep_seeds(z, 0, z.size(), grain, min_z, max_z, by_min_z, &sweep);
+    ThreadPool::instance().parallel_for(
+        z.size(),
+        [&](size_t from, size_t to) {
+            this->_sweep_do(from, to, z, min_z, max_z, by_min_z, seeds[from / grain], &(*layers)[from]);
+        },
+        threads_count,
+        grain
+    );
+}
+
+template <Axis A>
+void
+TriangleMeshSlicer<A>::_sweep_to(float slice_z, const std::vector<float> &min_z, const std::vector<float> &max_z,
+    const std::vector<int> &by_min_z, t_sweep* sweep) const
+{
+    // drop the facets ending below this layer, then pick up the ones starting at or below it
+    std::vector<int> &active = sweep->active;
+    active.erase(
+        std::remove_if(active.begin(), active.end(), [&max_z, slice_z](int f) { return max_z[f] < slice_z; }),
+        active.end()
+    );
+    const size_t started = active.size();
+    for (; sweep->next < by_min_z.size() && min_z[by_min_z[sweep->next]] <= slice_z; ++sweep->next)
+        if (max_z[by_min_z[sweep->next]] >= slice_z) active.push_back(by_min_z[sweep->next]);
+    std::sort(active.begin() + started, active.end());
+    std::inplace_merge(active.begin(), active.begin() + started, active.end());
+}
+
+/// The sweeps of the blocks of grain layers that [from, to) is split into,
+/// each one standing at the first layer of its block. They are taken from a
+/// single pass of sweep over the block starts, which leaves sweep at the last
+/// one, so every facet is picked up once instead of once per block.
+template <Axis A>
+std::vector<typename TriangleMeshSlicer<A>::t_sweep>
+TriangleMeshSlicer<A>::_sweep_seeds(const std::vector<float> &z, size_t from, size_t to, size_t grain,
+    const std::vector<float> &min_z, const std::vector<float> &max_z, const std::vector<int> &by_min_z,
+    t_sweep* sweep) const
+{
+    std::vector<t_sweep> seeds;
+    seeds.reserve((to - from + grain - 1) / grain);
+    for (size_t layer_idx = from; layer_idx < to; layer_idx += grain) {
+        this->_sweep_to(z[layer_idx], min_z, max_z, by_min_z, sweep);
+        seeds.push_back(*sweep);
+    }
+    return seeds;
+}
+
+template <Axis A>
+void
+TriangleMeshSlicer<A>::_sweep_do(size_t from, size_t to, const std::vector<float> &z, const std::vector<float> &min_z,
+    const std::vector<float> &max_z, const std::vector<int> &by_min_z, t_sweep sweep, Polygons* loops) const
+{
+    // The facets cut by the current layer are kept in facet order, so that
+    // each layer gets its lines in the same order as with the facet engine.
+    IntersectionLines lines;
+    for (size_t layer_idx = from; layer_idx < to; ++layer_idx) {
+        const float slice_z = z[layer_idx];
+        this->_sweep_to(slice_z, min_z, max_z, by_min_z, &sweep);
+        
+        lines.clear();
+        for (int facet_idx : sweep.active)
+            this->slice_facet(slice_z / SCALING_FACTOR, facet_idx, min_z[facet_idx], max_z[facet_idx], &lines);
+        this->make_loops(lines, &loops[layer_idx - from]);
+    }
+}
+
+template <Axis A>
+void
+TriangleMeshSlicer<A>::slice(const std::vector<float> &z, size_t window, const layer_slices_cb_t &cb) const
+{
+    if (!std::is_sorted(z.begin(), z.end())) {
+        std::vector<ExPolygons> layers;
+        this->slice(z, &layers);
+        for (size_t layer_idx = 0; layer_idx < layers.size(); ++layer_idx)
+            cb(layer_idx, std::move(layers[layer_idx]));
+        return;
+    }
+    
+    const int threads_count = std::max(1, this->threads);
+    window = std::max<size_t>(window, 1);
+    std::vector<float> min_z, max_z;
+    std::vector<int> by_min_z;
+    this->_sort_facets(&min_z, &max_z, &by_min_z);
+    
+    // The sweep carries on from one window to the next, so that no window
+    // walks the facets below it again.
+    t_sweep sweep;
+    std::vector<Polygons> loops;
+    std::vector<ExPolygons> slices;
+    for (size_t first = 0; first < z.size(); first += window) {
+        const size_t count = std::min(window, z.size() - first);
+        loops.assign(count, Polygons());
+        slices.assign(count, ExPolygons());
+        
+        const size_t grain = std::max<size_t>(1, count / size_t(threads_count));
+        const std::vector<t_sweep> seeds = this->_sweep_seeds(z, first, first + count, grain, min_z, max_z, by_min_z, &sweep);
+        ThreadPool::instance().parallel_for(
+            count,
+            [&](size_t from, size_t to) {
+                this->_sweep_do(first + from, first + to, z, min_z, max_z, by_min_z, seeds[from / grain], &loops[from]);
+                for (size_t i = from; i < to; ++i) {
+                    this->make_expolygons(loops[i], &slices[i]);
+                    Polygons().swap(loops[i]);
+                }
+            },
+            threads_count,
+            grain
+        );
+        
+        for (size_t i = 0; i < count; ++i)
+            cb(first + i, std::move(slices[i]));
     }
 }
 
@@ -1009,10 +1843,10 @@ TriangleMeshSlicer<A>::slice(float z, ExPolygons* slices) const
 
 template <Axis A>
 void
-TriangleMeshSlicer<A>::slice_facet(float slice_z, const stl_facet &facet, const int &facet_idx,
-    const float &min_z, const float &max_z, std::vector<IntersectionLine>* lines,
-    boost::mutex* lines_mutex) const
+TriangleMeshSlicer<A>::slice_facet(float slice_z, const int &facet_idx,
+    const float &min_z, const float &max_z, std::vector<IntersectionLine>* lines) const
 {
+    const int* vertices = &this->indexed.indices[facet_idx * 3];
     std::vector<IntersectionPoint> points;
     std::vector< std::vector<IntersectionPoint>::size_type > points_on_layer;
     bool found_horizontal_edge = false;
@@ -1021,30 +1855,32 @@ TriangleMeshSlicer<A>::slice_facet(float slice_z, const stl_facet &facet, const
        this is needed to get all intersection lines in a consistent order
        (external on the right of the line) */
     int i = 0;
-    if (_z(facet.vertex[1]) == min_z) {
+    if (_z(this->indexed.vertices[vertices[1]]) == min_z) {
         // vertex 1 has lowest Z
         i = 1;
-    } else if (_z(facet.vertex[2]) == min_z) {
+    } else if (_z(this->indexed.vertices[vertices[2]]) == min_z) {
         // vertex 2 has lowest Z
         i = 2;
     }
     for (int j = i; (j-i) < 3; j++) {  // loop through facet edges
-        int edge_id = this->facets_edges[facet_idx][j % 3];
-        int a_id = this->mesh->stl.v_indices[facet_idx].vertex[j % 3];
-        int b_id = this->mesh->stl.v_indices[facet_idx].vertex[(j+1) % 3];
-        stl_vertex* a = &this->v_scaled_shared[a_id];
-        stl_vertex* b = &this->v_scaled_shared[b_id];
+        int edge_id = this->indexed.edges[facet_idx * 3 + j % 3];
+        int a_id = vertices[j % 3];
+        int b_id = vertices[(j+1) % 3];
+        stl_vertex a_scaled = this->_scaled(a_id);
+        stl_vertex b_scaled = this->_scaled(b_id);
+        stl_vertex* a = &a_scaled;
+        stl_vertex* b = &b_scaled;
         
         if (_z(*a) == _z(*b) && _z(*a) == slice_z) {
             // edge is horizontal and belongs to the current layer
             
-            stl_vertex &v0 = this->v_scaled_shared[ this->mesh->stl.v_indices[facet_idx].vertex[0] ];
-            stl_vertex &v1 = this->v_scaled_shared[ this->mesh->stl.v_indices[facet_idx].vertex[1] ];
-            stl_vertex &v2 = this->v_scaled_shared[ this->mesh->stl.v_indices[facet_idx].vertex[2] ];
+            const stl_vertex v0 = this->_scaled(vertices[0]);
+            const stl_vertex v1 = this->_scaled(vertices[1]);
+            const stl_vertex v2 = this->_scaled(vertices[2]);
             IntersectionLine line;
             if (min_z == max_z) {
                 line.edge_type = feHorizontal;
-                if (_z(this->mesh->stl.facet_start[facet_idx].normal) < 0) {
+                if (_z(this->indexed.facet(facet_idx).normal) < 0) {
                     /*  if normal points downwards this is a bottom horizontal facet so we reverse
                         its point order */
                     std::swap(a, b);
@@ -1063,12 +1899,7 @@ TriangleMeshSlicer<A>::slice_facet(float slice_z, const stl_facet &facet, const
             line.b.y    = _y(*b);
             line.a_id   = a_id;
             line.b_id   = b_id;
-            if (lines_mutex != NULL) {
-                boost::lock_guard<boost::mutex> l(*lines_mutex);
-                lines->push_back(line);
-            } else {
-                lines->push_back(line);
-            }
+            lines->push_back(line);
             
             found_horizontal_edge = true;
             
@@ -1121,21 +1952,24 @@ TriangleMeshSlicer<A>::slice_facet(float slice_z, const stl_facet &facet, const
         line.b_id       = points[0].point_id;
         line.edge_a_id  = points[1].edge_id;
         line.edge_b_id  = points[0].edge_id;
-        if (lines_mutex != NULL) {
-            boost::lock_guard<boost::mutex> l(*lines_mutex);
-            lines->push_back(line);
-        } else {
-            lines->push_back(line);
-        }
+        lines->push_back(line);
         return;
     }
 }
 
 template <Axis A>
 void
-TriangleMeshSlicer<A>::_make_loops_do(size_t i, std::vector<IntersectionLines>* lines, std::vector<Polygons>* layers) const
+TriangleMeshSlicer<A>::_make_loops_do(size_t i, const std::vector<t_layer_lines>* chunks, std::vector<Polygons>* layers) const
 {
-    this->make_loops((*lines)[i], &(*layers)[i]);
+    const auto by_layer = [](const t_layer_line &line, size_t layer_idx) { return line.first < layer_idx; };
+    
+    IntersectionLines lines;
+    for (const t_layer_lines &chunk : *chunks) {
+        for (auto it = std::lower_bound(chunk.begin(), chunk.end(), i, by_layer);
+            it != chunk.end() && it->first == i; ++it)
+            lines.push_back(it->second);
+    }
+    this->make_loops(lines, &(*layers)[i]);
 }
 
 template <Axis A>
@@ -1183,14 +2017,23 @@ TriangleMeshSlicer<A>::make_loops(std::vector<IntersectionLine> &lines, Polygons
     }
     
     // build a map of lines by edge_a_id and a_id
-    std::vector<IntersectionLinePtrs> by_edge_a_id, by_a_id;
-    by_edge_a_id.resize(this->mesh->stl.stats.number_of_facets * 3);
-    by_a_id.resize(this->mesh->stl.stats.shared_vertices);
+    // Sorted tables sized by the lines of this layer rather than by the whole
+    // mesh; the stable sort keeps the candidates of each id in line order.
+    std::vector<t_line_by_id> by_edge_a_id, by_a_id;
     for (IntersectionLines::iterator line = lines.begin(); line != lines.end(); ++line) {
         if (line->skip) continue;
-        if (line->edge_a_id != -1) by_edge_a_id[line->edge_a_id].push_back(&(*line));
-        if (line->a_id != -1) by_a_id[line->a_id].push_back(&(*line));
+        if (line->edge_a_id != -1) by_edge_a_id.push_back(t_line_by_id(line->edge_a_id, &(*line)));
+        if (line->a_id != -1) by_a_id.push_back(t_line_by_id(line->a_id, &(*line)));
     }
+    const auto by_id = [](const t_line_by_id &l1, const t_line_by_id &l2) { return l1.first < l2.first; };
+    std::stable_sort(by_edge_a_id.begin(), by_edge_a_id.end(), by_id);
+    std::stable_sort(by_a_id.begin(), by_a_id.end(), by_id);
+    const auto first_spare = [&by_id](const std::vector<t_line_by_id> &table, int id) -> IntersectionLine* {
+        for (auto it = std::lower_bound(table.begin(), table.end(), t_line_by_id(id, NULL), by_id);
+            it != table.end() && it->first == id; ++it)
+            if (!it->second->skip) return it->second;
+        return NULL;
+    };
     
     CYCLE: while (1) {
         // take first spare line and start a new loop
@@ -1214,22 +2057,10 @@ TriangleMeshSlicer<A>::make_loops(std::vector<IntersectionLine> &lines, Polygons
         while (1) {
             // find a line starting where last one finishes
             IntersectionLine* next_line = NULL;
-            if (loop.back()->edge_b_id != -1) {
-                IntersectionLinePtrs &candidates = by_edge_a_id[loop.back()->edge_b_id];
-                for (IntersectionLinePtrs::iterator lineptr = candidates.begin(); lineptr != candidates.end(); ++lineptr) {
-                    if ((*lineptr)->skip) continue;
-                    next_line = *lineptr;
-                    break;
-                }
-            }
-            if (next_line == NULL && loop.back()->b_id != -1) {
-                IntersectionLinePtrs &candidates = by_a_id[loop.back()->b_id];
-                for (IntersectionLinePtrs::iterator lineptr = candidates.begin(); lineptr != candidates.end(); ++lineptr) {
-                    if ((*lineptr)->skip) continue;
-                    next_line = *lineptr;
-                    break;
-                }
-            }
+            if (loop.back()->edge_b_id != -1)
+                next_line = first_spare(by_edge_a_id, loop.back()->edge_b_id);
+            if (next_line == NULL && loop.back()->b_id != -1)
+                next_line = first_spare(by_a_id, loop.back()->b_id);
             
             if (next_line == NULL) {
                 // check whether we closed this loop
@@ -1403,16 +2234,18 @@ TriangleMeshSlicer<A>::cut(float z, TriangleMesh* upper, TriangleMesh* lower) co
     IntersectionLines upper_lines, lower_lines;
     
     const float scaled_z = scale_(z);
-    for (int facet_idx = 0; facet_idx < this->mesh->stl.stats.number_of_facets; facet_idx++) {
-        stl_facet* facet = &this->mesh->stl.facet_start[facet_idx];
+    const int facets_count = this->indexed.facets_count();
+    for (int facet_idx = 0; facet_idx < facets_count; facet_idx++) {
+        stl_facet facet_copy = this->indexed.facet(facet_idx);
+        stl_facet* facet = &facet_copy;
         
         // find facet extents
-        float min_z = fminf(_z(facet->vertex[0]), fminf(_z(facet->vertex[1]), _z(facet->vertex[2])));
-        float max_z = fmaxf(_z(facet->vertex[0]), fmaxf(_z(facet->vertex[1]), _z(facet->vertex[2])));
+        float min_z, max_z;
+        this->_facet_z_range(facet_idx, &min_z, &max_z);
         
         // intersect facet with cutting plane
         IntersectionLines lines;
-        this->slice_facet(scaled_z, *facet, facet_idx, min_z, max_z, &lines);
+        this->slice_facet(scaled_z, facet_idx, min_z, max_z, &lines);
         
         // save intersection lines for generating correct triangulations
         for (IntersectionLines::const_iterator it = lines.begin(); it != lines.end(); ++it) {
@@ -1554,69 +2387,12 @@ TriangleMeshSlicer<A>::cut(float z, TriangleMesh* upper, TriangleMesh* lower) co
 
 
 template <Axis A>
-TriangleMeshSlicer<A>::TriangleMeshSlicer(TriangleMesh* _mesh) : mesh(_mesh), v_scaled_shared(NULL)
+TriangleMeshSlicer<A>::TriangleMeshSlicer(TriangleMesh* _mesh)
+    : mesh(_mesh), threads(boost::thread::hardware_concurrency()), mode(smFacets), indexed(_mesh->indexed)
 {
-    // build a table to map a facet_idx to its three edge indices
+    // the slicer needs the shared vertices and a map of the facets to their edges
     this->mesh->require_shared_vertices();
-    typedef std::pair<int,int>              t_edge;
-    typedef std::vector<t_edge>             t_edges;  // edge_idx => a_id,b_id
-    typedef std::map<t_edge,int>            t_edges_map;  // a_id,b_id => edge_idx
-    
-    this->facets_edges.resize(this->mesh->stl.stats.number_of_facets);
-    
-    {
-        t_edges edges;
-        // reserve() instad of resize() because otherwise we couldn't read .size() below to assign edge_idx
-        edges.reserve(this->mesh->stl.stats.number_of_facets * 3);  // number of edges = number of facets * 3
-        t_edges_map edges_map;
-        for (int facet_idx = 0; facet_idx < this->mesh->stl.stats.number_of_facets; facet_idx++) {
-            this->facets_edges[facet_idx].resize(3);
-            for (int i = 0; i <= 2; i++) {
-                int a_id = this->mesh->stl.v_indices[facet_idx].vertex[i];
-                int b_id = this->mesh->stl.v_indices[facet_idx].vertex[(i+1) % 3];
-                
-                int edge_idx;
-                t_edges_map::const_iterator my_edge = edges_map.find(std::make_pair(b_id,a_id));
-                if (my_edge != edges_map.end()) {
-                    edge_idx = my_edge->second;
-                } else {
-                    /* admesh can assign the same edge ID to more than two facets (which is 
-                       still topologically correct), so we have to search for a duplicate of 
-                       this edge too in case it was already seen in this orientation */
-                    my_edge = edges_map.find(std::make_pair(a_id,b_id));
-                    
-                    if (my_edge != edges_map.end()) {
-                        edge_idx = my_edge->second;
-                    } else {
-                        // edge isn't listed in table, so we insert it
-                        edge_idx = edges.size();
-                        edges.push_back(std::make_pair(a_id,b_id));
-                        edges_map[ edges[edge_idx] ] = edge_idx;
-                    }
-                }
-                this->facets_edges[facet_idx][i] = edge_idx;
-                
-                #ifdef SLIC3R_DEBUG
-                printf("  [facet %d, edge %d] a_id = %d, b_id = %d   --> edge %d\n", facet_idx, i, a_id, b_id, edge_idx);
-                #endif
-            }
-        }
-    }
-    
-    // clone shared vertices coordinates and scale them
-    this->v_scaled_shared = (stl_vertex*)calloc(this->mesh->stl.stats.shared_vertices, sizeof(stl_vertex));
-    std::copy(this->mesh->stl.v_shared, this->mesh->stl.v_shared + this->mesh->stl.stats.shared_vertices, this->v_scaled_shared);
-    for (int i = 0; i < this->mesh->stl.stats.shared_vertices; i++) {
-        this->v_scaled_shared[i].x /= SCALING_FACTOR;
-        this->v_scaled_shared[i].y /= SCALING_FACTOR;
-        this->v_scaled_shared[i].z /= SCALING_FACTOR;
-    }
-}
-
-template <Axis A>
-TriangleMeshSlicer<A>::~TriangleMeshSlicer()
-{
-    if (this->v_scaled_shared != NULL) free(this->v_scaled_shared);
+    if (this->mesh->indexed.edges.empty()) this->mesh->indexed.make_edges();
 }
 
 template class TriangleMeshSlicer<X>;
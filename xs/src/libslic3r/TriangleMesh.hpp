@@ -3,6 +3,7 @@
 
 #include "libslic3r.h"
 #include <admesh/stl.h>
+#include <functional>
 #include <vector>
 #include <boost/thread.hpp>
 #include "BoundingBox.hpp"
@@ -32,6 +33,48 @@ struct mesh_stats {
     size_t normals_fixed {0};
 };
 
+/// Parallel equivalent of admesh's stl_check_facets_exact(): removes the
+/// degenerate facets and connects the facets whose edges have bitwise equal
+/// vertices. Instead of hashing the edges one at a time into a fixed size
+/// table, the edges are radix partitioned by a hash of their key and every
+/// partition is sorted and matched on its own. The facet order, the
+/// neighbors list and the connection stats come out as with admesh.
+void check_facets_exact(stl_file *stl, int threads_count = boost::thread::hardware_concurrency());
+
+/// Compact indexed form of a mesh, kept as separate arrays: every vertex is
+/// stored once, the facets are triplets of vertex indices and the edge map
+/// gives each facet edge the index it shares with the facets across it.
+/// TriangleMesh builds it from admesh's facet soup in
+/// require_shared_vertices(); the slicer, split(), cut() and
+/// horizontal_projection() work from it.
+class IndexedMesh
+{
+    public:
+    /// Vertices shared by the facets.
+    std::vector<stl_vertex> vertices;
+    /// Three vertex indices per facet, in the winding order of the facet.
+    std::vector<int> indices;
+    /// Three edge indices per facet, edge i joining vertices i and i+1.
+    /// Empty until make_edges() is called.
+    std::vector<int> edges;
+    /// Number of distinct edges.
+    size_t edges_count {0};
+
+    size_t facets_count() const { return this->indices.size() / 3; }
+    bool empty() const { return this->indices.empty(); }
+    const stl_vertex& vertex(size_t facet_idx, int i) const { return this->vertices[this->indices[facet_idx * 3 + i]]; }
+
+    /// The facet as admesh stores it, with its normal computed from its vertices.
+    stl_facet facet(size_t facet_idx) const;
+
+    /// Numbers the edges of the facets. Two facet edges get the same index
+    /// when they join the same two vertices, whatever their direction; an
+    /// edge can thus be shared by more than two facets.
+    void make_edges();
+
+    void clear();
+};
+
 class TriangleMesh
 {
     public:
@@ -87,17 +130,25 @@ class TriangleMesh
     void rotate(double angle, const Point& center);
     void rotate(double angle, Point* center);
 
-    TriangleMeshPtrs split() const;
+    TriangleMeshPtrs split();
     TriangleMeshPtrs cut_by_grid(const Pointf &grid) const;
     void merge(const TriangleMesh &mesh);
-    ExPolygons horizontal_projection() const;
+    ExPolygons horizontal_projection();
     Polygon convex_hull();
     BoundingBoxf3 bounding_box() const;
     void reset_repair_stats();
     bool needed_repair() const;
     size_t facets_count() const;
     void extrude_tin(float offset);
+
+    /// Repair the mesh if needed and build its indexed form.
     void require_shared_vertices();
+
+    /// Build the indexed mesh and free admesh's facet soup and neighbors
+    /// list, which it duplicates. The methods going through admesh rebuild
+    /// them on demand; code reading stl.facet_start directly must not be
+    /// handed a compacted mesh.
+    void compact();
     void reverse_normals();
 
 #ifndef SLIC3RXS // Don't build these functions when also building the Perl interface.
@@ -146,6 +197,8 @@ class TriangleMesh
 
     
     stl_file stl;
+    /// Indexed form of the mesh, empty until require_shared_vertices().
+    IndexedMesh indexed;
 	/// Whether or not this mesh has been repaired.
     bool repaired;
     
@@ -159,6 +212,16 @@ class TriangleMesh
     /// Perform the mechanics of a stl copy
     void clone(const TriangleMesh& other);
 
+    /// Rebuild the facet soup and the neighbors list freed by compact().
+    void require_facets();
+
+    /// Load an STL from a memory mapping of the file, converting or parsing
+    /// chunks of facets in parallel. Returns false, leaving the mesh untouched,
+    /// if the file cannot be mapped or is not a well formed STL.
+    bool read_stl_mapped(const std::string &input_file);
+    bool read_binary_stl(const unsigned char* data, size_t file_size);
+    bool read_ascii_stl(const char* data, size_t file_size);
+
     friend class TriangleMeshSlicer<X>;
     friend class TriangleMeshSlicer<Y>;
     friend class TriangleMeshSlicer<Z>;
@@ -189,20 +252,43 @@ typedef std::vector<IntersectionLine> IntersectionLines;
 typedef std::vector<IntersectionLine*> IntersectionLinePtrs;
 
 
+/// Engines TriangleMeshSlicer::slice() can cut the layers with.
+/// smFacets walks the facets in file order and looks up the layers each one spans.
+/// smSweep sorts the facets by their lowest Z once and sweeps the layer planes
+/// upwards, cutting each layer from the facets that span it and building its
+/// loops right away. It touches far less memory on tall meshes with many layers.
+/// Both engines produce the same loops.
+enum SlicingMode { smFacets, smSweep };
+
 /// \brief Class for processing TriangleMesh objects. 
 template <Axis A>
 class TriangleMeshSlicer
 {
     public:
     TriangleMesh* mesh;
+    /// Number of threads slice() runs on, including the calling one.
+    int threads;
+    /// Engine used by slice(). smSweep needs the Z list sorted and falls
+    /// back to smFacets otherwise.
+    SlicingMode mode;
     TriangleMeshSlicer(TriangleMesh* _mesh);
-    ~TriangleMeshSlicer();
     void slice(const std::vector<float> &z, std::vector<Polygons>* layers) const;
     void slice(const std::vector<float> &z, std::vector<ExPolygons>* layers) const;
     void slice(float z, ExPolygons* slices) const;
-    void slice_facet(float slice_z, const stl_facet &facet, const int &facet_idx,
-        const float &min_z, const float &max_z, std::vector<IntersectionLine>* lines,
-        boost::mutex* lines_mutex = NULL) const;
+    
+    /// Receives the slices of a layer along with the index of its Z.
+    typedef std::function<void(size_t, ExPolygons&&)> layer_slices_cb_t;
+    
+    /// \brief Streaming variant of slice(): cuts the layers a window at a time
+    /// and hands each layer's slices to cb in ascending order, so that only
+    /// the lines and loops of one window are alive at any time.
+    /// The slices are the same as the ones of the batch slice() above.
+    /// \param[in] z Sorted list of unscaled Z coordinates.
+    /// \param[in] window Number of layers cut at once.
+    /// \param[in] cb Called from the calling thread, once per layer.
+    void slice(const std::vector<float> &z, size_t window, const layer_slices_cb_t &cb) const;
+    void slice_facet(float slice_z, const int &facet_idx,
+        const float &min_z, const float &max_z, std::vector<IntersectionLine>* lines) const;
     
 	/// \brief Splits the current mesh into two parts.
 	/// \param[in] z Coordinate plane to cut along.
@@ -211,11 +297,33 @@ class TriangleMeshSlicer
     void cut(float z, TriangleMesh* upper, TriangleMesh* lower) const;
     
     private:
-    typedef std::vector< std::vector<int> > t_facets_edges;
-    t_facets_edges facets_edges;
-    stl_vertex* v_scaled_shared;
-    void _slice_do(size_t facet_idx, std::vector<IntersectionLines>* lines, boost::mutex* lines_mutex, const std::vector<float> &z) const;
-    void _make_loops_do(size_t i, std::vector<IntersectionLines>* lines, std::vector<Polygons>* layers) const;
+    /// A line of a layer keyed by one of its vertex or edge ids.
+    typedef std::pair<int, IntersectionLine*> t_line_by_id;
+    /// An intersection line tagged with the index of its layer.
+    typedef std::pair<size_t, IntersectionLine> t_layer_line;
+    /// Lines produced by a chunk of facets, sorted by layer.
+    typedef std::vector<t_layer_line> t_layer_lines;
+    /// The indexed mesh the slicer works from.
+    const IndexedMesh &indexed;
+    stl_vertex _scaled(int vertex_id) const;
+    void _facet_z_range(size_t facet_idx, float* min_z, float* max_z) const;
+    void _slice_do(size_t from, size_t to, t_layer_lines* lines, const std::vector<float> &z) const;
+    void _make_loops_do(size_t i, const std::vector<t_layer_lines>* chunks, std::vector<Polygons>* layers) const;
+    void _sort_facets(std::vector<float>* min_z, std::vector<float>* max_z, std::vector<int>* by_min_z) const;
+    /// Where a sweep stands: the facets cut by the last layer it reached, in
+    /// facet order, and the position in by_min_z of the next facet to pick up.
+    struct t_sweep {
+        std::vector<int> active;
+        size_t next {0};
+    };
+    void _slice_sweep(const std::vector<float> &z, std::vector<Polygons>* layers) const;
+    void _sweep_to(float slice_z, const std::vector<float> &min_z, const std::vector<float> &max_z,
+        const std::vector<int> &by_min_z, t_sweep* sweep) const;
+    std::vector<t_sweep> _sweep_seeds(const std::vector<float> &z, size_t from, size_t to, size_t grain,
+        const std::vector<float> &min_z, const std::vector<float> &max_z, const std::vector<int> &by_min_z,
+        t_sweep* sweep) const;
+    void _sweep_do(size_t from, size_t to, const std::vector<float> &z, const std::vector<float> &min_z,
+        const std::vector<float> &max_z, const std::vector<int> &by_min_z, t_sweep sweep, Polygons* loops) const;
     void make_loops(std::vector<IntersectionLine> &lines, Polygons* loops) const;
     void make_expolygons(const Polygons &loops, ExPolygons* slices) const;
     void make_expolygons_simple(std::vector<IntersectionLine> &lines, ExPolygons* slices) const;
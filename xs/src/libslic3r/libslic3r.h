@@ -11,6 +11,7 @@
 #include <vector>
 #include <boost/thread.hpp>
 #include <cstdint>
+#include "ThreadPool.hpp"
 
 #ifdef _MSC_VER
 #include <limits>
@@ -96,43 +97,39 @@ inline void append_to(std::vector<T> &dst, const std::vector<T> &src)
     dst.insert(dst.end(), src.begin(), src.end());
 }
 
-template <class T> void
-_parallelize_do(std::queue<T>* queue, boost::mutex* queue_mutex, boost::function<void(T)> func)
-{
-    //std::cout << "THREAD STARTED: " << boost::this_thread::get_id() << std::endl;
-    while (true) {
-        T i;
-        {
-            boost::lock_guard<boost::mutex> l(*queue_mutex);
-            if (queue->empty()) return;
-            i = queue->front();
-            queue->pop();
-        }
-        //std::cout << "  Thread " << boost::this_thread::get_id() << " processing item " << i << std::endl;
-        func(i);
-        boost::this_thread::interruption_point();
-    }
-}
-
+/// Call func on every item of the queue, in parallel, on the shared ThreadPool.
+/// At most threads_count threads (the calling one included) work on it.
 template <class T> void
 parallelize(std::queue<T> queue, boost::function<void(T)> func,
     int threads_count = boost::thread::hardware_concurrency())
 {
-    if (threads_count == 0) threads_count = 2;
-    boost::mutex queue_mutex;
-    boost::thread_group workers;
-    for (int i = 0; i < std::min(threads_count, (int)queue.size()); i++)
-        workers.add_thread(new boost::thread(&_parallelize_do<T>, &queue, &queue_mutex, func));
-    workers.join_all();
+    std::vector<T> items;
+    items.reserve(queue.size());
+    for (; !queue.empty(); queue.pop())
+        items.push_back(queue.front());
+    ThreadPool::instance().parallel_for(
+        items.size(),
+        [&items, &func](size_t from, size_t to) {
+            for (size_t i = from; i < to; ++i) func(items[i]);
+        },
+        threads_count
+    );
 }
 
+/// Call func on every value of the inclusive range [start, end], in parallel.
 template <class T> void
 parallelize(T start, T end, boost::function<void(T)> func,
     int threads_count = boost::thread::hardware_concurrency())
 {
-    std::queue<T> queue;
-    for (T i = start; i <= end; ++i) queue.push(i);
-    parallelize(queue, func, threads_count);
+    // an empty container yields end = size() - 1, which wraps for unsigned T
+    if (end < start || end - start + T(1) == T(0)) return;
+    ThreadPool::instance().parallel_for(
+        size_t(end - start) + 1,
+        [start, &func](size_t from, size_t to) {
+            for (size_t i = from; i < to; ++i) func(start + T(i));
+        },
+        threads_count
+    );
 }
 
 } // namespace Slic3r